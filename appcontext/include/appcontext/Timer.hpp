@@ -63,7 +63,7 @@ namespace appcontext {
 			gettimeofday( &current_time, NULL ) ;
 			return(
 				double( current_time.tv_sec - m_start_time.tv_sec )
-				+ (double( current_time.tv_usec ) - double( m_start_time.tv_usec )) / 100000.0
+				+ (double( current_time.tv_usec ) - double( m_start_time.tv_usec )) / 1000000.0
 			) ;
 		}
 
@@ -12,7 +12,6 @@
 #include <fstream>
 #include <ctime>
 #include <iostream>
-#include <deque>
 #include <algorithm>
 #include <map>
 
@@ -26,6 +25,7 @@
 #include <boost/bimap.hpp>
 #include <boost/bimap/multiset_of.hpp>
 #include <boost/bimap/set_of.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 
 #include "appcontext/ProgramFlow.hpp"
 #include "appcontext/CmdLineOptionProcessor.hpp"
@@ -51,6 +51,8 @@
 #include "qcdb/Storage.hpp"
 #include "qcdb/FlatTableDBOutputter.hpp"
 #include "qcdb/FlatFileOutputter.hpp"
+#include "worker/QueuedMultiThreadedWorker.hpp"
+#include "worker/FunctionTask.hpp"
 
 //#define DEBUG_INTHINNERATOR 1
 
@@ -76,11 +78,22 @@ namespace {
 		}
 		return seed ;
 	}
+
+	// Return a seed for the given thinning replicate.  This depends only on the base seed and the
+	// replicate index, so results are reproducible whatever the number of threads or value of -start-N.
+	// (Seeds are mixed using the splitmix64 finaliser so that nearby replicates get unrelated streams.)
+	std::size_t get_replicate_seed( std::size_t const seed, std::size_t const replicate ) {
+		uint64_t z = uint64_t( seed ) + ( uint64_t( replicate ) + 1 ) * 0x9E3779B97F4A7C15ull ;
+		z = ( z ^ ( z >> 30 )) * 0xBF58476D1CE4E5B9ull ;
+		z = ( z ^ ( z >> 27 )) * 0x94D049BB133111EBull ;
+		z = z ^ ( z >> 31 ) ;
+		return std::size_t( z ^ ( z >> 32 )) ;
+	}
 	
 	struct CompareByOrder {
 		typedef bool result_type ;
 		
-		CompareByOrder( std::deque< std::size_t > const& list ) {
+		CompareByOrder( std::vector< std::size_t > const& list ) {
 			m_positions_in_sorted_list.resize( list.size(), std::numeric_limits< std::size_t >::max() ) ;
 			for( std::size_t i = 0; i < list.size(); ++i ) {
 				assert( list[i] < m_positions_in_sorted_list.size() ) ;
@@ -296,6 +309,16 @@ struct InthinneratorOptionProcessor: public appcontext::CmdLineOptionProcessor
 							" useful when running jobs in parallel but giving output as though run in a single command." )
 			.set_takes_single_value()
 			.set_default_value(0) ;
+		options[ "-seed" ]
+			.set_description( "Specify the seed for random number generation.  Each thinning uses its own stream of random numbers"
+				" derived from this seed and its index, so results do not depend on -threads or on how work is split using -start-N."
+				" By default a seed is chosen randomly and reported in the log." )
+			.set_takes_single_value() ;
+		options[ "-threads" ]
+			.set_description( "Specify the number of worker threads to use to perform thinnings in parallel."
+				" If this is zero, thinnings are performed one after another on the main thread." )
+			.set_takes_single_value()
+			.set_default_value( 0 ) ;
 
 		options.declare_group( "Output file options" ) ;
 		options[ "-o" ]
@@ -344,6 +367,107 @@ struct InthinneratorOptionProcessor: public appcontext::CmdLineOptionProcessor
 	}
 } ;
 
+// AvailableSNPs represents the SNPs still available to be picked, as a subset of a fixed list
+// of SNP indices sorted in the order given by ProximityTest::prepare().
+// Availability is held in a Fenwick tree over the sorted list, so that counting, finding the k-th
+// available SNP, and removing a SNP all take O(log n) time.  Removing a range of the list
+// skips directly between available SNPs, so each SNP is visited at most once per thinning.
+// The sorted list is not copied and must outlive this object.
+class AvailableSNPs
+{
+public:
+	AvailableSNPs( std::vector< std::size_t > const& sorted_snps ):
+		m_sorted_snps( sorted_snps ),
+		m_available( sorted_snps.size(), 1 ),
+		m_tree( sorted_snps.size() + 1, 0 ),
+		m_size( sorted_snps.size() ),
+		m_top_bit( 1 )
+	{
+		// Build the tree in linear time; node i counts the entries in (i - lowbit(i), i].
+		for( std::size_t i = 1; i < m_tree.size(); ++i ) {
+			m_tree[i] += 1 ;
+			std::size_t const parent = i + ( i & ( ~i + 1 )) ;
+			if( parent < m_tree.size() ) {
+				m_tree[ parent ] += m_tree[i] ;
+			}
+		}
+		while( ( m_top_bit << 1 ) <= m_sorted_snps.size() ) {
+			m_top_bit <<= 1 ;
+		}
+	}
+
+	std::vector< std::size_t > const& sorted_snps() const { return m_sorted_snps ; }
+	std::size_t size() const { return m_size ; }
+	bool empty() const { return m_size == 0 ; }
+
+	// Return the k-th available SNP (in sorted order).
+	std::size_t operator[]( std::size_t k ) const {
+		assert( k < m_size ) ;
+		return m_sorted_snps[ find_kth( k ) ] ;
+	}
+
+	// Return true if the given SNP is available.  The comparator must define the sorted order.
+	template< typename Comparator >
+	bool contains( std::size_t snp, Comparator const& comparator ) const {
+		std::vector< std::size_t >::const_iterator where = std::lower_bound( m_sorted_snps.begin(), m_sorted_snps.end(), snp, comparator ) ;
+		return where != m_sorted_snps.end() && *where == snp && m_available[ where - m_sorted_snps.begin() ] ;
+	}
+
+	// Remove all SNPs at positions begin, ..., end-1 of the sorted list.
+	void remove( std::size_t begin, std::size_t const end ) {
+		assert( end <= m_sorted_snps.size() ) ;
+		for( begin = find_next_available( begin ); begin < end; begin = find_next_available( begin + 1 )) {
+			m_available[ begin ] = 0 ;
+			for( std::size_t i = begin + 1; i < m_tree.size(); i += ( i & ( ~i + 1 ))) {
+				--m_tree[i] ;
+			}
+			--m_size ;
+		}
+	}
+
+private:
+	std::vector< std::size_t > const& m_sorted_snps ;
+	std::vector< char > m_available ;
+	std::vector< uint32_t > m_tree ;
+	std::size_t m_size ;
+	std::size_t m_top_bit ;
+
+private:
+	// Return the number of available SNPs at positions before i in the sorted list.
+	std::size_t count_before( std::size_t i ) const {
+		std::size_t result = 0 ;
+		for( ; i > 0; i -= ( i & ( ~i + 1 ))) {
+			result += m_tree[i] ;
+		}
+		return result ;
+	}
+
+	// Return the position in the sorted list of the k-th available SNP.
+	std::size_t find_kth( std::size_t k ) const {
+		std::size_t position = 0 ;
+		for( std::size_t step = m_top_bit; step > 0; step >>= 1 ) {
+			if( position + step < m_tree.size() && m_tree[ position + step ] <= k ) {
+				position += step ;
+				k -= m_tree[ position ] ;
+			}
+		}
+		return position ;
+	}
+
+	// Return the position of the first available SNP at or after position i,
+	// or the length of the list if there is none.
+	std::size_t find_next_available( std::size_t i ) const {
+		if( i >= m_sorted_snps.size() ) {
+			return m_sorted_snps.size() ;
+		}
+		if( m_available[i] ) {
+			return i ;
+		}
+		std::size_t const k = count_before( i ) ;
+		return ( k < m_size ) ? find_kth( k ) : m_sorted_snps.size() ;
+	}
+} ;
+
 // SNPPicker encapsulates the operation of picking a SNP from a given list.
 // Different strategies are possible and are implemented by base classes.
 // Picking takes place in the context of a particular list of SNPs, passed in by the set_snps() method.
@@ -361,8 +485,11 @@ public:
 	virtual void set_snps( std::size_t, SNPGetter, SNPComparator ) = 0 ;
 
 	virtual std::size_t pick(
-		std::deque< std::size_t > const& among_these
+		AvailableSNPs const& among_these
 	) const = 0 ;
+	// Return a copy of this picker with its random number generator (if any) seeded with the given seed.
+	// Copies share no mutable state, so can be used for separate thinnings in separate threads.
+	virtual UniquePtr clone( std::size_t seed ) const = 0 ;
 	// Tell the picker the order in which SNPs are sorted.
 	// This permits pickers to do binary lookup in the list of SNPs.
 	// TODO: we should rewrite this to take a boost::function which is the sort comparator.
@@ -383,10 +510,14 @@ public:
 	}
 
 	std::size_t pick(
-		std::deque< std::size_t > const& among_these
+		AvailableSNPs const& among_these
 	) const {
 		assert( among_these.size() > 0 ) ;
-		return *(among_these.begin()) ;
+		return among_these[0] ;
+	}
+
+	UniquePtr clone( std::size_t ) const {
+		return UniquePtr( new FirstAvailableSNPPicker ) ;
 	}
 	
 	std::string display() const {
@@ -425,15 +556,17 @@ public:
 	}
 
 	std::size_t pick(
-		std::deque< std::size_t > const& among_these
+		AvailableSNPs const& among_these
 	) const {
 		assert( among_these.size() > 0 ) ;
 		Distribution distribution( 0, among_these.size() - 1 ) ;
 		std::size_t choice = distribution( *m_rng ) ;
 		assert( choice < among_these.size() ) ;
-		std::deque< std::size_t >::const_iterator i = among_these.begin() ;
-		std::advance( i, choice ) ;
-		return *i ;
+		return among_these[ choice ] ;
+	}
+
+	UniquePtr clone( std::size_t seed ) const {
+		return UniquePtr( new RandomSNPPicker( seed )) ;
 	}
 
 	std::string display() const {
@@ -471,6 +604,18 @@ public:
 		m_maximum_distance( maximum_distance )
 	{
 	}
+
+	RandomPositionSNPPicker(
+		RangeMap const& range_map,
+		std::size_t maximum_distance,
+		std::size_t seed
+	):
+		m_rng( new RNG( seed ) ),
+		m_uniform_01( 0.0, 1.0 ),
+		m_range_map( range_map ),
+		m_maximum_distance( maximum_distance )
+	{
+	}
 	
 	void set_snps( std::size_t number_of_snps, SNPGetter getter, SNPComparator comparator ) {
 		assert( number_of_snps > 0 ) ;
@@ -482,7 +627,7 @@ public:
 	}
 	
 	std::size_t pick(
-		std::deque< std::size_t > const& among_these
+		AvailableSNPs const& among_these
 	) const {
 		bool picked = false ;
 		std::size_t result = 0 ;
@@ -499,7 +644,7 @@ public:
 			if( previous != m_snps_by_position.end() && previous->first == pos ) {
 				// Have landed right on a SNP!  pick it.
 				result = previous->second ;
-				picked = std::binary_search( among_these.begin(), among_these.end(), result ) ;
+				picked = among_these.contains( result, m_snp_comparator ) ;
 			} else {
 				SnpByPositionMap::const_iterator next = previous ;
 				--previous ;
@@ -523,7 +668,7 @@ public:
 						result = previous->second ;
 					}
 
-					picked = std::binary_search( among_these.begin(), among_these.end(), result ) ;
+					picked = among_these.contains( result, m_snp_comparator ) ;
 				} else {
 					// no pickable SNP within distance of the chosen position.
 					// Go back and try again
@@ -540,6 +685,10 @@ public:
 		return result ;
 	}
 
+	UniquePtr clone( std::size_t seed ) const {
+		return UniquePtr( new RandomPositionSNPPicker( m_range_map, m_maximum_distance, seed )) ;
+	}
+
 	std::string display() const {
 		std::ostringstream ostr ;
 		ostr << "RandomPositionSNPPicker with map:\n" ;
@@ -636,6 +785,14 @@ public:
 
 	HighestValueSNPPicker(
 		SnpToValueMap const& values
+	):
+		m_values_per_snp( new SnpToValueMap( values ) ),
+		m_value_to_index_map( DoubleComparator() )
+	{
+	}
+
+	HighestValueSNPPicker(
+		boost::shared_ptr< SnpToValueMap const > values
 	):
 		m_values_per_snp( values ),
 		m_value_to_index_map( DoubleComparator() )
@@ -646,8 +803,8 @@ public:
 		m_value_to_index_map.clear() ;
 		m_index_to_value_map.resize( number_of_snps ) ;
 		for( std::size_t i = 0; i < number_of_snps; ++i ) {
-			SnpToValueMap::const_iterator where = m_values_per_snp.find( getter(i) ) ;
-			if( where == m_values_per_snp.end() ) {
+			SnpToValueMap::const_iterator where = m_values_per_snp->find( getter(i) ) ;
+			if( where == m_values_per_snp->end() ) {
 				throw genfile::BadArgumentError( "HighestValueSNPPicker::set_snps()", "snps", "SNP " + genfile::string_utils::to_string( getter(i) ) + " is not in the value map." ) ;
 			}
 			m_index_to_value_map[i] = where->second ;
@@ -657,18 +814,11 @@ public:
 	}
 
 	std::size_t pick(
-		std::deque< std::size_t > const& among_these
+		AvailableSNPs const& among_these
 	) const {
 		assert( among_these.size() > 0 ) ;
 		ValueToIndexMap::reverse_iterator pick = m_value_to_index_map.rbegin() ;
-		while(
-			!std::binary_search(
-				among_these.begin(),
-				among_these.end(),
-				pick->second,
-				m_snp_comparator
-			)
-		) {
+		while( !among_these.contains( pick->second, m_snp_comparator ) ) {
 			++pick ;
 			assert( pick != m_value_to_index_map.rend() ) ;
 		}
@@ -686,6 +836,11 @@ public:
         return chosen_snp ;
 	}
 
+	UniquePtr clone( std::size_t ) const {
+		// Picking is deterministic, so the seed is not needed.
+		return UniquePtr( new HighestValueSNPPicker( m_values_per_snp )) ;
+	}
+
 	std::string display() const {
 		return "HighestValueSNPPicker" ;
 	} ;
@@ -703,7 +858,7 @@ public:
 	}
 	
 private:
-	SnpToValueMap const m_values_per_snp ;
+	boost::shared_ptr< SnpToValueMap const > m_values_per_snp ;
 	IndexToValueMap m_index_to_value_map ;
 	mutable ValueToIndexMap m_value_to_index_map ;
 	SNPComparator m_snp_comparator ;
@@ -713,7 +868,7 @@ private:
 // ProximityTest encapsulates a criterion for two SNPs being 'too close together'.
 // Given the context of a fixed list of SNPs (passed in using set_snps),
 // ProximityTest supports the primitive remove_snps_too_close_to()
-// which removes from the given list indices of SNPs that are deemed 'too close in the genome'
+// which removes from the given set of available SNPs those that are deemed 'too close in the genome'
 // to the first argument.
 //
 // For efficiency reasons, ProximityTest is endowed with a prepare() method
@@ -727,8 +882,8 @@ public:
 public:
 	virtual ~ProximityTest() {}
 	virtual void set_snps( std::size_t number_of_snps, SNPGetter snps ) = 0 ;
-	virtual void prepare( std::deque< std::size_t >* among_these ) const = 0 ;
-	virtual void remove_snps_too_close_to( std::size_t chosen_snp_i, std::deque< std::size_t >* among_these ) const = 0 ;	
+	virtual void prepare( std::vector< std::size_t >* among_these ) const = 0 ;
+	virtual void remove_snps_too_close_to( std::size_t chosen_snp_i, AvailableSNPs* among_these ) const = 0 ;	
 	virtual std::string display() const = 0 ;
 	virtual std::set< std::string > get_attribute_names() const = 0 ;
 	virtual std::map< std::string, genfile::VariantEntry > get_attributes( std::size_t ) const = 0 ;
@@ -764,13 +919,13 @@ public:
 		return result ;
 	}
 
-	void prepare( std::deque< std::size_t >* among_these ) const {
+	void prepare( std::vector< std::size_t >* among_these ) const {
 		// Sort by chromosome / recombination distance
 		//std::sort( among_these->begin(), among_these->end(), boost::bind( &RecombinationDistanceProximityTest::compare_recombination_positions, this, _1, _2 )) ;
 		std::sort( among_these->begin(), among_these->end(), boost::bind( &RecombinationDistanceProximityTest::compare_physical_positions, this, _1, _2 )) ;
 	}
 
-	void remove_snps_too_close_to( std::size_t chosen_snp, std::deque< std::size_t >* among_these ) const {
+	void remove_snps_too_close_to( std::size_t chosen_snp, AvailableSNPs* among_these ) const {
 		std::pair< genfile::Chromosome, double >
 			lower_bound = get_recombination_position( m_snps[ chosen_snp ].get_position() ),
 			upper_bound = lower_bound ;
@@ -781,10 +936,11 @@ public:
 		// Find an iterator to the lowest SNP in among_these
 		// such that recombination position of the (SNP + margin)
 		// is greater than or equal to lower_bound
-		std::deque< std::size_t >::iterator
+		std::vector< std::size_t > const& sorted_snps = among_these->sorted_snps() ;
+		std::vector< std::size_t >::const_iterator
 			lower_bound_i = std::lower_bound(
-				among_these->begin(),
-				among_these->end(),
+				sorted_snps.begin(),
+				sorted_snps.end(),
 				lower_bound,
 				boost::bind(
 			 		&RecombinationDistanceProximityTest::compare_to_recombination_position,
@@ -798,10 +954,10 @@ public:
 		// Find an iterator to the lowest SNP in among_these
 		// such that recombination position of the (SNP - margin)
 		// is greater than upper_bound
-		std::deque< std::size_t >::iterator
+		std::vector< std::size_t >::const_iterator
 			upper_bound_i = std::upper_bound(
-				among_these->begin(),
-				among_these->end(),
+				sorted_snps.begin(),
+				sorted_snps.end(),
 				upper_bound,
 				boost::bind(
 			 		&RecombinationDistanceProximityTest::compare_recombination_position_to,
@@ -814,7 +970,7 @@ public:
 		// We should always have the chosen SNP itself.
 		// assert( std::distance( lower_bound_i, upper_bound_i ) >= 1 ) ;
 
-		among_these->erase( lower_bound_i, upper_bound_i ) ;
+		among_these->remove( lower_bound_i - sorted_snps.begin(), upper_bound_i - sorted_snps.begin() ) ;
 	}
 
 	std::set< std::string > get_attribute_names() const {
@@ -929,12 +1085,12 @@ public:
 		}
 	}
 
-	void prepare( std::deque< std::size_t >* among_these ) const {
+	void prepare( std::vector< std::size_t >* among_these ) const {
 		// Sort by chromosome / physical distance
 		std::sort( among_these->begin(), among_these->end(), boost::bind( &PhysicalDistanceProximityTest::compare, this, _1, _2 )) ;
 	}
 
-	void remove_snps_too_close_to( std::size_t chosen_snp, std::deque< std::size_t >* among_these ) const {
+	void remove_snps_too_close_to( std::size_t chosen_snp, AvailableSNPs* among_these ) const {
 		genfile::GenomePosition
 			lower_bound = m_snps[ chosen_snp ].get_position(),
 			upper_bound = lower_bound ;
@@ -948,10 +1104,11 @@ public:
 		
 		upper_bound.position() += m_minimum_distance_in_base_pairs ;
 
-		std::deque< std::size_t >::iterator
+		std::vector< std::size_t > const& sorted_snps = among_these->sorted_snps() ;
+		std::vector< std::size_t >::const_iterator
 			lower_bound_i = std::upper_bound(
-				among_these->begin(),
-				among_these->end(),
+				sorted_snps.begin(),
+				sorted_snps.end(),
 				lower_bound,
 				boost::bind(
 			 		&PhysicalDistanceProximityTest::compare_position_to_b,
@@ -961,10 +1118,10 @@ public:
 				)
 		) ;
 
-		std::deque< std::size_t >::iterator
+		std::vector< std::size_t >::const_iterator
 			upper_bound_i = std::lower_bound(
-				among_these->begin(),
-				among_these->end(),
+				sorted_snps.begin(),
+				sorted_snps.end(),
 				upper_bound,
 				boost::bind(
 			 		&PhysicalDistanceProximityTest::compare_a_to_position,
@@ -974,7 +1131,7 @@ public:
 				)
 		) ;
 
-		among_these->erase( lower_bound_i, upper_bound_i ) ;
+		among_these->remove( lower_bound_i - sorted_snps.begin(), upper_bound_i - sorted_snps.begin() ) ;
 	}
 	
 	std::set< std::string > get_attribute_names() const {
@@ -1854,6 +2011,9 @@ private:
 		
 	}
 
+	typedef std::map< boost::optional< std::string >, std::vector< std::size_t > > SnpsByTag ;
+	typedef boost::function< void ( std::size_t, std::size_t ) > ProgressCallback ;
+
 	void perform_thinnings(
 		boost::optional< std::vector< double > > const& recombination_offsets,
 		genes::Genes::UniquePtr const& genes
@@ -1864,6 +2024,9 @@ private:
 		std::size_t const start_N = options().get_value< std::size_t >( "-start-N" ) ;
 		std::size_t const max_num_picks = options().check( "-max-picks" ) ? options().get_value< std::size_t >( "-max-picks" ) : snps.size() ;
 		std::size_t const number_of_digits = std::max( std::size_t( std::log10( N + start_N ) ) + 1, std::size_t( 3u )) ;
+		std::size_t const number_of_threads = options().get_value< std::size_t >( "-threads" ) ;
+		std::size_t const seed = options().check( "-seed" ) ? options().get_value< std::size_t >( "-seed" ) : get_random_seed() ;
+		get_ui_context().logger() << "Using random seed " << seed << ".\n" ;
 
 		std::vector< boost::optional< std::string > > pick_tags ;
 		if( options().check( "-match-tag" )) {
@@ -1882,83 +2045,128 @@ private:
 			pick_tags.resize( max_num_picks, boost::optional< std::string >() ) ;
 		}
 
-//		std::cerr << "FORMAT STRING: " << formatstring << ".\n" ;
-		std::string const& filename = options().get< std::string >( "-o" ) ;
-		for( std::size_t i = start_N; i < (start_N+N); ++i ) {
-			get_ui_context().logger() << "Picking " << (i+1) << " of " << N << "..." ;
-			std::vector< std::size_t > picked_snps = pick_snps( snps, pick_tags ) ;
-			get_ui_context().logger() << picked_snps.size() << " SNPs picked.\n" ;
-			write_output( i, recombination_offsets, picked_snps, genes, filename ) ;
-		}
-	}
-
-	std::vector< std::size_t > pick_snps(
-		std::vector< TaggedSnp > const& snps,
-		std::vector< boost::optional< std::string > > const& pick_tags
-	) const {
-		// Create a list of all SNPs and sort it in the way preferred by the proximity test
-		std::deque< std::size_t > all_snp_indices(
+		// Create a list of all SNPs sorted in the way preferred by the proximity test,
+		// and per-tag subsets of it.  These are shared by all thinnings.
+		std::vector< std::size_t > sorted_snps(
 			boost::counting_iterator< std::size_t >( 0 ),
 			boost::counting_iterator< std::size_t >( snps.size() )
 		) ;
-		m_proximity_test->prepare( &all_snp_indices ) ;
-		CompareByOrder comparator( all_snp_indices ) ;
-
-		// Tell the SNP picker our full list of SNPs
+		m_proximity_test->prepare( &sorted_snps ) ;
+		CompareByOrder comparator( sorted_snps ) ;
+		// The picker is not itself used for picking, but reports per-SNP attributes in the output.
 		m_snp_picker->set_snps(
 			snps.size(),
-			boost::bind( &impl::get_snp, snps, _1 ),
+			boost::bind( &impl::get_snp, boost::cref( snps ), _1 ),
 			boost::cref( comparator )
 		) ;
-
-		// Create per-tag subsets of the full list
-		typedef std::map< boost::optional< std::string >, std::deque< std::size_t > > SnpsByTag ;
-		SnpsByTag remaining_snps_by_tag ;
-		for( std::size_t i = 0; i < all_snp_indices.size(); ++i ) {
-			remaining_snps_by_tag[ snps[all_snp_indices[i]].tag() ].push_back( all_snp_indices[i] ) ;
+		SnpsByTag snps_by_tag ;
+		for( std::size_t i = 0; i < sorted_snps.size(); ++i ) {
+			snps_by_tag[ snps[sorted_snps[i]].tag() ].push_back( sorted_snps[i] ) ;
+		}
+		for( std::size_t i = 0; i < pick_tags.size(); ++i ) {
+			if( snps_by_tag.find( pick_tags[i] ) == snps_by_tag.end() ) {
+				throw genfile::BadArgumentError(
+					"InthinneratorApplication::perform_thinnings()",
+					"pick_tags",
+					"A tag (\"" + ( pick_tags[i] ? pick_tags[i].get() : "NA" ) + "\") was supplied for which no SNP was available."
+				) ;
+			}
 		}
 
-		return pick_snps( snps, pick_tags, &remaining_snps_by_tag ) ;
+//		std::cerr << "FORMAT STRING: " << formatstring << ".\n" ;
+		std::string const& filename = options().get< std::string >( "-o" ) ;
+		if( number_of_threads == 0 ) {
+			for( std::size_t i = start_N; i < (start_N+N); ++i ) {
+				get_ui_context().logger() << "Picking " << (i+1) << " of " << N << "..." ;
+				std::vector< std::size_t > picked_snps ;
+				{
+					UIContext::ProgressContext progress_context = get_ui_context().get_progress_context( "Picking SNPs" ) ;
+					pick_snps( get_replicate_seed( seed, i ), snps, snps_by_tag, comparator, pick_tags, boost::ref( progress_context ), &picked_snps ) ;
+				}
+				get_ui_context().logger() << picked_snps.size() << " SNPs picked.\n" ;
+				write_output( i, recombination_offsets, picked_snps, genes, filename ) ;
+			}
+		} else {
+			// Pick one batch of thinnings at a time in parallel, then write them out in order on this thread.
+			worker::QueuedMultiThreadedWorker worker( number_of_threads ) ;
+			for( std::size_t batch_start = start_N; batch_start < (start_N+N); batch_start += number_of_threads ) {
+				std::size_t const batch_end = std::min( batch_start + number_of_threads, start_N + N ) ;
+				get_ui_context().logger() << "Picking " << (batch_start+1) << "-" << batch_end << " of " << N << "...\n" ;
+				std::vector< std::vector< std::size_t > > picked_snps( batch_end - batch_start ) ;
+				boost::ptr_vector< worker::Task > tasks ;
+				for( std::size_t i = batch_start; i < batch_end; ++i ) {
+					tasks.push_back(
+						new worker::FunctionTask(
+							boost::bind(
+								&InthinneratorApplication::pick_snps,
+								this,
+								get_replicate_seed( seed, i ),
+								boost::cref( snps ),
+								boost::cref( snps_by_tag ),
+								boost::cref( comparator ),
+								boost::cref( pick_tags ),
+								ProgressCallback(),
+								&picked_snps[ i - batch_start ]
+							)
+						)
+					) ;
+					worker.tell_to_perform_task( tasks.back() ) ;
+				}
+				for( std::size_t i = batch_start; i < batch_end; ++i ) {
+					tasks[ i - batch_start ].wait_until_complete() ;
+					get_ui_context().logger() << "Thinning " << (i+1) << ": " << picked_snps[ i - batch_start ].size() << " SNPs picked.\n" ;
+					write_output( i, recombination_offsets, picked_snps[ i - batch_start ], genes, filename ) ;
+				}
+			}
+		}
 	}
 
-	std::vector< std::size_t > pick_snps(
+	// Perform one thinning, storing the picked SNPs in result.
+	// This can be called concurrently from several threads.
+	void pick_snps(
+		std::size_t const seed,
 		std::vector< TaggedSnp > const& snps,
+		SnpsByTag const& snps_by_tag,
+		CompareByOrder const& comparator,
 		std::vector< boost::optional< std::string > > const& pick_tags,
-		std::map< boost::optional< std::string >, std::deque< std::size_t > >* remaining_snps_by_tag
+		ProgressCallback progress_callback,
+		std::vector< std::size_t >* result
 	) const {
-		typedef std::map< boost::optional< std::string >, std::deque< std::size_t > > SnpsByTag ;
-		std::vector< std::size_t > result ;
-		if( pick_tags.size() > 0 ) {
-			UIContext::ProgressContext progress_context = get_ui_context().get_progress_context( "Picking SNPs" ) ;
-
-			std::size_t remaining_snp_count = 0 ;
-			SnpsByTag::const_iterator next_tag_i = remaining_snps_by_tag->find( pick_tags[0] ) ;
-			while(
-				result.size() < pick_tags.size()
-				&& ( next_tag_i = remaining_snps_by_tag->find( pick_tags[ result.size() ] ) ) != remaining_snps_by_tag->end()
-				&& next_tag_i->second.size() > 0
-			) {
-				std::size_t picked_snp = m_snp_picker->pick( next_tag_i->second ) ;
-				remaining_snp_count = 0 ;
-				for( SnpsByTag::iterator i = remaining_snps_by_tag->begin(); i != remaining_snps_by_tag->end(); ++i ) {
-					m_proximity_test->remove_snps_too_close_to( picked_snp, &(i->second) ) ;
-					remaining_snp_count += i->second.size() ;
-				}
-				result.push_back( picked_snp ) ;
-				progress_context.notify_progress( snps.size() - remaining_snp_count, snps.size() ) ;
-			}
+		assert( result ) ;
+		result->clear() ;
 
-			if( next_tag_i == remaining_snps_by_tag->end() ) {
-				throw genfile::BadArgumentError(
-					"InthinneratorApplication::pick_snps()",
-					"pick_tags",
-					"A tag (\"" + ( pick_tags[ result.size() ] ? pick_tags[ result.size() ].get() : "NA" ) + "\") was supplied for which no SNP was available."
-				) ;
-			}
+		// Each thinning uses its own picker, so that thinnings are independent.
+		SNPPicker::UniquePtr picker = m_snp_picker->clone( seed ) ;
+		picker->set_snps(
+			snps.size(),
+			boost::bind( &impl::get_snp, boost::cref( snps ), _1 ),
+			boost::cref( comparator )
+		) ;
 
-			progress_context.notify_progress( snps.size() - remaining_snp_count, snps.size() ) ;
+		typedef std::map< boost::optional< std::string >, AvailableSNPs > AvailableSNPsByTag ;
+		AvailableSNPsByTag remaining_snps_by_tag ;
+		for( SnpsByTag::const_iterator i = snps_by_tag.begin(); i != snps_by_tag.end(); ++i ) {
+			remaining_snps_by_tag.insert( std::make_pair( i->first, AvailableSNPs( i->second ))) ;
+		}
+
+		std::size_t remaining_snp_count = snps.size() ;
+		while( result->size() < pick_tags.size() ) {
+			AvailableSNPsByTag::const_iterator const next_tag_i = remaining_snps_by_tag.find( pick_tags[ result->size() ] ) ;
+			assert( next_tag_i != remaining_snps_by_tag.end() ) ;
+			if( next_tag_i->second.empty() ) {
+				break ;
+			}
+			std::size_t picked_snp = picker->pick( next_tag_i->second ) ;
+			remaining_snp_count = 0 ;
+			for( AvailableSNPsByTag::iterator i = remaining_snps_by_tag.begin(); i != remaining_snps_by_tag.end(); ++i ) {
+				m_proximity_test->remove_snps_too_close_to( picked_snp, &(i->second) ) ;
+				remaining_snp_count += i->second.size() ;
+			}
+			result->push_back( picked_snp ) ;
+			if( progress_callback ) {
+				progress_callback( snps.size() - remaining_snp_count, snps.size() ) ;
+			}
 		}
-		return result ;
 	}
 	
 	void write_output(
@@ -21,6 +21,7 @@
 #include <memory>
 #include <numeric>
 #include <algorithm>
+#include <iterator>
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
@@ -37,6 +38,7 @@
 
 #include "db/Error.hpp"
 
+#include "genfile/FileUtils.hpp"
 #include "genfile/SNPDataSource.hpp"
 #include "genfile/SNPDataSourceChain.hpp"
 #include "genfile/SNPDataSourceRack.hpp"
@@ -46,6 +48,7 @@
 #include "genfile/GenFileSNPDataSink.hpp"
 #include "genfile/VCFFormatSNPDataSink.hpp"
 #include "genfile/SortingBGenFileSNPDataSink.hpp"
+#include "genfile/BGenFileSNPDataSource.hpp"
 #include "genfile/TrivialSNPDataSink.hpp"
 #include "genfile/CategoricalCohortIndividualSource.hpp"
 #include "genfile/CountingCohortIndividualSource.hpp"
@@ -57,6 +60,7 @@
 #include "genfile/StrandAligningSNPDataSource.hpp"
 #include "genfile/ThreshholdingSNPDataSource.hpp"
 #include "genfile/VCFFormatSNPDataSource.hpp"
+#include "genfile/PgenFileSNPDataSource.hpp"
 #include "genfile/PloidyConvertingSNPDataSource.hpp"
 #include "genfile/CommonSNPFilter.hpp"
 #include "genfile/SNPFilteringSNPDataSource.hpp"
@@ -82,7 +86,11 @@
 #include "statfile/SNPDataSourceAdapter.hpp"
 
 #include "qcdb/FlatFileOutputter.hpp"
+#include "qcdb/ColumnarFileOutputter.hpp"
 #include "qcdb/FlatTableDBOutputter.hpp"
+#include "qcdb/AsynchronousStorage.hpp"
+#include "qcdb/BGenIndexQuery.hpp"
+#include "qcdb/BGenIndexWriter.hpp"
 
 #include "appcontext/appcontext.hpp"
 
@@ -122,6 +130,20 @@ namespace impl {
 		assert( i < vector->size() ) ;
 		(*vector)[i] = value.as< std::string >() ;
 	}
+
+	// The data fields decoded ahead of processing when variants are read on other threads.
+	std::vector< std::string > get_specs_read_ahead() {
+		std::vector< std::string > specs ;
+		specs.push_back( ":genotypes:" ) ;
+		specs.push_back( ":intensities:" ) ;
+		specs.push_back( "XY" ) ;
+		return specs ;
+	}
+
+	// Output sinks may write any field present in the data, so keep them all in that case.
+	bool get_cache_supported_specs( appcontext::OptionProcessor const& options ) {
+		return options.check( "-og" ) || options.check( "-op" ) ;
+	}
 }
 
 struct QCToolOptionProcessor: public appcontext::CmdLineOptionProcessor
@@ -370,6 +392,18 @@ public:
 				" This option can be used, for example, when cohorts are typed on different platforms so have different SNPID fields." )
 			.set_takes_single_value()
 			.set_default_value( "position,alleles,ids" ) ;
+		options[ "-parallel-files" ]
+			.set_description( "When -g matches several files (for example using the '#' wildcard to match one file per chromosome),"
+				" read and decode up to this many of the files at once, each on a separate thread."
+				" Variants are still processed in file order." )
+			.set_takes_single_value()
+			.set_default_value( 0 ) ;
+		options[ "-cohort-read-ahead" ]
+			.set_description( "When more than one cohort is specified, read and decode each cohort's variants"
+				" on a separate thread, keeping up to this many variants per cohort queued for matching."
+				" The default (0) reads all cohorts in the main thread." )
+			.set_takes_single_value()
+			.set_default_value( 0 ) ;
 		options[ "-assume-chromosome" ]
 			.set_description( "Treat each SNP whose chromosome cannot be determined"
 				" as though it lies on the specified chromosome." )
@@ -399,7 +433,9 @@ public:
 			.set_default_value( "traditional" ) ;
 	
 		options[ "-osnp" ]
-			.set_description( "Set the name of the file used to output results of per-SNP computations." )
+			.set_description( "Set the name of the file used to output results of per-SNP computations."
+				" Files ending in .sqlite are written as sqlite databases, and files ending in .qcol are written"
+				" in a compressed columnar binary format that can be read column-by-column." )
 			.set_takes_single_value() ;
 
 		options[ "-osample" ]
@@ -437,6 +473,18 @@ public:
 			.set_default_value( "zlib" )
 			.set_takes_single_value()
 		;
+		options[ "-bgen-compression-level" ]
+			.set_description( "Specify the compression level to use when outputting BGEN files only."
+				" This can be 0-9 for zlib or 1-22 for zstd compression.  If not specified, zlib uses level 9"
+				" and zstd uses level 17." )
+			.set_takes_single_value()
+		;
+		options[ "-bgen-compression-threads" ]
+			.set_description( "For use when outputting BGEN files only.  Tell QCTOOL to encode and compress variants"
+				" using this many worker threads, with a separate thread writing them to the file." )
+			.set_takes_single_value()
+			.set_default_value( 0 )
+		;
 		options[ "-bgen-permitted-input-rounding-error" ]
 			.set_description(
 				"Specify the maximum error that will be tolerated in input probability values when writing a BGEN file. "
@@ -454,6 +502,22 @@ public:
 			.set_description( "For use when outputting BGEN files only.  Tell QCTOOL to omit the sample identifier block.  By default"
 				" this is written whenever -s is specified." )
 		;
+		options[ "-bgen-decompression-threads" ]
+			.set_description( "For use when reading compressed BGEN files only.  Tell QCTOOL to read variants ahead"
+				" and decompress them using this many worker threads." )
+			.set_takes_single_value()
+			.set_default_value( 0 )
+		;
+		options[ "-bgen-memory-map" ]
+			.set_description( "For use when reading uncompressed local BGEN files only.  Tell QCTOOL to memory-map the file"
+				" and read genotype data directly from the mapped pages." )
+		;
+		options[ "-bgen-index" ]
+			.set_description( "For use when outputting BGEN files only.  Tell QCTOOL to also write an index file"
+				" (with the same name as the output file, plus \".bgi\") recording the location of each variant."
+				" When reading a BGEN file, QCTOOL uses a matching index file if present to seek directly"
+				" to variants selected by -incl-range or -incl-rsids." )
+		;
 
 		options.option_implies_option( "-sort", "-og" ) ;
 		options.option_implies_option( "-omit-chromosome", "-og" ) ;
@@ -518,7 +582,9 @@ public:
 			.set_description( "Specify that " + globals::program_name + " should write a log file to the given file." )
 			.set_takes_single_value() ;
 		options [ "-threads" ]
-			.set_description( "Specify the number of worker threads to use in computationally intensive tasks." )
+			.set_description( "Specify the number of worker threads to use in computationally intensive tasks."
+				" If this is nonzero, SNPs are also read in a separate pipeline, per-SNP computations"
+				" and outputs are run in parallel, and per-SNP results are written on a separate thread." )
 			.set_takes_single_value()
 			.set_default_value( 0 ) ;
 		options[ "-analysis-name" ]
@@ -1552,6 +1618,10 @@ private:
 
 				progress_context.notify_progress( ++progress_count, file_count ) ;
 			}
+			std::size_t const parallel_files = m_options.get< std::size_t >( "-parallel-files" ) ;
+			if( parallel_files > 0 && chain->number_of_sources() > 1 ) {
+				chain->set_read_ahead( parallel_files, 256, impl::get_specs_read_ahead(), impl::get_cache_supported_specs( m_options ) ) ;
+			}
 			source.reset( chain.release() ) ;
 			
 			// If we have strand alignment information, implement it now
@@ -1580,6 +1650,10 @@ private:
 		}
 		
 		if( rack.get() ) {
+			std::size_t const read_ahead = m_options.get< std::size_t >( "-cohort-read-ahead" ) ;
+			if( read_ahead > 0 ) {
+				rack->set_read_ahead( read_ahead, impl::get_specs_read_ahead(), impl::get_cache_supported_specs( m_options ) ) ;
+			}
 			source.reset( rack.release() ) ;
 		}
 
@@ -1744,6 +1818,43 @@ private:
 			vcf_source->set_strict_mode( !m_options.check( "-permissive" )) ;
 		}
 
+		// bgen-specific options
+		if( genfile::BGenFileSNPDataSource* bgen_source = dynamic_cast< genfile::BGenFileSNPDataSource* >( source.get() ) ) {
+			if(
+				m_options.check( "-bgen-memory-map" )
+				&& uf.second != "-"
+				&& genfile::get_compression_type_indicated_by_filename( uf.second ) == "no_compression"
+			) {
+				bgen_source = new genfile::BGenFileSNPDataSource( uf.second, chromosome_hint, genfile::BGenFileSNPDataSource::eMemoryMappedAccess ) ;
+				source.reset( bgen_source ) ;
+			}
+			use_bgen_index_if_present( uf.second, bgen_source ) ;
+			std::size_t const decompression_threads = m_options.get< std::size_t >( "-bgen-decompression-threads" ) ;
+			if( decompression_threads > 0 && ( bgen_source->bgen_context().flags & genfile::bgen::e_CompressedSNPBlocks ) != genfile::bgen::e_NoCompression ) {
+				// A few blocks per thread keeps the workers busy while the consumer is working.
+				bgen_source->set_read_ahead( decompression_threads, 4 * decompression_threads ) ;
+			}
+		}
+
+		// pgen-specific options
+		if( genfile::PgenFileSNPDataSource* pgen_source = dynamic_cast< genfile::PgenFileSNPDataSource* >( source.get() ) ) {
+			// Ranges can only be used to skip records if no other inclusion filters are given,
+			// since these are combined with OR by the SNP filter.
+			if(
+				m_options.check_if_option_was_supplied( "-incl-range" )
+				&& !m_options.check_if_option_was_supplied( "-incl-rsids" )
+				&& !m_options.check_if_option_was_supplied( "-incl-snpids" )
+				&& !m_options.check_if_option_was_supplied( "-incl-positions" )
+			) {
+				std::vector< std::string > specs = m_options.get_values< std::string >( "-incl-range" ) ;
+				std::vector< genfile::GenomePositionRange > ranges ;
+				for( std::size_t i = 0; i < specs.size(); ++i ) {
+					ranges.push_back( genfile::GenomePositionRange::parse( specs[i] )) ;
+				}
+				pgen_source->set_ranges( ranges ) ;
+			}
+		}
+
 		genfile::CommonSNPFilter* snp_filter = get_snp_filter() ;
 		// Filter SNPs if necessary
 		if( snp_filter ) {
@@ -2123,6 +2234,14 @@ private:
 						if( bgen_sink ) {
 							bgen_sink->set_number_of_bits( m_options.get< std::size_t >( "-bgen-bits" )) ;
 							bgen_sink->set_compression_type( m_options.get< std::string >( "-bgen-compression" ) ) ;
+							if( m_options.check( "-bgen-compression-level" )) {
+								bgen_sink->set_compression_level( m_options.get< int >( "-bgen-compression-level" )) ;
+							}
+							if( m_options.get< std::size_t >( "-bgen-compression-threads" ) > 0 ) {
+								std::size_t const number_of_threads = m_options.get< std::size_t >( "-bgen-compression-threads" ) ;
+								// A few variants per thread keeps the workers busy.
+								bgen_sink->set_number_of_threads( number_of_threads, 4 * number_of_threads ) ;
+							}
 							bgen_sink->set_permitted_input_rounding_error( m_options.get< double >( "-bgen-permitted-input-rounding-error" ) ) ;
 
 							if( m_options.check( "-bgen-free-data" )) {
@@ -2153,12 +2272,72 @@ private:
 							)
 						) ;
 					}
+					if( m_options.check( "-bgen-index" )) {
+						add_bgen_index_writer( filename, sink.get() ) ;
+					}
 				}
 				m_fltrd_in_snp_data_sink->add_sink( sink ) ;
 			}
 		}
 	}
 
+	void add_bgen_index_writer( std::string const& filename, genfile::SNPDataSink* sink ) {
+		// The index is committed when the last copy of the callback is destroyed along with the sink.
+		genfile::SortingBGenFileSNPDataSink* sorting_sink = dynamic_cast< genfile::SortingBGenFileSNPDataSink* >( sink ) ;
+		genfile::BGenFileSNPDataSink* bgen_sink = dynamic_cast< genfile::BGenFileSNPDataSink* >( sink ) ;
+		if( sorting_sink || bgen_sink ) {
+			genfile::BGenFileSNPDataSink::VariantLocationCallback callback = boost::bind(
+				&qcdb::BGenIndexWriter::add_variant,
+				qcdb::BGenIndexWriter::create_shared( filename + ".bgi" ),
+				_1, _2, _3
+			) ;
+			if( sorting_sink ) {
+				sorting_sink->send_variant_locations_to( callback ) ;
+			} else {
+				bgen_sink->send_variant_locations_to( callback ) ;
+			}
+		}
+	}
+
+	void use_bgen_index_if_present( std::string const& filename, genfile::BGenFileSNPDataSource* source ) const {
+		// The rsid restriction can only be used if no other identifier-based inclusion filters are given,
+		// since these are combined with OR by the SNP filter.
+		bool const use_rsids = m_options.check_if_option_was_supplied( "-incl-rsids" )
+			&& !m_options.check_if_option_was_supplied( "-incl-snpids" )
+			&& !m_options.check_if_option_was_supplied( "-incl-positions" ) ;
+		bool const use_ranges = m_options.check_if_option_was_supplied( "-incl-range" ) ;
+		std::string const index_filename = filename + ".bgi" ;
+		if( !( use_rsids || use_ranges ) || !boost::filesystem::exists( index_filename ) ) {
+			return ;
+		}
+		if( boost::filesystem::last_write_time( index_filename ) < boost::filesystem::last_write_time( filename ) ) {
+			m_ui_context.logger() << "!! Warning: index file \"" << index_filename << "\" is older than \"" << filename << "\" and will not be used.\n" ;
+			return ;
+		}
+		qcdb::BGenIndexQuery::UniquePtr query = qcdb::BGenIndexQuery::create( index_filename ) ;
+		if( use_ranges ) {
+			std::vector< std::string > specs = m_options.get_values< std::string >( "-incl-range" ) ;
+			for( std::size_t i = 0; i < specs.size(); ++i ) {
+				query->include_range( genfile::GenomePositionRange::parse( specs[i] )) ;
+			}
+		}
+		if( use_rsids ) {
+			std::vector< std::string > files = m_options.get_values< std::string >( "-incl-rsids" ) ;
+			BOOST_FOREACH( std::string const& rsid_filename, files ) {
+				std::auto_ptr< std::istream > file = genfile::open_text_file_for_input( rsid_filename, "no_compression" ) ;
+				query->include_rsids(
+					std::vector< std::string >(
+						std::istream_iterator< std::string >( *file ),
+						std::istream_iterator< std::string >()
+					)
+				) ;
+			}
+		}
+		query->initialise() ;
+		m_ui_context.logger() << "Using index \"" << index_filename << "\" to read " << query->number_of_variants() << " variants from \"" << filename << "\".\n" ;
+		source->set_index_query( genfile::bgen::IndexQuery::UniquePtr( query.release() )) ;
+	}
+
 	void open_filtered_out_snp_data_sink() {
 		reset_filtered_out_snp_data_sink() ;
 		if( m_options.check_if_option_was_supplied( "-write-snp-excl-list" ) && m_mangled_options.snp_excl_list_filename_mapper().output_filenames().size() > 0 ) {
@@ -2649,6 +2828,8 @@ private:
 
 		if( elts[0].size() >= 7 && elts[0].substr( elts[0].size() - 7, 7 ) == ".sqlite" ) {
 			result[0] = "sqlite" ;
+		} else if( result[0] == "flat" && elts[0].size() >= 5 && elts[0].substr( elts[0].size() - 5, 5 ) == ".qcol" ) {
+			result[0] = "columnar" ;
 		}
 		result[1] = elts[0] ;
 
@@ -2687,7 +2868,19 @@ private:
 			get_ui_context()
 		) ;
 
-		genfile::SimpleSNPDataSourceProcessor processor ;
+		// With worker threads, read SNPs in a pipeline and run callbacks in parallel.
+		std::auto_ptr< genfile::SNPDataSourceProcessor > processor ;
+		if( number_of_threads > 0 ) {
+			processor.reset(
+				new genfile::ThreadedSNPDataSourceProcessor(
+					number_of_threads,
+					impl::get_specs_read_ahead(),
+					impl::get_cache_supported_specs( options() )
+				)
+			) ;
+		} else {
+			processor.reset( new genfile::SimpleSNPDataSourceProcessor() ) ;
+		}
 
 		qcdb::Storage::SharedPtr per_snp_storage ;
 		if( SNPSummaryComponent::is_needed( options() )) {
@@ -2711,6 +2904,12 @@ private:
 					table_storage->set_table_name( file_spec[2] ) ;
 				}
 				per_snp_storage = table_storage ;
+			} else if( file_spec[0] == "columnar" ) {
+				per_snp_storage = qcdb::ColumnarFileOutputter::create_shared(
+					file_spec[1],
+					options().get< std::string >( "-analysis-name" ),
+					options().get_values_as_map()
+				) ;
 			} else {
 				assert( file_spec[0] == "flat" ) ;
 				per_snp_storage = qcdb::FlatFileOutputter::create_shared(
@@ -2719,6 +2918,10 @@ private:
 					options().get_values_as_map()
 				) ;
 			}
+			if( number_of_threads > 0 ) {
+				// Write results on a separate thread so that computation and output overlap.
+				per_snp_storage = qcdb::AsynchronousStorage::create_shared( per_snp_storage ) ;
+			}
 
 			SNPSummaryComponent component(
 				context.get_cohort_individual_source(),
@@ -2726,7 +2929,7 @@ private:
 				get_ui_context()
 			) ;
 			
-			component.setup( processor, per_snp_storage ) ;
+			component.setup( *processor, per_snp_storage ) ;
 		}
 
 		sample_stats::SampleStorage::SharedPtr per_sample_storage ;
@@ -2751,6 +2954,12 @@ private:
 					dbStorage->set_table_name( file_spec[2] ) ;
 				}
 				per_sample_storage = dbStorage ;
+			} else if( file_spec[0] == "columnar" ) {
+				throw genfile::BadArgumentError(
+					"QCToolApplication::unsafe_process()",
+					"-osample \"" + file_spec[1] + "\"",
+					"The columnar (.qcol) format is only supported for per-SNP output (-osnp)."
+				) ;
 			} else {
 				assert( file_spec[0] == "flat" ) ;
 				per_sample_storage = sample_stats::FlatFileOutputter::create_shared(
@@ -2777,13 +2986,13 @@ private:
 					context.get_cohort_individual_source(),
 					get_ui_context()
 				) ;
-			sample_summary_component->setup( processor, per_sample_storage ) ;
+			sample_summary_component->setup( *processor, per_sample_storage ) ;
 		}
 		
 		std::auto_ptr< DataReadTest > data_read_test ;
 		if( options().check_if_option_was_supplied( "-read-test" )) {
 			data_read_test.reset( new DataReadTest() ) ;
-			processor.add_callback( *data_read_test ) ;
+			processor->add_callback( *data_read_test ) ;
 		}
 		
 		if( options().check_if_option_was_supplied_in_group( "Kinship options" )) {
@@ -2793,7 +3002,7 @@ private:
 				worker.get(),
 				get_ui_context()
 			) ;
-			relatedness_component->setup( processor, per_sample_storage ) ;
+			relatedness_component->setup( *processor, per_sample_storage ) ;
 		}
 
 		HaplotypeFrequencyComponent::UniquePtr haplotype_frequency_component ;
@@ -2844,7 +3053,7 @@ private:
 				get_ui_context()
 			) ;
 
-			processor.add_callback( *haplotype_frequency_component ) ;
+			processor->add_callback( *haplotype_frequency_component ) ;
 		}
 
 		if( options().check( "-og" ) || options().check( "-op" ) ) {
@@ -2855,7 +3064,7 @@ private:
 			) ;
 			component.setup(
 				context.fltrd_in_snp_data_sink(),
-				processor
+				*processor
 			) ;
 		}
 		
@@ -2867,9 +3076,9 @@ private:
 			) ;
 		}
 		// Process it (but only if there was something to do) !
-		if( processor.get_callbacks().size() > 0 ) {
-			processor.add_callback( ProgressWrapper::create( get_ui_context(), "Processing SNPs" ) ) ;
-			processor.process( context.snp_data_source() ) ;
+		if( processor->get_callbacks().size() > 0 ) {
+			processor->add_callback( ProgressWrapper::create( get_ui_context(), "Processing SNPs" ) ) ;
+			processor->process( context.snp_data_source() ) ;
 		} else {
 			get_ui_context().logger() << "SNPs do not need to be visited -- skipping.\n" ;
 		}
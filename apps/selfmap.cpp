@@ -6,19 +6,24 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <algorithm>
-#include <boost/unordered_map.hpp>
-#include <boost/bimap.hpp>
+#include <stdint.h>
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include "appcontext/CmdLineOptionProcessor.hpp"
 #include "appcontext/ApplicationContext.hpp"
 #include "appcontext/get_current_time_as_string.hpp"
 #include "genfile/MissingValue.hpp"
 #include "genfile/string_utils/string_utils.hpp"
 #include "components/SNPSummaryComponent/GenomeSequence.hpp"
-#include "components/SNPSummaryComponent/DBOutputter.hpp"
 #include "qcdb/Storage.hpp"
 #include "qcdb/FlatTableDBOutputter.hpp"
 #include "qcdb/FlatFileOutputter.hpp"
+#include "worker/Worker.hpp"
+#include "worker/SynchronousWorker.hpp"
+#include "worker/QueuedMultiThreadedWorker.hpp"
+#include "worker/FunctionTask.hpp"
 
 // #define DEBUG_SELFMAP 1
 
@@ -30,19 +35,53 @@ namespace globals {
 namespace {
 	double const NA = std::numeric_limits< double >::quiet_NaN() ;
 	namespace impl {
-		char complement_allele( char a ) {
-			switch( a ) {
-				case 'A': a = 'T'; break ;
-				case 'G': a = 'C'; break ;
-				case 'C': a = 'G'; break ;
-				case 'T': a = 'A'; break ;
+		// Return the 2-bit code (A=0, C=1, G=2, T=3) of the given base, or -1 if it is not one of these.
+		// With this coding, kmers of a fixed length sort in the same order as their sequences.
+		int encode_base( char const base ) {
+			switch( base ) {
+				case 'A': case 'a': return 0 ;
+				case 'C': case 'c': return 1 ;
+				case 'G': case 'g': return 2 ;
+				case 'T': case 't': return 3 ;
+				default: return -1 ;
 			}
-			return a ;
 		}
-	
-		void reverse_complement( std::string* sequence ) {
-			std::reverse( sequence->begin(), sequence->end() ) ;
-			std::transform( sequence->begin(), sequence->end(), sequence->begin(), &impl::complement_allele ) ;
+
+		std::string decode_kmer( uint64_t kmer, std::size_t const kmer_size ) {
+			char const bases[4] = { 'A', 'C', 'G', 'T' } ;
+			std::string result( kmer_size, 'N' ) ;
+			for( std::size_t i = kmer_size; i > 0; --i, kmer >>= 2 ) {
+				result[i-1] = bases[ kmer & 0x3 ] ;
+			}
+			return result ;
+		}
+
+		uint64_t reverse_complement( uint64_t kmer, std::size_t const kmer_size ) {
+			uint64_t result = 0 ;
+			for( std::size_t i = 0; i < kmer_size; ++i, kmer >>= 2 ) {
+				result = ( result << 2 ) | ( 3 - ( kmer & 0x3 )) ;
+			}
+			return result ;
+		}
+
+		// An occurrence of a kmer in the sequence, stored as its canonical (least of forward and
+		// reverse complement) 2-bit encoding and a location packing the range index, the start position,
+		// and whether the canonical kmer is the reverse complement of the sequence.
+		// Sorting occurrences groups them by kmer, and then by range and position.
+		struct KmerOccurrence {
+			uint64_t kmer ;
+			uint64_t location ;
+
+			static uint64_t make_location( uint64_t range_index, genfile::Position position, bool is_reverse ) {
+				return ( range_index << 33 ) | ( uint64_t( position ) << 1 ) | ( is_reverse ? 1 : 0 ) ;
+			}
+			std::size_t range_index() const { return location >> 33 ; }
+			genfile::Position position() const { return genfile::Position(( location >> 1 ) & 0xFFFFFFFF ) ; }
+			bool is_reverse() const { return location & 0x1 ; }
+		} ;
+
+		bool operator<( KmerOccurrence const& left, KmerOccurrence const& right ) {
+			return left.kmer < right.kmer || ( left.kmer == right.kmer && left.location < right.location ) ;
 		}
 	}
 }
@@ -104,6 +143,11 @@ struct SelfMapOptions: public appcontext::CmdLineOptionProcessor {
 
 		{
 			options.declare_group( "Analysis options" ) ;
+			options[ "-threads" ]
+				.set_description( "Specify the number of worker threads to use.  Each range is split into this many pieces"
+					" whose kmers are found and sorted in parallel." )
+				.set_takes_single_value()
+				.set_default_value( 0 ) ;
 		}
 	}
 } ;
@@ -125,8 +169,16 @@ public:
 		),
 		m_sequence( GenomeSequence::create( options().get< std::string >( "-sequence" ), get_ui_context().get_progress_context( "Reading sequence" ) ) ),
 		m_kmer_size( options().get< std::size_t >( "-kmer-size" ) ),
-		m_ranges( parse_ranges( options().get_values< std::string >( "-range" ) ) )
+		m_ranges( parse_ranges( options().get_values< std::string >( "-range" ) ) ),
+		m_number_of_threads( options().get< std::size_t >( "-threads" ) )
 	{
+		if( m_kmer_size < 1 || m_kmer_size > 32 ) {
+			throw genfile::BadArgumentError(
+				"SelfMapApplication::SelfMapApplication()",
+				"-kmer-size=" + genfile::string_utils::to_string( m_kmer_size ),
+				"Kmer size must be between 1 and 32."
+			) ;
+		}
 	}
 	
     std::vector< genfile::GenomePositionRange > parse_ranges( std::vector< std::string > const& spec ) {
@@ -168,72 +220,155 @@ private:
 	GenomeSequence::UniquePtr m_sequence ;
 	std::size_t m_kmer_size ;
 	std::vector< genfile::GenomePositionRange > m_ranges ;
+	std::size_t const m_number_of_threads ;
 
-	typedef std::map< std::string, std::vector< std::pair< genfile::GenomePosition, char > > > KmerMap ;
-	//typedef boost::unordered_map< std::string, std::vector< std::pair< genfile::Position, char > > > KmerMap ;
-	typedef boost::bimap< std::string, std::pair< genfile::GenomePosition, char > > KmerBimap ;
+	typedef std::vector< impl::KmerOccurrence > KmerOccurrences ;
+	typedef std::vector< std::pair< genfile::GenomePosition, char > > KmerLocations ;
 	
 private:
 
 	void unsafe_run() {
-		KmerMap kmerMap ;
-        for( std::size_t i = 0; i < m_ranges.size(); ++i ) {
-            process_range( m_ranges[i], &kmerMap ) ;
-        }
-		write_output( kmerMap, open_storage() ) ;
-    }
+		KmerOccurrences occurrences ;
+		find_kmers( &occurrences ) ;
+		write_output( occurrences, open_storage() ) ;
+	}
 
-    void process_range(
-        genfile::GenomePositionRange const& genomeRange,
-        KmerMap* result
-    ) {
-        using genfile::string_utils::to_string ;
-        
-        genfile::GenomePosition const& start = genomeRange.start() ;
-        genfile::GenomePosition const& end = genomeRange.end() ;
-		if( end.position() <= start.position() + m_kmer_size ) {
-			get_ui_context().logger() << "!! No kmers of length " << m_kmer_size << " in the range (of length " << ( end.position() - start.position() + 1 ) << ")\n" ;
-			throw appcontext::HaltProgramWithReturnCode( -1 ) ;
+	// Find all kmers in the ranges, sorted by canonical kmer.
+	// Each range is split into pieces whose kmers are found and sorted by worker threads;
+	// the sorted pieces are then merged.
+	void find_kmers( KmerOccurrences* result ) const {
+		using genfile::string_utils::to_string ;
+		worker::Worker::UniquePtr worker ;
+		if( m_number_of_threads > 0 ) {
+			worker.reset( new worker::QueuedMultiThreadedWorker( m_number_of_threads )) ;
+		} else {
+			worker.reset( new worker::SynchronousWorker() ) ;
 		}
-		std::string kmer ;
+		std::size_t const number_of_pieces_per_range = std::max( m_number_of_threads, std::size_t( 1 )) ;
 
-		GenomeSequence::PhysicalSequenceRange range = m_sequence->get_sequence( start.chromosome(), start.position(), end.position() ) ;
-		genfile::Position rangePosition = range.first.start().position() ;
-		GenomeSequence::ConstSequenceIterator kmer_start = range.second.first ;
-		GenomeSequence::ConstSequenceIterator kmer_end = kmer_start + m_kmer_size ;
+		boost::ptr_vector< KmerOccurrences > pieces ;
+		boost::ptr_vector< worker::Task > tasks ;
+		for( std::size_t i = 0; i < m_ranges.size(); ++i ) {
+			genfile::GenomePosition const& start = m_ranges[i].start() ;
+			genfile::GenomePosition const& end = m_ranges[i].end() ;
+			if( end.position() < start.position() + m_kmer_size ) {
+				get_ui_context().logger() << "!! No kmers of length " << m_kmer_size << " in the range (of length " << ( end.position() - start.position() ) << ")\n" ;
+				throw appcontext::HaltProgramWithReturnCode( -1 ) ;
+			}
+			GenomeSequence::PhysicalSequenceRange range = m_sequence->get_sequence( start.chromosome(), start.position(), end.position() ) ;
+			genfile::Position const range_start = range.first.start().position() ;
+			std::size_t const number_of_kmers = ( range.second.second - range.second.first ) - m_kmer_size + 1 ;
+			std::size_t const piece_size = ( number_of_kmers + number_of_pieces_per_range - 1 ) / number_of_pieces_per_range ;
+			for( std::size_t piece_start = 0; piece_start < number_of_kmers; piece_start += piece_size ) {
+				// Pieces overlap by kmer_size-1 bases so that every kmer is found exactly once.
+				std::size_t const piece_end = std::min( piece_start + piece_size, number_of_kmers ) + m_kmer_size - 1 ;
+				pieces.push_back( new KmerOccurrences() ) ;
+				tasks.push_back(
+					new worker::FunctionTask(
+						boost::bind(
+							&SelfMapApplication::find_and_sort_kmers,
+							this,
+							range.second.first + piece_start,
+							range.second.first + piece_end,
+							i,
+							range_start + piece_start,
+							&pieces.back()
+						)
+					)
+				) ;
+				worker->tell_to_perform_task( tasks.back() ) ;
+			}
+		}
 
 		{
-			appcontext::UIContext::ProgressContext progress_context = get_ui_context().get_progress_context( "Processing kmers (" + to_string( genomeRange ) + ")" ) ;
-
-			for( ; kmer_end != range.second.second; ++kmer_start, ++kmer_end, ++rangePosition ) {
-				progress_context.notify_progress( rangePosition, range.first.end().position() - m_kmer_size ) ;
-	#if DEBUG_SELFMAP
-				std::cerr << "SelfMapApplication:run(): looking at kmer: " << kmer << "...\n" ;
-	#endif
-				kmer.assign( kmer_start, kmer_end ) ;
-				genfile::string_utils::to_upper( &kmer ) ;
-				if( kmer.find( 'N' ) == std::string::npos ) {
-					(*result)[ kmer ].push_back(
-                        std::make_pair(
-                            genfile::GenomePosition( start.chromosome(), rangePosition ),
-                            '+'
-                        )
-                    ) ;
-					impl::reverse_complement( &kmer ) ;
-					(*result)[ kmer ].push_back(
-                        std::make_pair(
-                            genfile::GenomePosition( start.chromosome(), rangePosition + m_kmer_size ),
-                            '-'
-                        )
-                    ) ;
-				}
+			appcontext::UIContext::ProgressContext progress_context = get_ui_context().get_progress_context( "Finding kmers" ) ;
+			for( std::size_t i = 0; i < tasks.size(); ++i ) {
+				tasks[i].wait_until_complete() ;
+				progress_context( i+1, tasks.size() ) ;
 			}
-			progress_context.notify_progress( rangePosition, range.first.end().position() - m_kmer_size ) ;
 		}
-			
-#if DEBUG_SELFMAP
-			std::cerr << "SelfMapApplication:run(): kmerMap.size() = " << result->size() << ".\n" ;
-#endif
+		tasks.clear() ;
+
+		std::size_t total_size = 0 ;
+		for( std::size_t i = 0; i < pieces.size(); ++i ) {
+			total_size += pieces[i].size() ;
+		}
+		result->clear() ;
+		result->reserve( total_size ) ;
+		std::vector< std::size_t > boundaries( 1, 0 ) ;
+		for( std::size_t i = 0; i < pieces.size(); ++i ) {
+			result->insert( result->end(), pieces[i].begin(), pieces[i].end() ) ;
+			boundaries.push_back( result->size() ) ;
+			KmerOccurrences().swap( pieces[i] ) ;
+		}
+		merge_sorted_runs( *worker, result, boundaries ) ;
+	}
+
+	void find_and_sort_kmers(
+		GenomeSequence::ConstSequenceIterator sequence_i,
+		GenomeSequence::ConstSequenceIterator const sequence_end,
+		std::size_t const range_index,
+		genfile::Position position,
+		KmerOccurrences* result
+	) const {
+		// Maintain the 2-bit encodings of the current kmer and its reverse complement as we go,
+		// restarting after any base that is not one of ACGT.
+		uint64_t const mask = ( m_kmer_size == 32 ) ? ~uint64_t( 0 ) : (( uint64_t( 1 ) << ( 2 * m_kmer_size )) - 1 ) ;
+		std::size_t const shift = 2 * ( m_kmer_size - 1 ) ;
+		uint64_t forward = 0 ;
+		uint64_t reverse = 0 ;
+		std::size_t number_of_valid_bases = 0 ;
+		impl::KmerOccurrence occurrence ;
+		for( ; sequence_i != sequence_end; ++sequence_i, ++position ) {
+			int const base = impl::encode_base( *sequence_i ) ;
+			if( base < 0 ) {
+				number_of_valid_bases = 0 ;
+				continue ;
+			}
+			forward = (( forward << 2 ) | uint64_t( base )) & mask ;
+			reverse = ( reverse >> 2 ) | ( uint64_t( 3 - base ) << shift ) ;
+			if( ++number_of_valid_bases >= m_kmer_size ) {
+				bool const is_reverse = reverse < forward ;
+				occurrence.kmer = is_reverse ? reverse : forward ;
+				occurrence.location = impl::KmerOccurrence::make_location( range_index, position + 1 - m_kmer_size, is_reverse ) ;
+				result->push_back( occurrence ) ;
+			}
+		}
+		std::sort( result->begin(), result->end() ) ;
+	}
+
+	// Merge the sorted runs [boundaries[i], boundaries[i+1]) of the given vector into one sorted run,
+	// merging pairs of runs in parallel.
+	void merge_sorted_runs( worker::Worker& worker, KmerOccurrences* occurrences, std::vector< std::size_t > boundaries ) const {
+		typedef void (*MergeFunction)( KmerOccurrences::iterator, KmerOccurrences::iterator, KmerOccurrences::iterator ) ;
+		MergeFunction const merge = &std::inplace_merge< KmerOccurrences::iterator > ;
+		while( boundaries.size() > 2 ) {
+			boost::ptr_vector< worker::Task > tasks ;
+			std::vector< std::size_t > merged_boundaries( 1, 0 ) ;
+			std::size_t i = 0 ;
+			for( ; i + 2 < boundaries.size(); i += 2 ) {
+				tasks.push_back(
+					new worker::FunctionTask(
+						boost::bind(
+							merge,
+							occurrences->begin() + boundaries[i],
+							occurrences->begin() + boundaries[i+1],
+							occurrences->begin() + boundaries[i+2]
+						)
+					)
+				) ;
+				worker.tell_to_perform_task( tasks.back() ) ;
+				merged_boundaries.push_back( boundaries[i+2] ) ;
+			}
+			if( i + 2 == boundaries.size() ) {
+				// An odd run out; carry it to the next round.
+				merged_boundaries.push_back( boundaries[i+1] ) ;
+			}
+			for( std::size_t j = 0; j < tasks.size(); ++j ) {
+				tasks[j].wait_until_complete() ;
+			}
+			boundaries.swap( merged_boundaries ) ;
+		}
 	}
 
 	qcdb::Storage::SharedPtr open_storage() const {
@@ -241,7 +376,7 @@ private:
 		std::string const& filename = options().get< std::string >( "-o" ) ;
 
 		if( filename.size() > 7 && filename.substr( filename.size() - 7, 7 ) == ".sqlite" ) {
-			snp_summary_component::DBOutputter::SharedPtr outputter = snp_summary_component::DBOutputter::create_shared(
+			qcdb::FlatTableDBOutputter::SharedPtr outputter = qcdb::FlatTableDBOutputter::create_shared(
 				options().get< std::string >( "-o" ),
 				options().get< std::string >( "-analysis-name" ),
 				options().get< std::string >( "-analysis-chunk" ),
@@ -261,7 +396,7 @@ private:
 		return storage ;
 	}
 
-	void write_output( KmerMap const& kmerMap, qcdb::Storage::SharedPtr storage ) {
+	void write_output( KmerOccurrences const& occurrences, qcdb::Storage::SharedPtr storage ) {
 		appcontext::UIContext::ProgressContext progress_context = get_ui_context().get_progress_context( "Storing results" ) ;
 
 		storage->add_variable( "orientation" ) ;
@@ -270,54 +405,97 @@ private:
 		storage->add_variable( "other_orientation" ) ;
 
 		bool const include_diagonal = options().check( "-include-diagonal" ) ;
-		using genfile::string_utils::to_string ;
-		//genfile::GenomePosition position ( m_range.start().chromosome(), 0 ) ;
-		KmerMap::const_iterator i = kmerMap.begin() ;
-		KmerMap::const_iterator end_i = kmerMap.end() ;
-		std::size_t count = 0 ;
-		for( ; i != end_i; ++i, ++count ) {
-			genfile::GenomePosition const& position = i->second[0].first ;
-			genfile::VariantIdentifyingData snp(
-				to_string( position ),
-				".",
-				position,
-				i->first, "."
-			) ;
-			for( std::size_t j = 0; j < i->second.size(); ++j ) {
-				if( i->second[j].second == '+' ) {
-					snp.set_position( i->second[j].first ) ;
-					for( std::size_t k = ( j + ( include_diagonal ? 0 : 1 ) ); k < i->second.size(); ++k ) {
-						storage->create_new_variant( snp ) ;
-						storage->store_per_variant_data(
-							snp,
-							"orientation",
-							std::string( 1, i->second[j].second )
-						) ;
-						storage->store_per_variant_data(
-							snp,
-							"other_chromosome",
-							i->second[k].first.chromosome()
-						) ;
-
-						storage->store_per_variant_data(
-							snp,
-							"other_position",
-							genfile::VariantEntry::Integer( i->second[k].first.position() )
-						) ;
-
-						storage->store_per_variant_data(
-							snp,
-							"other_orientation",
-							std::string( 1, i->second[k].second )
-						) ;
-					}
+		KmerLocations locations ;
+		KmerOccurrences::const_iterator i = occurrences.begin() ;
+		KmerOccurrences::const_iterator const end_i = occurrences.end() ;
+		while( i != end_i ) {
+			KmerOccurrences::const_iterator group_end = i ;
+			for( ; group_end != end_i && group_end->kmer == i->kmer; ++group_end ) {}
+			uint64_t const kmer = i->kmer ;
+			uint64_t const reverse_kmer = impl::reverse_complement( kmer, m_kmer_size ) ;
+			// A single occurrence of a non-palindromic kmer maps only to itself.
+			if( include_diagonal || ( group_end - i ) > 1 || kmer == reverse_kmer ) {
+				get_locations( i, group_end, true, &locations ) ;
+				write_output( impl::decode_kmer( kmer, m_kmer_size ), locations, include_diagonal, *storage ) ;
+				if( reverse_kmer != kmer ) {
+					get_locations( i, group_end, false, &locations ) ;
+					write_output( impl::decode_kmer( reverse_kmer, m_kmer_size ), locations, include_diagonal, *storage ) ;
 				}
 			}
-			progress_context.notify_progress( count+1, kmerMap.size() ) ;
+			i = group_end ;
+			progress_context( i - occurrences.begin(), occurrences.size() ) ;
 		}
 
 		storage->finalise() ;
 	}
+
+	// Get the locations at which the canonical kmer of the given group of occurrences (or, if canonical is false,
+	// its reverse complement) occurs, in order.  Locations are '+' at the position of the kmer's first base if it
+	// occurs on the forward strand, or '-' at the position after its last base if its reverse complement does.
+	void get_locations(
+		KmerOccurrences::const_iterator i,
+		KmerOccurrences::const_iterator const end_i,
+		bool const canonical,
+		KmerLocations* result
+	) const {
+		result->clear() ;
+		bool const is_palindrome = ( i != end_i ) && ( impl::reverse_complement( i->kmer, m_kmer_size ) == i->kmer ) ;
+		for( ; i != end_i; ++i ) {
+			genfile::GenomePosition const position( m_ranges[ i->range_index() ].start().chromosome(), i->position() ) ;
+			if( is_palindrome || canonical != i->is_reverse() ) {
+				result->push_back( std::make_pair( position, '+' )) ;
+			}
+			if( is_palindrome || canonical == i->is_reverse() ) {
+				result->push_back( std::make_pair( genfile::GenomePosition( position.chromosome(), position.position() + m_kmer_size ), '-' )) ;
+			}
+		}
+	}
+
+	void write_output(
+		std::string const& kmer,
+		KmerLocations const& locations,
+		bool const include_diagonal,
+		qcdb::Storage& storage
+	) const {
+		using genfile::string_utils::to_string ;
+		genfile::GenomePosition const& position = locations[0].first ;
+		genfile::VariantIdentifyingData snp(
+			to_string( position ),
+			".",
+			position,
+			kmer, "."
+		) ;
+		for( std::size_t j = 0; j < locations.size(); ++j ) {
+			if( locations[j].second == '+' ) {
+				snp.set_position( locations[j].first ) ;
+				for( std::size_t k = ( j + ( include_diagonal ? 0 : 1 ) ); k < locations.size(); ++k ) {
+					storage.create_new_variant( snp ) ;
+					storage.store_per_variant_data(
+						snp,
+						"orientation",
+						std::string( 1, locations[j].second )
+					) ;
+					storage.store_per_variant_data(
+						snp,
+						"other_chromosome",
+						locations[k].first.chromosome()
+					) ;
+
+					storage.store_per_variant_data(
+						snp,
+						"other_position",
+						genfile::VariantEntry::Integer( locations[k].first.position() )
+					) ;
+
+					storage.store_per_variant_data(
+						snp,
+						"other_orientation",
+						std::string( 1, locations[k].second )
+					) ;
+				}
+			}
+		}
+	}
 } ;
 
 int main( int argc, char** argv ) {
@@ -1,146 +1,193 @@
-
 //          Copyright Gavin Band 2008 - 2012.
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
-#include <boost/variant.hpp>
+/*
+* Benchmark the speed of reading GEN files.
+*
+* Usage: benchmark-variant-io [<GEN file>...]
+*
+* With no arguments, a GEN file with 1000 samples and 2000 variants is written to a
+* temporary location, both uncompressed and gzipped, and each is read.
+* For each file the time to read all variants and genotype probabilities is reported,
+* as the best of several repeats, along with a checksum of the data read.
+* The probabilities are also parsed with stream extraction, strtod() and
+* genfile::string_utils::strtod() to compare number parsing on its own.
+*/
+
 #include <iostream>
+#include <iomanip>
 #include <vector>
-#include <fstream>
+#include <string>
 #include <sstream>
+#include <fstream>
 #include <cstdlib>
-#include <boost/progress.hpp>
-
-struct MissingValue {} ;
+#include <cstdio>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include "appcontext/Timer.hpp"
+#include "genfile/FileUtils.hpp"
+#include "genfile/snp_data_utils.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/VariantDataReader.hpp"
+#include "genfile/string_utils/slice.hpp"
+#include "genfile/string_utils/strtod.hpp"
 
-int main() {
-	
-	std::size_t const N = 100 ;
+namespace {
+	std::size_t const number_of_repeats = 5 ;
 
-	std::string number_string ;
+	// Sum the values set, weighted by genotype, so that all the data is used and results can be compared between runs.
+	struct SummingSetter: public genfile::VariantDataReader::PerSampleSetter {
+		SummingSetter( double& sum ): m_sum( sum ) {}
+		void initialise( std::size_t, std::size_t ) {}
+		bool set_sample( std::size_t ) { return true ; }
+		void set_number_of_entries( uint32_t, std::size_t, OrderType const, ValueType const ) {}
+		void set_value( std::size_t, MissingValue const ) {}
+		void set_value( std::size_t g, double const value ) { m_sum += ( g + 1 ) * value ; }
+		void finalise() {}
+	private:
+		double& m_sum ;
+	} ;
 
-	{
-		std::stringstream str ;
-		std::ifstream f( "/tmp/test/numbers.txt" ) ;
-
-		if( !f.is_open() ) {
-			std::cerr << "Please create \"/tmp/test/numbers.txt\".\n" ;
-			return -1 ;
-		}
-		std::size_t count = 0 ;
-		std::string entry ;
-		while( f >> entry ) {
-			str << entry << " " ;
-			++count ;
+	// Write a GEN file with probabilities formatted like those in IMPUTE2 output.
+	void write_gen_file( std::string const& filename, std::size_t number_of_variants, std::size_t number_of_samples ) {
+		std::auto_ptr< std::ostream > out = genfile::open_text_file_for_output( filename ) ;
+		std::srand( 1 ) ;
+		char buffer[32] ;
+		for( std::size_t v = 0; v < number_of_variants; ++v ) {
+			*out << "SNP" << v << " rs" << v << " " << ( 1000 + 10 * v ) << " A G" ;
+			for( std::size_t i = 0; i < number_of_samples; ++i ) {
+				int const a = std::rand() % 1001 ;
+				int const b = std::rand() % ( 1001 - a ) ;
+				double const probs[3] = { a / 1000.0, b / 1000.0, ( 1000 - a - b ) / 1000.0 } ;
+				for( std::size_t g = 0; g < 3; ++g ) {
+					std::snprintf( buffer, 32, "%g", probs[g] ) ;
+					*out << " " << buffer ;
+				}
+			}
+			*out << "\n" ;
 		}
-		std::cerr << "Read " << count << " numbers from \"/tmp/test/numbers.txt\".\n" ;
-		number_string = str.str() ;
 	}
-	
-	std::cerr << "Numbers begin with: \"" << number_string.substr(0, 50) << "...\".\n" ;
 
-	// Read everything once first to deal with any cache issues.
-	{
-		std::vector< double > numbers ;
-		numbers.reserve( 100000 ) ;
-		std::istringstream istr( number_string ) ;
-		numbers.clear() ;
-		double d ;
-		while( istr >> d ) {
-			numbers.push_back( d ) ;
+	void benchmark_source( std::string const& filename ) {
+		double best_time = 0.0 ;
+		double sum = 0.0 ;
+		std::size_t count = 0 ;
+		for( std::size_t repeat = 0; repeat < number_of_repeats; ++repeat ) {
+			appcontext::Timer timer ;
+			genfile::SNPDataSource::UniquePtr source = genfile::SNPDataSource::create( filename ) ;
+			genfile::VariantIdentifyingData variant ;
+			sum = 0.0 ;
+			count = 0 ;
+			while( source->get_snp_identifying_data( &variant )) {
+				genfile::VariantDataReader::UniquePtr reader = source->read_variant_data() ;
+				SummingSetter setter( sum ) ;
+				reader->get( ":genotypes:", setter ) ;
+				++count ;
+			}
+			double const time = timer.elapsed() ;
+			best_time = ( repeat == 0 ) ? time : std::min( best_time, time ) ;
 		}
+		std::cerr << std::fixed << std::setprecision( 3 )
+			<< "  " << std::setw( 40 ) << std::left << boost::filesystem::path( filename ).filename().string() << std::right
+			<< ": " << count << " variants in " << best_time << "s ("
+			<< std::setprecision( 0 ) << ( count / best_time ) << " variants/s), checksum "
+			<< std::setprecision( 3 ) << sum << ".\n" ;
 	}
-	
-	std::cerr << "Beginning tests...\n" ;
-	
-	{
-		std::vector< double > numbers ;
-		numbers.reserve( 100000 ) ;
+
+	// Compare parsing the probabilities of the given file by several methods.
+	void benchmark_number_parsing( std::string const& filename ) {
+		std::vector< char > data ;
 		{
-			double total_time = 0.0 ;
-			for( std::size_t i = 0; i < N; ++i ) {
-				numbers.clear() ;
-				std::vector< char > v( number_string.begin(), number_string.end() ) ;
-				// there's a trailing space in the number string.  Overwrite with a null terminator.
-				v.back() = char(0) ;
-				boost::timer timer ;
-				char* startptr = &v[0] ;
-				char* endptr = startptr ;
-				for( ; endptr != &(v.back()) ; startptr = endptr ) {
-					numbers.push_back( strtod( startptr, &endptr ) ) ;
+			std::auto_ptr< std::istream > in = genfile::open_text_file_for_input( filename ) ;
+			std::string line ;
+			while( std::getline( *in, line )) {
+				// Skip the identifying fields.
+				std::size_t pos = 0 ;
+				for( std::size_t i = 0; i < 5 && pos != std::string::npos; ++i ) {
+					pos = line.find( ' ', pos + 1 ) ;
+				}
+				if( pos != std::string::npos ) {
+					data.insert( data.end(), line.begin() + pos + 1, line.end() ) ;
+					data.push_back( ' ' ) ;
 				}
-				total_time += timer.elapsed() ;
 			}
-			std::cerr << "  strtod reads: " << N << "x" << numbers.size() << " numbers took " << total_time << "s in total, average " << total_time / ( double(N) ) << " numbers per second.\n" ;
 		}
-	}
-
-	typedef boost::variant< double, int, std::string, MissingValue > Entry ;
+		if( data.empty() ) {
+			return ;
+		}
+		data.back() = '\0' ;
+		std::string const number_string( data.begin(), data.end() - 1 ) ;
 
-	{
-		std::vector< Entry > numbers ;
-		numbers.reserve( 100000 ) ;
-		{
-			boost::timer timer ;
-			double total_time = 0.0 ;
-			for( std::size_t i = 0; i < N; ++i ) {
+		double times[3] = { 0, 0, 0 } ;
+		double sums[3] = { 0, 0, 0 } ;
+		for( std::size_t repeat = 0; repeat < number_of_repeats; ++repeat ) {
+			{
 				std::istringstream istr( number_string ) ;
-				numbers.clear() ;
+				appcontext::Timer timer ;
 				double d ;
-				boost::timer timer ;
+				sums[0] = 0 ;
 				while( istr >> d ) {
-					numbers.push_back( d ) ;
+					sums[0] += d ;
 				}
-				total_time += timer.elapsed() ;
+				times[0] = ( repeat == 0 ) ? timer.elapsed() : std::min( times[0], timer.elapsed() ) ;
 			}
-			std::cerr << " Variant reads: " << N << "x" << numbers.size() << " numbers took " << total_time << "s in total, average " << total_time / double(N) << " reads per second.\n" ;
-		}
-		
-		{
-			double total_time = 0.0 ;
-			for( std::size_t i = 0; i < N; ++i ) {
-				std::ostringstream ostr ;
-				boost::timer timer ;
-				for( std::size_t i = 0; i < numbers.size(); ++i ) {
-					ostr << boost::get< double >( numbers[i] ) << " " ;
+			{
+				appcontext::Timer timer ;
+				char* p = &data[0] ;
+				char* const end = &data.back() ;
+				sums[1] = 0 ;
+				while( p < end ) {
+					sums[1] += std::strtod( p, &p ) ;
 				}
-				total_time += timer.elapsed() ;
+				times[1] = ( repeat == 0 ) ? timer.elapsed() : std::min( times[1], timer.elapsed() ) ;
 			}
-			std::cerr << "Variant writes: took " << total_time << "s, average writing time was " << total_time / N << ".\n" ;
-		}
-		
-	}
-
-	{
-		std::vector< double > numbers ;
-		numbers.reserve( 100000 ) ;
-		{
-			double total_time = 0.0 ;
-			for( std::size_t i = 0; i < N; ++i ) {
-				std::istringstream istr( number_string ) ;
-				numbers.clear() ;
-				double d ;
-				boost::timer timer ;
-				while( istr >> d ) {
-					numbers.push_back( d ) ;
+			{
+				appcontext::Timer timer ;
+				char const* p = &data[0] ;
+				char const* const end = &data.back() ;
+				sums[2] = 0 ;
+				while( p < end ) {
+					char const* q = std::find( p, end, ' ' ) ;
+					sums[2] += genfile::string_utils::strtod( genfile::string_utils::slice( p, q )) ;
+					p = q + 1 ;
 				}
-				total_time += timer.elapsed() ;
+				times[2] = ( repeat == 0 ) ? timer.elapsed() : std::min( times[2], timer.elapsed() ) ;
 			}
-			std::cerr << "   Plain reads: " << N << "x" << numbers.size() << " numbers took " << total_time << "s in total, average " << total_time / ( double(N) ) << " numbers per second.\n" ;
 		}
-		
-		double total_time = 0.0 ;
-		for( std::size_t i = 0; i < N; ++i ) {
-			std::ostringstream ostr ;
-			boost::timer timer ;
-			for( std::size_t i = 0; i < numbers.size(); ++i ) {
-				ostr << numbers[i] << " " ;
-			}
-			total_time += timer.elapsed() ;
+		char const* names[3] = { "stream extraction", "strtod()", "string_utils::strtod()" } ;
+		for( std::size_t i = 0; i < 3; ++i ) {
+			std::cerr << std::fixed << std::setprecision( 3 )
+				<< "  " << std::setw( 40 ) << std::left << names[i] << std::right
+				<< ": " << times[i] << "s, checksum " << sums[i] << ".\n" ;
+		}
+	}
+}
+
+int main( int argc, char** argv ) {
+	std::vector< std::string > filenames( argv + 1, argv + argc ) ;
+	std::string directory ;
+	if( filenames.empty() ) {
+		directory = genfile::create_temporary_filename() ;
+		boost::filesystem::create_directory( directory ) ;
+		filenames.push_back( directory + "/benchmark.gen" ) ;
+		filenames.push_back( directory + "/benchmark.gen.gz" ) ;
+		std::cerr << "Writing test data to \"" << directory << "\"...\n" ;
+		for( std::size_t i = 0; i < filenames.size(); ++i ) {
+			write_gen_file( filenames[i], 2000, 1000 ) ;
 		}
-		std::cerr << "  Plain writes: took " << total_time << "s, average writing time was " << total_time / N << ".\n" ;
 	}
 
+	std::cerr << "Reading variants:\n" ;
+	for( std::size_t i = 0; i < filenames.size(); ++i ) {
+		benchmark_source( filenames[i] ) ;
+	}
+	std::cerr << "Parsing probabilities from \"" << filenames[0] << "\":\n" ;
+	benchmark_number_parsing( filenames[0] ) ;
+
+	if( !directory.empty() ) {
+		boost::filesystem::remove_all( directory ) ;
+	}
 	return 0 ;
 }
@@ -8,6 +8,8 @@
 #define QCTOOL_HAPLOTYPE_FREQUENCY_COMPONENT_HPP
 
 #include <string>
+#include <vector>
+#include <deque>
 #include <boost/function.hpp>
 #include <boost/optional.hpp>
 #include <boost/signals2/signal.hpp>
@@ -37,6 +39,7 @@ public:
 	) ;
 
 	void set_max_distance( uint64_t distance ) ;
+	void set_batch_size( std::size_t batch_size ) ;
 	void set_min_r2( double min_r2 ) ;
 	void set_stratification( genfile::SampleStratification stratification ) ;
 	void set_prior( Eigen::Matrix2d const& matrix ) ;
@@ -67,13 +70,24 @@ public:
 		bool const doEM
 	) ;
 
+	// As above, but with the dosage correlation already computed
+	// (one value per stratum, or a single value if there is no stratification).
+	void compute_ld_measures(
+		genfile::VariantIdentifyingData const& source_snp,
+		std::vector< int > const& source_calls,
+		std::vector< uint32_t > const& source_ploidy,
+		genfile::VariantIdentifyingData const& target_snp,
+		std::vector< int > const& target_calls,
+		std::vector< uint32_t > const& target_ploidy,
+		std::vector< double > const& dosage_r,
+		bool const doEM
+	) ;
+
 	bool compute_dosage_ld_measures(
 		genfile::VariantIdentifyingData const& source_snp,
 		genfile::VariantIdentifyingData const& target_snp,
-		Eigen::MatrixXd const& dosages,
-		Eigen::MatrixXd const& nonmissingness,
+		double const dosage_r,
 		std::string const& variable_name_stub,
-		std::vector< genfile::SampleRange > const& sample_set,
 		bool const alwaysOutput
 	) ;
 
@@ -93,6 +107,19 @@ public:
 	
 	void send_results_to( haplotype_frequency_component::FlatTableDBOutputter::UniquePtr ) ;
 	
+private:
+	// A decoded variant.  For variants from the LD source, these are kept while they lie within
+	// -max-ld-distance of the current targets and their dosages are stored in column 'column'
+	// of the window matrices below, which are used as a ring buffer.  For target variants
+	// the dosages are stored in column 'column' of the batch matrices.
+	struct WindowVariant {
+		genfile::VariantIdentifyingData snp ;
+		bool have_calls ;
+		std::vector< int > calls ;
+		std::vector< uint32_t > ploidy ;
+		int column ;
+	} ;
+
 private:
 	genfile::SNPDataSource::UniquePtr m_source ;
 	appcontext::UIContext& m_ui_context ;
@@ -102,6 +129,43 @@ private:
 	double m_min_r2 ;
 	haplotype_frequency_component::FlatTableDBOutputter::UniquePtr m_sink ;
 	Eigen::Matrix2d m_prior ;
+
+	// Sliding window state, used when m_max_distance > 0 and the LD source is sorted.
+	bool m_use_window ;
+	std::deque< WindowVariant > m_window ;
+	Eigen::MatrixXd m_window_dosages ;
+	Eigen::MatrixXd m_window_squared_dosages ;
+	Eigen::MatrixXd m_window_nonmissingness ;
+	int m_window_begin ;
+	bool m_have_pending_snp ;
+	genfile::VariantIdentifyingData m_pending_snp ;
+	boost::optional< genfile::GenomePosition > m_last_target_position ;
+
+	// Target variants waiting to have LD computed with the window, as a batch.
+	std::size_t m_batch_size ;
+	std::vector< WindowVariant > m_batch ;
+	Eigen::MatrixXd m_batch_dosages ;
+	Eigen::MatrixXd m_batch_squared_dosages ;
+	Eigen::MatrixXd m_batch_nonmissingness ;
+
+private:
+	bool source_is_sorted() ;
+	void reset_window() ;
+	void advance_window( genfile::GenomePosition const& first_target_position, genfile::GenomePosition const& last_target_position ) ;
+	void add_to_window( genfile::VariantIdentifyingData const& snp, genfile::VariantDataReader& data_reader ) ;
+	void add_to_batch( genfile::VariantIdentifyingData const& target_snp, genfile::VariantDataReader& target_data_reader ) ;
+	void compute_batch_ld_measures() ;
+	void compute_batch_dosage_r(
+		std::vector< genfile::SampleRange > const& sample_set,
+		Eigen::MatrixXd* result
+	) const ;
+	void decode_variant(
+		genfile::VariantDataReader& data_reader,
+		WindowVariant* variant,
+		Eigen::MatrixXd* dosages,
+		Eigen::MatrixXd* squared_dosages,
+		Eigen::MatrixXd* nonmissingness
+	) const ;
 } ;
 
 #endif
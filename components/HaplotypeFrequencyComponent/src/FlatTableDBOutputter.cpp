@@ -129,10 +129,16 @@ namespace haplotype_frequency_component {
 			create_schema() ;
 			// create_variables() ;
 		}
+		std::vector< genfile::VariantIdentifyingData > variants ;
+		variants.reserve( 2 * m_variants.size() ) ;
 		for( std::size_t i = 0; i < m_variants.size(); ++i ) {
-			db::Connection::RowId const variant1_id = m_outputter.get_or_create_variant( m_variants[i].first ) ;
-			db::Connection::RowId const variant2_id = m_outputter.get_or_create_variant( m_variants[i].second ) ;
-			store_data_for_variants( i, m_outputter.analysis_id(), variant1_id, variant2_id ) ;
+			variants.push_back( m_variants[i].first ) ;
+			variants.push_back( m_variants[i].second ) ;
+		}
+		std::vector< db::Connection::RowId > variant_ids ;
+		m_outputter.get_or_create_variants( variants.begin(), variants.end(), &variant_ids ) ;
+		for( std::size_t i = 0; i < m_variants.size(); ++i ) {
+			store_data_for_variants( i, m_outputter.analysis_id(), variant_ids[ 2*i ], variant_ids[ 2*i + 1 ] ) ;
 		}
 	}
 
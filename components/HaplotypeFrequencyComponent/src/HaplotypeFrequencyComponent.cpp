@@ -5,6 +5,10 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <limits>
 #include <boost/function.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/thread.hpp>
@@ -42,6 +46,13 @@ void HaplotypeFrequencyComponent::declare_options( appcontext::OptionProcessor&
 			"distance in megabases or kilobases if desired." )
 		.set_takes_single_value()
 		.set_default_value( "0" ) ;
+	options[ "-ld-batch-size" ]
+		.set_description( "Number of variants from the main dataset whose LD is computed together. "
+			"When -max-ld-distance is nonzero and the LD SNPs are sorted by position, correlations between each batch "
+			"and all nearby LD SNPs are computed using a single set of matrix products. "
+			"Larger batches are faster but hold more variants in memory." )
+		.set_takes_single_value()
+		.set_default_value( 64 ) ;
 	options[ "-min-r2" ]
 		.set_description( "Minimum squared correlation between variants.  LD results for pairs of variants with "
 			"lower than this squared correlation will not be output." )
@@ -57,6 +68,7 @@ void HaplotypeFrequencyComponent::declare_options( appcontext::OptionProcessor&
 	options.option_implies_option( "-prior-ld-weight", "-compute-ld-with" ) ;
 	options.option_implies_option( "-max-ld-distance", "-compute-ld-with" ) ;
 	options.option_implies_option( "-min-r2", "-compute-ld-with" ) ;
+	options.option_implies_option( "-ld-batch-size", "-compute-ld-with" ) ;
 }
 
 namespace {
@@ -149,6 +161,17 @@ HaplotypeFrequencyComponent::UniquePtr HaplotypeFrequencyComponent::create(
 	
 	result->set_max_distance( parse_physical_distance( options.get< std::string >( "-max-ld-distance" ))) ;
 	result->set_min_r2( options.get< double >( "-min-r2" )) ;
+	{
+		int const batch_size = options.get< int >( "-ld-batch-size" ) ;
+		if( batch_size < 1 ) {
+			throw genfile::BadArgumentError(
+				"HaplotypeFrequencyComponent::create()",
+				"-ld-batch-size " + options.get_value< std::string >( "-ld-batch-size" ),
+				"Batch size must be at least 1."
+			) ;
+		}
+		result->set_batch_size( batch_size ) ;
+	}
 	{
 		double const w = options.get< double >( "-prior-ld-weight" ) ;
 		Eigen::MatrixXd prior(2,2) ;
@@ -202,7 +225,11 @@ HaplotypeFrequencyComponent::HaplotypeFrequencyComponent(
 	m_threshhold( 0.9 ),
 	m_max_distance( 200000 ),
 	m_min_r2( 0.0 ),
-	m_prior( Eigen::Matrix2d::Zero() )
+	m_prior( Eigen::Matrix2d::Zero() ),
+	m_use_window( false ),
+	m_window_begin( 0 ),
+	m_have_pending_snp( false ),
+	m_batch_size( 64 )
 {
 }
 
@@ -210,6 +237,11 @@ void HaplotypeFrequencyComponent::set_max_distance( uint64_t distance ) {
 	m_max_distance = distance ;
 }
 
+void HaplotypeFrequencyComponent::set_batch_size( std::size_t batch_size ) {
+	assert( batch_size > 0 ) ;
+	m_batch_size = batch_size ;
+}
+
 void HaplotypeFrequencyComponent::set_min_r2( double min_r2 ) {
 	assert( min_r2 >= 0.0 ) ;
 	m_min_r2 = min_r2 ;
@@ -226,6 +258,15 @@ void HaplotypeFrequencyComponent::set_stratification( genfile::SampleStratificat
 
 void HaplotypeFrequencyComponent::begin_processing_snps( std::size_t number_of_samples, genfile::SNPDataSource::Metadata const& ) {
 	assert( m_source->number_of_samples() == number_of_samples ) ;
+	// If the LD source is sorted, we can stream through it once keeping only the variants
+	// within m_max_distance of the current batch of targets.  Otherwise we rescan it for each target.
+	m_use_window = ( m_max_distance > 0 ) && source_is_sorted() ;
+	if( m_max_distance > 0 && !m_use_window ) {
+		m_ui_context.logger() << "HaplotypeFrequencyComponent: LD source variants are not sorted by position, "
+			<< "so it will be rescanned for each variant.\n" ;
+	}
+	reset_window() ;
+	m_batch.clear() ;
 }
 
 void HaplotypeFrequencyComponent::processed_snp(
@@ -235,6 +276,10 @@ void HaplotypeFrequencyComponent::processed_snp(
 #if DEBUG_HAPLOTYPE_FREQUENCY_COMPONENT
 	std::cerr << "Processing " << target_snp << "...\n" ;
 #endif
+	if( m_use_window ) {
+		add_to_batch( target_snp, target_data_reader ) ;
+		return ;
+	}
 	genfile::VariantIdentifyingData source_snp ;
 	m_source->reset_to_start() ;
 	while( m_source->get_snp_identifying_data( &source_snp )) {
@@ -370,10 +415,10 @@ namespace {
 	
 	void tabulate_calls(
 		std::vector< genfile::SampleRange > const& sample_set,
-		std::vector< int > left_calls,
-		std::vector< uint32_t > left_ploidy,
-		std::vector< int > right_calls,
-		std::vector< uint32_t > right_ploidy,
+		std::vector< int > const& left_calls,
+		std::vector< uint32_t > const& left_ploidy,
+		std::vector< int > const& right_calls,
+		std::vector< uint32_t > const& right_ploidy,
 		Eigen::Matrix3d* diploid_table,
 		Eigen::Matrix2d* haploid_table
 	) {
@@ -550,6 +595,62 @@ void HaplotypeFrequencyComponent::compute_ld_measures(
 	}
 }
 
+namespace {
+	// Compute the correlation between the two columns of dosages over samples in the given set
+	// that are nonmissing in both columns.
+	double compute_dosage_r(
+		Eigen::MatrixXd const& dosages,
+		Eigen::MatrixXd const& nonmissingness,
+		std::vector< genfile::SampleRange > const& sample_set
+	) {
+		Eigen::RowVectorXd means = Eigen::RowVectorXd::Zero(2) ;
+		Eigen::RowVectorXd totals = Eigen::RowVectorXd::Zero(2) ;
+		for( std::size_t i = 0; i < sample_set.size(); ++i ) {
+
+#if DEBUG_HAPLOTYPE_FREQUENCY_COMPONENT
+			std::cerr << sample_set[i].begin() << "-" << sample_set[i].end() << ":\n" ;
+			std::cerr << dosages.rows() << "x" << dosages.cols()
+				<< ", " << nonmissingness.rows() << "x" << nonmissingness.cols() << ".\n" ;
+			std::cerr << dosages.block( 0, 0, std::min( int( dosages.rows() ), 10 ), dosages.cols() ) << ".\n" ;
+#endif
+			means.array() += (
+				dosages.block( sample_set[i].begin(), 0, sample_set[i].end() - sample_set[i].begin(), 2 ).array()
+				* nonmissingness.block( sample_set[i].begin(), 0, sample_set[i].end() - sample_set[i].begin(), 2 ).array()
+			).colwise().sum() ;
+		
+			totals += nonmissingness.block( sample_set[i].begin(), 0, sample_set[i].end() - sample_set[i].begin(), 2 ).colwise().sum() ;
+		}
+
+		means.array() /= totals.array() ;
+
+		Eigen::Matrix2d covariance = Eigen::Matrix2d::Zero() ;
+		Eigen::Matrix2d nonmissing = Eigen::Matrix2d::Zero() ;
+		for( std::size_t i = 0; i < sample_set.size(); ++i ) {
+			//Eigen::MatrixBase< Eigen::MatrixXd > block = (
+			Eigen::MatrixXd block = (
+				(dosages.block( sample_set[i].begin(), 0,  sample_set[i].end() - sample_set[i].begin(), 2 ).rowwise() - means ).array()
+					* nonmissingness.block( sample_set[i].begin(), 0,  sample_set[i].end() - sample_set[i].begin(), 2 ).array()
+			) ;
+			Eigen::Block< Eigen::MatrixXd const > nonmissing_block = nonmissingness.block(
+				sample_set[i].begin(), 0,  sample_set[i].end() - sample_set[i].begin(), 2
+			) ;
+
+			covariance += block.transpose() * block ;
+			nonmissing += nonmissing_block.transpose() * nonmissing_block ;
+		}
+		// Compute correlation as:
+		// 
+		double const r = covariance(0,1) / std::sqrt( covariance(0,0) * covariance(1,1) ) ;
+
+#if DEBUG_HAPLOTYPE_FREQUENCY_COMPONENT
+		std::cerr << "means = " << means << ".\n" ;
+		std::cerr << "cov =\n" << covariance << ".\n" ;
+		std::cerr << "r =\n" << r << ".\n" ;
+#endif
+		return r ;
+	}
+}
+
 void HaplotypeFrequencyComponent::compute_ld_measures(
 	genfile::VariantIdentifyingData const& source_snp,
 	std::vector< int > const& source_calls,
@@ -560,6 +661,38 @@ void HaplotypeFrequencyComponent::compute_ld_measures(
 	Eigen::MatrixXd const& dosages,
 	Eigen::MatrixXd const& nonmissingness,
 	bool const runEM
+) {
+	std::vector< double > dosage_r ;
+	if( m_stratification ) {
+		for( std::size_t i = 0; i < m_stratification->number_of_strata(); ++i ) {
+			dosage_r.push_back( compute_dosage_r( dosages, nonmissingness, m_stratification->stratum(i) )) ;
+		}
+	} else {
+		dosage_r.push_back(
+			compute_dosage_r( dosages, nonmissingness, std::vector< genfile::SampleRange  >( 1, genfile::SampleRange( 0, dosages.rows() ) ) )
+		) ;
+	}
+	compute_ld_measures(
+		source_snp,
+		source_calls,
+		source_ploidy,
+		target_snp,
+		target_calls,
+		target_ploidy,
+		dosage_r,
+		runEM
+	) ;
+}
+
+void HaplotypeFrequencyComponent::compute_ld_measures(
+	genfile::VariantIdentifyingData const& source_snp,
+	std::vector< int > const& source_calls,
+	std::vector< uint32_t > const& source_ploidy,
+	genfile::VariantIdentifyingData const& target_snp,
+	std::vector< int > const& target_calls,
+	std::vector< uint32_t > const& target_ploidy,
+	std::vector< double > const& dosage_r,
+	bool const runEM
 ) {
 	if( m_stratification ) {
 		bool output = (m_min_r2 == 0.0 ) ;
@@ -581,10 +714,8 @@ void HaplotypeFrequencyComponent::compute_ld_measures(
 				output = compute_dosage_ld_measures(
 					source_snp,
 					target_snp,
-					dosages,
-					nonmissingness,
+					dosage_r[i],
 					m_stratification->stratum_name(i) + ":",
-					m_stratification->stratum(i),
 					output
 				) || output ;
 			} catch( genfile::OperationFailedError const& e ) {
@@ -605,17 +736,15 @@ void HaplotypeFrequencyComponent::compute_ld_measures(
 					target_snp,
 					target_calls, target_ploidy,
 					"",
-					std::vector< genfile::SampleRange  >( 1, genfile::SampleRange( 0, dosages.rows() ) ),
+					std::vector< genfile::SampleRange  >( 1, genfile::SampleRange( 0, source_calls.size() ) ),
 					output
 				) ;
 			}
 			compute_dosage_ld_measures(
 				source_snp,
 				target_snp,
-				dosages,
-				nonmissingness,
+				dosage_r[0],
 				"",
-				std::vector< genfile::SampleRange  >( 1, genfile::SampleRange( 0, dosages.rows() ) ),
 				output
 			) ;
 		} catch( genfile::OperationFailedError const& e ) {
@@ -630,60 +759,11 @@ void HaplotypeFrequencyComponent::compute_ld_measures(
 bool HaplotypeFrequencyComponent::compute_dosage_ld_measures(
 	genfile::VariantIdentifyingData const& source_snp,
 	genfile::VariantIdentifyingData const& target_snp,
-	Eigen::MatrixXd const& dosages,
-	Eigen::MatrixXd const& nonmissingness,
+	double const r,
 	std::string const& variable_name_stub,
-	std::vector< genfile::SampleRange > const& sample_set,
 	bool alwaysOutput
 ) {
-	bool includeInOutput = alwaysOutput ;
-	Eigen::RowVectorXd means = Eigen::RowVectorXd::Zero(2) ;
-	Eigen::RowVectorXd totals = Eigen::RowVectorXd::Zero(2) ;
-	for( std::size_t i = 0; i < sample_set.size(); ++i ) {
-
-#if DEBUG_HAPLOTYPE_FREQUENCY_COMPONENT
-		std::cerr << sample_set[i].begin() << "-" << sample_set[i].end() << ":\n" ;
-		std::cerr << dosages.rows() << "x" << dosages.cols()
-			<< ", " << nonmissingness.rows() << "x" << nonmissingness.cols() << ".\n" ;
-		std::cerr << dosages.block( 0, 0, std::min( int( dosages.rows() ), 10 ), dosages.cols() ) << ".\n" ;
-#endif
-		means.array() += (
-			dosages.block( sample_set[i].begin(), 0, sample_set[i].end() - sample_set[i].begin(), 2 ).array()
-			* nonmissingness.block( sample_set[i].begin(), 0, sample_set[i].end() - sample_set[i].begin(), 2 ).array()
-		).colwise().sum() ;
-		
-		totals += nonmissingness.block( sample_set[i].begin(), 0, sample_set[i].end() - sample_set[i].begin(), 2 ).colwise().sum() ;
-	}
-
-	means.array() /= totals.array() ;
-
-	Eigen::Matrix2d covariance = Eigen::Matrix2d::Zero() ;
-	Eigen::Matrix2d nonmissing = Eigen::Matrix2d::Zero() ;
-	for( std::size_t i = 0; i < sample_set.size(); ++i ) {
-		//Eigen::MatrixBase< Eigen::MatrixXd > block = (
-		Eigen::MatrixXd block = (
-			(dosages.block( sample_set[i].begin(), 0,  sample_set[i].end() - sample_set[i].begin(), 2 ).rowwise() - means ).array()
-				* nonmissingness.block( sample_set[i].begin(), 0,  sample_set[i].end() - sample_set[i].begin(), 2 ).array()
-		) ;
-		Eigen::Block< Eigen::MatrixXd const > nonmissing_block = nonmissingness.block(
-			sample_set[i].begin(), 0,  sample_set[i].end() - sample_set[i].begin(), 2
-		) ;
-
-		covariance += block.transpose() * block ;
-		nonmissing += nonmissing_block.transpose() * nonmissing_block ;
-	}
-	// Compute correlation as:
-	// 
-	double r = covariance(0,1) / std::sqrt( covariance(0,0) * covariance(1,1) ) ;
-
-	includeInOutput = includeInOutput || (r*r >= m_min_r2 ) ;
-
-#if DEBUG_HAPLOTYPE_FREQUENCY_COMPONENT
-	std::cerr << "means = " << means << ".\n" ;
-	std::cerr << "cov =\n" << covariance << ".\n" ;
-	std::cerr << "r =\n" << r << ".\n" ;
-#endif
-
+	bool const includeInOutput = alwaysOutput || (r*r >= m_min_r2 ) ;
 	if( includeInOutput ) {
 		m_sink->store_per_variant_pair_data( source_snp, target_snp, variable_name_stub + "dosage_r", r  ) ;
 		m_sink->store_per_variant_pair_data( source_snp, target_snp, variable_name_stub + "dosage_r2", r*r ) ;
@@ -803,7 +883,275 @@ bool HaplotypeFrequencyComponent::compute_em_ld_measures(
 	return includeInOutput ;
 }
 
+bool HaplotypeFrequencyComponent::source_is_sorted() {
+	m_source->reset_to_start() ;
+	genfile::VariantIdentifyingData snp ;
+	boost::optional< genfile::GenomePosition > last_position ;
+	bool result = true ;
+	while( result && m_source->get_snp_identifying_data( &snp )) {
+		m_source->ignore_snp_probability_data() ;
+		if( last_position && snp.get_position() < *last_position ) {
+			result = false ;
+		}
+		last_position = snp.get_position() ;
+	}
+	return result ;
+}
+
+void HaplotypeFrequencyComponent::reset_window() {
+	m_source->reset_to_start() ;
+	m_window.clear() ;
+	m_window_dosages.resize( m_source->number_of_samples(), 0 ) ;
+	m_window_squared_dosages.resize( m_source->number_of_samples(), 0 ) ;
+	m_window_nonmissingness.resize( m_source->number_of_samples(), 0 ) ;
+	m_window_begin = 0 ;
+	m_have_pending_snp = false ;
+	m_last_target_position.reset() ;
+}
+
+void HaplotypeFrequencyComponent::advance_window(
+	genfile::GenomePosition const& first_target_position,
+	genfile::GenomePosition const& last_target_position
+) {
+	if( m_last_target_position && first_target_position < *m_last_target_position ) {
+		// Target variants have gone backwards; start again from the beginning of the LD source.
+		reset_window() ;
+	}
+	m_last_target_position = last_target_position ;
+
+	// Drop variants that are now too far behind the targets.
+	while( !m_window.empty() ) {
+		genfile::GenomePosition const& position = m_window.front().snp.get_position() ;
+		if(
+			position.chromosome() == first_target_position.chromosome()
+			&& int64_t( position.position() ) + m_max_distance >= int64_t( first_target_position.position() )
+		) {
+			break ;
+		}
+		m_window.pop_front() ;
+		m_window_begin = ( m_window_begin + 1 ) % m_window_dosages.cols() ;
+	}
+
+	// Read variants up to the far end of the window.
+	genfile::GenomePosition const window_end(
+		last_target_position.chromosome(),
+		genfile::Position( std::min( int64_t( last_target_position.position() ) + m_max_distance, int64_t( std::numeric_limits< genfile::Position >::max() )))
+	) ;
+	while( m_have_pending_snp || m_source->get_snp_identifying_data( &m_pending_snp )) {
+		m_have_pending_snp = true ;
+		genfile::GenomePosition const& position = m_pending_snp.get_position() ;
+		if( window_end < position ) {
+			break ;
+		}
+		if(
+			m_pending_snp.number_of_alleles() == 2
+			&& position.chromosome() == first_target_position.chromosome()
+			&& int64_t( position.position() ) + m_max_distance >= int64_t( first_target_position.position() )
+		) {
+			genfile::VariantDataReader::UniquePtr data_reader = m_source->read_variant_data() ;
+			add_to_window( m_pending_snp, *data_reader ) ;
+		} else {
+			m_source->ignore_snp_probability_data() ;
+		}
+		m_have_pending_snp = false ;
+	}
+}
+
+void HaplotypeFrequencyComponent::decode_variant(
+	genfile::VariantDataReader& data_reader,
+	WindowVariant* variant,
+	Eigen::MatrixXd* dosages,
+	Eigen::MatrixXd* squared_dosages,
+	Eigen::MatrixXd* nonmissingness
+) const {
+	variant->have_calls = false ;
+	try {
+		data_reader.get( ":genotypes:", CallSetter( &variant->calls, &variant->ploidy ) ) ;
+		variant->have_calls = true ;
+	} catch( ... ) {
+	}
+	dosages->col( variant->column ).setZero() ;
+	nonmissingness->col( variant->column ).setZero() ;
+	{
+		DosageSetter setter( dosages, nonmissingness, variant->column ) ;
+		data_reader.get( ":genotypes:", genfile::to_GP_unphased( setter ) ) ;
+	}
+	// Store dosages as zero where missing, so that sums over samples can be computed by matrix products.
+	dosages->col( variant->column ).array() *= nonmissingness->col( variant->column ).array() ;
+	squared_dosages->col( variant->column ) = dosages->col( variant->column ).array().square().matrix() ;
+}
+
+void HaplotypeFrequencyComponent::add_to_window( genfile::VariantIdentifyingData const& snp, genfile::VariantDataReader& data_reader ) {
+	int const number_of_samples = m_window_dosages.rows() ;
+	if( m_window.size() == std::size_t( m_window_dosages.cols() )) {
+		// Grow the ring buffer, putting the window back in order at the start.
+		int const capacity = std::max( 16, 2 * int( m_window_dosages.cols() )) ;
+		Eigen::MatrixXd dosages( number_of_samples, capacity ) ;
+		Eigen::MatrixXd squared_dosages( number_of_samples, capacity ) ;
+		Eigen::MatrixXd nonmissingness( number_of_samples, capacity ) ;
+		for( std::size_t i = 0; i < m_window.size(); ++i ) {
+			int const column = m_window[i].column ;
+			dosages.col( i ) = m_window_dosages.col( column ) ;
+			squared_dosages.col( i ) = m_window_squared_dosages.col( column ) ;
+			nonmissingness.col( i ) = m_window_nonmissingness.col( column ) ;
+			m_window[i].column = i ;
+		}
+		m_window_dosages.swap( dosages ) ;
+		m_window_squared_dosages.swap( squared_dosages ) ;
+		m_window_nonmissingness.swap( nonmissingness ) ;
+		m_window_begin = 0 ;
+	}
+
+	m_window.push_back( WindowVariant() ) ;
+	WindowVariant& variant = m_window.back() ;
+	variant.snp = snp ;
+	variant.column = ( m_window_begin + m_window.size() - 1 ) % m_window_dosages.cols() ;
+	decode_variant( data_reader, &variant, &m_window_dosages, &m_window_squared_dosages, &m_window_nonmissingness ) ;
+}
+
+void HaplotypeFrequencyComponent::add_to_batch(
+	genfile::VariantIdentifyingData const& target_snp,
+	genfile::VariantDataReader& target_data_reader
+) {
+	if( target_snp.number_of_alleles() != 2 ) {
+		return ;
+	}
+	// Targets in a batch must be in order on one chromosome, so they can share the window.
+	if(
+		!m_batch.empty()
+		&& (
+			target_snp.get_position().chromosome() != m_batch.back().snp.get_position().chromosome()
+			|| target_snp.get_position() < m_batch.back().snp.get_position()
+		)
+	) {
+		compute_batch_ld_measures() ;
+	}
+	int const number_of_samples = m_source->number_of_samples() ;
+	if( m_batch_dosages.rows() != number_of_samples || std::size_t( m_batch_dosages.cols() ) != m_batch_size ) {
+		m_batch_dosages.resize( number_of_samples, m_batch_size ) ;
+		m_batch_squared_dosages.resize( number_of_samples, m_batch_size ) ;
+		m_batch_nonmissingness.resize( number_of_samples, m_batch_size ) ;
+	}
+	m_batch.push_back( WindowVariant() ) ;
+	WindowVariant& variant = m_batch.back() ;
+	variant.snp = target_snp ;
+	variant.column = m_batch.size() - 1 ;
+	decode_variant( target_data_reader, &variant, &m_batch_dosages, &m_batch_squared_dosages, &m_batch_nonmissingness ) ;
+	if( m_batch.size() == m_batch_size ) {
+		compute_batch_ld_measures() ;
+	}
+}
+
+void HaplotypeFrequencyComponent::compute_batch_dosage_r(
+	std::vector< genfile::SampleRange > const& sample_set,
+	Eigen::MatrixXd* result
+) const {
+	// For each window variant x and batch variant y, we need sums over samples nonmissing in
+	// both of 1, x, y, x^2, y^2 and xy.  Since missing dosages are stored as zero, these are given
+	// by products of the window matrices with the blocks of:
+	int const batch_size = m_batch.size() ;
+	Eigen::MatrixXd batch( m_batch_dosages.rows(), 3 * batch_size ) ;
+	batch.leftCols( batch_size ) = m_batch_nonmissingness.leftCols( batch_size ) ;
+	batch.middleCols( batch_size, batch_size ) = m_batch_dosages.leftCols( batch_size ) ;
+	batch.rightCols( batch_size ) = m_batch_squared_dosages.leftCols( batch_size ) ;
+
+	int const window_size = m_window.size() ;
+	Eigen::MatrixXd dosage_sums = Eigen::MatrixXd::Zero( window_size, 2 * batch_size ) ;          // sum x, sum xy
+	Eigen::MatrixXd nonmissingness_sums = Eigen::MatrixXd::Zero( window_size, 3 * batch_size ) ;  // count, sum y, sum y^2
+	Eigen::MatrixXd squared_dosage_sums = Eigen::MatrixXd::Zero( window_size, batch_size ) ;      // sum x^2
+
+	// The window occupies at most two contiguous blocks of columns of the ring buffer.
+	int const capacity = m_window_dosages.cols() ;
+	int const first_block_size = std::min( window_size, capacity - m_window_begin ) ;
+	int const block_begin[2] = { m_window_begin, 0 } ;
+	int const block_size[2] = { first_block_size, window_size - first_block_size } ;
+	int const block_offset[2] = { 0, first_block_size } ;
+
+	for( std::size_t range_i = 0; range_i < sample_set.size(); ++range_i ) {
+		int const begin = sample_set[range_i].begin() ;
+		int const size = sample_set[range_i].size() ;
+		for( int block_i = 0; block_i < 2; ++block_i ) {
+			if( block_size[block_i] == 0 ) {
+				continue ;
+			}
+			dosage_sums.middleRows( block_offset[block_i], block_size[block_i] ).noalias()
+				+= m_window_dosages.block( begin, block_begin[block_i], size, block_size[block_i] ).transpose()
+				* batch.block( begin, 0, size, 2 * batch_size ) ;
+			nonmissingness_sums.middleRows( block_offset[block_i], block_size[block_i] ).noalias()
+				+= m_window_nonmissingness.block( begin, block_begin[block_i], size, block_size[block_i] ).transpose()
+				* batch.middleRows( begin, size ) ;
+			squared_dosage_sums.middleRows( block_offset[block_i], block_size[block_i] ).noalias()
+				+= m_window_squared_dosages.block( begin, block_begin[block_i], size, block_size[block_i] ).transpose()
+				* batch.block( begin, 0, size, batch_size ) ;
+		}
+	}
+
+	Eigen::ArrayXXd const count = nonmissingness_sums.leftCols( batch_size ).array() ;
+	Eigen::ArrayXXd const x = dosage_sums.leftCols( batch_size ).array() ;
+	Eigen::ArrayXXd const y = nonmissingness_sums.middleCols( batch_size, batch_size ).array() ;
+	Eigen::ArrayXXd const covariance = dosage_sums.rightCols( batch_size ).array() - x * y / count ;
+	Eigen::ArrayXXd const x_variance = squared_dosage_sums.array() - x * x / count ;
+	Eigen::ArrayXXd const y_variance = nonmissingness_sums.rightCols( batch_size ).array() - y * y / count ;
+	*result = ( covariance / ( x_variance * y_variance ).sqrt() ).matrix() ;
+}
+
+void HaplotypeFrequencyComponent::compute_batch_ld_measures() {
+	if( m_batch.empty() ) {
+		return ;
+	}
+	advance_window( m_batch.front().snp.get_position(), m_batch.back().snp.get_position() ) ;
+
+	if( !m_window.empty() ) {
+		// Compute dosage correlations between the whole window and the whole batch at once, for each stratum.
+		std::vector< std::vector< genfile::SampleRange > > sample_sets ;
+		if( m_stratification ) {
+			for( std::size_t i = 0; i < m_stratification->number_of_strata(); ++i ) {
+				sample_sets.push_back( m_stratification->stratum(i) ) ;
+			}
+		} else {
+			sample_sets.push_back( std::vector< genfile::SampleRange >( 1, genfile::SampleRange( 0, m_batch_dosages.rows() ) ) ) ;
+		}
+		std::vector< Eigen::MatrixXd > batch_dosage_r( sample_sets.size() ) ;
+		for( std::size_t i = 0; i < sample_sets.size(); ++i ) {
+			compute_batch_dosage_r( sample_sets[i], &batch_dosage_r[i] ) ;
+		}
+
+		std::vector< double > dosage_r( sample_sets.size() ) ;
+		for( std::size_t j = 0; j < m_batch.size(); ++j ) {
+			WindowVariant const& target = m_batch[j] ;
+			int64_t const target_position = target.snp.get_position().position() ;
+			for( std::size_t i = 0; i < m_window.size(); ++i ) {
+				WindowVariant const& variant = m_window[i] ;
+				// The window covers the whole batch, so check the distance to this target.
+				if( std::abs( int64_t( variant.snp.get_position().position() ) - target_position ) > m_max_distance ) {
+					continue ;
+				}
+#if DEBUG_HAPLOTYPE_FREQUENCY_COMPONENT
+				std::cerr << "Computing LD measures for " << variant.snp << " : " << target.snp << "...\n" ;
+#endif
+				for( std::size_t k = 0; k < sample_sets.size(); ++k ) {
+					dosage_r[k] = batch_dosage_r[k]( i, j ) ;
+				}
+				compute_ld_measures(
+					variant.snp,
+					variant.calls,
+					variant.ploidy,
+					target.snp,
+					target.calls,
+					target.ploidy,
+					dosage_r,
+					variant.have_calls && target.have_calls
+				) ;
+			}
+		}
+	}
+	m_batch.clear() ;
+}
+
 void HaplotypeFrequencyComponent::end_processing_snps() {
+	if( m_use_window ) {
+		compute_batch_ld_measures() ;
+	}
 	if( m_sink.get() ) {
 		m_sink->finalise() ;
 	}
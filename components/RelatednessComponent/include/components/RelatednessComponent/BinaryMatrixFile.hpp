@@ -0,0 +1,86 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef RELATEDNESS_COMPONENT_BINARY_MATRIX_FILE_HPP
+#define RELATEDNESS_COMPONENT_BINARY_MATRIX_FILE_HPP
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <Eigen/Core>
+
+namespace pca {
+	// A binary file holding one or more double-valued matrices ("layers") of the same shape.
+	// The file starts with a header:
+	//   the 8 bytes "qcmatrix",
+	//   uint32 layout (0 = full, 1 = lower triangle), uint32 number of layers,
+	//   uint64 number of rows, uint64 number of columns, uint64 number of SNPs,
+	//   uint32 description length, followed by the description.
+	// All integers are little-endian.  The layers follow in order, each stored as doubles in native byte order.
+	// Full matrices are stored column-major.  Lower triangular matrices must be square and store,
+	// row by row, entries (i,j) with j <= i; the upper triangle is implied by symmetry.
+	// Blocks can be written in any order, so large matrices can be computed a tile at a time.
+	struct BinaryMatrixFile: public boost::noncopyable {
+	public:
+		typedef std::auto_ptr< BinaryMatrixFile > UniquePtr ;
+		enum Layout { eFull = 0, eLowerTriangle = 1 } ;
+		struct Header {
+			Header():
+				layout( eFull ),
+				number_of_layers( 1 ),
+				number_of_rows( 0 ),
+				number_of_columns( 0 ),
+				number_of_snps( 0 )
+			{}
+			Layout layout ;
+			uint32_t number_of_layers ;
+			uint64_t number_of_rows ;
+			uint64_t number_of_columns ;
+			uint64_t number_of_snps ;
+			std::string description ;
+		} ;
+
+		// Create a new file, overwriting any existing file.  All entries are initially zero.
+		static UniquePtr create( std::string const& filename, Header const& header ) ;
+		// Open an existing file for reading.
+		static UniquePtr open( std::string const& filename ) ;
+		// Return true if the file exists and starts with the binary matrix file magic number.
+		static bool is_binary_matrix_file( std::string const& filename ) ;
+
+	public:
+		~BinaryMatrixFile() ;
+		std::string const& filename() const { return m_filename ; }
+		Header const& header() const { return m_header ; }
+
+		// Write a block whose top-left entry is (i,j) into the given layer.
+		// For lower triangular files, entries of the block above the diagonal are ignored.
+		// This can be called from several threads at once.
+		void write_block( std::size_t layer, std::size_t i, std::size_t j, Eigen::MatrixXd const& block ) ;
+		// Read row i, up to and including column number_of_columns-1, or column i for lower triangular files.
+		void read_row( std::size_t layer, std::size_t i, Eigen::VectorXd* result ) ;
+		// Read a whole layer.  For lower triangular files the upper triangle is filled by symmetry.
+		void read_matrix( std::size_t layer, Eigen::MatrixXd* result ) ;
+
+	private:
+		std::string const m_filename ;
+		Header m_header ;
+		std::fstream m_stream ;
+		uint64_t m_data_offset ;
+		boost::mutex m_mutex ;
+
+	private:
+		BinaryMatrixFile( std::string const& filename, Header const& header, std::ios_base::openmode mode ) ;
+		BinaryMatrixFile( std::string const& filename ) ;
+		uint64_t number_of_entries() const ;
+		uint64_t get_offset( std::size_t layer, std::size_t i, std::size_t j ) const ;
+		void write_header() ;
+		void read_header() ;
+	} ;
+}
+
+#endif
@@ -15,6 +15,7 @@
 #include "genfile/VariantDataReader.hpp"
 #include "genfile/SNPDataSourceProcessor.hpp"
 #include "genfile/SingleSNPGenotypeProbabilities.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
 #include "genfile/CohortIndividualSource.hpp"
 #include "worker/Worker.hpp"
 #include "worker/Task.hpp"
@@ -81,7 +82,48 @@ namespace impl {
 		int begin_sample_j ;
 		int end_sample_j ;
 	} ;
-	
+
+	// Return a tiling of the lower triangle of a dxd matrix, with B blocks across the diagonal.
+	// Off-diagonal blocks above the diagonal are also returned; they have begin_sample_i < begin_sample_j.
+	std::vector< SampleBounds > get_matrix_lower_diagonal_tiling( std::size_t d, std::size_t B ) ;
+
+	// Threshhold calls at a variant and pack them two bits per sample, 32 samples to a word,
+	// coded as 0 (missing), 1 (AA), 2 (AB), 3 (BB).  genotype_values is filled with the
+	// normalised genotype value for each code.
+	// Return false if the variant should be excluded due to its frequency.
+	bool pack_genotypes(
+		genfile::GenotypeProbabilityMatrix const& data,
+		double const call_threshhold,
+		double const allele_frequency_threshhold,
+		uint64_t* packed_genotypes,
+		double* genotype_values
+	) ;
+
+	// Unpack genotypes for the given range of samples at the given number of packed SNPs into
+	// a samples x SNPs matrix of normalised genotype values, and a nonmissingness bit-plane per sample.
+	// The matrix must have a multiple of 64 columns; columns beyond number_of_snps are zeroed.
+	void unpack_genotypes(
+		uint64_t const* packed_genotypes,
+		std::size_t const number_of_words_per_snp,
+		double const* genotype_values,
+		std::size_t const number_of_snps,
+		std::size_t const begin_sample,
+		std::size_t const end_sample,
+		KinshipCoefficientComputer::Computation::Matrix* genotypes,
+		std::vector< uint64_t >* nonmissingness
+	) ;
+
+	// Add the number of SNPs nonmissing in both of samples i and j, for i >= j within the bounds,
+	// to the column-major result whose first entry corresponds to (begin_sample_i, begin_sample_j).
+	void accumulate_nonmissingness(
+		uint64_t const* row_nonmissingness,
+		uint64_t const* column_nonmissingness,
+		std::size_t const number_of_words,
+		SampleBounds const& bounds,
+		int* result,
+		std::size_t const result_stride
+	) ;
+
 	struct Dispatcher ;
 
 	struct NTaskDispatcher {
@@ -125,6 +167,7 @@ namespace impl {
 		Computation::Matrix m_result ;
 		Computation::IntegerMatrix m_nonmissingness ;
 		std::auto_ptr< Dispatcher > m_dispatcher ;
+		genfile::GenotypeProbabilityMatrix m_genotype_data ;
 	} ;
 
 	struct NormaliseGenotypesAndComputeXXtFast: public KinshipCoefficientComputer::Computation {
@@ -153,6 +196,7 @@ namespace impl {
 		std::vector< SampleBounds > m_matrix_tiling ;
 		std::vector< uint64_t > m_combined_genotypes ;
 		std::vector< uint64_t > m_per_snp_genotypes ;
+		genfile::GenotypeProbabilityMatrix m_genotype_data ;
 		std::size_t m_snp_count ;
 		Computation::Matrix m_result ;
 		Computation::IntegerMatrix m_nonmissingness ;
@@ -174,6 +218,62 @@ namespace impl {
 			std::vector< uint64_t > const& genotypes
 		) ;
 	} ;
+
+	// Computation of the kinship matrix using a 2-bit-packed genotype store, following the
+	// approach of plink 2.
+	// Threshholded calls are packed 32 samples to a word as they arrive.  Once a batch of SNPs
+	// has been collected, the batch is unpacked into a matrix of normalised genotypes (zero where missing)
+	// and a bit-plane per sample recording which SNPs are nonmissing.  The result is then accumulated
+	// tile by tile, using a matrix product for the genotypes and popcounts for the nonmissingness.
+	struct NormaliseGenotypesAndComputeXXtPacked: public KinshipCoefficientComputer::Computation {
+		static UniquePtr create( worker::Worker*, std::size_t const number_of_snps_per_batch ) ;
+
+		NormaliseGenotypesAndComputeXXtPacked(
+			worker::Worker* worker,
+			std::size_t const number_of_snps_per_batch
+		) ;
+		Computation::Matrix const& result() const ;
+		Computation::IntegerMatrix const& nonmissingness() const ;
+		std::string get_summary() const ;
+		void begin_processing_snps( std::size_t number_of_samples, genfile::SNPDataSource::Metadata const& ) ;
+		void processed_snp( genfile::VariantIdentifyingData const& id_data, genfile::VariantDataReader::SharedPtr data_reader ) ;
+		void end_processing_snps() ;
+		std::size_t number_of_snps_included() const ;
+
+	private:
+		// A batch of SNPs unpacked ready for computation.
+		struct Batch {
+			Computation::Matrix genotypes ;
+			std::vector< uint64_t > nonmissingness ;
+			std::size_t number_of_words_per_sample ;
+		} ;
+
+		worker::Worker* m_worker ;
+		NTaskDispatcher::UniquePtr m_dispatcher ;
+		double const m_call_threshhold ;
+		double const m_allele_frequency_threshhold ;
+		std::size_t const m_number_of_snps_per_batch ;
+		std::size_t m_number_of_samples ;
+		std::vector< SampleBounds > m_matrix_tiling ;
+		// Genotypes of the current batch, coded as 0 (missing), 1 (AA), 2 (AB), 3 (BB)
+		// and packed 32 samples to a word.  SNPs are laid out consecutively.
+		std::vector< uint64_t > m_packed_genotypes ;
+		std::size_t m_number_of_words_per_snp ;
+		// Normalised value for each genotype code, for each SNP in the current batch.
+		std::vector< double > m_genotype_values ;
+		std::size_t m_number_of_snps_in_batch ;
+		// The batch being computed; this is only modified when no tasks are running.
+		Batch m_batch ;
+		genfile::GenotypeProbabilityMatrix m_genotype_data ;
+		std::size_t m_snp_count ;
+		Computation::Matrix m_result ;
+		Computation::IntegerMatrix m_nonmissingness ;
+
+	private:
+		void unpack_batch() ;
+		void submit_tasks() ;
+		void compute_block( SampleBounds const& sample_bounds ) ;
+	} ;
 }
 
 #endif
@@ -0,0 +1,92 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef COMPONENTS_RELATEDNESS_COMPONENT_OUT_OF_CORE_KINSHIP_COMPUTER_HPP
+#define COMPONENTS_RELATEDNESS_COMPONENT_OUT_OF_CORE_KINSHIP_COMPUTER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <stdint.h>
+#include <boost/signals2/signal.hpp>
+#include "Eigen/Core"
+#include "genfile/VariantIdentifyingData.hpp"
+#include "genfile/VariantDataReader.hpp"
+#include "genfile/SNPDataSourceProcessor.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
+#include "worker/Worker.hpp"
+#include "appcontext/UIContext.hpp"
+#include "components/RelatednessComponent/KinshipCoefficientComputer.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
+
+// Compute the kinship matrix without holding it in memory.
+// As SNPs are processed, threshholded calls are packed two bits per sample and written to a file.
+// When all SNPs have been seen this file is memory-mapped and the lower triangle of the matrix
+// is computed a tile at a time, with tiles sized so the working memory stays within a given budget.
+// Finished tiles are written to a lower triangular BinaryMatrixFile with two layers:
+// the pairwise nonmissingness counts, and the kinship coefficients.
+struct OutOfCoreKinshipComputer: public genfile::SNPDataSourceProcessor::Callback {
+public:
+	typedef std::auto_ptr< OutOfCoreKinshipComputer > UniquePtr ;
+	typedef KinshipCoefficientComputer::Computation::Matrix Matrix ;
+	typedef KinshipCoefficientComputer::Computation::IntegerMatrix IntegerMatrix ;
+	typedef boost::signals2::signal< void( pca::BinaryMatrixFile&, std::string const& source, std::string const& description ) > ResultSignal ;
+	typedef ResultSignal::slot_type ResultsCallback ;
+
+public:
+	OutOfCoreKinshipComputer(
+		worker::Worker* worker,
+		appcontext::UIContext& ui_context,
+		std::string const& filename,
+		std::size_t const memory_budget_in_bytes
+	) ;
+	~OutOfCoreKinshipComputer() throw() ;
+
+	void send_results_to( ResultsCallback callback ) ;
+	std::string get_summary() const ;
+
+	void begin_processing_snps( std::size_t number_of_samples, genfile::SNPDataSource::Metadata const& ) ;
+	void processed_snp( genfile::VariantIdentifyingData const& id_data, genfile::VariantDataReader::SharedPtr data_reader ) ;
+	void end_processing_snps() ;
+
+private:
+	// Working storage for one tile.
+	struct Tile {
+		impl::SampleBounds bounds ;
+		Matrix values ;
+		IntegerMatrix counts ;
+		Matrix row_genotypes ;
+		Matrix column_genotypes ;
+		std::vector< uint64_t > row_nonmissingness ;
+		std::vector< uint64_t > column_nonmissingness ;
+	} ;
+
+	worker::Worker* m_worker ;
+	appcontext::UIContext& m_ui_context ;
+	std::string const m_filename ;
+	std::string const m_genotype_filename ;
+	std::size_t const m_memory_budget ;
+	double const m_call_threshhold ;
+	double const m_allele_frequency_threshhold ;
+	std::size_t const m_number_of_snps_per_batch ;
+	std::size_t m_number_of_samples ;
+	std::size_t m_number_of_words_per_snp ;
+	std::size_t m_number_of_snps ;
+	std::auto_ptr< std::ofstream > m_genotype_file ;
+	std::vector< uint64_t > m_packed_genotypes ;
+	// Normalised value for each genotype code, for each SNP.
+	std::vector< double > m_genotype_values ;
+	genfile::GenotypeProbabilityMatrix m_genotype_data ;
+	ResultSignal m_result_signal ;
+
+private:
+	std::size_t get_tile_memory_usage( std::size_t const tile_size ) const ;
+	std::size_t choose_number_of_blocks( std::size_t const number_of_concurrent_tiles ) const ;
+	void compute_tile( uint64_t const* packed_genotypes, Tile* tile ) const ;
+	void compute_tiles( pca::BinaryMatrixFile& result ) ;
+} ;
+
+#endif
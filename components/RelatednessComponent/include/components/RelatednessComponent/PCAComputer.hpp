@@ -17,6 +17,7 @@
 #include "components/SampleSummaryComponent/SampleStorage.hpp"
 #include "appcontext/OptionProcessor.hpp"
 #include "appcontext/UIContext.hpp"
+#include "worker/Worker.hpp"
 
 struct PCAComputer
 {
@@ -36,6 +37,7 @@ public:
 	PCAComputer(
 		appcontext::OptionProcessor const& options,
 		genfile::CohortIndividualSource const& samples,
+		worker::Worker* worker,
 		appcontext::UIContext& ui_context
 	) ;
 
@@ -61,6 +63,7 @@ private:
 	appcontext::OptionProcessor const& m_options ;
 	appcontext::UIContext& m_ui_context ;
 	genfile::CohortIndividualSource const& m_samples ;
+	worker::Worker* m_worker ;
 	std::string m_filename ;
 	std::size_t m_number_of_samples ;
 	std::size_t m_number_of_snps ;
@@ -82,6 +85,7 @@ private:
 
 private:
 	void compute_PCA() ;
+	void compute_randomised_eigendecomposition( Eigen::MatrixXd* kinship_eigendecomposition ) ;
 	
 } ;
 
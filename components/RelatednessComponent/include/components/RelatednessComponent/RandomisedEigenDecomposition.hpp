@@ -0,0 +1,33 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef QCTOOL_RELATEDNESS_COMPONENT_RANDOMISED_EIGEN_DECOMPOSITION_HPP
+#define QCTOOL_RELATEDNESS_COMPONENT_RANDOMISED_EIGEN_DECOMPOSITION_HPP
+
+#include <Eigen/Core>
+#include "worker/Worker.hpp"
+
+namespace pca {
+	// Compute the leading eigenvalues and eigenvectors of a symmetric matrix using a randomised
+	// block Krylov method.  The matrix is multiplied by a random block of
+	// number_of_eigenvalues + oversampling vectors, and by its powers up to number_of_iterations;
+	// the span of the results is orthonormalised and the matrix is decomposed exactly
+	// within that subspace.  This costs O(N^2 k) rather than O(N^3) for a full decomposition.
+	// Products with the matrix are split across the threads of the given worker.
+	// Only the lower triangle of the matrix is used.
+	// Eigenvalues are returned in decreasing order, with eigenvectors in corresponding columns.
+	void compute_randomised_partial_eigendecomposition(
+		worker::Worker* worker,
+		Eigen::MatrixXd const& matrix,
+		Eigen::VectorXd* eigenvalues,
+		Eigen::MatrixXd* eigenvectors,
+		int number_of_eigenvalues,
+		int number_of_iterations = 4,
+		int oversampling = 10,
+		unsigned int seed = 1
+	) ;
+}
+
+#endif
@@ -28,6 +28,7 @@ namespace relatedness {
 		ResultSignal m_result_signal ;
 
 		void load_matrix_impl( std::string const& filename, Eigen::MatrixXd* matrix, std::size_t* number_of_snps ) const ;
+		void load_binary_matrix_impl( std::string const& filename, Eigen::MatrixXd* matrix, std::size_t* number_of_snps ) const ;
 	} ;
 }
 
@@ -14,6 +14,7 @@
 #include "genfile/VariantEntry.hpp"
 #include "genfile/string_utils.hpp"
 #include "statfile/BuiltInTypeStatSink.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
 
 namespace pca {
 	std::string get_metadata( std::string const& source, std::string const& description ) ;
@@ -58,6 +59,26 @@ namespace pca {
 		boost::function< genfile::VariantEntry ( std::size_t ) > get_column_names = 0
 	) ;
 
+	// As above, but reading the matrices row by row from the first two layers
+	// of a lower triangular binary matrix file, so the matrix need not fit in memory.
+	void write_matrix_lower_diagonals_in_long_form(
+		std::string const& filename,
+		BinaryMatrixFile& matrix,
+		std::string const& source,
+		std::string const& description,
+		boost::function< genfile::VariantEntry ( std::size_t ) > get_row_names = 0,
+		boost::function< genfile::VariantEntry ( std::size_t ) > get_column_names = 0
+	) ;
+
+	// Write matrix to a full binary matrix file (see BinaryMatrixFile).
+	void write_binary_matrix(
+		std::string const& filename,
+		Eigen::MatrixXd const& matrix,
+		std::size_t const number_of_snps,
+		std::string const& source,
+		std::string const& description
+	) ;
+
 	void write_loadings_to_sink(
 		boost::shared_ptr< statfile::BuiltInTypeStatSink> sink,
 		genfile::VariantIdentifyingData snp,
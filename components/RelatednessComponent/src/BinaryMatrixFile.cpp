@@ -0,0 +1,226 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <boost/thread/locks.hpp>
+#include <Eigen/Core>
+#include "genfile/Error.hpp"
+#include "genfile/endianness_utils.hpp"
+#include "genfile/string_utils/string_utils.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
+
+namespace pca {
+	namespace {
+		char const magic[] = "qcmatrix" ;
+		std::size_t const magic_size = 8 ;
+
+		template< typename IntegerType >
+		void write_integer( std::ostream& out, IntegerType const value ) {
+			uint8_t buffer[ sizeof( IntegerType ) ] ;
+			genfile::write_little_endian_integer( buffer, buffer + sizeof( IntegerType ), value ) ;
+			out.write( reinterpret_cast< char const* >( buffer ), sizeof( IntegerType )) ;
+		}
+
+		template< typename IntegerType >
+		void read_integer( std::istream& in, IntegerType* value ) {
+			uint8_t buffer[ sizeof( IntegerType ) ] ;
+			in.read( reinterpret_cast< char* >( buffer ), sizeof( IntegerType )) ;
+			genfile::read_little_endian_integer( buffer, buffer + sizeof( IntegerType ), value ) ;
+		}
+	}
+
+	BinaryMatrixFile::UniquePtr BinaryMatrixFile::create( std::string const& filename, Header const& header ) {
+		if( header.layout == eLowerTriangle && header.number_of_rows != header.number_of_columns ) {
+			throw genfile::BadArgumentError(
+				"pca::BinaryMatrixFile::create()",
+				"header",
+				"Lower triangular matrices must be square."
+			) ;
+		}
+		return UniquePtr( new BinaryMatrixFile( filename, header, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc )) ;
+	}
+
+	BinaryMatrixFile::UniquePtr BinaryMatrixFile::open( std::string const& filename ) {
+		return UniquePtr( new BinaryMatrixFile( filename )) ;
+	}
+
+	bool BinaryMatrixFile::is_binary_matrix_file( std::string const& filename ) {
+		std::ifstream stream( filename.c_str(), std::ios::binary ) ;
+		char buffer[ magic_size ] ;
+		stream.read( buffer, magic_size ) ;
+		return stream && std::memcmp( buffer, magic, magic_size ) == 0 ;
+	}
+
+	BinaryMatrixFile::BinaryMatrixFile( std::string const& filename, Header const& header, std::ios_base::openmode mode ):
+		m_filename( filename ),
+		m_header( header ),
+		m_stream( filename.c_str(), mode ),
+		m_data_offset( 0 )
+	{
+		if( !m_stream ) {
+			throw genfile::ResourceNotOpenedError( filename ) ;
+		}
+		write_header() ;
+		// Extend the file to its full size; the data is initially zero.
+		uint64_t const size = m_data_offset + m_header.number_of_layers * number_of_entries() * sizeof( double ) ;
+		if( size > m_data_offset ) {
+			m_stream.seekp( size - 1 ) ;
+			m_stream.put( 0 ) ;
+		}
+		if( !m_stream ) {
+			throw genfile::OperationFailedError( "pca::BinaryMatrixFile::BinaryMatrixFile()", filename, "Extend file to " + genfile::string_utils::to_string( size ) + " bytes." ) ;
+		}
+	}
+
+	BinaryMatrixFile::BinaryMatrixFile( std::string const& filename ):
+		m_filename( filename ),
+		m_stream( filename.c_str(), std::ios::in | std::ios::binary ),
+		m_data_offset( 0 )
+	{
+		if( !m_stream ) {
+			throw genfile::ResourceNotOpenedError( filename ) ;
+		}
+		read_header() ;
+	}
+
+	BinaryMatrixFile::~BinaryMatrixFile() {}
+
+	void BinaryMatrixFile::write_header() {
+		m_stream.seekp( 0 ) ;
+		m_stream.write( magic, magic_size ) ;
+		write_integer< uint32_t >( m_stream, m_header.layout ) ;
+		write_integer< uint32_t >( m_stream, m_header.number_of_layers ) ;
+		write_integer< uint64_t >( m_stream, m_header.number_of_rows ) ;
+		write_integer< uint64_t >( m_stream, m_header.number_of_columns ) ;
+		write_integer< uint64_t >( m_stream, m_header.number_of_snps ) ;
+		write_integer< uint32_t >( m_stream, m_header.description.size() ) ;
+		m_stream.write( m_header.description.data(), m_header.description.size() ) ;
+		m_data_offset = m_stream.tellp() ;
+	}
+
+	void BinaryMatrixFile::read_header() {
+		char buffer[ magic_size ] ;
+		m_stream.read( buffer, magic_size ) ;
+		if( !m_stream || std::memcmp( buffer, magic, magic_size ) != 0 ) {
+			throw genfile::MalformedInputError( m_filename, 0 ) ;
+		}
+		uint32_t layout = 0 ;
+		uint32_t description_size = 0 ;
+		read_integer( m_stream, &layout ) ;
+		read_integer( m_stream, &m_header.number_of_layers ) ;
+		read_integer( m_stream, &m_header.number_of_rows ) ;
+		read_integer( m_stream, &m_header.number_of_columns ) ;
+		read_integer( m_stream, &m_header.number_of_snps ) ;
+		read_integer( m_stream, &description_size ) ;
+		if( !m_stream || layout > eLowerTriangle || ( layout == eLowerTriangle && m_header.number_of_rows != m_header.number_of_columns )) {
+			throw genfile::MalformedInputError( m_filename, 0 ) ;
+		}
+		m_header.layout = Layout( layout ) ;
+		std::vector< char > description( description_size ) ;
+		if( description_size > 0 ) {
+			m_stream.read( &description[0], description_size ) ;
+		}
+		m_header.description.assign( description.begin(), description.end() ) ;
+		if( !m_stream ) {
+			throw genfile::MalformedInputError( m_filename, 0 ) ;
+		}
+		m_data_offset = m_stream.tellg() ;
+	}
+
+	uint64_t BinaryMatrixFile::number_of_entries() const {
+		if( m_header.layout == eLowerTriangle ) {
+			return m_header.number_of_rows * ( m_header.number_of_rows + 1 ) / 2 ;
+		} else {
+			return m_header.number_of_rows * m_header.number_of_columns ;
+		}
+	}
+
+	uint64_t BinaryMatrixFile::get_offset( std::size_t layer, std::size_t i, std::size_t j ) const {
+		uint64_t entry ;
+		if( m_header.layout == eLowerTriangle ) {
+			assert( j <= i ) ;
+			entry = uint64_t( i ) * ( i + 1 ) / 2 + j ;
+		} else {
+			entry = uint64_t( j ) * m_header.number_of_rows + i ;
+		}
+		return m_data_offset + ( layer * number_of_entries() + entry ) * sizeof( double ) ;
+	}
+
+	void BinaryMatrixFile::write_block( std::size_t layer, std::size_t i, std::size_t j, Eigen::MatrixXd const& block ) {
+		assert( layer < m_header.number_of_layers ) ;
+		assert( i + block.rows() <= m_header.number_of_rows ) ;
+		assert( j + block.cols() <= m_header.number_of_columns ) ;
+		boost::mutex::scoped_lock lock( m_mutex ) ;
+		if( m_header.layout == eLowerTriangle ) {
+			// Rows are contiguous on disk.
+			std::vector< double > row( block.cols() ) ;
+			for( int r = 0; r < block.rows(); ++r ) {
+				std::size_t const row_i = i + r ;
+				if( row_i < j ) {
+					continue ;
+				}
+				std::size_t const number_of_columns = std::min( std::size_t( block.cols() ), row_i - j + 1 ) ;
+				for( std::size_t c = 0; c < number_of_columns; ++c ) {
+					row[c] = block( r, c ) ;
+				}
+				m_stream.seekp( get_offset( layer, row_i, j )) ;
+				m_stream.write( reinterpret_cast< char const* >( &row[0] ), number_of_columns * sizeof( double )) ;
+			}
+		} else {
+			// Columns are contiguous on disk.
+			for( int c = 0; c < block.cols(); ++c ) {
+				m_stream.seekp( get_offset( layer, i, j + c )) ;
+				m_stream.write( reinterpret_cast< char const* >( block.col( c ).data() ), block.rows() * sizeof( double )) ;
+			}
+		}
+		if( !m_stream ) {
+			throw genfile::OperationFailedError( "pca::BinaryMatrixFile::write_block()", m_filename, "write" ) ;
+		}
+	}
+
+	void BinaryMatrixFile::read_row( std::size_t layer, std::size_t i, Eigen::VectorXd* result ) {
+		assert( layer < m_header.number_of_layers ) ;
+		assert( i < m_header.number_of_rows ) ;
+		boost::mutex::scoped_lock lock( m_mutex ) ;
+		if( m_header.layout == eLowerTriangle ) {
+			result->resize( i + 1 ) ;
+			m_stream.seekg( get_offset( layer, i, 0 )) ;
+			m_stream.read( reinterpret_cast< char* >( result->data() ), ( i + 1 ) * sizeof( double )) ;
+		} else {
+			result->resize( m_header.number_of_columns ) ;
+			for( std::size_t j = 0; j < m_header.number_of_columns; ++j ) {
+				m_stream.seekg( get_offset( layer, i, j )) ;
+				m_stream.read( reinterpret_cast< char* >( result->data() + j ), sizeof( double )) ;
+			}
+		}
+		if( !m_stream ) {
+			throw genfile::MalformedInputError( m_filename, i ) ;
+		}
+	}
+
+	void BinaryMatrixFile::read_matrix( std::size_t layer, Eigen::MatrixXd* result ) {
+		assert( layer < m_header.number_of_layers ) ;
+		result->resize( m_header.number_of_rows, m_header.number_of_columns ) ;
+		if( m_header.layout == eLowerTriangle ) {
+			Eigen::VectorXd row ;
+			for( std::size_t i = 0; i < m_header.number_of_rows; ++i ) {
+				read_row( layer, i, &row ) ;
+				result->row( i ).head( i + 1 ) = row.transpose() ;
+				result->col( i ).head( i ) = row.head( i ) ;
+			}
+		} else {
+			boost::mutex::scoped_lock lock( m_mutex ) ;
+			m_stream.seekg( get_offset( layer, 0, 0 )) ;
+			m_stream.read( reinterpret_cast< char* >( result->data() ), number_of_entries() * sizeof( double )) ;
+			if( !m_stream ) {
+				throw genfile::MalformedInputError( m_filename, 0 ) ;
+			}
+		}
+	}
+}
@@ -24,6 +24,7 @@
 #include "genfile/VariantDataReader.hpp"
 #include "genfile/SNPDataSourceProcessor.hpp"
 #include "genfile/SingleSNPGenotypeProbabilities.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
 #include "genfile/vcf/get_set_eigen.hpp"
 #include "statfile/BuiltInTypeStatSink.hpp"
 #include "statfile/BuiltInTypeStatSource.hpp"
@@ -41,6 +42,31 @@
 #define USING_BOOST_THREADPOOL 1
 
 namespace impl {
+	// Return the thresholded call for sample i at a biallelic variant, coded as
+	// 0 (AA), 1 (AB), 2 (BB), or -1 if no genotype has probability above the threshhold.
+	// Haploid samples are called as AA or BB.
+	int get_threshholded_call( genfile::GenotypeProbabilityMatrix const& data, int const i, double const threshhold ) {
+		switch( data.ploidy(i) ) {
+			case 1:
+				if( data.probabilities( i, 0 ) > threshhold ) {
+					return 0 ;
+				} else if( data.probabilities( i, 1 ) > threshhold ) {
+					return 2 ;
+				}
+				break ;
+			case 2:
+				for( int g = 0; g < 3; ++g ) {
+					if( data.probabilities( i, g ) > threshhold ) {
+						return g ;
+					}
+				}
+				break ;
+			default:
+				break ;
+		}
+		return -1 ;
+	}
+
 	#if HAVE_EIGEN
 		template< typename Vector, typename Matrix >
 		void accumulate_xxt_using_eigen(
@@ -551,10 +577,15 @@ namespace impl {
 		genotypes.setZero( m_result.rows() ) ;
 		nonmissingness.setZero( m_result.rows() ) ;
 
-		data_reader->get(
-			":genotypes:",
-			genfile::vcf::get_threshholded_calls( genotypes, nonmissingness, m_call_threshhold, 0, 0, 1, 2 )
-		) ;
+		data_reader->get_probabilities( ":genotypes:", &m_genotype_data ) ;
+		assert( m_genotype_data.probabilities.rows() == genotypes.size() ) ;
+		for( int i = 0; i < genotypes.size(); ++i ) {
+			int const call = impl::get_threshholded_call( m_genotype_data, i, m_call_threshhold ) ;
+			if( call != -1 ) {
+				genotypes(i) = call ;
+				nonmissingness(i) = 1 ;
+			}
+		}
 
 		// estimate allele frequency using data augmentation:
 		// add two haplotypes, one with each allele.
@@ -741,10 +772,11 @@ namespace impl {
 
 		// I find it simplest here to encode genotypes as
 		// 0 (missing), 1 (AA homozygote), 2 (heterozygote), 3 (BB homozygote).
-		data_reader->get(
-			":genotypes:",
-			genfile::vcf::get_threshholded_calls( m_per_snp_genotypes, m_call_threshhold, 0, 1, 2, 3 )
-		) ;
+		data_reader->get_probabilities( ":genotypes:", &m_genotype_data ) ;
+		assert( std::size_t( m_genotype_data.probabilities.rows() ) == m_per_snp_genotypes.size() ) ;
+		for( std::size_t i = 0; i < m_per_snp_genotypes.size(); ++i ) {
+			m_per_snp_genotypes[i] = get_threshholded_call( m_genotype_data, i, m_call_threshhold ) + 1 ;
+		}
 
 		// compute allele frequency
 		double allele2_count = 0.0 ;
@@ -943,6 +975,307 @@ namespace impl {
 	}
 }
 
+namespace impl {
+	namespace {
+		int popcount( uint64_t x ) {
+#if defined( __GNUC__ )
+			// This compiles to a single instruction where the target supports it.
+			return __builtin_popcountll( x ) ;
+#else
+			x = x - (( x >> 1 ) & 0x5555555555555555ull ) ;
+			x = ( x & 0x3333333333333333ull ) + (( x >> 2 ) & 0x3333333333333333ull ) ;
+			x = ( x + ( x >> 4 )) & 0x0F0F0F0F0F0F0F0Full ;
+			return int(( x * 0x0101010101010101ull ) >> 56 ) ;
+#endif
+		}
+	}
+
+	void accumulate_nonmissingness(
+		uint64_t const* row_nonmissingness,
+		uint64_t const* column_nonmissingness,
+		std::size_t const number_of_words,
+		SampleBounds const& bounds,
+		int* result,
+		std::size_t const result_stride
+	) {
+		int const tile_size = 4 ;
+		for( int j0 = bounds.begin_sample_j; j0 < bounds.end_sample_j; j0 += tile_size ) {
+			int const j1 = std::min( j0 + tile_size, bounds.end_sample_j ) ;
+			uint64_t const* b = column_nonmissingness + ( j0 - bounds.begin_sample_j ) * number_of_words ;
+			int* result_column = result + ( j0 - bounds.begin_sample_j ) * result_stride - bounds.begin_sample_i ;
+			// Start at the first tile containing entries on or below the diagonal.
+			int i0 = bounds.begin_sample_i ;
+			if( i0 < j0 ) {
+				i0 += (( j0 - i0 ) / tile_size ) * tile_size ;
+			}
+			for( ; i0 < bounds.end_sample_i; i0 += tile_size ) {
+				int const i1 = std::min( i0 + tile_size, bounds.end_sample_i ) ;
+				uint64_t const* a = row_nonmissingness + ( i0 - bounds.begin_sample_i ) * number_of_words ;
+				if( i1 - i0 == tile_size && j1 - j0 == tile_size ) {
+					int counts[4][4] = { { 0 } } ;
+					for( std::size_t w = 0; w < number_of_words; ++w ) {
+						uint64_t const a0 = a[w], a1 = a[w + number_of_words], a2 = a[w + 2*number_of_words], a3 = a[w + 3*number_of_words] ;
+						for( int jj = 0; jj < tile_size; ++jj ) {
+							uint64_t const bj = b[w + jj*number_of_words] ;
+							counts[0][jj] += popcount( a0 & bj ) ;
+							counts[1][jj] += popcount( a1 & bj ) ;
+							counts[2][jj] += popcount( a2 & bj ) ;
+							counts[3][jj] += popcount( a3 & bj ) ;
+						}
+					}
+					for( int jj = 0; jj < tile_size; ++jj ) {
+						for( int ii = std::max( 0, j0 + jj - i0 ); ii < tile_size; ++ii ) {
+							result_column[ jj * result_stride + i0 + ii ] += counts[ii][jj] ;
+						}
+					}
+				} else {
+					for( int j = j0; j < j1; ++j ) {
+						for( int i = std::max( i0, j ); i < i1; ++i ) {
+							uint64_t const* ai = a + ( i - i0 ) * number_of_words ;
+							uint64_t const* bj = b + ( j - j0 ) * number_of_words ;
+							int count = 0 ;
+							for( std::size_t w = 0; w < number_of_words; ++w ) {
+								count += popcount( ai[w] & bj[w] ) ;
+							}
+							result_column[ ( j - j0 ) * result_stride + i ] += count ;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	bool pack_genotypes(
+		genfile::GenotypeProbabilityMatrix const& data,
+		double const call_threshhold,
+		double const allele_frequency_threshhold,
+		uint64_t* packed_genotypes,
+		double* genotype_values
+	) {
+		std::size_t const number_of_samples = data.probabilities.rows() ;
+		std::size_t const number_of_words = ( number_of_samples + 31 ) / 32 ;
+		std::fill( packed_genotypes, packed_genotypes + number_of_words, 0 ) ;
+		double allele2_count = 0.0 ;
+		double nonmissing_count = 0.0 ;
+		for( std::size_t i = 0; i < number_of_samples; ++i ) {
+			int const call = get_threshholded_call( data, i, call_threshhold ) ;
+			if( call != -1 ) {
+				allele2_count += call ;
+				nonmissing_count += 1 ;
+			}
+			packed_genotypes[ i / 32 ] |= uint64_t( call + 1 ) << ( 2 * ( i % 32 )) ;
+		}
+		// Regularised estimate based on adding one of each allele, as for the other methods.
+		double const posterior_allele_frequency = (1 + allele2_count) / ( 2 + ( 2 * nonmissing_count)) ;
+		double const allele_frequency = allele2_count / ( 2 * nonmissing_count ) ;
+		if( nonmissing_count == 0 || std::min( allele_frequency, 1.0 - allele_frequency ) <= allele_frequency_threshhold ) {
+			return false ;
+		}
+		double const mean = 2.0 * allele_frequency ;
+		double const sd = std::sqrt( ( 2.0 * posterior_allele_frequency * ( 1.0 - posterior_allele_frequency )) ) ;
+		genotype_values[0] = 0.0 ;
+		for( int g = 0; g < 3; ++g ) {
+			genotype_values[g+1] = ( g - mean ) / sd ;
+		}
+		return true ;
+	}
+
+	void unpack_genotypes(
+		uint64_t const* packed_genotypes,
+		std::size_t const number_of_words_per_snp,
+		double const* genotype_values,
+		std::size_t const number_of_snps,
+		std::size_t const begin_sample,
+		std::size_t const end_sample,
+		KinshipCoefficientComputer::Computation::Matrix* genotypes,
+		std::vector< uint64_t >* nonmissingness
+	) {
+		assert( genotypes->rows() == int( end_sample - begin_sample ) && genotypes->cols() % 64 == 0 ) ;
+		assert( std::size_t( genotypes->cols() ) >= number_of_snps ) ;
+		std::size_t const number_of_words_per_sample = genotypes->cols() / 64 ;
+		// Unused columns of a final partial batch are zero and have no nonmissingness bits.
+		genotypes->rightCols( genotypes->cols() - number_of_snps ).setZero() ;
+		nonmissingness->assign( genotypes->rows() * number_of_words_per_sample, 0 ) ;
+		for( std::size_t snp_i = 0; snp_i < number_of_snps; ++snp_i ) {
+			uint64_t const* packed = packed_genotypes + snp_i * number_of_words_per_snp ;
+			double const* values = genotype_values + 4 * snp_i ;
+			double* column = genotypes->col( snp_i ).data() ;
+			uint64_t const bit = uint64_t( 1 ) << ( snp_i % 64 ) ;
+			uint64_t* nonmissingness_word = &(*nonmissingness)[ snp_i / 64 ] ;
+			for( std::size_t i = begin_sample; i < end_sample; ++i ) {
+				int const code = int( packed[ i / 32 ] >> ( 2 * ( i % 32 ))) & 0x3 ;
+				column[ i - begin_sample ] = values[ code ] ;
+				if( code != 0 ) {
+					nonmissingness_word[ ( i - begin_sample ) * number_of_words_per_sample ] |= bit ;
+				}
+			}
+		}
+	}
+
+	NormaliseGenotypesAndComputeXXtPacked::UniquePtr NormaliseGenotypesAndComputeXXtPacked::create(
+		worker::Worker* worker,
+		std::size_t const number_of_snps_per_batch
+	) {
+		return NormaliseGenotypesAndComputeXXtPacked::UniquePtr( new NormaliseGenotypesAndComputeXXtPacked( worker, number_of_snps_per_batch ) ) ;
+	}
+
+	NormaliseGenotypesAndComputeXXtPacked::NormaliseGenotypesAndComputeXXtPacked(
+		worker::Worker* worker,
+		std::size_t const number_of_snps_per_batch
+	):
+		m_worker( worker ),
+		m_dispatcher( new NTaskDispatcher( worker ) ),
+		m_call_threshhold( 0.9 ),
+		m_allele_frequency_threshhold( 0.001 ),
+		// Nonmissingness bits are stored a word at a time, so the batch size is a multiple of 64.
+		m_number_of_snps_per_batch( std::max( std::size_t( 64 ), 64 * (( number_of_snps_per_batch + 63 ) / 64 ) ) ),
+		m_number_of_samples( 0 ),
+		m_number_of_words_per_snp( 0 ),
+		m_number_of_snps_in_batch( 0 ),
+		m_snp_count( 0 )
+	{
+		m_genotype_values.resize( 4 * m_number_of_snps_per_batch, 0.0 ) ;
+		m_batch.number_of_words_per_sample = m_number_of_snps_per_batch / 64 ;
+	}
+
+	NormaliseGenotypesAndComputeXXtPacked::Matrix const& NormaliseGenotypesAndComputeXXtPacked::result() const {
+		return m_result ;
+	}
+
+	NormaliseGenotypesAndComputeXXtPacked::IntegerMatrix const& NormaliseGenotypesAndComputeXXtPacked::nonmissingness() const {
+		return m_nonmissingness ;
+	}
+
+	std::size_t NormaliseGenotypesAndComputeXXtPacked::number_of_snps_included() const {
+		return m_snp_count ;
+	}
+
+	std::string NormaliseGenotypesAndComputeXXtPacked::get_summary() const {
+		return (
+			boost::format(
+				"NormaliseGenotypesAndComputeXXtPacked():\n"
+				" - %d SNPs per batch\n"
+				" - %d tiles\n"
+				" - minimum allele frequency: %.3f"
+			)
+				% m_number_of_snps_per_batch
+				% m_matrix_tiling.size()
+				% m_allele_frequency_threshhold
+		).str()
+		;
+	}
+
+	void NormaliseGenotypesAndComputeXXtPacked::begin_processing_snps(
+		std::size_t number_of_samples,
+		genfile::SNPDataSource::Metadata const&
+	) {
+		m_number_of_samples = number_of_samples ;
+		m_result.setZero( number_of_samples, number_of_samples ) ;
+		m_nonmissingness.setZero( number_of_samples, number_of_samples ) ;
+		std::vector< SampleBounds > const tiling = get_matrix_lower_diagonal_tiling(
+			number_of_samples,
+			std::max( std::size_t( 1 ), m_worker->get_number_of_worker_threads() )
+		) ;
+		// Tiles lying wholly above the diagonal have nothing to do.
+		m_matrix_tiling.clear() ;
+		for( std::size_t i = 0; i < tiling.size(); ++i ) {
+			if( tiling[i].begin_sample_i >= tiling[i].begin_sample_j ) {
+				m_matrix_tiling.push_back( tiling[i] ) ;
+			}
+		}
+		m_dispatcher->set_number_of_tasks( m_matrix_tiling.size() ) ;
+		m_number_of_words_per_snp = ( number_of_samples + 31 ) / 32 ;
+		m_packed_genotypes.assign( m_number_of_words_per_snp * m_number_of_snps_per_batch, 0 ) ;
+		m_batch.genotypes.setZero( number_of_samples, m_number_of_snps_per_batch ) ;
+		m_batch.nonmissingness.assign( number_of_samples * m_batch.number_of_words_per_sample, 0 ) ;
+		m_number_of_snps_in_batch = 0 ;
+		m_snp_count = 0 ;
+	}
+
+	void NormaliseGenotypesAndComputeXXtPacked::processed_snp(
+		genfile::VariantIdentifyingData const& id_data,
+		genfile::VariantDataReader::SharedPtr data_reader
+	) {
+		data_reader->get_probabilities( ":genotypes:", &m_genotype_data ) ;
+		assert( std::size_t( m_genotype_data.probabilities.rows() ) == m_number_of_samples ) ;
+		std::size_t const snp_i = m_number_of_snps_in_batch ;
+		bool const included = pack_genotypes(
+			m_genotype_data,
+			m_call_threshhold,
+			m_allele_frequency_threshhold,
+			&m_packed_genotypes[ snp_i * m_number_of_words_per_snp ],
+			&m_genotype_values[ 4 * snp_i ]
+		) ;
+		if( !included ) {
+			return ;
+		}
+
+		++m_snp_count ;
+		if( ++m_number_of_snps_in_batch == m_number_of_snps_per_batch ) {
+			submit_tasks() ;
+		}
+	}
+
+	void NormaliseGenotypesAndComputeXXtPacked::end_processing_snps() {
+		if( m_number_of_snps_in_batch > 0 ) {
+			submit_tasks() ;
+		}
+		m_dispatcher->wait_until_complete() ;
+		m_result.array() /= m_nonmissingness.array().cast< double >() ;
+	}
+
+	void NormaliseGenotypesAndComputeXXtPacked::submit_tasks() {
+		// The previous batch must be finished before we overwrite it.
+		m_dispatcher->wait_until_complete() ;
+		unpack_batch() ;
+		for( std::size_t tile_i = 0; tile_i < m_matrix_tiling.size(); ++tile_i ) {
+			m_dispatcher->submit_task(
+				tile_i,
+				boost::bind(
+					&NormaliseGenotypesAndComputeXXtPacked::compute_block,
+					this,
+					boost::cref( m_matrix_tiling[ tile_i ] )
+				)
+			) ;
+		}
+		m_number_of_snps_in_batch = 0 ;
+	}
+
+	void NormaliseGenotypesAndComputeXXtPacked::unpack_batch() {
+		unpack_genotypes(
+			&m_packed_genotypes[0], m_number_of_words_per_snp,
+			&m_genotype_values[0], m_number_of_snps_in_batch,
+			0, m_number_of_samples,
+			&m_batch.genotypes,
+			&m_batch.nonmissingness
+		) ;
+	}
+
+	void NormaliseGenotypesAndComputeXXtPacked::compute_block( SampleBounds const& bounds ) {
+		int const rows = bounds.end_sample_i - bounds.begin_sample_i ;
+		int const cols = bounds.end_sample_j - bounds.begin_sample_j ;
+		if( rows > 0 && cols > 0 ) {
+			if( bounds.begin_sample_i == bounds.begin_sample_j && bounds.end_sample_i == bounds.end_sample_j ) {
+				m_result.block( bounds.begin_sample_i, bounds.begin_sample_j, rows, cols )
+					.selfadjointView< Eigen::Lower >()
+					.rankUpdate( m_batch.genotypes.middleRows( bounds.begin_sample_i, rows ), 1.0 ) ;
+			} else {
+				m_result.block( bounds.begin_sample_i, bounds.begin_sample_j, rows, cols ).noalias()
+					+= m_batch.genotypes.middleRows( bounds.begin_sample_i, rows )
+					* m_batch.genotypes.middleRows( bounds.begin_sample_j, cols ).transpose() ;
+			}
+			accumulate_nonmissingness(
+				&m_batch.nonmissingness[ bounds.begin_sample_i * m_batch.number_of_words_per_sample ],
+				&m_batch.nonmissingness[ bounds.begin_sample_j * m_batch.number_of_words_per_sample ],
+				m_batch.number_of_words_per_sample,
+				bounds,
+				&m_nonmissingness( bounds.begin_sample_i, bounds.begin_sample_j ),
+				m_nonmissingness.outerStride()
+			) ;
+		}
+	}
+}
+
 KinshipCoefficientComputer::KinshipCoefficientComputer(
 	appcontext::OptionProcessor const& options,
 	genfile::CohortIndividualSource const& samples,
@@ -0,0 +1,250 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "Eigen/Core"
+#include "genfile/Error.hpp"
+#include "genfile/string_utils/string_utils.hpp"
+#include "components/RelatednessComponent/KinshipCoefficientComputer.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
+#include "components/RelatednessComponent/OutOfCoreKinshipComputer.hpp"
+
+OutOfCoreKinshipComputer::OutOfCoreKinshipComputer(
+	worker::Worker* worker,
+	appcontext::UIContext& ui_context,
+	std::string const& filename,
+	std::size_t const memory_budget_in_bytes
+):
+	m_worker( worker ),
+	m_ui_context( ui_context ),
+	m_filename( filename ),
+	m_genotype_filename( filename + ".genotypes.tmp" ),
+	m_memory_budget( memory_budget_in_bytes ),
+	m_call_threshhold( 0.9 ),
+	m_allele_frequency_threshhold( 0.001 ),
+	m_number_of_snps_per_batch( 128 ),
+	m_number_of_samples( 0 ),
+	m_number_of_words_per_snp( 0 ),
+	m_number_of_snps( 0 )
+{}
+
+OutOfCoreKinshipComputer::~OutOfCoreKinshipComputer() throw() {
+	if( m_genotype_file.get() ) {
+		m_genotype_file.reset() ;
+		std::remove( m_genotype_filename.c_str() ) ;
+	}
+}
+
+void OutOfCoreKinshipComputer::send_results_to( ResultsCallback callback ) {
+	m_result_signal.connect( callback ) ;
+}
+
+std::string OutOfCoreKinshipComputer::get_summary() const {
+	return (
+		boost::format(
+			"OutOfCoreKinshipComputer():\n"
+			" - result file: \"%s\"\n"
+			" - memory budget: %dMb\n"
+			" - %d SNPs per batch\n"
+			" - minimum allele frequency: %.3f"
+		)
+			% m_filename
+			% ( m_memory_budget / ( 1024 * 1024 ))
+			% m_number_of_snps_per_batch
+			% m_allele_frequency_threshhold
+	).str()
+	;
+}
+
+void OutOfCoreKinshipComputer::begin_processing_snps( std::size_t number_of_samples, genfile::SNPDataSource::Metadata const& ) {
+	m_number_of_samples = number_of_samples ;
+	m_number_of_words_per_snp = ( number_of_samples + 31 ) / 32 ;
+	m_number_of_snps = 0 ;
+	m_packed_genotypes.resize( m_number_of_words_per_snp ) ;
+	m_genotype_values.clear() ;
+	// Make sure we have enough memory for at least one tile.
+	choose_number_of_blocks( 1 ) ;
+	m_genotype_file.reset(
+		new std::ofstream( m_genotype_filename.c_str(), std::ios::binary | std::ios::trunc )
+	) ;
+	if( !*m_genotype_file ) {
+		throw genfile::ResourceNotOpenedError( m_genotype_filename ) ;
+	}
+}
+
+void OutOfCoreKinshipComputer::processed_snp( genfile::VariantIdentifyingData const& id_data, genfile::VariantDataReader::SharedPtr data_reader ) {
+	data_reader->get_probabilities( ":genotypes:", &m_genotype_data ) ;
+	assert( std::size_t( m_genotype_data.probabilities.rows() ) == m_number_of_samples ) ;
+	double values[4] ;
+	bool const included = impl::pack_genotypes(
+		m_genotype_data,
+		m_call_threshhold,
+		m_allele_frequency_threshhold,
+		&m_packed_genotypes[0],
+		values
+	) ;
+	if( included ) {
+		m_genotype_file->write(
+			reinterpret_cast< char const* >( &m_packed_genotypes[0] ),
+			m_packed_genotypes.size() * sizeof( uint64_t )
+		) ;
+		if( !*m_genotype_file ) {
+			throw genfile::OperationFailedError( "OutOfCoreKinshipComputer::processed_snp()", m_genotype_filename, "write" ) ;
+		}
+		m_genotype_values.insert( m_genotype_values.end(), values, values + 4 ) ;
+		++m_number_of_snps ;
+	}
+}
+
+void OutOfCoreKinshipComputer::end_processing_snps() {
+	m_genotype_file->close() ;
+
+	std::string const description = "Number of SNPs: "
+		+ genfile::string_utils::to_string( m_number_of_snps )
+		+ "\nNumber of samples: "
+		+ genfile::string_utils::to_string( m_number_of_samples )
+	;
+	pca::BinaryMatrixFile::Header header ;
+	header.layout = pca::BinaryMatrixFile::eLowerTriangle ;
+	header.number_of_layers = 2 ;
+	header.number_of_rows = header.number_of_columns = m_number_of_samples ;
+	header.number_of_snps = m_number_of_snps ;
+	header.description = "layers: pairwise.complete.obs, value\n" + description ;
+	pca::BinaryMatrixFile::UniquePtr result = pca::BinaryMatrixFile::create( m_filename, header ) ;
+	compute_tiles( *result ) ;
+
+	m_genotype_file.reset() ;
+	std::remove( m_genotype_filename.c_str() ) ;
+
+	m_result_signal( *result, "OutOfCoreKinshipComputer", description ) ;
+}
+
+std::size_t OutOfCoreKinshipComputer::get_tile_memory_usage( std::size_t const tile_size ) const {
+	// Values and counts for the tile, plus unpacked genotypes and nonmissingness
+	// for a batch of SNPs for its rows and columns.
+	return tile_size * tile_size * ( sizeof( double ) + sizeof( int ) )
+		+ 2 * tile_size * m_number_of_snps_per_batch * sizeof( double )
+		+ 2 * tile_size * ( m_number_of_snps_per_batch / 8 ) ;
+}
+
+std::size_t OutOfCoreKinshipComputer::choose_number_of_blocks( std::size_t const number_of_concurrent_tiles ) const {
+	std::size_t const N = std::max( m_number_of_samples, std::size_t( 1 ) ) ;
+	for( std::size_t number_of_blocks = 1; number_of_blocks <= N; ++number_of_blocks ) {
+		std::size_t const tile_size = ( N + number_of_blocks - 1 ) / number_of_blocks ;
+		if( number_of_concurrent_tiles * get_tile_memory_usage( tile_size ) <= m_memory_budget ) {
+			return number_of_blocks ;
+		}
+	}
+	throw genfile::BadArgumentError(
+		"OutOfCoreKinshipComputer::choose_number_of_blocks()",
+		"memory budget=" + genfile::string_utils::to_string( m_memory_budget ),
+		"The memory budget is too small to compute even the smallest tile."
+	) ;
+}
+
+void OutOfCoreKinshipComputer::compute_tiles( pca::BinaryMatrixFile& result ) {
+	if( m_number_of_samples == 0 ) {
+		return ;
+	}
+
+	std::auto_ptr< boost::iostreams::mapped_file_source > genotype_file ;
+	uint64_t const* packed_genotypes = 0 ;
+	if( m_number_of_snps > 0 ) {
+		genotype_file.reset( new boost::iostreams::mapped_file_source( m_genotype_filename )) ;
+		packed_genotypes = reinterpret_cast< uint64_t const* >( genotype_file->data() ) ;
+	}
+
+	// Run one tile per thread, but use fewer threads if that lets tiles be bigger
+	// than the smallest useful size.
+	std::size_t number_of_concurrent_tiles = std::max( m_worker->get_number_of_worker_threads(), std::size_t( 1 ) ) ;
+	while( number_of_concurrent_tiles > 1 && get_tile_memory_usage( 64 ) * number_of_concurrent_tiles > m_memory_budget ) {
+		--number_of_concurrent_tiles ;
+	}
+	std::size_t const number_of_blocks = choose_number_of_blocks( number_of_concurrent_tiles ) ;
+	std::vector< impl::SampleBounds > tiling ;
+	{
+		std::vector< impl::SampleBounds > const all_tiles = impl::get_matrix_lower_diagonal_tiling( m_number_of_samples, number_of_blocks ) ;
+		for( std::size_t i = 0; i < all_tiles.size(); ++i ) {
+			if( all_tiles[i].begin_sample_i >= all_tiles[i].begin_sample_j ) {
+				tiling.push_back( all_tiles[i] ) ;
+			}
+		}
+	}
+	m_ui_context.logger()
+		<< "OutOfCoreKinshipComputer::compute_tiles(): computing "
+		<< tiling.size() << " tiles, "
+		<< number_of_concurrent_tiles << " at a time.\n" ;
+
+	std::vector< Tile > tiles( std::min( number_of_concurrent_tiles, tiling.size() ) ) ;
+	impl::NTaskDispatcher dispatcher( m_worker ) ;
+	dispatcher.set_number_of_tasks( tiles.size() ) ;
+	for( std::size_t tile_i = 0; tile_i < tiling.size(); tile_i += tiles.size() ) {
+		std::size_t const number_of_tiles = std::min( tiles.size(), tiling.size() - tile_i ) ;
+		for( std::size_t k = 0; k < number_of_tiles; ++k ) {
+			tiles[k].bounds = tiling[ tile_i + k ] ;
+			dispatcher.submit_task(
+				k,
+				boost::bind( &OutOfCoreKinshipComputer::compute_tile, this, packed_genotypes, &tiles[k] )
+			) ;
+		}
+		dispatcher.wait_until_complete() ;
+		for( std::size_t k = 0; k < number_of_tiles; ++k ) {
+			Tile const& tile = tiles[k] ;
+			result.write_block( 0, tile.bounds.begin_sample_i, tile.bounds.begin_sample_j, tile.counts.cast< double >() ) ;
+			result.write_block( 1, tile.bounds.begin_sample_i, tile.bounds.begin_sample_j, tile.values ) ;
+		}
+	}
+}
+
+void OutOfCoreKinshipComputer::compute_tile( uint64_t const* packed_genotypes, Tile* tile ) const {
+	impl::SampleBounds const& bounds = tile->bounds ;
+	int const rows = bounds.end_sample_i - bounds.begin_sample_i ;
+	int const cols = bounds.end_sample_j - bounds.begin_sample_j ;
+	bool const diagonal = ( bounds.begin_sample_i == bounds.begin_sample_j && bounds.end_sample_i == bounds.end_sample_j ) ;
+	std::size_t const number_of_words_per_sample = m_number_of_snps_per_batch / 64 ;
+	tile->values.setZero( rows, cols ) ;
+	tile->counts.setZero( rows, cols ) ;
+	tile->row_genotypes.resize( rows, m_number_of_snps_per_batch ) ;
+	tile->column_genotypes.resize( cols, m_number_of_snps_per_batch ) ;
+
+	for( std::size_t snp_i = 0; snp_i < m_number_of_snps; snp_i += m_number_of_snps_per_batch ) {
+		std::size_t const number_of_snps = std::min( m_number_of_snps_per_batch, m_number_of_snps - snp_i ) ;
+		impl::unpack_genotypes(
+			packed_genotypes + snp_i * m_number_of_words_per_snp, m_number_of_words_per_snp,
+			&m_genotype_values[ 4 * snp_i ], number_of_snps,
+			bounds.begin_sample_i, bounds.end_sample_i,
+			&tile->row_genotypes, &tile->row_nonmissingness
+		) ;
+		if( diagonal ) {
+			tile->values.selfadjointView< Eigen::Lower >().rankUpdate( tile->row_genotypes, 1.0 ) ;
+		} else {
+			impl::unpack_genotypes(
+				packed_genotypes + snp_i * m_number_of_words_per_snp, m_number_of_words_per_snp,
+				&m_genotype_values[ 4 * snp_i ], number_of_snps,
+				bounds.begin_sample_j, bounds.end_sample_j,
+				&tile->column_genotypes, &tile->column_nonmissingness
+			) ;
+			tile->values.noalias() += tile->row_genotypes * tile->column_genotypes.transpose() ;
+		}
+		std::vector< uint64_t > const& column_nonmissingness = diagonal ? tile->row_nonmissingness : tile->column_nonmissingness ;
+		impl::accumulate_nonmissingness(
+			&tile->row_nonmissingness[0],
+			&column_nonmissingness[0],
+			number_of_words_per_sample,
+			bounds,
+			tile->counts.data(),
+			tile->counts.outerStride()
+		) ;
+	}
+	tile->values.array() /= tile->counts.array().cast< double >() ;
+}
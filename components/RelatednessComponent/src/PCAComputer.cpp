@@ -22,17 +22,21 @@
 #include "components/SampleSummaryComponent/SampleStorage.hpp"
 #include "components/RelatednessComponent/PCAComputer.hpp"
 #include "components/RelatednessComponent/LapackEigenDecomposition.hpp"
+#include "components/RelatednessComponent/RandomisedEigenDecomposition.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
 #include "components/RelatednessComponent/names.hpp"
 #include "components/RelatednessComponent/write_matrix_to_stream.hpp"
 
 PCAComputer::PCAComputer(
 	appcontext::OptionProcessor const& options,
 	genfile::CohortIndividualSource const& samples,
+	worker::Worker* worker,
 	appcontext::UIContext& ui_context
 ):
 	m_options( options ),
 	m_ui_context( ui_context ),
 	m_samples( samples ),
+	m_worker( worker ),
 	m_number_of_samples( samples.get_number_of_individuals() ),
 	m_number_of_PCs_to_compute( std::min( m_options.get< std::size_t >( "-PCs" ), samples.get_number_of_individuals() ) ),
 	m_threshhold( 0.9 )
@@ -119,6 +123,27 @@ void PCAComputer::load_long_form_matrix(
 	std::size_t* number_of_snps,
 	appcontext::UIContext& ui_context
 ) {
+	if( pca::BinaryMatrixFile::is_binary_matrix_file( filename )) {
+		// A matrix written by OutOfCoreKinshipComputer, with samples in sample file order.
+		pca::BinaryMatrixFile::UniquePtr file = pca::BinaryMatrixFile::open( filename ) ;
+		pca::BinaryMatrixFile::Header const& header = file->header() ;
+		if( header.layout != pca::BinaryMatrixFile::eLowerTriangle || header.number_of_layers < 2 ) {
+			throw genfile::MalformedInputError( filename, 0 ) ;
+		}
+		if( header.number_of_rows != samples.get_number_of_individuals() ) {
+			throw genfile::MismatchError(
+				"PCAComputer::load_long_form_matrix()",
+				filename,
+				"number of samples: " + genfile::string_utils::to_string( header.number_of_rows ),
+				"expected number: " + genfile::string_utils::to_string( samples.get_number_of_individuals() )
+			) ;
+		}
+		file->read_matrix( 1, matrix ) ;
+		*number_of_snps = header.number_of_snps ;
+		ui_context.logger() << "PCAComputer::load_long_form_matrix(): loaded binary matrix \"" << filename << "\" computed from " << *number_of_snps << " SNPs.\n" ;
+		return ;
+	}
+
 	statfile::BuiltInTypeStatSource::UniquePtr source = statfile::BuiltInTypeStatSource::open( filename ) ;
 	std::size_t number_of_samples = 0 ;
 	load_matrix_metadata( samples, *source, &number_of_samples, number_of_snps, ui_context ) ;
@@ -228,9 +253,17 @@ genfile::VariantEntry PCAComputer::get_pca_name( std::size_t i ) {
 }
 
 void PCAComputer::compute_PCA() {
-	Eigen::MatrixXd kinship_eigendecomposition( m_number_of_samples, m_number_of_samples + 1 ) ;
+	bool const randomised = ( m_options.get< std::string >( "-PCA-method" ) == "randomised" ) ;
+	// A randomised decomposition has fewer columns, so don't allocate the full matrix up front.
+	Eigen::MatrixXd kinship_eigendecomposition( m_number_of_samples, randomised ? 0 : m_number_of_samples + 1 ) ;
+	if( randomised ) {
+		m_ui_context.logger() << "========================================================================\n" ;
+		compute_randomised_eigendecomposition( &kinship_eigendecomposition ) ;
+	}
 #if HAVE_LAPACK
-	if( m_options.check( "-use-eigen" ))
+	else if( m_options.check( "-use-eigen" ))
+#else
+	else
 #endif
 	{
 		m_ui_context.logger() << "========================================================================\n" ;
@@ -260,8 +293,8 @@ void PCAComputer::compute_PCA() {
 	}
 #endif
 
-	// Verify the decomposition.
-	{
+	// Verify the decomposition, if it is complete.
+	if( std::size_t( kinship_eigendecomposition.cols() ) == m_number_of_samples + 1 ) {
 		std::size_t size = std::min( std::size_t(10), m_number_of_samples ) ;
 		m_ui_context.logger() << "Top-left of U U^t is:\n" ;
 		{
@@ -374,6 +407,29 @@ void PCAComputer::compute_PCA() {
 	m_ui_context.logger() << "========================================================================\n" ;
 }
 
+// Compute only the leading eigenvectors needed for the PCs.
+// The result has one column of eigenvalues followed by one column per eigenvector;
+// eigenvalues that were not computed are reported as missing.
+void PCAComputer::compute_randomised_eigendecomposition( Eigen::MatrixXd* kinship_eigendecomposition ) {
+	std::size_t const number_of_components = std::min( m_number_of_PCs_to_compute, m_number_of_samples ) ;
+	m_ui_context.logger() << "PCAComputer: Computing top " << number_of_components << " eigenvectors of " << m_number_of_samples << "x" << m_number_of_samples << " kinship matrix using randomised block Krylov method...\n" ;
+	Eigen::VectorXd eigenvalues ;
+	Eigen::MatrixXd eigenvectors ;
+	pca::compute_randomised_partial_eigendecomposition(
+		m_worker,
+		m_kinship_matrix,
+		&eigenvalues,
+		&eigenvectors,
+		number_of_components,
+		m_options.get< int >( "-PCA-iterations" )
+	) ;
+	kinship_eigendecomposition->resize( m_number_of_samples, number_of_components + 1 ) ;
+	kinship_eigendecomposition->col( 0 ).setConstant( std::numeric_limits< double >::quiet_NaN() ) ;
+	kinship_eigendecomposition->col( 0 ).head( number_of_components ) = eigenvalues ;
+	kinship_eigendecomposition->rightCols( number_of_components ) = eigenvectors ;
+	m_ui_context.logger() << "PCAComputer: Done, leading eigenvalues are: " << eigenvalues.head( std::min( number_of_components, std::size_t( 10 ))).transpose() << ".\n" ;
+}
+
 void PCAComputer::send_UDUT_to( UDUTCallback callback ) {
 	m_UDUT_signal.connect( callback ) ;
 }
@@ -72,8 +72,9 @@ PCALoadingComputer::PCALoadingComputer( int number_of_loadings ):
 {}
 
 void PCALoadingComputer::set_UDUT( std::size_t number_of_snps, Matrix const& udut ) {
-	assert( udut.cols() == udut.rows() + 1 ) ;
-	int n = std::min( int( m_number_of_loadings ), int( udut.rows() ) ) ;
+	// A randomised decomposition may hold only the leading eigenvectors.
+	assert( udut.cols() > 1 && udut.cols() <= udut.rows() + 1 ) ;
+	int n = std::min( int( m_number_of_loadings ), int( udut.cols() - 1 ) ) ;
 	m_D = udut.block( 0, 0, n, 1 ) ;
 	m_sqrt_D_inverse = 1 / m_D.array().sqrt() ;
 	m_U = udut.block( 0, 1, udut.rows(), n ) ;
@@ -0,0 +1,132 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <algorithm>
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <Eigen/Core>
+#include <Eigen/QR>
+#include <Eigen/Eigenvalues>
+#include "worker/Worker.hpp"
+#include "components/RelatednessComponent/KinshipCoefficientComputer.hpp"
+#include "components/RelatednessComponent/RandomisedEigenDecomposition.hpp"
+
+namespace pca {
+	namespace {
+		// Compute rows [begin, end) of A M, where A is symmetric and only its lower triangle is used.
+		void multiply_rows(
+			Eigen::MatrixXd const* A,
+			Eigen::MatrixXd const* M,
+			Eigen::MatrixXd* result,
+			int const begin,
+			int const end
+		) {
+			int const N = A->rows() ;
+			int const n = end - begin ;
+			Eigen::Block< Eigen::MatrixXd > rows = result->middleRows( begin, n ) ;
+			rows.noalias() = A->block( begin, begin, n, n ).selfadjointView< Eigen::Lower >() * M->middleRows( begin, n ) ;
+			if( begin > 0 ) {
+				rows.noalias() += A->block( begin, 0, n, begin ) * M->topRows( begin ) ;
+			}
+			if( end < N ) {
+				rows.noalias() += A->block( end, begin, N - end, n ).transpose() * M->bottomRows( N - end ) ;
+			}
+		}
+
+		void multiply(
+			impl::NTaskDispatcher* dispatcher,
+			Eigen::MatrixXd const& A,
+			Eigen::MatrixXd const& M,
+			Eigen::MatrixXd* result
+		) {
+			int const N = A.rows() ;
+			result->resize( N, M.cols() ) ;
+			if( !dispatcher ) {
+				multiply_rows( &A, &M, result, 0, N ) ;
+				return ;
+			}
+			int const number_of_tasks = dispatcher->number_of_tasks() ;
+			int const chunk_size = ( N + number_of_tasks - 1 ) / number_of_tasks ;
+			for( int task_i = 0; task_i < number_of_tasks; ++task_i ) {
+				int const begin = std::min( N, task_i * chunk_size ) ;
+				int const end = std::min( N, begin + chunk_size ) ;
+				if( end > begin ) {
+					dispatcher->submit_task( task_i, boost::bind( &multiply_rows, &A, &M, result, begin, end )) ;
+				}
+			}
+			dispatcher->wait_until_complete() ;
+		}
+
+		// Replace the columns of Y by an orthonormal basis for their span.
+		void orthonormalise( Eigen::MatrixXd* Y ) {
+			Eigen::HouseholderQR< Eigen::MatrixXd > qr( *Y ) ;
+			*Y = qr.householderQ() * Eigen::MatrixXd::Identity( Y->rows(), Y->cols() ) ;
+		}
+	}
+
+	void compute_randomised_partial_eigendecomposition(
+		worker::Worker* worker,
+		Eigen::MatrixXd const& matrix,
+		Eigen::VectorXd* eigenvalues,
+		Eigen::MatrixXd* eigenvectors,
+		int number_of_eigenvalues,
+		int number_of_iterations,
+		int oversampling,
+		unsigned int seed
+	) {
+		assert( matrix.rows() == matrix.cols() ) ;
+		assert( eigenvalues ) ;
+		assert( eigenvectors ) ;
+		int const N = matrix.rows() ;
+		number_of_eigenvalues = std::min( number_of_eigenvalues, N ) ;
+		int const block_size = std::min( N, number_of_eigenvalues + oversampling ) ;
+		int const subspace_size = block_size * ( number_of_iterations + 1 ) ;
+
+		if( subspace_size >= N ) {
+			// The Krylov subspace would be the whole space, so decompose the matrix directly.
+			Eigen::SelfAdjointEigenSolver< Eigen::MatrixXd > solver( matrix ) ;
+			*eigenvalues = solver.eigenvalues().tail( number_of_eigenvalues ).reverse() ;
+			*eigenvectors = solver.eigenvectors().rightCols( number_of_eigenvalues ).rowwise().reverse() ;
+			return ;
+		}
+
+		impl::NTaskDispatcher::UniquePtr dispatcher ;
+		if( worker ) {
+			dispatcher.reset( new impl::NTaskDispatcher( worker )) ;
+			dispatcher->set_number_of_tasks( std::max( worker->get_number_of_worker_threads(), std::size_t( 1 ) )) ;
+		}
+
+		boost::mt19937 rng( seed ) ;
+		boost::variate_generator< boost::mt19937&, boost::normal_distribution<> > normal( rng, boost::normal_distribution<>() ) ;
+		Eigen::MatrixXd block( N, block_size ) ;
+		for( int j = 0; j < block_size; ++j ) {
+			for( int i = 0; i < N; ++i ) {
+				block( i, j ) = normal() ;
+			}
+		}
+
+		// Build the block Krylov subspace [ A G, A^2 G, ... ].  Each block is orthonormalised
+		// before the next multiplication so that the leading eigenvectors do not swamp the rest.
+		Eigen::MatrixXd basis( N, subspace_size ) ;
+		Eigen::MatrixXd product ;
+		for( int i = 0; i <= number_of_iterations; ++i ) {
+			multiply( dispatcher.get(), matrix, block, &product ) ;
+			orthonormalise( &product ) ;
+			basis.middleCols( i * block_size, block_size ) = product ;
+			block.swap( product ) ;
+		}
+		orthonormalise( &basis ) ;
+
+		// Decompose Q^t A Q within the subspace and map the eigenvectors back.
+		multiply( dispatcher.get(), matrix, basis, &product ) ;
+		Eigen::MatrixXd const projected = basis.transpose() * product ;
+		Eigen::SelfAdjointEigenSolver< Eigen::MatrixXd > solver( projected ) ;
+		*eigenvalues = solver.eigenvalues().tail( number_of_eigenvalues ).reverse() ;
+		*eigenvectors = basis * solver.eigenvectors().rightCols( number_of_eigenvalues ).rowwise().reverse() ;
+	}
+}
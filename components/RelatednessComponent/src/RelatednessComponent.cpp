@@ -4,6 +4,7 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
+#include <cstdio>
 #include <boost/function.hpp>
 #include "config/config.hpp"
 #include "genfile/VariantIdentifyingData.hpp"
@@ -19,6 +20,8 @@
 #include "components/RelatednessComponent/RelatednessComponent.hpp"
 #include "components/RelatednessComponent/PCAComputer.hpp"
 #include "components/RelatednessComponent/KinshipCoefficientComputer.hpp"
+#include "components/RelatednessComponent/OutOfCoreKinshipComputer.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
 #include "components/RelatednessComponent/PCALoadingComputer.hpp"
 #include "components/RelatednessComponent/UDUTDecompositionLoader.hpp"
 #include "components/RelatednessComponent/PCALoadingLoader.hpp"
@@ -48,6 +51,21 @@ void RelatednessComponent::declare_options( appcontext::OptionProcessor& options
 		)
 		.set_takes_single_value()
 		.set_default_value( 20 ) ;
+	options[ "-PCA-method" ]
+		.set_description( "Method to use to compute principal components from the kinship matrix.  "
+			"The default, \"full\", computes the full eigendecomposition of the matrix.  "
+			"\"randomised\" computes only the eigenvectors needed for the PCs, using a randomised block Krylov method "
+			"whose matrix products run on the worker threads.  This is much faster for large numbers of samples; "
+			"the UDUT file then contains only those eigenvectors."
+		)
+		.set_takes_single_value()
+		.set_default_value( "full" ) ;
+	options[ "-PCA-iterations" ]
+		.set_description( "Number of block Krylov iterations to use with -PCA-method randomised.  "
+			"More iterations give more accurate eigenvectors at the cost of more matrix products."
+		)
+		.set_takes_single_value()
+		.set_default_value( 4 ) ;
 	options[ "-loadings" ]
 		.set_description( "Compute SNP loadings for each principal component, and store them in the specified file." )
 		.set_takes_single_value() ;
@@ -60,18 +78,31 @@ void RelatednessComponent::declare_options( appcontext::OptionProcessor& options
 		.set_description( "Method to use for relatedness matrix computation."
 			"The default is \"lookup-table\", which uses a lookup table to compute kinship values across"
 			" several SNPs at a time.  This is usually fastest.  Alternatives are \"cblas\""
-			" or \"eigen\", which use those linear algebra libraries to compute the matrix."
+			" or \"eigen\", which use those linear algebra libraries to compute the matrix, and \"packed\", which"
+			" stores genotypes in two bits per sample and computes batches of SNPs at once using matrix products and"
+			" popcounts.  \"packed\" is much faster for large numbers of samples."
 		)
 		.set_takes_single_value()
 		.set_default_value( "lookup-table" )
 	;
+	options[ "-kinship-memory-budget" ]
+		.set_description( "Compute the kinship matrix out of core, using at most approximately the given number of megabytes"
+			" of working memory.  Genotypes are packed into a temporary file alongside the output, and the matrix is computed"
+			" a tile at a time.  If the -kinship filename ends in \".bin\", the matrix is written in binary form, which can be"
+			" passed to -load-kinship; otherwise it is converted to the usual long form."
+		)
+		.set_takes_single_value() ;
 
 	options.option_implies_option( "-kinship", "-s" ) ;
 	options.option_implies_option( "-kinship-method", "-kinship" ) ;
+	options.option_implies_option( "-kinship-memory-budget", "-kinship" ) ;
+	options.option_excludes_option( "-kinship-memory-budget", "-PCs" ) ;
 	options.option_implies_option( "-load-kinship", "-s" ) ;
 	options.option_implies_option( "-UDUT", "-PCs" ) ;
 	options.option_implies_option( "-PCs", "-UDUT" ) ;
 	options.option_implies_option( "-PCs", "-osample" ) ;
+	options.option_implies_option( "-PCA-method", "-PCs" ) ;
+	options.option_implies_option( "-PCA-iterations", "-PCs" ) ;
 	options.option_excludes_option( "-load-kinship", "-kinship" ) ;
 	options.option_excludes_option( "-project-onto", "-loadings" ) ;
 	options.option_excludes_option( "-load-UDUT", "-UDUT" ) ;
@@ -115,6 +146,21 @@ namespace impl {
 			+ tags[tag_i]
 		;
 	}
+
+	bool ends_with( std::string const& string, std::string const& suffix ) {
+		return string.size() >= suffix.size() && string.compare( string.size() - suffix.size(), suffix.size(), suffix ) == 0 ;
+	}
+
+	void write_out_of_core_kinship_in_long_form(
+		std::string const& filename,
+		KinshipCoefficientManager::GetNames get_ids,
+		pca::BinaryMatrixFile& matrix,
+		std::string const& source,
+		std::string const& description
+	) {
+		pca::write_matrix_lower_diagonals_in_long_form( filename, matrix, source, description, get_ids, get_ids ) ;
+		std::remove( matrix.filename().c_str() ) ;
+	}
 }
 
 void RelatednessComponent::setup(
@@ -143,14 +189,33 @@ void RelatednessComponent::setup(
 				"Expected -kinship or -load-kinship to be supplied."
 			) ;
 		}
-		pca_computer = PCAComputer::SharedPtr( new PCAComputer( m_options, m_samples, m_ui_context ) ) ;
-		pca_computer->send_UDUT_to(
-			boost::bind(
-				&pca::write_matrix,
-				m_options.get< std::string >( "-UDUT" ),
-				_3, "qctool:PCAComputer" ,_1, _4, _5
-			)
-		) ;
+		std::string const& PCA_method = m_options.get< std::string >( "-PCA-method" ) ;
+		if( PCA_method != "full" && PCA_method != "randomised" ) {
+			throw genfile::BadArgumentError(
+				"RelatednessComponent::setup()",
+				"-PCA-method " + PCA_method,
+				"Method must be \"full\" or \"randomised\""
+			) ;
+		}
+		pca_computer = PCAComputer::SharedPtr( new PCAComputer( m_options, m_samples, m_worker, m_ui_context ) ) ;
+		std::string const& UDUT_filename = m_options.get< std::string >( "-UDUT" ) ;
+		if( impl::ends_with( UDUT_filename, ".bin" )) {
+			pca_computer->send_UDUT_to(
+				boost::bind(
+					&pca::write_binary_matrix,
+					UDUT_filename,
+					_3, _2, "qctool:PCAComputer", _1
+				)
+			) ;
+		} else {
+			pca_computer->send_UDUT_to(
+				boost::bind(
+					&pca::write_matrix,
+					UDUT_filename,
+					_3, "qctool:PCAComputer" ,_1, _4, _5
+				)
+			) ;
+		}
 		pca_computer->send_PCs_to( storage ) ;
 	}
 
@@ -188,7 +253,27 @@ void RelatednessComponent::setup(
 		) ;
 	}
 	
-	if( m_options.check( "-kinship" )) {
+	if( m_options.check( "-kinship-memory-budget" )) {
+		std::string const& filename = m_options.get< std::string >( "-kinship" ) ;
+		std::size_t const memory_budget = m_options.get< std::size_t >( "-kinship-memory-budget" ) * 1024 * 1024 ;
+		OutOfCoreKinshipComputer::UniquePtr result ;
+		if( impl::ends_with( filename, ".bin" )) {
+			result.reset( new OutOfCoreKinshipComputer( m_worker, m_ui_context, filename, memory_budget )) ;
+		} else {
+			result.reset( new OutOfCoreKinshipComputer( m_worker, m_ui_context, filename + ".tmp.bin", memory_budget )) ;
+			result->send_results_to(
+				boost::bind(
+					&impl::write_out_of_core_kinship_in_long_form,
+					filename, get_ids,
+					_1, _2, _3
+				)
+			) ;
+		}
+		m_ui_context.logger() << "RelatednessComponent::setup(): using computation: " << result->get_summary() << ".\n" ;
+		processor.add_callback(
+			genfile::SNPDataSourceProcessor::Callback::UniquePtr( result.release() )
+		) ;
+	} else if( m_options.check( "-kinship" )) {
 		KinshipCoefficientComputer::Computation::UniquePtr computation ;
 		std::string const& method = m_options.get< std::string >( "-kinship-method" ) ;
 		if( method == "cblas" ) {
@@ -205,11 +290,17 @@ void RelatednessComponent::setup(
 					m_worker, 4
 				).release()
 			) ;
+		} else if( method == "packed" ) {
+			computation.reset(
+				impl::NormaliseGenotypesAndComputeXXtPacked::create(
+					m_worker, 128
+				).release()
+			) ;
 		} else {
 			throw genfile::BadArgumentError(
 				"RelatednessComponent::setup()",
 				"-method " + method,
-				"Method must be \"fast\", \"cblas\", or \"eigen\""
+				"Method must be \"lookup-table\", \"packed\", \"cblas\", or \"eigen\""
 			) ;
 		}
 		
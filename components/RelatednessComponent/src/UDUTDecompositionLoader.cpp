@@ -11,6 +11,7 @@
 #include "genfile/CohortIndividualSource.hpp"
 #include "genfile/Error.hpp"
 #include "statfile/BuiltInTypeStatSource.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
 #include "components/RelatednessComponent/UDUTDecompositionLoader.hpp"
 
 namespace relatedness {
@@ -30,11 +31,16 @@ namespace relatedness {
 	}
 
 	void UDUTDecompositionLoader::load_matrix_impl( std::string const& filename, Eigen::MatrixXd* matrix, std::size_t* number_of_snps ) const {
-		statfile::BuiltInTypeStatSource::UniquePtr source = statfile::BuiltInTypeStatSource::open( filename ) ;
 		assert( matrix ) ;
 		assert( number_of_snps ) ;
 		
 		using namespace genfile::string_utils ;
+		if( pca::BinaryMatrixFile::is_binary_matrix_file( filename )) {
+			load_binary_matrix_impl( filename, matrix, number_of_snps ) ;
+			return ;
+		}
+
+		statfile::BuiltInTypeStatSource::UniquePtr source = statfile::BuiltInTypeStatSource::open( filename ) ;
 		// Read the metadata
 		std::size_t number_of_samples = 0 ;
 		std::vector< std::string > metadata = split( source->get_descriptive_text(), "\n" ) ;
@@ -56,16 +62,18 @@ namespace relatedness {
 			) ;
 		}
 
-		if( source->number_of_columns() != number_of_samples + 1 ) {
-			throw genfile::MalformedInputError( source->get_source_spec(), 0, std::min( source->number_of_columns(), number_of_samples + 1 )) ;
+		// The decomposition may be truncated to the leading eigenvectors, as computed by -PCA-method randomised.
+		std::size_t const number_of_columns = source->number_of_columns() ;
+		if( number_of_columns < 2 || number_of_columns > number_of_samples + 1 ) {
+			throw genfile::MalformedInputError( source->get_source_spec(), 0, std::min( number_of_columns, number_of_samples + 1 )) ;
 		}
 		if( source->number_of_rows() && *source->number_of_rows() != number_of_samples ) {
 			throw genfile::MalformedInputError( source->get_source_spec(), 0, std::min( *source->number_of_rows(), number_of_samples )) ;
 		}
 		// Read the matrix, making sure the samples come in the same order as in the sample file.
-		matrix->resize( number_of_samples, number_of_samples+1 ) ;
+		matrix->resize( number_of_samples, number_of_columns ) ;
 		for( std::size_t i = 0; i < number_of_samples; ++i ) {
-			for( std::size_t j = 0; j < ( number_of_samples + 1 ); ++j ) {
+			for( std::size_t j = 0; j < number_of_columns; ++j ) {
 				(*source) >> (*matrix)(i,j) ;
 			}
 			(*source) >> statfile::end_row() ;
@@ -75,4 +83,24 @@ namespace relatedness {
 		}
 		
 	}
+
+	void UDUTDecompositionLoader::load_binary_matrix_impl( std::string const& filename, Eigen::MatrixXd* matrix, std::size_t* number_of_snps ) const {
+		using genfile::string_utils::to_string ;
+		pca::BinaryMatrixFile::UniquePtr file = pca::BinaryMatrixFile::open( filename ) ;
+		pca::BinaryMatrixFile::Header const& header = file->header() ;
+		std::size_t const number_of_samples = m_samples.get_number_of_individuals() ;
+		if( header.number_of_rows != number_of_samples ) {
+			throw genfile::MismatchError(
+				"UDUTDecompositionLoader::load_matrix()",
+				filename,
+				"number of samples: " + to_string( header.number_of_rows ),
+				"expected number: " + to_string( number_of_samples )
+			) ;
+		}
+		if( header.layout != pca::BinaryMatrixFile::eFull || header.number_of_columns < 2 || header.number_of_columns > number_of_samples + 1 ) {
+			throw genfile::MalformedInputError( filename, 0, std::min( std::size_t( header.number_of_columns ), number_of_samples + 1 )) ;
+		}
+		file->read_matrix( 0, matrix ) ;
+		*number_of_snps = header.number_of_snps ;
+	}
 }
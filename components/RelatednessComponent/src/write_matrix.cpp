@@ -15,10 +15,12 @@
 #include "genfile/VariantEntry.hpp"
 #include "genfile/VariantIdentifyingData.hpp"
 #include "genfile/string_utils.hpp"
+#include "genfile/Error.hpp"
 #include "statfile/BuiltInTypeStatSink.hpp"
 #include "statfile/DelimitedStatSink.hpp"
 #include "appcontext/get_current_time_as_string.hpp"
 #include "components/RelatednessComponent/write_matrix.hpp"
+#include "components/RelatednessComponent/BinaryMatrixFile.hpp"
 #include "components/RelatednessComponent/names.hpp"
 
 namespace pca {
@@ -169,6 +171,62 @@ namespace pca {
 		}
 	}
 
+	void write_matrix_lower_diagonals_in_long_form(
+		std::string const& filename,
+		BinaryMatrixFile& matrix,
+		std::string const& source,
+		std::string const& description,
+		boost::function< genfile::VariantEntry ( std::size_t ) > get_row_names,
+		boost::function< genfile::VariantEntry ( std::size_t ) > get_column_names
+	) {
+		BinaryMatrixFile::Header const& header = matrix.header() ;
+		if( header.layout != BinaryMatrixFile::eLowerTriangle || header.number_of_layers < 2 ) {
+			throw genfile::BadArgumentError(
+				"pca::write_matrix_lower_diagonals_in_long_form()",
+				"matrix=\"" + matrix.filename() + "\"",
+				"Expected a lower triangular matrix file with at least two layers."
+			) ;
+		}
+		using genfile::string_utils::to_string ;
+		statfile::BuiltInTypeStatSink::UniquePtr sink = statfile::BuiltInTypeStatSink::open( filename ) ;
+		sink->write_metadata( get_metadata( source, description ) ) ;
+		(*sink) | "sample_1" | "sample_2" | "pairwise.complete.obs" | "value" ;
+		Eigen::VectorXd row1 ;
+		Eigen::VectorXd row2 ;
+		for( std::size_t i = 0; i < header.number_of_rows; ++i ) {
+			matrix.read_row( 0, i, &row1 ) ;
+			matrix.read_row( 1, i, &row2 ) ;
+			genfile::VariantEntry row_name = get_row_names ? get_row_names( i ) : ( "row_" + to_string( i ) ) ;
+			for( std::size_t j = 0; j <= i; ++j ) {
+				(*sink)
+					<< row_name
+					<< ( get_column_names ? get_column_names( j ) : ( "column_" + to_string( j ) ) )
+					<< row1( j )
+					<< row2( j )
+				;
+				(*sink) << statfile::end_row() ;
+			}
+		}
+	}
+
+	void write_binary_matrix(
+		std::string const& filename,
+		Eigen::MatrixXd const& matrix,
+		std::size_t const number_of_snps,
+		std::string const& source,
+		std::string const& description
+	) {
+		BinaryMatrixFile::Header header ;
+		header.layout = BinaryMatrixFile::eFull ;
+		header.number_of_layers = 1 ;
+		header.number_of_rows = matrix.rows() ;
+		header.number_of_columns = matrix.cols() ;
+		header.number_of_snps = number_of_snps ;
+		header.description = get_metadata( source, description ) ;
+		BinaryMatrixFile::UniquePtr file = BinaryMatrixFile::create( filename, header ) ;
+		file->write_block( 0, 0, 0, matrix ) ;
+	}
+
 	void write_loadings_to_sink(
 		boost::shared_ptr< statfile::BuiltInTypeStatSink > sink,
 		genfile::VariantIdentifyingData snp,
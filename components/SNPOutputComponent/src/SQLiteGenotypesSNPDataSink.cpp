@@ -451,10 +451,8 @@ void SQLiteGenotypesSNPDataSink::flush_genotype_data( std::size_t const data_cou
 	std::cerr << "Flushing " << data_count << " genotypes..." ;
 	std::size_t max_data_size = 0 ;
 #endif
-	std::vector< db::Connection::RowId > variant_ids( data_count ) ;
-	for( std::size_t i = 0; i < data_count; ++i ) {
-		variant_ids[i] = m_outputter->get_or_create_variant( m_genotype_snps[i] ) ;
-	}
+	std::vector< db::Connection::RowId > variant_ids ;
+	m_outputter->get_or_create_variants( m_genotype_snps.begin(), m_genotype_snps.begin() + data_count, &variant_ids ) ;
 #if DEBUG_SQLITEGENOTYPESNPDATASINK
 	std::cerr << "stored variants..." ;
 #endif
@@ -485,10 +483,8 @@ void SQLiteGenotypesSNPDataSink::flush_intensity_data( std::size_t const data_co
 	std::cerr << "Flushing " << data_count << " intensities..." ;
 	std::size_t max_data_size = 0 ;
 #endif
-	std::vector< db::Connection::RowId > variant_ids( data_count ) ;
-	for( std::size_t i = 0; i < data_count; ++i ) {
-		variant_ids[i] = m_outputter->get_or_create_variant( m_intensity_snps[i] ) ;
-	}
+	std::vector< db::Connection::RowId > variant_ids ;
+	m_outputter->get_or_create_variants( m_intensity_snps.begin(), m_intensity_snps.begin() + data_count, &variant_ids ) ;
 #if DEBUG_SQLITEGENOTYPESNPDATASINK
 	std::cerr << "stored variants..." ;
 #endif
@@ -335,10 +335,8 @@ void SQLiteHaplotypesSNPDataSink::flush_data( std::size_t const data_count ) {
 	std::cerr << "Flushing " << data_count << " elements..." ;
 	std::size_t max_data_size = 0 ;
 #endif
-	std::vector< db::Connection::RowId > variant_ids( data_count ) ;
-	for( std::size_t i = 0; i < data_count; ++i ) {
-		variant_ids[i] = m_outputter->get_or_create_variant( m_snps[i] ) ;
-	}
+	std::vector< db::Connection::RowId > variant_ids ;
+	m_outputter->get_or_create_variants( m_snps.begin(), m_snps.begin() + data_count, &variant_ids ) ;
 #if DEBUG_SQLITEHAPLOTYPESSNPDATASINK
 	std::cerr << "stored variants..." ;
 #endif
@@ -13,21 +13,33 @@
 #include <string>
 #include <boost/function.hpp>
 #include <boost/optional.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include "components/SNPSummaryComponent/SNPSummaryComputation.hpp"
 #include "genfile/Chromosome.hpp"
 #include "genfile/VariantEntry.hpp"
 #include "genfile/wildcard.hpp"
 #include "genfile/GenomePositionRange.hpp"
 
+namespace boost {
+	namespace iostreams {
+		class mapped_file_source ;
+	}
+}
+
+// Class GenomeSequence gives access to reference sequence stored in one or more single-sequence FASTA files.
+// The bases of each file are held contiguously, either in a memory-mapped cache file or (if the cache
+// cannot be used) in memory.  The cache is a file named <fasta filename>.qcseq next to the FASTA file;
+// it is written the first time the FASTA file is used, or when it is older than the FASTA file.
+// Since it is mapped read-only, its pages are shared by all processes using the same reference.
 struct GenomeSequence {
 public:
 	typedef std::auto_ptr< GenomeSequence > UniquePtr ;
-	typedef std::deque< char > ChromosomeSequence ;
-	typedef ChromosomeSequence::const_iterator ConstSequenceIterator ;
+	typedef std::vector< char > ChromosomeSequence ;
+	typedef char const* ConstSequenceIterator ;
 	typedef std::pair< ConstSequenceIterator, ConstSequenceIterator > ConstSequenceRange ;
 	typedef std::pair< genfile::GenomePositionRange, ConstSequenceRange > PhysicalSequenceRange ;
 	typedef genfile::Chromosome Chromosome ;
-	typedef std::pair< std::pair< genfile::Position, genfile::Position >, ChromosomeSequence > ChromosomeRangeAndSequence ;
+	typedef std::pair< std::pair< genfile::Position, genfile::Position >, ConstSequenceRange > ChromosomeRangeAndSequence ;
 	typedef std::map< Chromosome, ChromosomeRangeAndSequence > SequenceData ;
 	typedef genfile::VariantEntry OptionalString ;
 	typedef boost::function< void ( std::size_t, boost::optional< std::size_t > ) > ProgressCallback ;
@@ -37,6 +49,7 @@ public:
 public:
 
 	GenomeSequence( std::string const& fasta_filename, ProgressCallback ) ;
+	~GenomeSequence() ;
 
 	SequenceData const& sequence() const { return m_sequence ; }
 	std::string const get_spec() const { return m_fasta_filename ; }
@@ -53,15 +66,23 @@ private:
 	std::map< genfile::Chromosome, std::string > m_identifiers ;
 	boost::optional< std::string > m_build ;
 	boost::optional< std::string > m_organism ;
-	
+	// Storage for the sequence data, which m_sequence points into.
+	boost::ptr_vector< boost::iostreams::mapped_file_source > m_mapped_files ;
+	boost::ptr_vector< ChromosomeSequence > m_loaded_sequences ;
+
 	void load_sequence( std::vector< genfile::wildcard::FilenameMatch > const& files, SequenceData* sequence, ProgressCallback callback ) ;
-	void load_sequence(
-		genfile::wildcard::FilenameMatch const& file,
-		Chromosome* chromosome,
-		ChromosomeSequence* sequence,
-		std::pair< genfile::Position, genfile::Position >* range,
-		std::string* identifier
-	) ;
+	ConstSequenceRange load_sequence( std::string const& filename, std::string* identifier ) ;
+	ConstSequenceRange map_cache_file( std::string const& cache_filename, std::string* identifier ) ;
+	void write_cache_file( std::string const& filename, std::string const& cache_filename ) const ;
+	void read_fasta(
+		std::string const& filename,
+		std::string* identifier,
+		boost::function< void ( char const*, char const* ) > callback
+	) const ;
+
+private:
+	GenomeSequence( GenomeSequence const& ) ;
+	GenomeSequence& operator=( GenomeSequence const& ) ;
 } ;
 
 #endif
@@ -15,6 +15,7 @@
 #include "genfile/SNPDataSourceProcessor.hpp"
 #include "genfile/VariantEntry.hpp"
 #include "genfile/CohortIndividualSource.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
 #include "appcontext/OptionProcessor.hpp"
 #include "appcontext/UIContext.hpp"
 #include "components/SNPSummaryComponent/SNPSummaryComputation.hpp"
@@ -70,8 +71,7 @@ private:
 	int m_haploid_coding_column ;
 
 	std::size_t m_snp_index ;
-	SNPSummaryComputation::Genotypes m_genotypes ;
-	SNPSummaryComputation::Ploidy m_ploidy ;
+	genfile::GenotypeProbabilityMatrix m_genotypes ;
 
 private:
 	std::vector< char > get_sexes( genfile::CohortIndividualSource const& samples, std::string const& sex_column_name ) const ;
@@ -9,13 +9,36 @@
 #include <algorithm>
 #include <sstream>
 #include <iterator>
+#include <cstring>
 #include <boost/optional.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "genfile/types.hpp"
 #include "genfile/FileUtils.hpp"
 #include "genfile/Error.hpp"
+#include "genfile/endianness_utils.hpp"
 #include "genfile/string_utils/slice.hpp"
 #include "genfile/VariantEntry.hpp"
 #include "components/SNPSummaryComponent/GenomeSequence.hpp"
 
+namespace {
+	// The cache file consists of a fixed-size header, the bases, and the FASTA identifier.
+	// The header holds the magic number, version, number of bases and length of the identifier.
+	char const cache_magic[4] = { 'q', 's', 'e', 'q' } ;
+	uint32_t const cache_version = 1 ;
+	std::size_t const cache_header_size = 24 ;
+
+	void append_to_sequence( GenomeSequence::ChromosomeSequence* sequence, char const* begin, char const* end ) {
+		sequence->insert( sequence->end(), begin, end ) ;
+	}
+
+	void write_to_stream( std::ostream* stream, uint64_t* count, char const* begin, char const* end ) {
+		stream->write( begin, end - begin ) ;
+		(*count) += ( end - begin ) ;
+	}
+}
+
 GenomeSequence::UniquePtr GenomeSequence::create( std::string const& fasta_filename, ProgressCallback callback ) {
 	return GenomeSequence::UniquePtr(
 		new GenomeSequence( fasta_filename, callback )
@@ -28,18 +51,21 @@ GenomeSequence::GenomeSequence( std::string const& fasta_filename, ProgressCallb
 	load_sequence( genfile::wildcard::find_files_by_chromosome( fasta_filename, genfile::wildcard::eALL_CHROMOSOMES ), &m_sequence, callback ) ;
 }
 
+GenomeSequence::~GenomeSequence() {}
+
 void GenomeSequence::load_sequence( std::vector< genfile::wildcard::FilenameMatch > const& files, SequenceData* sequence, ProgressCallback callback ) {
 	assert( sequence ) ;
 	for( std::size_t i = 0; i < files.size(); ++i ) {
-		ChromosomeRangeAndSequence data ;
-		Chromosome chromosome ;
-		std::string identifier ;
-		load_sequence( files[i], &chromosome, &data.second, &data.first, &identifier ) ;
+		Chromosome const chromosome( files[i].match() ) ;
 		if( m_sequence.find( chromosome ) != m_sequence.end() ) {
 			throw genfile::DuplicateKeyError( m_fasta_filename, "chromosome=\"" + files[i].match() + "\"" ) ;
 		}
-		m_sequence[ chromosome ].first = data.first ;
-		m_sequence[ chromosome ].second.swap( data.second ) ;
+		std::string identifier ;
+		ConstSequenceRange const range = load_sequence( files[i].filename(), &identifier ) ;
+		m_sequence[ chromosome ] = ChromosomeRangeAndSequence(
+			std::make_pair( genfile::Position( 1 ), genfile::Position( range.second - range.first + 1 ) ),
+			range
+		) ;
 		m_identifiers[ chromosome ] = identifier ;
 		if( callback ) {
 			callback( i + 1, files.size() ) ;
@@ -47,64 +73,159 @@ void GenomeSequence::load_sequence( std::vector< genfile::wildcard::FilenameMatc
 	}
 }
 
-void GenomeSequence::load_sequence(
-	genfile::wildcard::FilenameMatch const& file,
-	Chromosome* chromosome,
-	ChromosomeSequence* sequence,
-	std::pair< genfile::Position, genfile::Position >* limits,
-	std::string* identifier
-) {
-	assert( sequence ) ;
-	assert( sequence->empty() ) ;
-	using genfile::string_utils::to_string ;
+GenomeSequence::ConstSequenceRange GenomeSequence::load_sequence( std::string const& filename, std::string* identifier ) {
+	std::string const cache_filename = filename + ".qcseq" ;
+	boost::system::error_code ec ;
+	bool const cache_is_current = boost::filesystem::exists( cache_filename, ec )
+		&& boost::filesystem::last_write_time( cache_filename, ec ) >= boost::filesystem::last_write_time( filename, ec ) ;
+	try {
+		if( !cache_is_current ) {
+			write_cache_file( filename, cache_filename ) ;
+		}
+		return map_cache_file( cache_filename, identifier ) ;
+	}
+	catch( genfile::ResourceNotOpenedError const& ) {
+		// e.g. the directory is not writeable; fall back to reading into memory.
+	}
+	catch( genfile::OperationFailedError const& ) {
+		// as above.
+	}
 
+	std::auto_ptr< ChromosomeSequence > sequence( new ChromosomeSequence() ) ;
+	read_fasta( filename, identifier, boost::bind( &append_to_sequence, sequence.get(), _1, _2 )) ;
+	ConstSequenceIterator const begin = sequence->empty() ? 0 : &(*sequence)[0] ;
+	ConstSequenceRange const result( begin, begin + sequence->size() ) ;
+	m_loaded_sequences.push_back( sequence ) ;
+	return result ;
+}
+
+GenomeSequence::ConstSequenceRange GenomeSequence::map_cache_file( std::string const& cache_filename, std::string* identifier ) {
+	std::auto_ptr< boost::iostreams::mapped_file_source > file ;
+	try {
+		file.reset( new boost::iostreams::mapped_file_source( cache_filename )) ;
+	}
+	catch( std::ios_base::failure const& ) {
+		throw genfile::ResourceNotOpenedError( cache_filename ) ;
+	}
+	genfile::byte_t const* const data = reinterpret_cast< genfile::byte_t const* >( file->data() ) ;
+	uint32_t version = 0 ;
+	uint64_t sequence_length = 0 ;
+	uint32_t identifier_length = 0 ;
+	if( file->size() >= cache_header_size ) {
+		genfile::read_little_endian_integer( data + 4, data + 8, &version ) ;
+		genfile::read_little_endian_integer( data + 8, data + 16, &sequence_length ) ;
+		genfile::read_little_endian_integer( data + 16, data + 20, &identifier_length ) ;
+	}
+	if(
+		file->size() < cache_header_size
+		|| !std::equal( cache_magic, cache_magic + 4, file->data() )
+		|| version != cache_version
+		|| file->size() != cache_header_size + sequence_length + identifier_length
+	) {
+		throw genfile::MalformedInputError(
+			cache_filename,
+			"File does not appear to be a valid sequence cache file (try deleting it)",
+			0
+		) ;
+	}
+	char const* const begin = file->data() + cache_header_size ;
+	identifier->assign( begin + sequence_length, begin + sequence_length + identifier_length ) ;
+	m_mapped_files.push_back( file ) ;
+	return ConstSequenceRange( begin, begin + sequence_length ) ;
+}
+
+// Write the cache to a temporary file and move it into place, so that other processes
+// never see an incomplete cache file.
+void GenomeSequence::write_cache_file( std::string const& filename, std::string const& cache_filename ) const {
+	boost::system::error_code ec ;
+	std::string const temp_filename = boost::filesystem::unique_path( cache_filename + ".tmp%%%%-%%%%-%%%%-%%%%", ec ).string() ;
+	if( ec ) {
+		throw genfile::ResourceNotOpenedError( cache_filename ) ;
+	}
+	std::ofstream stream( temp_filename.c_str(), std::ios::binary | std::ios::trunc ) ;
+	if( !stream ) {
+		throw genfile::ResourceNotOpenedError( temp_filename ) ;
+	}
+
+	std::vector< genfile::byte_t > header( cache_header_size, 0 ) ;
+	stream.write( reinterpret_cast< char const* >( &header[0] ), header.size() ) ;
+	std::string identifier ;
+	uint64_t sequence_length = 0 ;
+	try {
+		read_fasta( filename, &identifier, boost::bind( &write_to_stream, &stream, &sequence_length, _1, _2 )) ;
+	}
+	catch( ... ) {
+		stream.close() ;
+		boost::filesystem::remove( temp_filename, ec ) ;
+		throw ;
+	}
+	stream.write( identifier.data(), identifier.size() ) ;
+
+	std::copy( cache_magic, cache_magic + 4, header.begin() ) ;
+	genfile::write_little_endian_integer( &header[0] + 4, &header[0] + 8, cache_version ) ;
+	genfile::write_little_endian_integer( &header[0] + 8, &header[0] + 16, sequence_length ) ;
+	genfile::write_little_endian_integer( &header[0] + 16, &header[0] + 20, uint32_t( identifier.size() )) ;
+	stream.seekp( 0 ) ;
+	stream.write( reinterpret_cast< char const* >( &header[0] ), header.size() ) ;
+	stream.close() ;
+	if( !stream ) {
+		boost::filesystem::remove( temp_filename, ec ) ;
+		throw genfile::OperationFailedError( "GenomeSequence::write_cache_file()", temp_filename, "write" ) ;
+	}
+	boost::filesystem::rename( temp_filename, cache_filename, ec ) ;
+	if( ec ) {
+		boost::filesystem::remove( temp_filename, ec ) ;
+		throw genfile::OperationFailedError( "GenomeSequence::write_cache_file()", cache_filename, "rename" ) ;
+	}
+}
+
+// Read the bases of a single-sequence FASTA file, passing them to the callback a buffer at a time.
+void GenomeSequence::read_fasta(
+	std::string const& filename,
+	std::string* identifier,
+	boost::function< void ( char const*, char const* ) > callback
+) const {
 	// read header
-	std::auto_ptr< std::istream > stream( genfile::open_text_file_for_input( file.filename() )) ;
+	std::auto_ptr< std::istream > stream( genfile::open_text_file_for_input( filename )) ;
 	std::string line ;
 	std::getline( *stream, line ) ;
 	if( !*stream ) {
-		throw genfile::MalformedInputError( file.filename(), 0 ) ;
+		throw genfile::MalformedInputError( filename, 0 ) ;
 	}
 	if( line.size() == 0 || line[0] != '>' ) {
 		throw genfile::MalformedInputError(
-			file.filename(),
+			filename,
 			"File does not appear to be a FASTA file (it does not start with a line \">....\")",
 			0
 		) ;
 	}
-	line = line.substr( 1, line.size() ) ;
-	*identifier = line ;
-	*chromosome = genfile::Chromosome( file.match() ) ;
-	
-	// Ok, now read the data
+	*identifier = line.substr( 1, line.size() ) ;
+
+	// Ok, now read the data, removing newlines in place.
 	std::size_t const BUFFER_SIZE = 1024*1024 ;
 	std::vector< char > buffer( BUFFER_SIZE ) ;
-	std::size_t line_count = 0 ;
+	bool at_line_start = true ;
 	do {
 		stream->read( &buffer[0], BUFFER_SIZE ) ;
-		std::size_t const count = stream->gcount() ;
-		char const* p_end = &buffer[0] + count ;
-		for(
-			char const* p = &buffer[0] ;
-			p < p_end;
-			++p
-		 ) {
-			char const* segment_end = std::find( p, p_end, '\n' ) ;
-			sequence->insert( sequence->end(), p, segment_end ) ;
-			p = segment_end ;
-			++line_count ;
-			if( (p < p_end) && (*(p+1) == '>') ) {
+		char* const begin = &buffer[0] ;
+		char const* const p_end = begin + stream->gcount() ;
+		char* out = begin ;
+		for( char const* p = begin; p < p_end; ) {
+			if( at_line_start && *p == '>' ) {
 				throw genfile::MalformedInputError(
-					file.filename(),
+					filename,
 					"Only single-sequence FASTA files are supported",
 					0
 				) ;
 			}
+			char const* segment_end = std::find( p, p_end, '\n' ) ;
+			std::memmove( out, p, segment_end - p ) ;
+			out += ( segment_end - p ) ;
+			at_line_start = ( segment_end < p_end ) ;
+			p = at_line_start ? ( segment_end + 1 ) : segment_end ;
 		}
+		callback( begin, out ) ;
 	} while( *stream ) ;
-	
-	limits->first = 1 ;
-	limits->second = sequence->size() + 1 ;
 }
 
 std::string GenomeSequence::get_summary( std::string const& prefix, std::size_t column_width ) const {
@@ -147,7 +268,7 @@ char GenomeSequence::get_base( genfile::GenomePosition const& position ) const {
 			"Position is not in the sequence (" + to_string( position.chromosome() ) + ":" + to_string( sequence_start ) + "-" + to_string( sequence_end ) + ")."
 		) ;
 	}
-	return *(where->second.second.begin() + position.position() - sequence_start) ;
+	return *(where->second.second.first + position.position() - sequence_start) ;
 }
 
 void GenomeSequence::get_sequence( genfile::Chromosome const& chromosome, genfile::Position start, genfile::Position end, std::deque<char>* result ) const {
@@ -188,8 +309,8 @@ GenomeSequence::get_sequence( genfile::Chromosome const& chromosome, genfile::Po
 			chromosome, actual_start, actual_end
 		),
 		ConstSequenceRange(
-			where->second.second.begin() + start - sequence_start,
-			where->second.second.begin() + end - sequence_start
+			where->second.second.first + start - sequence_start,
+			where->second.second.first + end - sequence_start
 		)
 	) ;
 }
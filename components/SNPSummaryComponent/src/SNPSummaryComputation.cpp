@@ -6,6 +6,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <boost/function.hpp>
 #include <boost/bind.hpp>
 #include <boost/math/distributions/chi_squared.hpp>
@@ -24,36 +25,50 @@
 namespace snp_summary_component {
 	
 	namespace {
-		struct AlleleCountClient: public genfile::VariantDataReader::PerSampleSetter {
-			AlleleCountClient( std::vector< double >* counts ):
-				m_counts( counts ),
-				m_number_of_alleles( 0 )
-			{
+		// Compute expected allele counts from the genotype probability matrix
+		// that is already filled by the SNPSummaryComputationManager.
+		struct AlleleCounter {
+			void operator()(
+				SNPSummaryComputation::Genotypes const& genotypes,
+				SNPSummaryComputation::Ploidy const& ploidy,
+				std::size_t const number_of_alleles,
+				std::vector< double >* counts
+			) {
 				assert( counts != 0 ) ;
+				assert( counts->size() == number_of_alleles ) ;
+				assert( genotypes.rows() == ploidy.size() ) ;
+				for( int i = 0; i < genotypes.rows(); ++i ) {
+					if( ploidy(i) <= 0 ) {
+						// no data for this sample.
+						continue ;
+					}
+					genfile::impl::Enumeration const& enumeration = get_table( ploidy(i) ) ;
+					assert( number_of_alleles <= enumeration.first.second ) ;
+					uint32_t const bitsPerAllele = enumeration.first.first ;
+					uint16_t const mask = uint16_t( 0xFFFF ) >> ( 16 - bitsPerAllele ) ;
+					for( int g = 0; g < genotypes.cols(); ++g ) {
+						double const value = genotypes( i, g ) ;
+						if( value == 0.0 ) {
+							continue ;
+						}
+						uint16_t const encodedGenotype = enumeration.second.second[ uint16_t( g ) ] ;
+						// Dosage of the 1st allele in the genotype is not encoded directly.
+						// We compute it as the ploidy minus the dosage of other alleles.
+						uint16_t dosage_of_nonref_alleles = 0 ;
+						for( std::size_t allele = 1; allele < number_of_alleles; ++allele ) {
+							uint16_t const dosage = ( encodedGenotype >> ( (allele-1) * bitsPerAllele )) & mask ;
+							(*counts)[allele] += value * dosage ;
+							dosage_of_nonref_alleles += dosage ;
+						}
+						(*counts)[0] += value * ( ploidy(i) - dosage_of_nonref_alleles ) ;
+					}
+				}
 			}
+		
+		private:
+			std::map< uint32_t, genfile::impl::Enumeration > m_tables ;
 
-			~AlleleCountClient() throw() {}
-			
-			void set_counts( std::vector< double >* counts ) {
-				assert( counts != 0 ) ;
-				m_counts = counts ;
-			}
-			
-			void initialise( std::size_t number_of_samples, std::size_t number_of_alleles ) {
-				m_number_of_alleles = number_of_alleles ;
-				assert( m_counts->size() == number_of_alleles ) ;
-			}
-			
-			bool set_sample( std::size_t i ) {
-				m_ploidy = 0 ;
-				m_table = 0 ;
-				return true ;
-			}
-			
-			void set_number_of_entries( uint32_t ploidy, std::size_t n, OrderType const order_type, ValueType const value_type ) {
-				assert( order_type == genfile::ePerUnorderedGenotype ) ;
-				assert( value_type == genfile::eProbability ) ;
-				
+			genfile::impl::Enumeration const& get_table( uint32_t ploidy ) {
 				std::map< uint32_t, genfile::impl::Enumeration >::iterator where = m_tables.find( ploidy ) ;
 				if( where == m_tables.end() ) {
 					std::pair< std::map< uint32_t, genfile::impl::Enumeration >::iterator, bool >
@@ -61,49 +76,15 @@ namespace snp_summary_component {
 					assert( result.second ) ;
 					where = result.first ;
 				}
-				m_ploidy = ploidy ;
-				m_table = &(where->second) ;
-			}
-			
-			void set_value( std::size_t value_i, genfile::MissingValue const value ) {
-				set_value( value_i, 0.0 ) ;
+				return where->second ;
 			}
-
-			void set_value( std::size_t value_i, double const value ) {
-				assert( value_i <= std::size_t( std::numeric_limits< uint16_t >::max() )) ;
-				genfile::impl::Enumeration const& enumeration = *m_table ;
-				std::size_t const& maxAlleles = enumeration.first.second ;
-				assert( m_number_of_alleles <= maxAlleles ) ;
-				uint16_t const encodedGenotype = enumeration.second.second[ uint16_t( value_i ) ] ;
-				uint32_t const bitsPerAllele = enumeration.first.first ;
-				uint16_t mask = uint16_t( 0xFFFF ) >> ( 16 - bitsPerAllele ) ;
-				// Dosage of the 1st allele in the genotype is not encoded directly.
-				// We compute it as the ploidy minus the dosage of other alleles.
-				uint16_t dosage_of_nonref_alleles = 0 ;
-				for( std::size_t allele = 1; allele < m_number_of_alleles; ++allele ) {
-					uint16_t const dosage = ( encodedGenotype >> ( (allele-1) * bitsPerAllele )) & mask ;
-					(*m_counts)[allele] += value * dosage ;
-					dosage_of_nonref_alleles += dosage ;
-				}
-				(*m_counts)[0] += value * (m_ploidy - dosage_of_nonref_alleles) ;
-			}
-			
-			void finalise() {}
-		private:
-			std::vector< double >* m_counts ;
-			std::size_t m_number_of_alleles ;
-			uint32_t m_ploidy ;
-			std::map< uint32_t, genfile::impl::Enumeration > m_tables ;
-			genfile::impl::Enumeration* m_table ;
 		} ;
 	}
 
 	struct AlleleCountComputation: public SNPSummaryComputation {
 	public:
 		
-		AlleleCountComputation():
-			m_counter( &m_counts )
-		{}
+		AlleleCountComputation() {}
 
 		void list_variables( NameCallback callback ) const {
 			using genfile::string_utils::to_string ;
@@ -123,9 +104,8 @@ namespace snp_summary_component {
 		) {
 			using genfile::string_utils::to_string ;
 			m_counts = std::vector< double >( snp.number_of_alleles(), 0.0 ) ;
-			m_counter.set_counts( &m_counts ) ;
 			callback( "number_of_alleles", int64_t( snp.number_of_alleles() )) ;
-			data_reader.get( ":genotypes:", genfile::to_GP_unphased( m_counter ) ) ;
+			m_counter( genotypes, ploidy, snp.number_of_alleles(), &m_counts ) ;
 			std::size_t i = 0 ;
 			for( ; i < snp.number_of_alleles(); ++i ) {
 				callback( "allele" + to_string(i+1) + "_count", m_counts[i] ) ;
@@ -140,7 +120,7 @@ namespace snp_summary_component {
 		}
 	private:
 		std::vector< double > m_counts ;
-		AlleleCountClient m_counter ;
+		AlleleCounter m_counter ;
 	} ;
 
 	struct AlleleFrequencyComputation: public SNPSummaryComputation
@@ -14,7 +14,7 @@
 #include "genfile/VariantEntry.hpp"
 #include "genfile/vcf/get_set_eigen.hpp"
 #include "genfile/Error.hpp"
-#include "genfile/ToGP.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
 #include "components/SNPSummaryComponent/SNPSummaryComputation.hpp"
 #include "components/SNPSummaryComponent/SNPSummaryComputationManager.hpp"
 #include "components/SNPSummaryComponent/StratifyingSNPSummaryComputation.hpp"
@@ -89,92 +89,21 @@ void SNPSummaryComputationManager::set_haploid_genotype_coding( int coding ) {
 
 void SNPSummaryComputationManager::begin_processing_snps( std::size_t number_of_samples, genfile::SNPDataSource::Metadata const& ) {
 	m_snp_index = 0 ;
-	m_genotypes.resize( number_of_samples, 3 ) ;
 	Computations::iterator i = m_computations.begin(), end_i = m_computations.end() ;
 	for( ; i != end_i; ++i ) {
 		i->second->begin_processing_snps( number_of_samples ) ;
 	}
 }
 
-namespace {
-	struct GPSetter: public genfile::VariantDataReader::PerSampleSetter {
-		~GPSetter() throw() {}
-		GPSetter(
-			Eigen::MatrixXd* genotypes,
-			SNPSummaryComputation::Ploidy* ploidy
-		):
-			m_genotypes( genotypes ),
-			m_ploidy( ploidy ),
-			m_sample_i( 0 )
-		{
-			assert( genotypes != 0 ) ;
-			assert( ploidy != 0 ) ;
-		}
-
-		void initialise( std::size_t number_of_samples, std::size_t number_of_alleles ) {
-#if DEBUG_PER_VARIANT_COMPUTATION_MANAGER
-			std::cerr << "GPSetter::initialise( " << number_of_samples << ", " << number_of_alleles << " ).\n" ;
-#endif
-			// assume at most diploidy, max entries is number of alleles choose 2.
-			m_genotypes->resize( number_of_samples, number_of_alleles * (number_of_alleles+1)/2 ) ;
-			m_genotypes->setZero() ;
-			m_ploidy->resize( number_of_samples ) ;
-			m_ploidy->setConstant( -1 ) ;
-			m_sample_i = 0 ;
-			m_max_ploidy = 0 ;
-			m_min_ploidy = std::numeric_limits< uint32_t >::max() ;
-		}
-
-		bool set_sample( std::size_t i ) {
-			m_sample_i = i ;
-			return true ;
-		}
-		
-		void set_number_of_entries( uint32_t ploidy, std::size_t n, OrderType const order_type, ValueType const value_type ) {
-			assert( order_type == genfile::ePerUnorderedGenotype ) ;
-			assert( value_type == genfile::eProbability ) ;
-			(*m_ploidy)( m_sample_i ) = ploidy ;
-			m_min_ploidy = std::min( ploidy, m_min_ploidy ) ;
-			m_max_ploidy = std::max( ploidy, m_max_ploidy ) ;
-		}
-		
-		void set_value( std::size_t value_i, genfile::MissingValue const value ) {
-			// GEnotypes already set to 0, nothing to do.
-		}
-
-		void set_value( std::size_t value_i, double const value ) {
-#if DEBUG_PER_VARIANT_COMPUTATION_MANAGER
-			std::cerr << "GPSetter::set_value( " << value_i << ", " << value << " ).\n" ;
-			std::cerr << "GPSetter: m_ploidy[" << m_sample_i << "] = " << m_ploidy[ m_sample_i ] << ".\n" ;
-#endif
-			assert( value_i < m_genotypes->cols() ) ;
-			(*m_genotypes)( m_sample_i, value_i ) = value ;
-		}
-
-		void finalise() {}
-
-		uint32_t max_ploidy() const { return m_max_ploidy ; }
-		uint32_t min_ploidy() const { return m_min_ploidy ; }
-
-	private:
-		Eigen::MatrixXd* m_genotypes ;
-		SNPSummaryComputation::Ploidy* m_ploidy ;
-		int m_sample_i ;
-		uint32_t m_max_ploidy ;
-		uint32_t m_min_ploidy ;
-	} ;
-}
-
 void SNPSummaryComputationManager::processed_snp(
 	genfile::VariantIdentifyingData const& snp,
 	genfile::VariantDataReader& data_reader
 ) {
 	try {
-		GPSetter setter( &m_genotypes, &m_ploidy ) ;
-		data_reader.get( ":genotypes:", genfile::to_GP_unphased( setter )) ;
+		data_reader.get_probabilities( ":genotypes:", &m_genotypes ) ;
 
 #if DEBUG_SNP_SUMMARY_COMPUTATION_MANAGER
-		std::cerr << "SNPSummaryComputationManager::processed_snp(): ploidy = " << m_ploidy.transpose() << "...\n" ;
+		std::cerr << "SNPSummaryComputationManager::processed_snp(): ploidy = " << m_genotypes.ploidy.transpose() << "...\n" ;
 #endif
 
 		boost::function< void ( std::string const& value_name, genfile::VariantEntry const& value ) > callback
@@ -184,8 +113,8 @@ void SNPSummaryComputationManager::processed_snp(
 		for( ; i != end_i; ++i ) {
 			i->second->operator()(
 				snp,
-				m_genotypes,
-				m_ploidy,
+				m_genotypes.probabilities,
+				m_genotypes.ploidy,
 				data_reader,
 				callback
 			) ;
@@ -9,16 +9,25 @@
 
 #include <iostream>
 #include <string>
+#include <boost/function.hpp>
 #include "genfile/snp_data_utils.hpp"
 #include "genfile/SNPDataSink.hpp"
 #include "genfile/bgen/bgen.hpp"
 #include "genfile/Error.hpp"
 
 namespace genfile {
+	namespace impl {
+		struct BGenWritePipeline ;
+	}
 
 	// This class encapsulates the basic method of writing a BGen file.
 	class BasicBGenFileSNPDataSink: public SNPDataSink
 	{
+		friend struct impl::BGenWritePipeline ;
+	public:
+		// Callback receiving the offset in the file and the total size in bytes of each variant's data.
+		typedef boost::function< void ( VariantIdentifyingData const& variant, int64_t offset, int64_t size ) > VariantLocationCallback ;
+
 	protected:
 		// This class is intended to be used via a derived class.
 		BasicBGenFileSNPDataSink(
@@ -38,6 +47,7 @@ namespace genfile {
 			int const number_of_bits = 16
 		) ;
 
+		~BasicBGenFileSNPDataSink() ;
 
 		SinkPos get_stream_pos() const ;
 		std::string get_spec() const ;
@@ -55,9 +65,19 @@ namespace genfile {
 
 		void set_number_of_bits( int const bits ) ;
 		void set_compression_type( std::string const& compression_type ) ;
+		// Set the compression level: 0-9 for zlib or 1-22 for zstd.  A negative value selects
+		// the default level for the compression type.  Call this after set_compression_type().
+		void set_compression_level( int const level ) ;
+		// Quantise and compress variants on the given number of worker threads, while another
+		// thread writes the compressed variants to the file in order.  At most max_variants_in_flight
+		// variants are buffered at once.  Zero threads (the default) writes each variant as it is given.
+		// Errors are reported by a later call to write_variant_data(), finalise(), or get_stream_pos().
+		void set_number_of_threads( std::size_t number_of_threads, std::size_t max_variants_in_flight ) ;
 		void set_permitted_input_rounding_error( double const accuracy ) ;
 		void set_free_data( std::string const& free_data ) ;
 		void set_write_sample_identifier_block( bool write ) ;
+		// Report the location of each variant as it is written, e.g. to build an index.
+		void send_variant_locations_to( VariantLocationCallback callback ) ;
 
 		bgen::Context const& bgen_context() const { return m_bgen_context ; }
 
@@ -67,6 +87,9 @@ namespace genfile {
 		std::string const& filename() const ;
 		
 		void update_offset_and_header_block() ;
+		// Wait until all variants have been written to the stream.
+		void flush_pipeline() const ;
+		void finalise_impl() ;
 		
 	private:
 
@@ -81,6 +104,9 @@ namespace genfile {
 		bool m_have_written_header ;
 		int m_number_of_bits ;
 		double m_permitted_rounding_error ;
+		int m_compression_level ;
+		VariantLocationCallback m_variant_location_callback ;
+		std::auto_ptr< impl::BGenWritePipeline > m_write_pipeline ;
 		
 		std::vector< byte_t > m_buffer1 ;
 		std::vector< byte_t > m_buffer2 ;
@@ -9,15 +9,24 @@
 
 #include <iostream>
 #include <string>
+#include <utility>
 #include "snp_data_utils.hpp"
 #include "SNPDataSource.hpp"
 #include "IdentifyingDataCachingSNPDataSource.hpp"
 #include "bgen/bgen.hpp"
+#include "bgen/IndexQuery.hpp"
 #include "Chromosome.hpp"
 
+namespace boost {
+	namespace iostreams {
+		class mapped_file_source ;
+	}
+}
+
 namespace genfile {
 	namespace impl {
 		struct BGenFileSNPDataReader ;
+		struct BGenReadAheadStage ;
 	}
 
 	// This class represents a SNPDataSource which reads its data
@@ -25,23 +34,44 @@ namespace genfile {
 	class BGenFileSNPDataSource: public IdentifyingDataCachingSNPDataSource
 	{
 		friend struct impl::BGenFileSNPDataReader ;
+		friend struct impl::BGenReadAheadStage ;
+	public:
+		// eStreamAccess reads the file through a stream, copying each genotype data block into a buffer.
+		// eMemoryMappedAccess maps the file into memory and parses or uncompresses genotype data
+		// directly from the mapped pages.  This requires an uncompressed (i.e. not .gz) local file.
+		enum AccessMode { eStreamAccess = 0, eMemoryMappedAccess = 1 } ;
+
 	public:
 		BGenFileSNPDataSource( std::auto_ptr< std::istream >, Chromosome missing_chromosome = Chromosome() ) ;
 		BGenFileSNPDataSource( std::string const& filename, Chromosome missing_chromosome = Chromosome() ) ;
+		BGenFileSNPDataSource( std::string const& filename, Chromosome missing_chromosome, AccessMode mode ) ;
+		~BGenFileSNPDataSource() ;
 
 		Metadata get_metadata() const ;
 
 		unsigned int number_of_samples() const { return m_bgen_context.number_of_samples ; }
 		bool has_sample_ids() const ;
 		void get_sample_ids( GetSampleIds ) const ;
-		OptionalSnpCount total_number_of_snps() const { return m_bgen_context.number_of_variants ; }
-		operator bool() const { return m_stream_ptr->good() ; }
+		OptionalSnpCount total_number_of_snps() const ;
+		operator bool() const ;
 
 		std::istream& stream() { return *m_stream_ptr ; }
 		std::istream const& stream() const { return *m_stream_ptr ; }
 		std::string get_source_spec() const ;
 		bgen::Context const& bgen_context() const { return m_bgen_context ; }
 
+		// Restrict this source to the variants found by the given index query.
+		// Instead of reading every block in turn, the source then seeks directly to each
+		// variant returned by the query.  This also resets the source to the start.
+		// The stream must support seeking.
+		void set_index_query( bgen::IndexQuery::UniquePtr query ) ;
+
+		// Read up to number_of_blocks variants ahead of the consumer, decompressing their
+		// genotype data blocks on the given number of worker threads.  Variants are still
+		// returned in file order.  Passing number_of_threads = 0 turns read-ahead off.
+		// This also resets the source to the start.
+		void set_read_ahead( std::size_t number_of_threads, std::size_t number_of_blocks ) ;
+
 	private:
 
 		void reset_to_start_impl() ;
@@ -59,8 +89,20 @@ namespace genfile {
 		bgen::Context m_bgen_context ;
 		boost::optional< std::vector< std::string > > m_sample_ids ;
 		std::auto_ptr< std::istream > m_stream_ptr ;
+		bgen::IndexQuery::UniquePtr m_index_query ;
+		std::size_t m_index_query_position ;
+		std::auto_ptr< impl::BGenReadAheadStage > m_read_ahead ;
+		std::auto_ptr< boost::iostreams::mapped_file_source > m_mapped_file ;
 
 		void setup( std::auto_ptr< std::istream > stream ) ;
+		void map_file( std::string const& filename ) ;
+		// Give the operating system a hint about how the mapped file will be accessed.
+		void advise_mapped_file_access( bool sequential ) ;
+		void read_snp_identifying_data_from_stream( VariantIdentifyingData* result ) ;
+		// Read the raw (possibly compressed) genotype data block for the current variant.
+		// If the file is memory-mapped this returns a range in the mapping; otherwise
+		// the data is read into the given buffer.
+		std::pair< byte_t const*, byte_t const* > read_genotype_data_block( std::vector< byte_t >* buffer ) ;
 
 		uint32_t read_header_data() ;
 		std::vector< byte_t > m_compressed_data_buffer ;
@@ -0,0 +1,94 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_BUFFERED_LINE_READER_HPP
+#define GENFILE_BUFFERED_LINE_READER_HPP
+
+#include <iosfwd>
+#include <vector>
+#include <memory>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/exception_ptr.hpp>
+#include "genfile/string_utils/slice.hpp"
+
+namespace genfile {
+	// Class BufferedLineReader reads a stream in large blocks and returns each line
+	// as a view into the block, without copying it.
+	// Blocks are reference-counted: a Line keeps its block alive, so lines can be
+	// held (or passed to other threads) after further lines have been read.
+	// A block is only reused for reading once no Line refers to it.
+	// In read-ahead mode the next block is read on a background thread while the current
+	// one is used, so that (for example) decompressing a gzipped stream overlaps with parsing.
+	struct BufferedLineReader
+	{
+	public:
+		typedef boost::shared_ptr< std::vector< char > > Buffer ;
+
+		struct Line {
+			Line(): begin( 0 ), end( 0 ) {}
+			Buffer buffer ;
+			// The line, excluding the terminating newline.
+			char const* begin ;
+			char const* end ;
+
+			string_utils::slice as_slice() const { return string_utils::slice( begin, end ) ; }
+		} ;
+
+	public:
+		BufferedLineReader( std::istream& stream, std::size_t const block_size = 4 * 1024 * 1024 ) ;
+		~BufferedLineReader() ;
+
+		// Turn read-ahead mode on or off.  This must be called before reading begins.
+		void set_read_ahead( bool read_ahead ) ;
+
+		// Stop reading from the stream, so that the caller may reposition or destroy it.
+		// reset() must be called before reading further lines.
+		void stop() ;
+
+		// Read from the given stream, discarding any buffered data.
+		void reset( std::istream& stream ) ;
+
+		// Read the next line, returning false if there are no more lines.
+		// The final line need not be terminated by a newline.
+		bool read_line( Line* line ) ;
+
+		std::size_t number_of_lines_read() const { return m_number_of_lines_read ; }
+
+	private:
+		std::istream* m_stream ;
+		std::size_t const m_block_size ;
+		Buffer m_buffer ;
+		// Unread data is in [m_begin, m_end) of m_buffer.
+		std::size_t m_begin ;
+		std::size_t m_end ;
+		bool m_end_of_stream ;
+		std::size_t m_number_of_lines_read ;
+
+		// Read-ahead state.  m_next_block is filled by the reading thread and emptied by read_block().
+		typedef boost::mutex::scoped_lock ScopedLock ;
+		bool m_read_ahead ;
+		std::auto_ptr< boost::thread > m_thread ;
+		boost::mutex m_mutex ;
+		boost::condition m_condition ;
+		std::vector< char > m_next_block ;
+		std::vector< char > m_incoming ;
+		bool m_have_next_block ;
+		bool m_next_block_is_last ;
+		bool m_stop ;
+		boost::exception_ptr m_error ;
+
+	private:
+		void read_block() ;
+		void receive_block() ;
+		void read_ahead_loop() ;
+		BufferedLineReader( BufferedLineReader const& ) ;
+		BufferedLineReader& operator=( BufferedLineReader const& ) ;
+	} ;
+}
+
+#endif
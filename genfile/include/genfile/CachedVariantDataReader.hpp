@@ -0,0 +1,84 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_CACHED_VARIANT_DATA_READER_HPP
+#define GENFILE_CACHED_VARIANT_DATA_READER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "genfile/types.hpp"
+#include "genfile/VariantDataReader.hpp"
+
+namespace genfile {
+	// class CachedVariantDataReader
+	// A VariantDataReader which eagerly reads the given specs from another reader
+	// and records the sequence of setter calls.  These are then replayed for each
+	// call to get().  The result does not depend on the source it came from, so it
+	// remains valid after the source has moved on to the next variant and can be
+	// read from several threads at once.
+	class CachedVariantDataReader: public VariantDataReader {
+	public:
+		typedef std::auto_ptr< CachedVariantDataReader > UniquePtr ;
+		// Cache each of the given specs that the reader supports.
+		// If cache_supported_specs is true, also cache every spec listed by get_supported_specs().
+		static UniquePtr create(
+			VariantDataReader& reader,
+			std::vector< std::string > const& specs,
+			bool cache_supported_specs = false
+		) ;
+
+	public:
+		CachedVariantDataReader(
+			VariantDataReader& reader,
+			std::vector< std::string > const& specs,
+			bool cache_supported_specs = false
+		) ;
+		~CachedVariantDataReader() ;
+
+		CachedVariantDataReader& get( std::string const& spec, PerSampleSetter& setter ) ;
+		bool supports( std::string const& spec ) const ;
+		void get_supported_specs( SpecSetter setter ) const ;
+		std::size_t get_number_of_samples() const { return m_number_of_samples ; }
+
+		// Return the approximate number of bytes used to store the data.
+		std::size_t get_memory_usage() const ;
+
+	public:
+		// Storage for the recorded calls of a single spec.
+		// Calls are stored as a stream of opcodes, with their arguments
+		// stored in separate typed arrays to keep the representation compact.
+		struct Recording {
+			enum Op {
+				eInitialise = 0,
+				eSetSample = 1,
+				eSetNumberOfEntries = 2,
+				eRepeatNumberOfEntries = 3,
+				eMissingValue = 4,
+				eStringValue = 5,
+				eIntegerValue = 6,
+				eDoubleValue = 7,
+				eFinalise = 8
+			} ;
+			std::string type ;
+			std::vector< char > ops ;
+			std::vector< uint32_t > arguments ;
+			std::vector< double > doubles ;
+			std::vector< int64_t > integers ;
+			std::vector< std::string > strings ;
+		} ;
+
+	private:
+		std::size_t const m_number_of_samples ;
+		typedef std::map< std::string, Recording* > Recordings ;
+		Recordings m_recordings ;
+		// Order in which specs were reported by the original reader.
+		std::vector< std::string > m_specs ;
+
+		void replay( Recording const& recording, PerSampleSetter& setter ) const ;
+	} ;
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include "snp_data_utils.hpp"
 #include "gen.hpp"
 #include "genfile/IdentifyingDataCachingSNPDataSource.hpp"
+#include "genfile/BufferedLineReader.hpp"
 #include "string_utils/slice.hpp"
 #include "vcf/MetadataParser.hpp"
 
@@ -38,7 +39,7 @@ namespace genfile {
 		bool has_sample_ids() const { return false ; } // reading IDs not currently implemented
 		OptionalSnpCount total_number_of_snps() const { return m_total_number_of_snps ; }
 		
-		operator bool() const { return m_stream_ptr->good() ; }
+		operator bool() const { return !m_end_of_data ; }
 		std::istream& stream() { return *m_stream_ptr ; }
 		std::istream const& stream() const { return *m_stream_ptr ; }
 
@@ -60,15 +61,17 @@ namespace genfile {
 		unsigned int m_number_of_samples ;
 		OptionalSnpCount m_total_number_of_snps ;
 		std::auto_ptr< std::istream > m_stream_ptr ;
+		BufferedLineReader m_line_reader ;
 		Chromosome m_chromosome ;
+		bool m_end_of_data ;
 		
-		std::string m_line ;
+		BufferedLineReader::Line m_line ;
 		typedef string_utils::slice slice ;
 		std::vector< slice > m_elts ;
 
 	private:
-		void setup( std::string const& filename, CompressionType compression_type ) ;
-		void setup( std::auto_ptr< std::istream > stream_ptr ) ;
+		void setup() ;
+		void read_header_line() ;
 	} ;
 }
 
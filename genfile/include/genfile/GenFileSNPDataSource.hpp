@@ -9,9 +9,12 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include "snp_data_utils.hpp"
 #include "gen.hpp"
 #include "IdentifyingDataCachingSNPDataSource.hpp"
+#include "BufferedLineReader.hpp"
+#include "string_utils/slice.hpp"
 #include "vcf/MetadataParser.hpp"
 
 namespace genfile {
@@ -20,6 +23,8 @@ namespace genfile {
 	}
 	// This class represents a SNPDataSource which reads its data
 	// from a plain GEN file.
+	// Lines are read in blocks and parsed in place; for compressed files the blocks
+	// are decompressed on a separate thread.
 	class GenFileSNPDataSource: public IdentifyingDataCachingSNPDataSource
 	{
 		friend struct impl::GenFileSNPDataReader ;
@@ -33,7 +38,7 @@ namespace genfile {
 		bool has_sample_ids() const { return false ; }
 		OptionalSnpCount total_number_of_snps() const { return m_total_number_of_snps ; }
 		
-		operator bool() const { return m_stream_ptr->good() ; }
+		operator bool() const { return !m_end_of_data ; }
 		std::istream& stream() { return *m_stream_ptr ; }
 		std::istream const& stream() const { return *m_stream_ptr ; }
 
@@ -55,12 +60,16 @@ namespace genfile {
 		unsigned int m_number_of_samples ;
 		OptionalSnpCount m_total_number_of_snps ;
 		std::auto_ptr< std::istream > m_stream_ptr ;
+		BufferedLineReader m_line_reader ;
 		Chromosome m_chromosome ;
 		bool m_have_chromosome_column ;
-		std::string m_line ;
+		bool m_end_of_data ;
+		// The current line, its identifying fields, and the remainder holding the probabilities.
+		BufferedLineReader::Line m_line ;
+		std::vector< string_utils::slice > m_fields ;
+		string_utils::slice m_probabilities ;
 
-		void setup( std::string const& filename, CompressionType compression_type ) ;
-		void setup( std::auto_ptr< std::istream > stream_ptr ) ;
+		void setup() ;
 		void read_header_data() ;
 	} ;
 }
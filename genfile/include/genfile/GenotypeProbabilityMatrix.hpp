@@ -0,0 +1,118 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_GENOTYPE_PROBABILITY_MATRIX_HPP
+#define GENFILE_GENOTYPE_PROBABILITY_MATRIX_HPP
+
+#include <limits>
+#include <algorithm>
+#include <cassert>
+#include <Eigen/Core>
+#include "genfile/types.hpp"
+#include "genfile/MissingValue.hpp"
+#include "genfile/Error.hpp"
+#include "genfile/string_utils/string_utils.hpp"
+
+namespace genfile {
+	// Dense storage for the unphased genotype probabilities of all samples at one variant.
+	// This is owned by the caller and can be reused across variants to avoid reallocation.
+	// Row i of probabilities holds the probabilities for sample i, in the order used
+	// for unphased genotypes at that sample's ploidy; unused entries are zero.
+	// Samples with missing data have a zero row and missing(i) = 1.
+	struct GenotypeProbabilityMatrix {
+		typedef Eigen::MatrixXd Probabilities ;
+		typedef Eigen::VectorXi IntegerVector ;
+
+		GenotypeProbabilityMatrix():
+			number_of_alleles( 0 ),
+			min_ploidy( 0 ),
+			max_ploidy( 0 )
+		{}
+
+		Probabilities probabilities ;
+		IntegerVector ploidy ;
+		IntegerVector missing ;
+		std::size_t number_of_alleles ;
+		uint32_t min_ploidy ;
+		uint32_t max_ploidy ;
+	} ;
+
+	namespace impl {
+		// Fills a GenotypeProbabilityMatrix from unphased genotype probabilities.
+		// This class has no virtual methods, so that formats whose parsers are templated on the
+		// setter type (e.g. bgen::parse_probability_data) can fill the matrix with no virtual calls.
+		// It also satisfies the interface ToGP< Setter > expects of its client.
+		struct GenotypeProbabilityMatrixFiller {
+			typedef genfile::OrderType OrderType ;
+			typedef genfile::ValueType ValueType ;
+
+			GenotypeProbabilityMatrixFiller( GenotypeProbabilityMatrix* result ):
+				m_result( result ),
+				m_sample_i( 0 )
+			{
+				assert( result != 0 ) ;
+			}
+
+			void initialise( std::size_t number_of_samples, std::size_t number_of_alleles ) {
+				// Assume at most diploidy to begin with; we widen below if needed.
+				std::size_t const number_of_columns = std::max( number_of_alleles * ( number_of_alleles + 1 ) / 2, std::size_t( 1 ) ) ;
+				m_result->probabilities.setZero( number_of_samples, number_of_columns ) ;
+				m_result->ploidy.setConstant( number_of_samples, -1 ) ;
+				m_result->missing.setZero( number_of_samples ) ;
+				m_result->number_of_alleles = number_of_alleles ;
+				m_result->min_ploidy = std::numeric_limits< uint32_t >::max() ;
+				m_result->max_ploidy = 0 ;
+				m_sample_i = 0 ;
+			}
+
+			bool set_sample( std::size_t i ) {
+				m_sample_i = i ;
+				return true ;
+			}
+
+			void set_number_of_entries( uint32_t ploidy, std::size_t n, OrderType const order_type, ValueType const value_type ) {
+				if( order_type != ePerUnorderedGenotype || value_type != eProbability ) {
+					throw genfile::BadArgumentError(
+						"genfile::impl::GenotypeProbabilityMatrixFiller::set_number_of_entries()",
+						"order_type=" + string_utils::to_string( order_type ) + ", value_type=" + string_utils::to_string( value_type ),
+						"Unsupported order_type/value_type combination."
+					) ;
+				}
+				if( n > std::size_t( m_result->probabilities.cols() ) ) {
+					std::size_t const old_cols = m_result->probabilities.cols() ;
+					m_result->probabilities.conservativeResize( Eigen::NoChange, n ) ;
+					m_result->probabilities.rightCols( n - old_cols ).setZero() ;
+				}
+				m_result->ploidy( m_sample_i ) = ploidy ;
+				m_result->min_ploidy = std::min( ploidy, m_result->min_ploidy ) ;
+				m_result->max_ploidy = std::max( ploidy, m_result->max_ploidy ) ;
+			}
+
+			void set_value( std::size_t value_i, genfile::MissingValue const value ) {
+				// Probabilities are already zero.
+			}
+
+			void set_value( std::size_t value_i, double const value ) {
+				assert( value_i < std::size_t( m_result->probabilities.cols() ) ) ;
+				m_result->probabilities( m_sample_i, value_i ) = value ;
+			}
+
+			void finalise() {
+				// Missing calls may be reported either as missing values or as zero probabilities.
+				m_result->missing = ( m_result->probabilities.rowwise().sum().array() == 0.0 ).cast< int >() ;
+				if( m_result->min_ploidy > m_result->max_ploidy ) {
+					// no samples.
+					m_result->min_ploidy = m_result->max_ploidy = 0 ;
+				}
+			}
+
+		private:
+			GenotypeProbabilityMatrix* m_result ;
+			std::size_t m_sample_i ;
+		} ;
+	}
+}
+
+#endif
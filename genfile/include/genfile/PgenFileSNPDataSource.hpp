@@ -0,0 +1,92 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_PGENFILESNPDATASOURCE_HPP
+#define GENFILE_PGENFILESNPDATASOURCE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include "genfile/snp_data_utils.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/IdentifyingDataCachingSNPDataSource.hpp"
+#include "genfile/GenomePositionRange.hpp"
+#include "genfile/BufferedLineReader.hpp"
+#include "genfile/pgen/pgen.hpp"
+
+namespace genfile {
+	namespace impl {
+		struct PgenFileSNPDataReader ;
+	}
+
+	// This class represents a SNPDataSource which reads its data from a PLINK 2 .pgen file,
+	// with variants described by the .pvar file and samples by the .psam file.
+	// Genotypes are reported as GT hardcalls, with phase where present, and DS dosages.
+	// For :genotypes:, records with dosages are reported as genotype probabilities and
+	// other records as hardcalls.
+	class PgenFileSNPDataSource: public IdentifyingDataCachingSNPDataSource
+	{
+		friend struct impl::PgenFileSNPDataReader ;
+	public:
+		PgenFileSNPDataSource( std::string const& pgenFilename, std::string const& pvarFilename, std::string const& psamFilename ) ;
+
+		Metadata get_metadata() const ;
+		unsigned int number_of_samples() const { return m_index.number_of_samples ; }
+		bool has_sample_ids() const { return true ; }
+		void get_sample_ids( GetSampleIds ) const ;
+		OptionalSnpCount total_number_of_snps() const ;
+		operator bool() const { return !m_exhausted && *m_pgen_stream_ptr ; }
+		std::string get_source_spec() const { return m_pgen_filename ; }
+
+		// Restrict this source to variants lying in one of the given ranges.
+		// Genotype records of other variants are skipped using the index in the .pgen header.
+		void set_ranges( std::vector< GenomePositionRange > const& ranges ) ;
+
+	private:
+		void reset_to_start_impl() ;
+
+		void read_snp_identifying_data_impl( VariantIdentifyingData* result ) ;
+		VariantDataReader::UniquePtr read_variant_data_impl() ;
+		void ignore_snp_probability_data_impl() ;
+
+		bool read_pvar_line( std::vector< string_utils::slice >* elts ) ;
+		void read_record( std::size_t variant, pgen::Record* result, bool hardcalls_only ) ;
+
+	private:
+		std::string const m_pgen_filename ;
+		std::string const m_pvar_filename ;
+		std::auto_ptr< std::istream > m_pgen_stream_ptr ;
+		uint64_t m_pgen_stream_position ;
+		pgen::Index m_index ;
+		std::vector< std::string > m_sample_ids ;
+
+		std::auto_ptr< std::istream > m_pvar_stream_ptr ;
+		std::auto_ptr< BufferedLineReader > m_pvar_reader ;
+		// Column indices of #CHROM, POS, ID, REF and ALT in the .pvar file.
+		std::vector< std::size_t > m_pvar_columns ;
+		std::size_t m_number_of_pvar_header_lines ;
+		// The current .pvar line, which m_pvar_elts refer into.
+		BufferedLineReader::Line m_pvar_line ;
+		std::vector< string_utils::slice > m_pvar_elts ;
+
+		std::vector< GenomePositionRange > m_ranges ;
+		bool m_exhausted ;
+		// The index of the next variant in the .pvar file, and of the variant last read.
+		std::size_t m_next_variant ;
+		std::size_t m_current_variant ;
+
+		// Hardcalls of the most recently decoded record that is not LD-compressed.
+		std::size_t m_ld_base_variant ;
+		std::vector< pgen::byte_t > m_ld_base ;
+		std::vector< pgen::byte_t > m_buffer ;
+
+	private:
+		void setup( std::string const& psamFilename ) ;
+		void open_pvar() ;
+	} ;
+}
+
+#endif
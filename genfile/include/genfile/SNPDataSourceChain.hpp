@@ -18,6 +18,8 @@
 #include "wildcard.hpp"
 
 namespace genfile {
+	class VariantReadAheadQueue ;
+
 	// class SNPDataSourceChain represnets a SNPDataSource
 	// which gets it data sequentially from a collection of other SNPDataSources
 	class SNPDataSourceChain: public SNPDataSource
@@ -46,6 +48,18 @@ namespace genfile {
 
 		void add_source( std::auto_ptr< SNPDataSource > source ) ;
 
+		// Read and decode the sources (e.g. the per-chromosome files matching a '#' wildcard)
+		// on separate threads, with up to number_of_sources of them read at once ahead of the
+		// current one.  Each thread queues up to number_of_variants variants, caching the given
+		// specs as for CachedVariantDataReader.  Variants are still returned in chain order.
+		// This must be called after all sources are added; a value of 0 turns this off.
+		void set_read_ahead(
+			std::size_t number_of_sources,
+			std::size_t number_of_variants,
+			std::vector< std::string > const& specs,
+			bool cache_supported_specs = false
+		) ;
+
 		Metadata get_metadata() const ;
 		unsigned int number_of_samples() const ;
 		bool has_sample_ids() const ;
@@ -84,11 +98,17 @@ VariantIdentifyingData* variant		) ;
 
 		void move_to_next_source() ;
 		void move_to_next_nonempty_source_if_necessary() ;
+		void start_read_ahead( std::size_t source_index ) ;
 
 		std::vector< SNPDataSource* > m_sources ;
 		std::size_t m_current_source ;
 		unsigned int m_number_of_samples ;
 		Metadata m_metadata ;
+
+		// When reading ahead, m_read_ahead has one queue per source.
+		std::vector< VariantReadAheadQueue* > m_read_ahead ;
+		std::size_t m_number_of_sources_read_ahead ;
+		VariantDataReader::UniquePtr m_current_data ;
 		
 		moved_to_next_source_callback_t m_moved_to_next_source_callback ;
 	} ;
@@ -7,6 +7,8 @@
 #ifndef GENFILE_SNP_DATA_SOURCE_PROCESSOR_HPP
 #define GENFILE_SNP_DATA_SOURCE_PROCESSOR_HPP
 
+#include <vector>
+#include <string>
 #include <boost/function.hpp>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
@@ -57,6 +59,34 @@ namespace genfile {
 	public:
 		virtual void process( genfile::SNPDataSource& source, ProgressCallback = ProgressCallback() ) ;		
 	} ;
+
+	class ThreadedSNPDataSourceProcessor: public SNPDataSourceProcessor
+		// This class reads SNPs on the calling thread in batches, caching the data
+		// for the given specs (see CachedVariantDataReader), and hands each batch to
+		// a pool of worker threads.  Each callback is owned by one worker thread, so
+		// each callback sees the SNPs in file order, but different callbacks run in
+		// parallel with each other and with reading of the next batch.
+		// Callbacks must therefore not share unsynchronised state.
+		// If cache_supported_specs is true, every spec listed by the source's readers is
+		// cached in addition to the given specs (this is needed e.g. to write all VCF fields).
+	{
+	public:
+		ThreadedSNPDataSourceProcessor(
+			std::size_t number_of_threads,
+			std::vector< std::string > const& specs,
+			bool cache_supported_specs = false,
+			std::size_t batch_size = 64,
+			std::size_t max_batches_in_flight = 2
+		) ;
+		virtual void process( genfile::SNPDataSource& source, ProgressCallback = ProgressCallback() ) ;
+
+	private:
+		std::size_t const m_number_of_threads ;
+		std::vector< std::string > const m_specs ;
+		bool const m_cache_supported_specs ;
+		std::size_t const m_batch_size ;
+		std::size_t const m_max_batches_in_flight ;
+	} ;
 }
 
 
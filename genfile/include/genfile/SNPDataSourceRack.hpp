@@ -15,6 +15,8 @@
 
 namespace genfile {
 	
+	class VariantReadAheadQueue ;
+
 	namespace impl {
 		struct RackVariantDataReader ;
 	}
@@ -81,6 +83,18 @@ namespace genfile {
 		std::size_t number_of_sources() const ;
 		SNPDataSource& get_source( std::size_t ) const ;
 
+		// Read each source on its own thread, up to number_of_variants variants ahead.
+		// The data for the given specs (and, if cache_supported_specs is true, for all the specs
+		// the source supports) is decoded on that thread.  Cohorts are then matched by merging
+		// the read-ahead queues using hashes of the compared fields.
+		// Sources must not be used directly while reading ahead.
+		// Passing number_of_variants = 0 turns read-ahead off.  This also resets the rack to the start.
+		void set_read_ahead(
+			std::size_t number_of_variants,
+			std::vector< std::string > const& specs,
+			bool cache_supported_specs = false
+		) ;
+
 		Metadata get_metadata() const ;
 		unsigned int number_of_samples() const ;
 		bool has_sample_ids() const ;
@@ -108,6 +122,15 @@ namespace genfile {
 			VariantIdentifyingData const& reference_snp,
 			VariantIdentifyingData* result
 		) ;
+
+		// Find the next variant present in all sources, using the read-ahead queues.
+		bool get_matching_variants_from_read_ahead( std::vector< VariantIdentifyingData >* variants ) ;
+
+		// Combine the identifiers of the matching variants and record the allele flips for each source.
+		void merge_matching_variants(
+			std::vector< VariantIdentifyingData > const& variants,
+			VariantIdentifyingData* result
+		) ;
 		
 		std::vector< VariantIdentifyingData > get_intersected_snps(
 			std::vector< VariantIdentifyingData > const& snps1,
@@ -132,6 +155,9 @@ namespace genfile {
 		friend struct impl::RackVariantDataReader ;
 
 		std::vector< SNPDataSource* > m_sources ;
+		std::vector< VariantReadAheadQueue* > m_read_ahead ;
+		// When reading ahead, the decoded data for the current variant in each source.
+		std::vector< VariantDataReader::SharedPtr > m_current_data ;
 		std::vector< char > m_flips ;
 		uint32_t m_number_of_samples ;
 		bool m_read_past_end ;
@@ -76,6 +76,8 @@ namespace genfile {
 
 		std::auto_ptr< SNPDataSource > m_source ;
 		std::vector< std::size_t > m_indices_of_samples_to_filter_out ;
+		// The complement of the above, which is passed to readers that can skip samples themselves.
+		std::vector< std::size_t > m_indices_of_samples_to_keep ;
 		std::vector< double > m_genotype_data ;
 	} ;
 }
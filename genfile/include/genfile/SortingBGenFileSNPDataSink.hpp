@@ -11,6 +11,7 @@
 #include <string>
 #include <utility>
 #include <map>
+#include <deque>
 #include <stdint.h>
 #include "genfile/snp_data_utils.hpp"
 #include "genfile/SNPDataSink.hpp"
@@ -41,6 +42,11 @@ namespace genfile {
 		
 		void set_sample_names_impl( std::size_t number_of_samples, SampleNameGetter ) ;
 		void set_metadata_impl( Metadata const& ) ;
+
+		// Report the final location of each variant in the sorted file, e.g. to build an index.
+		// Locations are reported in file order when the sink is destroyed.
+		// (Callbacks set on the wrapped sink instead see the unsorted locations.)
+		void send_variant_locations_to( BasicBGenFileSNPDataSink::VariantLocationCallback callback ) ;
 		
 	public:
 		// return the number of samples represented in SNPs in the file.
@@ -63,6 +69,13 @@ namespace genfile {
 		> OffsetMap ;
 		OffsetMap m_file_offsets ;
 		std::ostream::streampos m_offset_of_first_snp ;
+		BasicBGenFileSNPDataSink::VariantLocationCallback m_variant_location_callback ;
+		// If the wrapped sink is a bgen sink, it reports where each variant was written.
+		// This lets it write variants in the background.  These are the entries still waiting for a location.
+		bool m_sink_reports_locations ;
+		std::deque< OffsetMap::iterator > m_unlocated_variants ;
+
+		void set_variant_location( int64_t offset, int64_t size ) ;
 	} ;
 }
 
@@ -13,6 +13,7 @@
 #include <boost/optional.hpp>
 #include "genfile/VariantEntry.hpp"
 #include "genfile/SNPDataSource.hpp"
+#include "genfile/BufferedLineReader.hpp"
 #include "genfile/vcf/MetadataParser.hpp"
 #include "genfile/vcf/Types.hpp"
 #include "genfile/VariantDataReader.hpp"
@@ -64,10 +65,6 @@ namespace genfile {
 		void get_snp_identifying_data_impl( 
 VariantIdentifyingData* variant		) ;
 		
-		void get_snp_identifying_data_impl( 
-			std::istream* stream_ptr,
-VariantIdentifyingData* variant		) ;
-		
 
 		VariantDataReader::UniquePtr read_variant_data_impl() ;
 
@@ -78,6 +75,12 @@ VariantIdentifyingData* variant		) ;
 		std::string const m_spec ;
 		CompressionType m_compression_type ;
 		std::auto_ptr< std::istream > m_stream_ptr ;
+		// Data lines are read in blocks through m_line_reader.
+		// m_line is the current line and m_line_position the start of its unparsed part.
+		BufferedLineReader m_line_reader ;
+		BufferedLineReader::Line m_line ;
+		char const* m_line_position ;
+		bool m_end_of_data ;
 		vcf::MetadataParser::UniquePtr m_metadata_parser ;
 		vcf::MetadataParser::Metadata m_metadata  ;
 		typedef boost::ptr_map< std::string, vcf::VCFEntryType > EntryTypeMap ;
@@ -20,6 +20,7 @@
 #include "genfile/SingleSNPGenotypeProbabilities.hpp"
 #include "genfile/BasicTypes.hpp"
 #include "genfile/vcf/Types.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
 
 namespace genfile {
 	class VariantDataReader: public boost::noncopyable
@@ -45,6 +46,17 @@ namespace genfile {
 		// Do NOT use this with truly const setter objects!
 		VariantDataReader& get( std::string const& spec, PerSampleSetter const& setter ) ;
 		virtual VariantDataReader& get( std::string const& spec, PerVariantSetter& setter ) ;
+		// Bulk access to unphased genotype probabilities for all samples, stored in a caller-owned matrix.
+		// The default implementation converts the data using ToGP via get() above; readers override this
+		// to fill the matrix directly, avoiding a virtual call per value.
+		virtual VariantDataReader& get_probabilities( std::string const& spec, GenotypeProbabilityMatrix* result ) ;
+		// Restrict subsequent calls to get() and get_probabilities() to the samples with the given
+		// indices, which must be sorted and distinct.  These are then reported as samples 0, 1, ...
+		// and get_number_of_samples() returns their number.  The vector is not copied and must
+		// outlive this reader.
+		// Readers that can skip unwanted samples while decoding override this and return true.
+		// The default returns false, in which case the caller must filter samples itself.
+		virtual bool set_sample_subset( std::vector< std::size_t > const& samples ) ;
 		virtual bool supports( std::string const& spec ) const = 0 ;
 		virtual void get_supported_specs( SpecSetter ) const = 0 ;
 		virtual std::size_t get_number_of_samples() const = 0 ;
@@ -97,6 +97,8 @@ namespace genfile {
 			enum { eIDs = 0x1, eRSID = 0x2, ePosition = 0x4, eAlleles = 0x8, eAlternateIDs = 0x10, eMask = 0x1F } ;
 			bool operator()( VariantIdentifyingData const& left, VariantIdentifyingData const& right ) const ;
 			bool are_equal( VariantIdentifyingData const& left, VariantIdentifyingData const& right ) const ;
+			// Hash the compared fields, so that variants for which are_equal() is true have equal hashes.
+			std::size_t hash( VariantIdentifyingData const& value ) const ;
 			bool check_if_comparable_fields_are_known( VariantIdentifyingData const& value ) const ;
 			std::vector< int > const& get_compared_fields() const { return m_fields_to_compare ;}
 			
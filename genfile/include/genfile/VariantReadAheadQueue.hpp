@@ -0,0 +1,97 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_VARIANT_READ_AHEAD_QUEUE_HPP
+#define GENFILE_VARIANT_READ_AHEAD_QUEUE_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/ptr_container/ptr_deque.hpp>
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/VariantIdentifyingData.hpp"
+#include "genfile/VariantDataReader.hpp"
+
+namespace genfile {
+	// class VariantReadAheadQueue
+	// Reads variants from a source on a separate thread, decoding the given specs of each
+	// into a CachedVariantDataReader, and queues them for the owner to consume.
+	// The owner may look ahead in the queue and remove entries from anywhere in it.
+	// While the queue is running, the source must not be used by any other thread.
+	class VariantReadAheadQueue {
+	public:
+		typedef std::auto_ptr< VariantReadAheadQueue > UniquePtr ;
+		typedef boost::function< std::size_t ( VariantIdentifyingData const& ) > Hasher ;
+
+		struct Entry {
+			typedef std::auto_ptr< Entry > UniquePtr ;
+			VariantIdentifyingData variant ;
+			// The hash of the variant, or 0 if no hasher was given.
+			std::size_t key ;
+			VariantDataReader::UniquePtr data ;
+		} ;
+
+	public:
+		// Queue up to number_of_variants variants.  If a hasher is given, it is called
+		// on the reading thread to fill in the key of each entry.
+		VariantReadAheadQueue(
+			SNPDataSource& source,
+			std::size_t number_of_variants,
+			std::vector< std::string > const& specs,
+			bool cache_supported_specs = false,
+			Hasher hasher = Hasher()
+		) ;
+		~VariantReadAheadQueue() ;
+
+		// Start reading from the current position of the source.
+		void start() ;
+		// Stop reading and discard any queued variants.
+		void stop() ;
+		bool started() const { return m_thread.get() != 0 ; }
+
+		// Return the i-th queued variant, waiting for it to be read if necessary,
+		// or 0 if the source ends before it.
+		// Errors in the source are rethrown here once the preceding variants have been consumed.
+		Entry const* peek( std::size_t i ) ;
+		// Remove the i-th queued variant.
+		void erase( std::size_t i ) ;
+		// Remove the i-th queued variant and return it.
+		Entry::UniquePtr take( std::size_t i ) ;
+
+	private:
+		typedef boost::mutex Mutex ;
+		typedef Mutex::scoped_lock ScopedLock ;
+		typedef boost::condition ConditionVariable ;
+
+		SNPDataSource& m_source ;
+		std::size_t const m_number_of_variants ;
+		std::vector< std::string > const m_specs ;
+		bool const m_cache_supported_specs ;
+		Hasher const m_hasher ;
+
+		boost::ptr_deque< Entry > m_queue ;
+		std::size_t m_wanted ;
+		bool m_end_of_data ;
+		bool m_stop ;
+		boost::exception_ptr m_error ;
+
+		std::auto_ptr< boost::thread > m_thread ;
+		Mutex m_mutex ;
+		ConditionVariable m_space_available ;
+		ConditionVariable m_entry_available ;
+
+	private:
+		void read_loop() ;
+		VariantReadAheadQueue( VariantReadAheadQueue const& ) ;
+		VariantReadAheadQueue& operator=( VariantReadAheadQueue const& ) ;
+	} ;
+}
+
+#endif
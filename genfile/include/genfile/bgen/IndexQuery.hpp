@@ -0,0 +1,34 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_BGEN_INDEX_QUERY_HPP
+#define GENFILE_BGEN_INDEX_QUERY_HPP
+
+#include <memory>
+#include <utility>
+#include <stdint.h>
+
+namespace genfile {
+	namespace bgen {
+		// class IndexQuery
+		// Represents the result of looking up a set of variants in an index of a bgen file.
+		// Each variant is reported as the offset of its data in the file (i.e. the start of
+		// its identifying data block) and the total size in bytes of its identifying data
+		// and genotype data blocks.  Variants are reported in file order.
+		// Implementations (e.g. one backed by a .bgi file) live outside this library.
+		class IndexQuery {
+		public:
+			typedef std::auto_ptr< IndexQuery > UniquePtr ;
+			typedef std::pair< int64_t, int64_t > FileRange ;
+
+		public:
+			virtual ~IndexQuery() {}
+			virtual std::size_t number_of_variants() const = 0 ;
+			virtual FileRange locate_variant( std::size_t index ) const = 0 ;
+		} ;
+	}
+}
+
+#endif
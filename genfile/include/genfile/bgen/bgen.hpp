@@ -205,6 +205,14 @@ namespace genfile {
 			Context const& context
 		) ;
 
+		// Low-level function which reads the size of the genotype data block at the current
+		// position in the stream, leaving the stream positioned at the start of the raw probability data.
+		// The raw data occupies the returned number of bytes.
+		uint32_t read_genotype_data_block_size(
+			std::istream& aStream,
+			Context const& context
+		) ;
+
 		// Low-level function which reads raw probability data from a genotype data block
 		// contained in the input stream into a supplied buffer. The buffer will be resized
 		// to fit the data (incurring an allocation if the buffer is not large enough.)
@@ -234,6 +242,15 @@ namespace genfile {
 			std::vector< byte_t >* buffer2
 		) ;
 
+		// As above, but uncompressing raw probability data stored in the range [begin, end).
+		// This lets callers uncompress data held elsewhere (e.g. in a memory-mapped file) without copying it first.
+		void uncompress_probability_data(
+			Context const& context,
+			byte_t const* begin,
+			byte_t const* const end,
+			std::vector< byte_t >* buffer2
+		) ;
+
 		// template< typename Setter >
 		// parse uncompressed genotype probability data stored in the given buffer.
 		// Values are returned as doubles or as missing values using the
@@ -870,70 +887,64 @@ namespace genfile {
 #endif
 				} ;
 				
-				// Optimised bit parser implementations
-				template<int bits>
-				struct SpecialisedBitParser ;
-
-				// Specialisation for 8 bit data
-				template<>
-				struct SpecialisedBitParser<8> {
-					SpecialisedBitParser(
-						byte_t const* buffer,
-						byte_t const* const end
-					):
-						m_buffer( buffer ),
-						m_end( end )
-					{}
-
-					// check we can consume n more values
-					bool check( std::size_t n ) const {
-						return (m_buffer + n) <= m_end ;
-					}
+				// Unpack n values stored using the given number of bits (1-32) starting at buffer,
+				// scaling each to the range [0,1], and store them in result.
+				// Each bit depth is handled by its own kernel in which all shifts and masks
+				// are compile-time constants, allowing the compiler to unroll and vectorise it;
+				// the kernel is selected at runtime from the bit depth.
+				// Returns a pointer to the byte containing the next unread bit.
+				byte_t const* unpack_probabilities(
+					byte_t const* buffer,
+					byte_t const* const end,
+					int const bits,
+					std::size_t const n,
+					double* result
+				) ;
 
-					double next() {
-						return double(
-							(*reinterpret_cast< uint8_t const* >( m_buffer++ ))
-						) / 255.0;
+				// Optimised parser that unpacks all values in the block up front
+				// using unpack_probabilities(), then returns them one at a time.
+				// Storage for the values is supplied by the caller so it can be reused.
+				struct BlockBitParser {
+					BlockBitParser(
+						byte_t const* buffer,
+						byte_t const* const end,
+						int const bits,
+						std::vector< double >* storage
+					) {
+						assert( storage != 0 ) ;
+						if( bits < 1 || bits > 32 ) {
+							throw BGenError() ;
+						}
+						std::size_t const n = ( std::size_t( end - buffer ) * 8 ) / bits ;
+						storage->resize( n ) ;
+						if( n > 0 ) {
+							unpack_probabilities( buffer, end, bits, n, &(*storage)[0] ) ;
+						}
+						m_values = n > 0 ? &(*storage)[0] : 0 ;
+						m_end = m_values + n ;
 					}
 
-				private:
-					byte_t const* m_buffer ;
-					byte_t const* const m_end ;
-				} ;
-
-				// Specialisation for 16 bit data
-				template<>
-				struct SpecialisedBitParser<16> {
-					SpecialisedBitParser(
-						byte_t const* buffer,
-						byte_t const* const end
+					// Return values that have already been unpacked.
+					BlockBitParser(
+						double const* values,
+						double const* const end
 					):
-						m_buffer( buffer ),
+						m_values( values ),
 						m_end( end )
-					{}	
+					{}
 
 					// check we can consume n more values
 					bool check( std::size_t n ) const {
-						return (m_buffer + 2*n) <= m_end ;
+						return (m_values + n) <= m_end ;
 					}
 
 					double next() {
-#if BGEN_LITTLE_ENDIAN
-						double const value = double(
-							*reinterpret_cast< uint16_t const* >( m_buffer )
-						) / 65535.0 ;
-#else // BGEN_BIG_ENDIAN
-						// machine is big-endian, get bytes in right order.
-						uint16_t data = uint16_t(*m_buffer) | uint16_t(*(m_buffer+1)) << 8 ;
-						double const value = double(data) / 65535.0 ;
-#endif
-						m_buffer += 2 ;
-						return value ;
+						return *m_values++ ;
 					}
 
 				private:
-					byte_t const* m_buffer ;
-					byte_t const* const m_end ;
+					double const* m_values ;
+					double const* m_end ;
 				} ;
 
 				// Round a point on the unit simplex (expressed as n floating-point probabilities)
@@ -1038,73 +1049,72 @@ namespace genfile {
 				this->end = end ;
 			}
 			
+			namespace impl {
+				// Gather the ploidy bytes and unpacked values for the given samples (which must be
+				// sorted and distinct) from the given block.
+				// Runs of consecutive samples are unpacked in bulk; the values for other samples
+				// are skipped without being decoded.
+				void unpack_sample_subset(
+					GenotypeDataBlock const& pack,
+					std::vector< std::size_t > const& samples,
+					std::vector< byte_t >* ploidy,
+					std::vector< double >* values
+				) ;
+			}
+
+			// Parse probability data for the given subset of samples only,
+			// which are reported to the setter as samples 0, 1, ...
 			template< typename Setter >
 			void parse_probability_data(
 				byte_t const* buffer,
 				byte_t const* const end,
 				Context const& context,
+				std::vector< std::size_t > const& samples,
 				Setter& setter
 			) {
 				GenotypeDataBlock pack( context, buffer, end ) ;
+				std::vector< byte_t > ploidy ;
+				std::vector< double > values ;
+				impl::unpack_sample_subset( pack, samples, &ploidy, &values ) ;
+
+				GenotypeDataBlock subset ;
+				subset.numberOfSamples = samples.size() ;
+				subset.numberOfAlleles = pack.numberOfAlleles ;
+				subset.ploidyExtent[0] = pack.ploidyExtent[0] ;
+				subset.ploidyExtent[1] = pack.ploidyExtent[1] ;
+				subset.ploidy = ploidy.empty() ? 0 : &ploidy[0] ;
+				subset.phased = pack.phased ;
+				subset.bits = pack.bits ;
+				subset.buffer = pack.buffer ;
+				subset.end = pack.end ;
+
+				double const* const values_begin = values.empty() ? 0 : &values[0] ;
+				impl::BlockBitParser valueConsumer( values_begin, values_begin + values.size() ) ;
+				if( pack.ploidyExtent[0] == 2 && pack.ploidyExtent[1] == 2 && pack.numberOfAlleles == 2 ) {
+					parse_probability_data_diploid_biallelic( subset, valueConsumer, context, setter ) ;
+				} else {
+					parse_probability_data_general( subset, valueConsumer, context, setter ) ;
+				}
+			}
 
-				// We optimise the most common and simplest-to- parse cases.
-				// These are the case where all samples are diploid, and/or where
-				// the number of bits is a multiple of 8.
-				// This if statement chooses an appropriate implementation.
+			template< typename Setter >
+			void parse_probability_data(
+				byte_t const* buffer,
+				byte_t const* const end,
+				Context const& context,
+				Setter& setter
+			) {
+				GenotypeDataBlock pack( context, buffer, end ) ;
+
+				// Values for all bit depths are unpacked in bulk by BlockBitParser.
+				// We also optimise the most common and simplest-to-parse case,
+				// where all samples are diploid and the variant is biallelic.
+				std::vector< double > values ;
+				impl::BlockBitParser valueConsumer( pack.buffer, pack.end, pack.bits, &values ) ;
 				if( pack.ploidyExtent[0] == 2 && pack.ploidyExtent[1] == 2 && pack.numberOfAlleles == 2 ) {
-					switch( pack.bits ) {
-						case 8:
-							parse_probability_data_diploid_biallelic(
-								pack,
-								impl::SpecialisedBitParser<8>( pack.buffer, pack.end ),
-								context,
-								setter
-							) ;
-							break ;
-						case 16:
-							parse_probability_data_diploid_biallelic(
-								pack,
-								impl::SpecialisedBitParser<16>( pack.buffer, pack.end ),
-								context,
-								setter
-							) ;
-							break ;
-						default:
-							parse_probability_data_diploid_biallelic(
-								pack,
-								impl::BitParser( pack.buffer, pack.end, pack.bits ),
-								context,
-								setter
-							) ;
-							break ;
-					}
+					parse_probability_data_diploid_biallelic( pack, valueConsumer, context, setter ) ;
 				} else {
-					switch( pack.bits ) {
-						case 8:
-							parse_probability_data_general(
-								pack,
-								impl::SpecialisedBitParser<8>( pack.buffer, pack.end ),
-								context,
-								setter
-							) ;
-							break ;
-						case 16:
-							parse_probability_data_general(
-								pack,
-								impl::SpecialisedBitParser<16>( pack.buffer, pack.end ),
-								context,
-								setter
-							) ;
-							break ;
-						default:
-							parse_probability_data_general(
-								pack,
-								impl::BitParser( pack.buffer, pack.end, pack.bits ),
-								context,
-								setter
-							) ;
-							break ;
-					}
+					parse_probability_data_general( pack, valueConsumer, context, setter ) ;
 				}
 			}
 
@@ -1690,6 +1700,10 @@ namespace genfile {
 			return p ;
 		}
 
+		// Write genotype data blocks.
+		// If compression_level is negative, a default level for the compression type is used.
+		// If zstd_context is nonzero it is used for zstd compression; it must not be used by
+		// another thread at the same time.
 		struct GenotypeDataBlockWriter
 		{
 			GenotypeDataBlockWriter(
@@ -1697,13 +1711,17 @@ namespace genfile {
 				std::vector< byte_t >* buffer2,
 				Context const& context,
 				int const number_of_bits,
-				double permitted_rounding_error = 0.0005
+				double permitted_rounding_error = 0.0005,
+				int const compression_level = -1,
+				ZSTD_CCtx* zstd_context = 0
 			):
 				m_buffer1( buffer1 ),
 				m_buffer2( buffer2 ),
 				m_context( context ),
 				m_layout( m_context.flags & e_Layout ),
 				m_number_of_bits( number_of_bits ),
+				m_compression_level( compression_level ),
+				m_zstd_context( zstd_context ),
 				m_layout1_writer(),
 				m_layout2_writer( number_of_bits, permitted_rounding_error ),
 				m_writer(0)
@@ -1772,14 +1790,15 @@ namespace genfile {
 							&(*m_buffer1)[0], &(*m_buffer1)[0] + uncompressed_data_size,
 							m_buffer2,
 							offset,
-							9 // highest compression setting.
+							( m_compression_level < 0 ) ? 9 : m_compression_level // default is highest compression setting.
 						) ;
 					} else if( compressionType == e_ZstdCompression ) {
 						zstd_compress(
+							m_zstd_context,
 							&(*m_buffer1)[0], &(*m_buffer1)[0] + uncompressed_data_size,
 							m_buffer2,
 							offset,
-							17 // reasonable balance between speed and compression.
+							( m_compression_level < 0 ) ? 17 : m_compression_level // default is a reasonable balance between speed and compression.
 						) ;
 					} else {
 						assert(0) ;
@@ -1820,6 +1839,8 @@ namespace genfile {
 			Context const& m_context ;
 			uint32_t const m_layout ;
 			std::size_t m_number_of_bits ;
+			int const m_compression_level ;
+			ZSTD_CCtx* m_zstd_context ;
 			v11::ProbabilityDataWriter m_layout1_writer ;
 			v12::ProbabilityDataWriter m_layout2_writer ;
 			impl::ProbabilityDataWriterBase* m_writer ;
@@ -18,6 +18,7 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <cstring>
 #include <stdint.h>
 #include <boost/format.hpp>
 #include "genfile/snp_data_utils.hpp"
@@ -156,6 +157,72 @@ namespace genfile {
 			}
 		}
 
+		namespace impl {
+			// Split the first number_of_fields whitespace-separated fields from the given line of a GEN file
+			// into fields, and return the remainder of the line, which holds
+			// the probabilities.  The fields are separated from each other and from the remainder by a space or tab.
+			// Throws InputError if the line has too few fields.
+			string_utils::slice read_snp_identifying_data(
+				string_utils::slice const& line,
+				std::size_t const number_of_fields,
+				std::vector< string_utils::slice >* fields
+			) ;
+
+			// Parse one probability.  The values 0 and 1, which are common in GEN files, are handled without strtod().
+			inline double parse_probability( char const* begin, char const* end ) {
+				if( end - begin == 1 && ( *begin == '0' || *begin == '1' )) {
+					return double( *begin - '0' ) ;
+				}
+				try {
+					return string_utils::strtod( string_utils::slice( begin, end )) ;
+				}
+				catch( string_utils::StringConversionError const& ) {
+					throw InputError(
+						"(unknown)",
+						"Malformed probability \"" + std::string( begin, end ) + "\""
+					) ;
+				}
+			}
+
+			// Parse the space-separated probabilities of a GEN line (as returned by
+			// read_snp_identifying_data()) in place, passing each triple to the setter.
+			// Return the number of samples.
+			template< typename GenotypeProbabilitySetter >
+			std::size_t read_snp_probability_data(
+				string_utils::slice const& data,
+				GenotypeProbabilitySetter set_genotype_probabilities
+			) {
+				char const* p = data.begin() ;
+				char const* const end = data.end() ;
+				if( p == end ) {
+					return 0 ;
+				}
+				std::size_t count = 0 ;
+				double values[3] ;
+				while( true ) {
+					char const* q = reinterpret_cast< char const* >( std::memchr( p, ' ', end - p )) ;
+					if( !q ) {
+						q = end ;
+					}
+					values[ count % 3 ] = parse_probability( p, q ) ;
+					if( ( ++count % 3 ) == 0 ) {
+						set_genotype_probabilities( ( count / 3 ) - 1, values[0], values[1], values[2] ) ;
+					}
+					if( q == end ) {
+						break ;
+					}
+					p = q + 1 ;
+				}
+				if( count % 3 != 0 ) {
+					throw InputError(
+						"(unknown)",
+						( boost::format( "Wrong number of elements (%d, not a multiple of 3)" ) % count ).str()
+					) ;
+				}
+				return count / 3 ;
+			}
+		}
+
 		template<
 			typename NumberOfSamplesSetter,
 			typename FlagsSetter
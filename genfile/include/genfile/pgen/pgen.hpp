@@ -0,0 +1,126 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef GENFILE_PGEN_PGEN_HPP
+#define GENFILE_PGEN_PGEN_HPP
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <exception>
+#include <stdint.h>
+
+/*
+* This file contains a reader for the genotype records of PLINK 2 .pgen files.
+* Only the parts of the format needed to read biallelic hardcalls, hardcall phase and
+* dosages are implemented; records with a multiallelic hardcall track are rejected.
+* Dosage phase tracks are skipped.
+*/
+
+namespace genfile {
+	namespace pgen {
+		typedef unsigned char byte_t ;
+
+		struct PgenError: public virtual std::exception {
+			~PgenError() throw() {}
+			char const* what() const throw() { return "PgenError" ; }
+		} ;
+
+		// Storage modes, given by the third byte of the file.
+		enum StorageMode {
+			e_Plink1Mode = 0x01,					// A PLINK 1 .bed file; not supported here.
+			e_FixedWidthHardcallMode = 0x02,		// Every record holds 2-bit hardcalls only.
+			e_FixedWidthDosageMode = 0x03,			// Every record holds 2-bit hardcalls and a dosage for each sample.
+			e_VariableWidthMode = 0x10,				// Records are described by the index in the header.
+			e_ExternalIndexMode = 0x11				// As e_VariableWidthMode, with the index in a .pgi file; not supported here.
+		} ;
+
+		// Bits of the variant record type.
+		enum RecordTypeFlags {
+			e_MainTrackMask = 0x07,
+			e_MultiallelicTrack = 0x08,
+			e_PhaseTrack = 0x10,
+			e_DosageTrackMask = 0x60,
+			e_DosagePhaseTrack = 0x80
+		} ;
+
+		// Types of the main (hardcall) track, given by the low three bits of the record type.
+		enum MainTrackType {
+			e_TwoBitHardcalls = 0,
+			e_OneBitHardcalls = 1,
+			e_LDCompressed = 2,
+			e_LDCompressedInverted = 3,
+			e_HomRefWithDifferences = 4,
+			e_AllHomRef = 5,
+			e_HomAltWithDifferences = 6,
+			e_MissingWithDifferences = 7
+		} ;
+
+		// Hardcall values, counting copies of the (first) ALT allele.
+		enum Hardcall { e_HomRef = 0, e_Het = 1, e_HomAlt = 2, e_MissingHardcall = 3 } ;
+
+		// Dosages are stored as 16-bit integers in which 16384 represents one copy of the ALT allele.
+		uint16_t const e_DosageScale = 16384 ;
+		uint16_t const e_MissingDosage = 65535 ;
+
+		// Phase of a heterozygous hardcall.
+		enum Phase { e_Unphased = 0, e_RefAlt = 1, e_AltRef = 2 } ;
+
+		// Return true if records of the given type store their hardcalls relative to the
+		// hardcalls of an earlier record (the "LD base").
+		inline bool is_ld_compressed( byte_t type ) {
+			return ( type & 0x06 ) == 0x02 ;
+		}
+
+		// The header and variant index of a .pgen file.
+		struct Index {
+			Index() ;
+
+			StorageMode storage_mode ;
+			uint32_t number_of_variants ;
+			uint32_t number_of_samples ;
+			// The type of each variant record.
+			std::vector< byte_t > types ;
+			// The file offset of each record, followed by the offset of the end of the last record.
+			std::vector< uint64_t > offsets ;
+
+			uint64_t record_size( std::size_t variant ) const { return offsets[ variant + 1 ] - offsets[ variant ] ; }
+			// Return the variant whose hardcalls are the LD base for the given variant,
+			// which must have an LD-compressed record type.
+			std::size_t get_ld_base( std::size_t variant ) const ;
+		} ;
+
+		// Read the header and index from the start of a .pgen file.
+		// Throws MalformedInputError (reporting the given source) if the header is malformed or unsupported.
+		void read_index( std::istream& stream, std::string const& source, Index* index ) ;
+
+		// A decoded variant record.
+		struct Record {
+			// One hardcall per sample.
+			std::vector< byte_t > hardcalls ;
+			// The phase of each sample; empty if the record has no phase track.
+			std::vector< byte_t > phases ;
+			// The ALT allele dosage of each sample; empty if the record has no dosage track.
+			// Samples without an explicit dosage have the dosage implied by their hardcall.
+			std::vector< uint16_t > dosages ;
+		} ;
+
+		// Parse the record in [buffer, end) into result.
+		// If the record is LD-compressed, ld_base must hold the hardcalls of its LD base.
+		// If hardcalls_only is true, the phase and dosage tracks are not parsed.
+		// Throws PgenError if the record is malformed or uses an unsupported track.
+		void parse_record(
+			byte_t const* buffer,
+			byte_t const* const end,
+			uint32_t const number_of_samples,
+			byte_t const type,
+			std::vector< byte_t > const& ld_base,
+			Record* result,
+			bool hardcalls_only = false
+		) ;
+	}
+}
+
+#endif
@@ -45,6 +45,17 @@ namespace genfile {
 				std::string const& data,
 				boost::ptr_map< std::string, VCFEntryType > const& entry_types
 			) ;
+
+			// Construct a CallReader reading from the given range, which is not copied;
+			// it must remain valid for the lifetime of this object.
+			CallReader(
+				std::size_t number_of_samples,
+				std::size_t number_of_alleles,
+				std::string const& format,
+				char const* data_begin,
+				char const* data_end,
+				boost::ptr_map< std::string, VCFEntryType > const& entry_types
+			) ;
 		
 			CallReader& get( std::string const& spec, Setter& setter ) ;
 		
@@ -53,12 +64,18 @@ namespace genfile {
 			~CallReader() {} ;
 		
 			void set_strict_mode( bool value ) ;
+
+			// Only parse data for the samples with the given indices, which must be sorted and distinct.
+			// These are reported to setters as samples 0, 1, ...; the data for other samples is skipped.
+			// This must be called before get(); the vector is not copied and must outlive this object.
+			void set_sample_subset( std::vector< std::size_t > const& samples ) ;
 			
 		private:
 			std::size_t const m_number_of_samples ;
 			std::size_t const m_number_of_alleles ;
 			std::vector< std::string > const m_format_elts ;
-			std::string const m_data ;
+			std::string const m_data_storage ;
+			string_utils::slice const m_data ;
 			boost::ptr_map< std::string, VCFEntryType > const& m_entry_types ;
 			std::size_t m_index ;
 			std::vector< VCFEntryType const* > m_entries_by_position ;
@@ -71,7 +88,13 @@ namespace genfile {
 			std::vector< std::size_t > m_ploidy ;
 			std::vector< OrderType > m_order_types ;
 			bool m_strict_mode ;
+			// If non-null, the subset of samples to report.
+			std::vector< std::size_t > const* m_samples ;
 		private:
+			void check_arguments() const ;
+			std::size_t number_of_reported_samples() const ;
+			// Return the index in the data of the given reported sample.
+			std::size_t get_sample_index( std::size_t reported_sample_i ) const ;
 			void split_data() ;
 			void load_genotypes() ;
 			void set_values(
@@ -37,6 +37,16 @@ namespace genfile {
 		std::size_t const offset = 0,
 		int const compressionLevel = 22
 	) ;
+	// As above, but using the given zstd compression context.  Reusing one context
+	// for many calls (e.g. one per thread) avoids reallocating its working memory each time.
+	void zstd_compress(
+		ZSTD_CCtx* context,
+		byte_t const* buffer,
+		byte_t const* const end,
+		std::vector< byte_t >* dest,
+		std::size_t const offset = 0,
+		int const compressionLevel = 22
+	) ;
 
 	// Compress the given data into the given destination buffer.  The destination will be resized
 	// to fit the compressed data.  (Since the capacity of dest may be larger than its size,
@@ -6,15 +6,262 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <deque>
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/exception_ptr.hpp>
 #include "genfile/snp_data_utils.hpp"
 #include "genfile/SNPDataSink.hpp"
 #include "genfile/bgen/bgen.hpp"
 #include "genfile/Error.hpp"
 #include "genfile/BGenFileSNPDataSink.hpp"
 #include "genfile/ToGP.hpp"
+#include "genfile/CachedVariantDataReader.hpp"
 
 namespace genfile {
+	namespace {
+		std::string get_allele( VariantIdentifyingData const* id_data, std::size_t i ) {
+			return id_data->get_allele( i ) ;
+		}
+
+		byte_t const* write_identifying_data(
+			std::vector< byte_t >* buffer,
+			bgen::Context const& context,
+			VariantIdentifyingData const& id_data
+		) {
+			std::string const& SNPID = ( id_data.number_of_identifiers() > 1 ? id_data.get_identifiers_as_string(",", 1) : id_data.get_identifiers_as_string(",", 0,1) ) ;
+			std::string chromosome ;
+			if( !id_data.get_position().chromosome().is_missing() ) {
+				chromosome = id_data.get_position().chromosome() ;
+			}
+			return bgen::write_snp_identifying_data(
+				buffer,
+				context,
+				//id_data.get_identifiers_as_string(",", 1),
+				SNPID,
+				id_data.get_primary_id(),
+				chromosome,
+				id_data.get_position().position(),
+				id_data.number_of_alleles(),
+				boost::bind( &get_allele, &id_data, _1 )
+			) ;
+		}
+	}
+
+	namespace impl {
+		// Quantises and compresses variants on a pool of worker threads, while a writer thread
+		// writes finished variants to the sink's stream in the order they were submitted.
+		// Jobs live in a fixed ring whose buffers are reused; job k uses slot k % (ring size).
+		// Location callbacks are made on the submitting thread, in order, as slots are reclaimed.
+		struct BGenWritePipeline {
+			struct Job {
+				enum State { eFree = 0, eQueued = 1, eCompressing = 2, eCompressed = 3, eWritten = 4 } ;
+				Job(): state( eFree ), offset( 0 ), size( 0 ) {}
+
+				VariantIdentifyingData variant ;
+				boost::shared_ptr< CachedVariantDataReader > data ;
+				std::vector< byte_t > id_buffer ;
+				std::vector< byte_t > buffer1 ;
+				std::vector< byte_t > buffer2 ;
+				std::pair< byte_t const*, byte_t const* > id_data ;
+				std::pair< byte_t const*, byte_t const* > genotype_data ;
+				State state ;
+				int64_t offset ;
+				int64_t size ;
+			} ;
+
+			BGenWritePipeline(
+				BasicBGenFileSNPDataSink& sink,
+				std::size_t number_of_threads,
+				std::size_t max_variants_in_flight
+			):
+				m_sink( sink ),
+				m_jobs( std::max( max_variants_in_flight, std::size_t( 1 ) ) ),
+				m_number_of_jobs_submitted( 0 ),
+				m_number_of_jobs_written( 0 ),
+				m_number_of_jobs_reported( 0 ),
+				m_good( true ),
+				m_stop( false )
+			{
+				for( std::size_t i = 0; i < std::max( number_of_threads, std::size_t( 1 ) ); ++i ) {
+					m_threads.create_thread( boost::bind( &BGenWritePipeline::compression_thread_loop, this )) ;
+				}
+				m_threads.create_thread( boost::bind( &BGenWritePipeline::writer_thread_loop, this )) ;
+			}
+
+			~BGenWritePipeline() {
+				{
+					ScopedLock lock( m_mutex ) ;
+					m_stop = true ;
+					m_changed.notify_all() ;
+				}
+				m_threads.join_all() ;
+			}
+
+			bool good() const {
+				ScopedLock lock( m_mutex ) ;
+				return m_good ;
+			}
+
+			// Take a copy of the genotype data and queue the variant for compression.
+			void submit( VariantIdentifyingData const& variant, VariantDataReader& data_reader ) {
+				std::size_t const job_i = m_number_of_jobs_submitted ;
+				if( job_i >= m_jobs.size() ) {
+					wait_until_written( job_i - m_jobs.size() + 1 ) ;
+					report_locations( job_i - m_jobs.size() + 1 ) ;
+				}
+				// The slot is now free, and only this thread touches free slots.
+				Job& job = m_jobs[ job_i % m_jobs.size() ] ;
+				job.variant = variant ;
+				job.data.reset(
+					CachedVariantDataReader::create(
+						data_reader,
+						std::vector< std::string >( 1, ":genotypes:" )
+					).release()
+				) ;
+				{
+					ScopedLock lock( m_mutex ) ;
+					job.state = Job::eQueued ;
+					m_pending.push_back( job_i % m_jobs.size() ) ;
+					++m_number_of_jobs_submitted ;
+					m_changed.notify_all() ;
+				}
+			}
+
+			// Wait until all submitted variants have been written.
+			void flush() {
+				wait_until_written( m_number_of_jobs_submitted ) ;
+				report_locations( m_number_of_jobs_submitted ) ;
+			}
+
+		private:
+			typedef boost::mutex Mutex ;
+			typedef Mutex::scoped_lock ScopedLock ;
+			typedef boost::condition ConditionVariable ;
+
+			BasicBGenFileSNPDataSink& m_sink ;
+			std::vector< Job > m_jobs ;
+			// Indices of slots waiting for compression, in submission order.
+			std::deque< std::size_t > m_pending ;
+			std::size_t m_number_of_jobs_submitted ;
+			std::size_t m_number_of_jobs_written ;
+			std::size_t m_number_of_jobs_reported ;
+			bool m_good ;
+			bool m_stop ;
+			boost::exception_ptr m_error ;
+
+			boost::thread_group m_threads ;
+			mutable Mutex m_mutex ;
+			ConditionVariable m_changed ;
+
+		private:
+			void wait_until_written( std::size_t number_of_jobs ) {
+				ScopedLock lock( m_mutex ) ;
+				while( !m_error && m_number_of_jobs_written < number_of_jobs ) {
+					m_changed.wait( lock ) ;
+				}
+				if( m_error ) {
+					boost::rethrow_exception( m_error ) ;
+				}
+			}
+
+			// Report locations of written jobs, in order, and free their slots.
+			void report_locations( std::size_t number_of_jobs ) {
+				for( ; m_number_of_jobs_reported < number_of_jobs; ++m_number_of_jobs_reported ) {
+					Job& job = m_jobs[ m_number_of_jobs_reported % m_jobs.size() ] ;
+					assert( job.state == Job::eWritten ) ;
+					if( m_sink.m_variant_location_callback ) {
+						m_sink.m_variant_location_callback( job.variant, job.offset, job.size ) ;
+					}
+					job.data.reset() ;
+					job.state = Job::eFree ;
+				}
+			}
+
+			void compression_thread_loop() {
+				ZSTD_CCtx* zstd_context = ZSTD_createCCtx() ;
+				ScopedLock lock( m_mutex ) ;
+				while( true ) {
+					while( !m_stop && !m_error && m_pending.empty() ) {
+						m_changed.wait( lock ) ;
+					}
+					if( m_stop || m_error ) {
+						break ;
+					}
+					Job& job = m_jobs[ m_pending.front() ] ;
+					m_pending.pop_front() ;
+					job.state = Job::eCompressing ;
+					lock.unlock() ;
+					try {
+						compress( job, zstd_context ) ;
+					}
+					catch( ... ) {
+						lock.lock() ;
+						m_error = boost::current_exception() ;
+						m_changed.notify_all() ;
+						break ;
+					}
+					lock.lock() ;
+					job.state = Job::eCompressed ;
+					m_changed.notify_all() ;
+				}
+				ZSTD_freeCCtx( zstd_context ) ;
+			}
+
+			void compress( Job& job, ZSTD_CCtx* zstd_context ) const {
+				bgen::Context const& context = m_sink.m_bgen_context ;
+				byte_t const* const id_end = write_identifying_data( &job.id_buffer, context, job.variant ) ;
+				job.id_data = std::make_pair( &job.id_buffer[0], id_end ) ;
+				bgen::GenotypeDataBlockWriter writer(
+					&job.buffer1, &job.buffer2,
+					context,
+					m_sink.m_number_of_bits,
+					m_sink.m_permitted_rounding_error,
+					m_sink.m_compression_level,
+					zstd_context
+				) ;
+				VariantDataReader& data_reader = *job.data ;
+				data_reader.get( ":genotypes:", to_GP( writer ) ) ;
+				job.genotype_data = writer.repr() ;
+			}
+
+			void writer_thread_loop() {
+				std::ostream& stream = *m_sink.m_stream_ptr ;
+				ScopedLock lock( m_mutex ) ;
+				while( true ) {
+					Job* job = 0 ;
+					while(
+						!m_stop && !m_error
+						&& !(
+							m_number_of_jobs_written < m_number_of_jobs_submitted
+							&& ( job = &m_jobs[ m_number_of_jobs_written % m_jobs.size() ] )->state == Job::eCompressed
+						)
+					) {
+						m_changed.wait( lock ) ;
+					}
+					if( m_stop || m_error ) {
+						return ;
+					}
+					lock.unlock() ;
+					std::ostream::pos_type const start = stream.tellp() ;
+					stream.write( reinterpret_cast< char const* >( job->id_data.first ), job->id_data.second - job->id_data.first ) ;
+					stream.write( reinterpret_cast< char const* >( job->genotype_data.first ), job->genotype_data.second - job->genotype_data.first ) ;
+					job->offset = int64_t( start ) ;
+					job->size = int64_t( stream.tellp() - start ) ;
+					lock.lock() ;
+					m_good = stream.good() ;
+					job->state = Job::eWritten ;
+					++m_number_of_jobs_written ;
+					m_changed.notify_all() ;
+				}
+			}
+		} ;
+	}
+
 	// This class is intended to be used via a derived class.
 	BasicBGenFileSNPDataSink::BasicBGenFileSNPDataSink(
 		std::string const& filename,
@@ -31,7 +278,8 @@ namespace genfile {
 		m_have_written_header( false ),
 		m_number_of_bits( number_of_bits ),
 		// assume stored probabilities are accurate to 3dps by default
-		m_permitted_rounding_error( 0.0005 ) 
+		m_permitted_rounding_error( 0.0005 ),
+		m_compression_level( -1 )
 	{
 		m_bgen_context.flags = flags ;
 		m_bgen_context.free_data = serialise( metadata ) ;
@@ -53,13 +301,20 @@ namespace genfile {
 		m_have_written_header( false ),
 		m_number_of_bits( number_of_bits ),
 		// assume stored probabilities are accurate to 3dps by default
-		m_permitted_rounding_error( 0.0005 ) 
+		m_permitted_rounding_error( 0.0005 ),
+		m_compression_level( -1 )
 	{
 		m_bgen_context.flags = flags ;
 		m_bgen_context.free_data = serialise( metadata ) ;
 		setup() ;
 	}
 
+	BasicBGenFileSNPDataSink::~BasicBGenFileSNPDataSink() {
+		// Derived classes flush the pipeline before rewriting the header.
+		// Here we just stop the threads before the stream is destroyed.
+		m_write_pipeline.reset() ;
+	}
+
 	void BasicBGenFileSNPDataSink::set_number_of_bits( int const bits ) {
 		assert( bits > 0 ) ;
 		assert( bits <= 32 ) ;
@@ -82,23 +337,56 @@ namespace genfile {
 		}
 	}
 	
+	void BasicBGenFileSNPDataSink::set_compression_level( int const level ) {
+		uint32_t const compression_type = m_bgen_context.flags & bgen::e_CompressedSNPBlocks ;
+		if(
+			( compression_type == bgen::e_ZlibCompression && level > 9 )
+			|| ( compression_type == bgen::e_ZstdCompression && ( level == 0 || level > 22 ))
+		) {
+			throw BadArgumentError(
+				"genfile::BasicBGenFileSNPDataSink::set_compression_level()",
+				"level=" + string_utils::to_string( level ),
+				"Compression level is out of range for this compression type"
+			) ;
+		}
+		m_compression_level = level ;
+	}
+
+	void BasicBGenFileSNPDataSink::set_number_of_threads( std::size_t number_of_threads, std::size_t max_variants_in_flight ) {
+		flush_pipeline() ;
+		m_write_pipeline.reset() ;
+		if( number_of_threads > 0 ) {
+			m_write_pipeline.reset( new impl::BGenWritePipeline( *this, number_of_threads, max_variants_in_flight )) ;
+		}
+	}
+
+	void BasicBGenFileSNPDataSink::flush_pipeline() const {
+		if( m_write_pipeline.get() ) {
+			m_write_pipeline->flush() ;
+		}
+	}
+
+	void BasicBGenFileSNPDataSink::finalise_impl() {
+		flush_pipeline() ;
+	}
+
 	void BasicBGenFileSNPDataSink::set_permitted_input_rounding_error( double const accuracy ) {
 		assert( accuracy >= 0 ) ;
 		m_permitted_rounding_error = accuracy ;
 	}
 
 	SNPDataSink::SinkPos BasicBGenFileSNPDataSink::get_stream_pos() const {
+		flush_pipeline() ;
 		return SinkPos( this, m_stream_ptr->tellp() ) ;
 	}
 	
 	std::string BasicBGenFileSNPDataSink::get_spec() const { return m_filename ; }
 
-	BasicBGenFileSNPDataSink::operator bool() const { return m_stream_ptr->good() ; }
-
-	namespace {
-		std::string get_allele( VariantIdentifyingData const* id_data, std::size_t i ) {
-			return id_data->get_allele( i ) ;
+	BasicBGenFileSNPDataSink::operator bool() const {
+		if( m_write_pipeline.get() ) {
+			return m_write_pipeline->good() ;
 		}
+		return m_stream_ptr->good() ;
 	}
 
 	void BasicBGenFileSNPDataSink::write_variant_data_impl(
@@ -108,23 +396,13 @@ namespace genfile {
 	) {
 		// std::cerr << id_data << ".\n" ;
 		assert( m_have_written_header ) ;
+		if( m_write_pipeline.get() ) {
+			m_write_pipeline->submit( id_data, data_reader ) ;
+			return ;
+		}
+		std::ostream::pos_type const start = m_variant_location_callback ? stream_ptr()->tellp() : std::ostream::pos_type( 0 ) ;
 		{
-			std::string const& SNPID = ( id_data.number_of_identifiers() > 1 ? id_data.get_identifiers_as_string(",", 1) : id_data.get_identifiers_as_string(",", 0,1) ) ;
-			std::string chromosome ;
-			if( !id_data.get_position().chromosome().is_missing() ) {
-				chromosome = id_data.get_position().chromosome() ;
-			}
-			byte_t const* const end = bgen::write_snp_identifying_data(
-				&m_buffer1,
-				m_bgen_context,
-				//id_data.get_identifiers_as_string(",", 1),
-				SNPID,
-				id_data.get_primary_id(),
-				chromosome,
-				id_data.get_position().position(),
-				id_data.number_of_alleles(),
-				boost::bind( &get_allele, &id_data, _1 )
-			) ;
+			byte_t const* const end = write_identifying_data( &m_buffer1, m_bgen_context, id_data ) ;
 			stream_ptr()->write( reinterpret_cast< char* >( &(m_buffer1[0]) ), end - &(m_buffer1[0]) ) ;
 		}
 
@@ -133,19 +411,24 @@ namespace genfile {
 				&m_buffer1, &m_buffer2,
 				m_bgen_context,
 				m_number_of_bits,
-				m_permitted_rounding_error
+				m_permitted_rounding_error,
+				m_compression_level
 			) ;
 			
 			data_reader.get( ":genotypes:", to_GP( writer ) ) ;
 			
 			stream_ptr()->write( reinterpret_cast< char const* >( writer.repr().first ), writer.repr().second  - writer.repr().first ) ;
 		}
+		if( m_variant_location_callback ) {
+			m_variant_location_callback( id_data, int64_t( start ), int64_t( stream_ptr()->tellp() - start ) ) ;
+		}
 	}
 
 	std::auto_ptr< std::ostream >& BasicBGenFileSNPDataSink::stream_ptr() { return m_stream_ptr ; }
 	std::string const& BasicBGenFileSNPDataSink::filename() const { return m_filename ; }
 	
 	void BasicBGenFileSNPDataSink::update_offset_and_header_block() {
+		flush_pipeline() ;
 		m_bgen_context.number_of_variants = number_of_snps_written() ;
 		m_stream_ptr->seekp( 0, std::ios_base::beg ) ;
 		if( !stream_ptr()->bad() ) {
@@ -161,6 +444,10 @@ namespace genfile {
 		m_bgen_context.free_data = free_data ;
 	}
 
+	void BasicBGenFileSNPDataSink::send_variant_locations_to( VariantLocationCallback callback ) {
+		m_variant_location_callback = callback ;
+	}
+
 	void BasicBGenFileSNPDataSink::set_write_sample_identifier_block( bool write ) {
 		uint32_t const layout = m_bgen_context.flags & bgen::e_Layout ;
 		if( write && (layout == bgen::e_Layout2) ) {
@@ -259,7 +546,14 @@ namespace genfile {
 		// We are about to close the file.
 		// To write the correct header info, we seek back to the start and rewrite the header block
 		// The header comes after the offset which is 4 bytes.
-		update_offset_and_header_block() ;
+		try {
+			update_offset_and_header_block() ;
+		}
+		catch( std::exception const& e ) {
+			// Can't throw from a destructor; errors from the write pipeline are also
+			// reported by finalise(), which should be called to detect them.
+			std::cerr << "genfile::BGenFileSNPDataSink::~BGenFileSNPDataSink(): error writing \"" << filename() << "\": " << e.what() << ".\n" ;
+		}
 	}
 }
 
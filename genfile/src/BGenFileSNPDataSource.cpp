@@ -6,8 +6,21 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+#if !defined( _WIN32 )
+#include <sys/mman.h>
+#endif
 #include "genfile/snp_data_utils.hpp"
 #include "genfile/SNPDataSource.hpp"
 #include "genfile/bgen/bgen.hpp"
@@ -15,16 +28,229 @@
 #include "genfile/zlib.hpp"
 
 namespace genfile {
+	namespace impl {
+		// Reads variants from a BGenFileSNPDataSource ahead of the consumer and decompresses
+		// their genotype data blocks on a pool of worker threads.
+		// Variants are held in a fixed ring of slots whose buffers are reused from variant to variant.
+		// The stream is only read on the consumer's thread, and slots are handed back in file order.
+		struct BGenReadAheadStage {
+			struct Slot {
+				enum State { eFree = 0, eQueued = 1, eDecompressing = 2, eDone = 3 } ;
+				Slot(): state( eFree ), complete( false ) {}
+
+				VariantIdentifyingData variant ;
+				std::vector< byte_t > compressed_data ;
+				// The raw data; this points into compressed_data, or into the file if it is memory-mapped.
+				std::pair< byte_t const*, byte_t const* > raw_data ;
+				std::vector< byte_t > uncompressed_data ;
+				State state ;
+				// false if the stream ended part way through the genotype data block.
+				bool complete ;
+				boost::exception_ptr error ;
+			} ;
+
+			BGenReadAheadStage(
+				BGenFileSNPDataSource& source,
+				std::size_t number_of_threads,
+				std::size_t number_of_slots
+			):
+				m_source( source ),
+				// One slot is held by the consumer, so we need at least two to read ahead at all.
+				m_slots( std::max( number_of_slots, std::size_t( 2 ) ) ),
+				m_current( eNoSlot ),
+				m_end_of_data( false ),
+				m_good( true ),
+				m_stop( false )
+			{
+				for( std::size_t i = 0; i < m_slots.size(); ++i ) {
+					m_free.push_back( i ) ;
+				}
+				for( std::size_t i = 0; i < number_of_threads; ++i ) {
+					m_threads.create_thread( boost::bind( &BGenReadAheadStage::worker_thread_loop, this )) ;
+				}
+			}
+
+			~BGenReadAheadStage() {
+				{
+					ScopedLock lock( m_mutex ) ;
+					m_stop = true ;
+					m_work_available.notify_all() ;
+				}
+				m_threads.join_all() ;
+			}
+
+			bool good() const { return m_good ; }
+
+			// Release the current slot, top up the ring from the stream, and
+			// return the slot holding the next variant, or 0 if there are no more variants.
+			Slot const* next() {
+				{
+					ScopedLock lock( m_mutex ) ;
+					release_current_slot( lock ) ;
+				}
+				fill_free_slots() ;
+				ScopedLock lock( m_mutex ) ;
+				if( m_queue.empty() ) {
+					m_good = false ;
+					return 0 ;
+				}
+				m_current = m_queue.front() ;
+				m_queue.pop_front() ;
+				return &m_slots[ m_current ] ;
+			}
+
+			// Wait until the genotype data for the current slot has been decompressed.
+			Slot& wait_for_current() {
+				assert( m_current != eNoSlot ) ;
+				ScopedLock lock( m_mutex ) ;
+				Slot& slot = m_slots[ m_current ] ;
+				while( slot.state != Slot::eDone ) {
+					m_work_done.wait( lock ) ;
+				}
+				if( slot.error ) {
+					boost::exception_ptr error = slot.error ;
+					slot.error = boost::exception_ptr() ;
+					boost::rethrow_exception( error ) ;
+				}
+				if( !slot.complete ) {
+					m_good = false ;
+				}
+				return slot ;
+			}
+
+			// Discard all variants read so far, ready for the source to reposition its stream.
+			void reset() {
+				ScopedLock lock( m_mutex ) ;
+				release_current_slot( lock ) ;
+				while( !m_queue.empty() ) {
+					m_current = m_queue.front() ;
+					m_queue.pop_front() ;
+					release_current_slot( lock ) ;
+				}
+				m_end_of_data = false ;
+				m_good = true ;
+			}
+
+		private:
+			typedef boost::mutex Mutex ;
+			typedef Mutex::scoped_lock ScopedLock ;
+			typedef boost::condition ConditionVariable ;
+			static std::size_t const eNoSlot = std::size_t( -1 ) ;
+
+			BGenFileSNPDataSource& m_source ;
+			std::vector< Slot > m_slots ;
+			// Slots read from the stream but not yet handed to the consumer, in file order.
+			std::deque< std::size_t > m_queue ;
+			// Slots waiting for a worker thread to decompress them, in file order.
+			std::deque< std::size_t > m_pending ;
+			std::vector< std::size_t > m_free ;
+			std::size_t m_current ;
+			bool m_end_of_data ;
+			bool m_good ;
+			bool m_stop ;
+
+			boost::thread_group m_threads ;
+			Mutex m_mutex ;
+			ConditionVariable m_work_available ;
+			ConditionVariable m_work_done ;
+
+		private:
+			// Must be called with the mutex held.
+			void release_current_slot( ScopedLock& lock ) {
+				if( m_current == eNoSlot ) {
+					return ;
+				}
+				Slot& slot = m_slots[ m_current ] ;
+				if( slot.state == Slot::eQueued ) {
+					// Not needed (e.g. the consumer ignored this variant), so don't decompress it.
+					m_pending.erase( std::find( m_pending.begin(), m_pending.end(), m_current )) ;
+				}
+				while( slot.state == Slot::eDecompressing ) {
+					m_work_done.wait( lock ) ;
+				}
+				slot.state = Slot::eFree ;
+				slot.error = boost::exception_ptr() ;
+				m_free.push_back( m_current ) ;
+				m_current = eNoSlot ;
+			}
+
+			void fill_free_slots() {
+				while( true ) {
+					std::size_t slot_i ;
+					{
+						ScopedLock lock( m_mutex ) ;
+						if( m_end_of_data || m_free.empty() ) {
+							return ;
+						}
+						slot_i = m_free.back() ;
+						m_free.pop_back() ;
+					}
+					// Free slots are owned by this thread, so we can fill this without the lock.
+					Slot& slot = m_slots[ slot_i ] ;
+					m_source.read_snp_identifying_data_from_stream( &slot.variant ) ;
+					bool const have_variant = m_source.stream().good() ;
+					if( have_variant ) {
+						slot.raw_data = m_source.read_genotype_data_block( &slot.compressed_data ) ;
+						slot.complete = m_source.stream().good() ;
+					}
+					{
+						ScopedLock lock( m_mutex ) ;
+						if( !have_variant ) {
+							m_free.push_back( slot_i ) ;
+							m_end_of_data = true ;
+						} else if( !slot.complete ) {
+							slot.state = Slot::eDone ;
+							m_queue.push_back( slot_i ) ;
+							m_end_of_data = true ;
+						} else {
+							slot.state = Slot::eQueued ;
+							m_queue.push_back( slot_i ) ;
+							m_pending.push_back( slot_i ) ;
+							m_work_available.notify_one() ;
+						}
+					}
+				}
+			}
+
+			void worker_thread_loop() {
+				ScopedLock lock( m_mutex ) ;
+				while( true ) {
+					while( !m_stop && m_pending.empty() ) {
+						m_work_available.wait( lock ) ;
+					}
+					if( m_stop ) {
+						return ;
+					}
+					Slot& slot = m_slots[ m_pending.front() ] ;
+					m_pending.pop_front() ;
+					slot.state = Slot::eDecompressing ;
+					lock.unlock() ;
+					try {
+						bgen::uncompress_probability_data( m_source.bgen_context(), slot.raw_data.first, slot.raw_data.second, &slot.uncompressed_data ) ;
+					}
+					catch( ... ) {
+						slot.error = boost::current_exception() ;
+					}
+					lock.lock() ;
+					slot.state = Slot::eDone ;
+					m_work_done.notify_all() ;
+				}
+			}
+		} ;
+	}
+
 	BGenFileSNPDataSource::BGenFileSNPDataSource( std::auto_ptr< std::istream > stream, Chromosome missing_chromosome ):
 		m_filename( "(anonymous stream)" ),
-		m_missing_chromosome( missing_chromosome )
+		m_missing_chromosome( missing_chromosome ),
+		m_index_query_position( 0 )
 	{
 		setup( stream ) ;
 	}
 	
 	BGenFileSNPDataSource::BGenFileSNPDataSource( std::string const& filename, Chromosome missing_chromosome ):
 		m_filename( filename ),
-		m_missing_chromosome( missing_chromosome )
+		m_missing_chromosome( missing_chromosome ),
+		m_index_query_position( 0 )
 	{
 		setup(
 			open_binary_file_for_input(
@@ -34,7 +260,39 @@ namespace genfile {
 		) ;
 	}
 
+	BGenFileSNPDataSource::BGenFileSNPDataSource( std::string const& filename, Chromosome missing_chromosome, AccessMode mode ):
+		m_filename( filename ),
+		m_missing_chromosome( missing_chromosome ),
+		m_index_query_position( 0 )
+	{
+		if( mode == eMemoryMappedAccess ) {
+			map_file( filename ) ;
+		} else {
+			setup(
+				open_binary_file_for_input(
+					filename,
+					get_compression_type_indicated_by_filename( filename )
+				)
+			) ;
+		}
+	}
+
+	BGenFileSNPDataSource::~BGenFileSNPDataSource() {
+		// Stop the worker threads before the stream and context are destroyed.
+		m_read_ahead.reset() ;
+	}
+
+	BGenFileSNPDataSource::operator bool() const {
+		if( m_read_ahead.get() ) {
+			return m_read_ahead->good() ;
+		}
+		return m_stream_ptr->good() ;
+	}
+
 	void BGenFileSNPDataSource::reset_to_start_impl() {
+		if( m_read_ahead.get() ) {
+			m_read_ahead->reset() ;
+		}
 		stream().clear() ;
 		stream().seekg(0) ;
 
@@ -42,6 +300,29 @@ namespace genfile {
 		bgen::uint32_t offset ;
 		bgen::read_offset( (*m_stream_ptr), &offset ) ;
 		m_stream_ptr->ignore( offset ) ;
+		m_index_query_position = 0 ;
+	}
+
+	void BGenFileSNPDataSource::set_index_query( bgen::IndexQuery::UniquePtr query ) {
+		m_index_query = query ;
+		// Reading through an index jumps around the file.
+		advise_mapped_file_access( m_index_query.get() == 0 ) ;
+		reset_to_start() ;
+	}
+
+	void BGenFileSNPDataSource::set_read_ahead( std::size_t number_of_threads, std::size_t number_of_blocks ) {
+		m_read_ahead.reset() ;
+		if( number_of_threads > 0 ) {
+			m_read_ahead.reset( new impl::BGenReadAheadStage( *this, number_of_threads, number_of_blocks )) ;
+		}
+		reset_to_start() ;
+	}
+
+	SNPDataSource::OptionalSnpCount BGenFileSNPDataSource::total_number_of_snps() const {
+		if( m_index_query.get() ) {
+			return m_index_query->number_of_variants() ;
+		}
+		return m_bgen_context.number_of_variants ;
 	}
 
 	SNPDataSource::Metadata BGenFileSNPDataSource::get_metadata() const {
@@ -104,6 +385,26 @@ namespace genfile {
 	}
 
 	void BGenFileSNPDataSource::read_snp_identifying_data_impl( VariantIdentifyingData* result ) {
+		if( m_read_ahead.get() ) {
+			impl::BGenReadAheadStage::Slot const* slot = m_read_ahead->next() ;
+			if( slot ) {
+				*result = slot->variant ;
+			}
+		} else {
+			read_snp_identifying_data_from_stream( result ) ;
+		}
+	}
+
+	void BGenFileSNPDataSource::read_snp_identifying_data_from_stream( VariantIdentifyingData* result ) {
+		if( m_index_query.get() ) {
+			if( m_index_query_position < m_index_query->number_of_variants() ) {
+				stream().seekg( m_index_query->locate_variant( m_index_query_position++ ).first ) ;
+			} else {
+				// No more variants; signal end of data.
+				stream().setstate( std::ios::eofbit | std::ios::failbit ) ;
+				return ;
+			}
+		}
 		std::string SNPID, rsid ;
 		uint32_t position ;
 		std::string chromosome_string ;
@@ -132,39 +433,62 @@ namespace genfile {
 
 	namespace impl {
 		struct BGenFileSNPDataReader: public VariantDataReader {
+			typedef std::pair< byte_t const*, byte_t const* > Range ;
+
+			// Read the genotype data block for the current variant from the source.
+			// It is uncompressed when first needed.
 			BGenFileSNPDataReader( BGenFileSNPDataSource& source ):
-				m_source( source )
+				m_source( source ),
+				m_have_uncompressed_data( false ),
+				m_samples( 0 )
 			{
 				assert( source ) ;
-				bgen::read_genotype_data_block(
-					m_source.stream(),
-					m_source.bgen_context(),
-					&m_source.m_compressed_data_buffer
-				) ;
+				m_data = m_source.read_genotype_data_block( &m_source.m_compressed_data_buffer ) ;
+				if( ( m_source.bgen_context().flags & bgen::e_CompressedSNPBlocks ) == bgen::e_NoCompression ) {
+					// Parse the raw data in place.
+					m_have_uncompressed_data = true ;
+				}
 			}
+
+			// Use genotype data that has already been uncompressed.
+			BGenFileSNPDataReader( BGenFileSNPDataSource& source, std::vector< byte_t > const& uncompressed_data ):
+				m_source( source ),
+				m_data( get_range( uncompressed_data )),
+				m_have_uncompressed_data( true ),
+				m_samples( 0 )
+			{}
 			
 			BGenFileSNPDataReader& get( std::string const& spec, PerSampleSetter& setter ) {
 				assert( spec == "GP" || spec == ":genotypes:" ) ;
-				bgen::uncompress_probability_data(
-					m_source.bgen_context(),
-					m_source.m_compressed_data_buffer,
-					&(m_source.m_uncompressed_data_buffer)
-				) ;
-				bgen::parse_probability_data(
-					&(m_source.m_uncompressed_data_buffer)[0],
-					&(m_source.m_uncompressed_data_buffer)[0] + m_source.m_uncompressed_data_buffer.size(),
-					m_source.bgen_context(),
-					setter
-				) ;
+				Range const data = get_uncompressed_data() ;
+				parse( data, setter ) ;
+				return *this ;
+			}
+
+			BGenFileSNPDataReader& get_probabilities( std::string const& spec, GenotypeProbabilityMatrix* result ) {
+				assert( spec == "GP" || spec == ":genotypes:" ) ;
+				Range const data = get_uncompressed_data() ;
+				// The parser is templated on the setter, so this fills the matrix with no virtual calls.
+				impl::GenotypeProbabilityMatrixFiller filler( result ) ;
+				parse( data, filler ) ;
 				return *this ;
 			}
+
+			// Samples are skipped while unpacking, which is supported for layout 2 data.
+			bool set_sample_subset( std::vector< std::size_t > const& samples ) {
+				if( ( m_source.bgen_context().flags & bgen::e_Layout ) != bgen::e_Layout2 ) {
+					return false ;
+				}
+				m_samples = &samples ;
+				return true ;
+			}
 			
 			bool supports( std::string const& spec ) const {
 				return spec == "GP" || spec == ":genotypes:";
 			}
 			
 			std::size_t get_number_of_samples() const {
-				return m_source.number_of_samples() ;
+				return m_samples ? m_samples->size() : m_source.number_of_samples() ;
 			}
 
 			void get_supported_specs( SpecSetter setter ) const {
@@ -174,21 +498,130 @@ namespace genfile {
 
 		private:
 			BGenFileSNPDataSource& m_source ;
-			std::vector< double > m_genotypes ;
+			// The raw data, until it has been uncompressed; then the uncompressed data.
+			Range m_data ;
+			bool m_have_uncompressed_data ;
+			// If non-null, the samples to report.
+			std::vector< std::size_t > const* m_samples ;
+
+		private:
+			template< typename Setter >
+			void parse( Range const& data, Setter& setter ) const {
+				if( m_samples ) {
+					bgen::v12::parse_probability_data(
+						data.first,
+						data.second,
+						m_source.bgen_context(),
+						*m_samples,
+						setter
+					) ;
+				} else {
+					bgen::parse_probability_data(
+						data.first,
+						data.second,
+						m_source.bgen_context(),
+						setter
+					) ;
+				}
+			}
+
+			static Range get_range( std::vector< byte_t > const& buffer ) {
+				byte_t const* begin = buffer.empty() ? 0 : &buffer[0] ;
+				return Range( begin, begin + buffer.size() ) ;
+			}
+
+			Range get_uncompressed_data() {
+				if( !m_have_uncompressed_data ) {
+					bgen::uncompress_probability_data(
+						m_source.bgen_context(),
+						m_data.first,
+						m_data.second,
+						&(m_source.m_uncompressed_data_buffer)
+					) ;
+					m_data = get_range( m_source.m_uncompressed_data_buffer ) ;
+					m_have_uncompressed_data = true ;
+				}
+				return m_data ;
+			}
 		} ;
 	}
 
 	VariantDataReader::UniquePtr BGenFileSNPDataSource::read_variant_data_impl() {
+		if( m_read_ahead.get() ) {
+			impl::BGenReadAheadStage::Slot const& slot = m_read_ahead->wait_for_current() ;
+			if( !slot.complete ) {
+				return VariantDataReader::UniquePtr() ;
+			}
+			return VariantDataReader::UniquePtr( new impl::BGenFileSNPDataReader( *this, slot.uncompressed_data )) ;
+		}
 		return VariantDataReader::UniquePtr( new impl::BGenFileSNPDataReader( *this )) ;
 	}
 
 	void BGenFileSNPDataSource::ignore_snp_probability_data_impl() {
+		if( m_read_ahead.get() ) {
+			// The slot is released, without waiting for decompression, when the next variant is read.
+			return ;
+		}
 		bgen::ignore_genotype_data_block(
 			stream(),
 			m_bgen_context
 		) ;
 	}
 
+	std::pair< byte_t const*, byte_t const* > BGenFileSNPDataSource::read_genotype_data_block( std::vector< byte_t >* buffer ) {
+		if( m_mapped_file.get() ) {
+			uint32_t const size = bgen::read_genotype_data_block_size( stream(), m_bgen_context ) ;
+			std::streamoff const offset = stream().tellg() ;
+			if( offset < 0 || std::size_t( offset ) + size > m_mapped_file->size() ) {
+				stream().setstate( std::ios::failbit ) ;
+				return std::pair< byte_t const*, byte_t const* >( 0, 0 ) ;
+			}
+			byte_t const* const begin = reinterpret_cast< byte_t const* >( m_mapped_file->data() ) + offset ;
+			stream().seekg( size, std::ios::cur ) ;
+			return std::make_pair( begin, begin + size ) ;
+		} else {
+			bgen::read_genotype_data_block( stream(), m_bgen_context, buffer ) ;
+			byte_t const* const begin = buffer->empty() ? 0 : &(*buffer)[0] ;
+			return std::make_pair( begin, begin + buffer->size() ) ;
+		}
+	}
+
+	void BGenFileSNPDataSource::map_file( std::string const& filename ) {
+		if( !( get_compression_type_indicated_by_filename( filename ) == "no_compression" )) {
+			throw BadArgumentError(
+				"genfile::BGenFileSNPDataSource::map_file()",
+				"filename=\"" + filename + "\"",
+				"Only uncompressed files can be memory-mapped."
+			) ;
+		}
+		try {
+			m_mapped_file.reset( new boost::iostreams::mapped_file_source( filename )) ;
+		}
+		catch( std::ios_base::failure const& ) {
+			throw ResourceNotOpenedError( filename ) ;
+		}
+		advise_mapped_file_access( true ) ;
+		// The stream reads directly from the mapped pages, without buffering.
+		setup(
+			std::auto_ptr< std::istream >(
+				new boost::iostreams::stream< boost::iostreams::array_source >( m_mapped_file->data(), m_mapped_file->size() )
+			)
+		) ;
+	}
+
+	void BGenFileSNPDataSource::advise_mapped_file_access( bool sequential ) {
+#if defined( POSIX_MADV_SEQUENTIAL ) && defined( POSIX_MADV_RANDOM )
+		if( m_mapped_file.get() ) {
+			// This is only a hint, so errors are ignored.
+			posix_madvise(
+				const_cast< char* >( m_mapped_file->data() ),
+				m_mapped_file->size(),
+				sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM
+			) ;
+		}
+#endif
+	}
+
 	void BGenFileSNPDataSource::setup( std::auto_ptr< std::istream > stream ) {
 		m_stream_ptr = stream ;
 		bgen::uint32_t offset = 0 ;
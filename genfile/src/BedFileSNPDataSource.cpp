@@ -106,7 +106,8 @@ namespace genfile {
 			BedFileSNPDataReader( BedFileSNPDataSource& source ):
 				m_source( source ),
 				m_number_of_samples( source.number_of_samples() ),
-				m_buffer( ( m_number_of_samples + 3 ) / 4, 0 )
+				m_buffer( ( m_number_of_samples + 3 ) / 4, 0 ),
+				m_samples( 0 )
 			{
 				source.m_bed_stream_ptr->read( &m_buffer[0], m_buffer.size() ) ;
 				if( !(*source.m_bed_stream_ptr )) {
@@ -120,12 +121,16 @@ namespace genfile {
 			
 			BedFileSNPDataReader& get( std::string const& spec, PerSampleSetter& setter ) {
 				assert( spec == "GT" || spec == ":genotypes:" ) ;
-				setter.initialise( m_number_of_samples, 2 ) ;
+				std::size_t const N = get_number_of_samples() ;
+				setter.initialise( N, 2 ) ;
 				uint32_t const ploidy = 2 ;
-				for( std::size_t i = 0; i < m_number_of_samples; ++i ) {
+				for( std::size_t j = 0; j < N; ++j ) {
+					// With a sample subset, unwanted samples are not visited.
+					std::size_t const i = m_samples ? (*m_samples)[j] : j ;
+					assert( i < m_number_of_samples ) ;
 					std::size_t index = i/4 ;
 					std::size_t data = ( m_buffer[ index ] >> (2*(i%4)) ) & 0x3 ;
-					setter.set_sample( i ) ;
+					setter.set_sample( j ) ;
 					setter.set_number_of_entries( ploidy, 2, ePerUnorderedHaplotype, eAlleleIndex ) ;
 					std::pair< int64_t, int64_t > const& genotype = m_source.m_genotype_table[ data ] ;
 #if DEBUG_BED_FORMAT > 2
@@ -144,7 +149,12 @@ namespace genfile {
 				return *this ;
 			}
 			
-			std::size_t get_number_of_samples() const { return m_number_of_samples ; }
+			std::size_t get_number_of_samples() const { return m_samples ? m_samples->size() : m_number_of_samples ; }
+
+			bool set_sample_subset( std::vector< std::size_t > const& samples ) {
+				m_samples = &samples ;
+				return true ;
+			}
 			
 			bool supports( std::string const& spec ) const {
 				return spec == "GT" || spec == ":genotypes:";
@@ -159,6 +169,8 @@ namespace genfile {
 			BedFileSNPDataSource& m_source ;
 			std::size_t m_number_of_samples ;
 			std::vector< char > m_buffer ;
+			// If non-null, the samples to report.
+			std::vector< std::size_t > const* m_samples ;
 		} ;
 	}
 
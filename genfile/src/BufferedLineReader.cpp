@@ -0,0 +1,175 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+#include <boost/bind.hpp>
+#include "genfile/BufferedLineReader.hpp"
+
+namespace genfile {
+	BufferedLineReader::BufferedLineReader( std::istream& stream, std::size_t const block_size ):
+		m_stream( &stream ),
+		m_block_size( block_size ),
+		m_begin( 0 ),
+		m_end( 0 ),
+		m_end_of_stream( false ),
+		m_number_of_lines_read( 0 ),
+		m_read_ahead( false ),
+		m_have_next_block( false ),
+		m_next_block_is_last( false ),
+		m_stop( false )
+	{
+		assert( m_block_size > 0 ) ;
+	}
+
+	BufferedLineReader::~BufferedLineReader() {
+		stop() ;
+	}
+
+	void BufferedLineReader::set_read_ahead( bool read_ahead ) {
+		assert( !m_thread.get() ) ;
+		m_read_ahead = read_ahead ;
+	}
+
+	void BufferedLineReader::stop() {
+		if( m_thread.get() ) {
+			{
+				ScopedLock lock( m_mutex ) ;
+				m_stop = true ;
+				m_condition.notify_all() ;
+			}
+			m_thread->join() ;
+			m_thread.reset() ;
+		}
+		m_have_next_block = false ;
+		m_error = boost::exception_ptr() ;
+	}
+
+	void BufferedLineReader::reset( std::istream& stream ) {
+		stop() ;
+		m_stream = &stream ;
+		m_begin = m_end = 0 ;
+		m_end_of_stream = false ;
+		m_number_of_lines_read = 0 ;
+	}
+
+	bool BufferedLineReader::read_line( Line* line ) {
+		assert( line ) ;
+		while( true ) {
+			if( m_begin < m_end ) {
+				// memchr() is vectorised in the C library, making this much quicker than a loop.
+				char const* const begin = &(*m_buffer)[0] + m_begin ;
+				char const* const newline = reinterpret_cast< char const* >( std::memchr( begin, '\n', m_end - m_begin )) ;
+				if( newline || m_end_of_stream ) {
+					line->buffer = m_buffer ;
+					line->begin = begin ;
+					line->end = newline ? newline : ( &(*m_buffer)[0] + m_end ) ;
+					m_begin = newline ? ( newline + 1 - &(*m_buffer)[0] ) : m_end ;
+					++m_number_of_lines_read ;
+					return true ;
+				}
+			} else if( m_end_of_stream ) {
+				return false ;
+			}
+			read_block() ;
+		}
+	}
+
+	// Move any partial line to the start of a buffer and fill the rest from the stream,
+	// or from the block read by the read-ahead thread.
+	void BufferedLineReader::read_block() {
+		std::size_t const remaining = m_end - m_begin ;
+		std::size_t required = std::max( m_block_size, 2 * remaining ) ;
+		if( m_read_ahead ) {
+			receive_block() ;
+			required = remaining + m_incoming.size() ;
+		}
+		if( m_buffer.get() && m_buffer.unique() && m_buffer->size() >= required ) {
+			std::memmove( &(*m_buffer)[0], &(*m_buffer)[0] + m_begin, remaining ) ;
+		} else {
+			// In read-ahead mode, allow room for a partial line plus a whole block so the buffer can be reused.
+			Buffer buffer( new std::vector< char >( m_read_ahead ? std::max( required, remaining + 2 * m_block_size ) : required ) ) ;
+			if( remaining > 0 ) {
+				std::memcpy( &(*buffer)[0], &(*m_buffer)[0] + m_begin, remaining ) ;
+			}
+			m_buffer = buffer ;
+		}
+		m_begin = 0 ;
+		if( m_read_ahead ) {
+			if( !m_incoming.empty() ) {
+				std::memcpy( &(*m_buffer)[0] + remaining, &m_incoming[0], m_incoming.size() ) ;
+			}
+			m_end = remaining + m_incoming.size() ;
+		} else {
+			m_stream->read( &(*m_buffer)[0] + remaining, m_buffer->size() - remaining ) ;
+			m_end = remaining + m_stream->gcount() ;
+			if( !*m_stream ) {
+				m_end_of_stream = true ;
+			}
+		}
+	}
+
+	// Wait for the read-ahead thread to produce a block and move it into m_incoming,
+	// starting the thread if necessary.
+	void BufferedLineReader::receive_block() {
+		if( !m_thread.get() ) {
+			m_stop = false ;
+			m_have_next_block = false ;
+			m_thread.reset( new boost::thread( boost::bind( &BufferedLineReader::read_ahead_loop, this ))) ;
+		}
+		ScopedLock lock( m_mutex ) ;
+		while( !m_have_next_block ) {
+			m_condition.wait( lock ) ;
+		}
+		if( m_error ) {
+			boost::exception_ptr error = m_error ;
+			m_error = boost::exception_ptr() ;
+			m_end_of_stream = true ;
+			m_incoming.clear() ;
+			boost::rethrow_exception( error ) ;
+		}
+		// Swapping hands our previous block back to the thread to be refilled.
+		m_incoming.swap( m_next_block ) ;
+		m_end_of_stream = m_next_block_is_last ;
+		m_have_next_block = false ;
+		m_condition.notify_all() ;
+	}
+
+	void BufferedLineReader::read_ahead_loop() {
+		try {
+			std::vector< char > block ;
+			while( true ) {
+				// Only this thread uses the stream, so it is read without the lock.
+				block.resize( m_block_size ) ;
+				m_stream->read( &block[0], block.size() ) ;
+				block.resize( m_stream->gcount() ) ;
+				bool const last = !*m_stream ;
+				ScopedLock lock( m_mutex ) ;
+				while( m_have_next_block && !m_stop ) {
+					m_condition.wait( lock ) ;
+				}
+				if( m_stop ) {
+					return ;
+				}
+				m_next_block.swap( block ) ;
+				m_next_block_is_last = last ;
+				m_have_next_block = true ;
+				m_condition.notify_all() ;
+				if( last ) {
+					return ;
+				}
+			}
+		}
+		catch( ... ) {
+			ScopedLock lock( m_mutex ) ;
+			m_error = boost::current_exception() ;
+			m_have_next_block = true ;
+			m_condition.notify_all() ;
+		}
+	}
+}
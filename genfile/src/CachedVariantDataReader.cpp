@@ -0,0 +1,268 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cassert>
+#include <boost/bind.hpp>
+#include "genfile/Error.hpp"
+#include "genfile/VariantDataReader.hpp"
+#include "genfile/CachedVariantDataReader.hpp"
+
+namespace genfile {
+	namespace impl {
+		typedef CachedVariantDataReader::Recording Recording ;
+
+		struct RecordingSetter: public VariantDataReader::PerSampleSetter {
+			RecordingSetter( Recording& recording ):
+				m_recording( recording ),
+				m_have_entries( false )
+			{}
+
+			void initialise( std::size_t nSamples, std::size_t nAlleles ) {
+				m_recording.ops.push_back( Recording::eInitialise ) ;
+				m_recording.arguments.push_back( nSamples ) ;
+				m_recording.arguments.push_back( nAlleles ) ;
+			}
+
+			bool set_sample( std::size_t i ) {
+				m_recording.ops.push_back( Recording::eSetSample ) ;
+				m_recording.arguments.push_back( i ) ;
+				return true ;
+			}
+
+			void set_number_of_entries( uint32_t ploidy, std::size_t n, OrderType const order_type, ValueType const value_type ) {
+				if(
+					m_have_entries
+					&& ploidy == m_ploidy && n == m_n && order_type == m_order_type && value_type == m_value_type
+				) {
+					// Most formats repeat the same shape for every sample, so store this compactly.
+					m_recording.ops.push_back( Recording::eRepeatNumberOfEntries ) ;
+				} else {
+					m_recording.ops.push_back( Recording::eSetNumberOfEntries ) ;
+					m_recording.arguments.push_back( ploidy ) ;
+					m_recording.arguments.push_back( n ) ;
+					m_recording.arguments.push_back( order_type ) ;
+					m_recording.arguments.push_back( value_type ) ;
+					m_ploidy = ploidy ;
+					m_n = n ;
+					m_order_type = order_type ;
+					m_value_type = value_type ;
+					m_have_entries = true ;
+				}
+			}
+
+			void set_value( std::size_t i, MissingValue const value ) {
+				m_recording.ops.push_back( Recording::eMissingValue ) ;
+				m_recording.arguments.push_back( i ) ;
+			}
+
+			void set_value( std::size_t i, std::string& value ) {
+				m_recording.ops.push_back( Recording::eStringValue ) ;
+				m_recording.arguments.push_back( i ) ;
+				m_recording.strings.push_back( value ) ;
+			}
+
+			void set_value( std::size_t i, Integer const value ) {
+				m_recording.ops.push_back( Recording::eIntegerValue ) ;
+				m_recording.arguments.push_back( i ) ;
+				m_recording.integers.push_back( value ) ;
+			}
+
+			void set_value( std::size_t i, double const value ) {
+				m_recording.ops.push_back( Recording::eDoubleValue ) ;
+				m_recording.arguments.push_back( i ) ;
+				m_recording.doubles.push_back( value ) ;
+			}
+
+			void finalise() {
+				m_recording.ops.push_back( Recording::eFinalise ) ;
+			}
+
+		private:
+			Recording& m_recording ;
+			bool m_have_entries ;
+			uint32_t m_ploidy ;
+			std::size_t m_n ;
+			OrderType m_order_type ;
+			ValueType m_value_type ;
+		} ;
+
+		void add_spec( std::vector< std::string >* specs, std::map< std::string, std::string >* types, std::string const& name, std::string const& type ) {
+			specs->push_back( name ) ;
+			(*types)[ name ] = type ;
+		}
+	}
+
+	CachedVariantDataReader::UniquePtr CachedVariantDataReader::create(
+		VariantDataReader& reader,
+		std::vector< std::string > const& specs,
+		bool cache_supported_specs
+	) {
+		return UniquePtr( new CachedVariantDataReader( reader, specs, cache_supported_specs )) ;
+	}
+
+	CachedVariantDataReader::CachedVariantDataReader(
+		VariantDataReader& reader,
+		std::vector< std::string > const& requested_specs,
+		bool cache_supported_specs
+	):
+		m_number_of_samples( reader.get_number_of_samples() )
+	{
+		std::vector< std::string > supported_specs ;
+		std::map< std::string, std::string > types ;
+		reader.get_supported_specs( boost::bind( &impl::add_spec, &supported_specs, &types, _1, _2 )) ;
+
+		std::vector< std::string > specs = requested_specs ;
+		if( cache_supported_specs ) {
+			specs.insert( specs.end(), supported_specs.begin(), supported_specs.end() ) ;
+		}
+
+		for( std::size_t i = 0; i < specs.size(); ++i ) {
+			std::string const& spec = specs[i] ;
+			if( m_recordings.find( spec ) != m_recordings.end() || !reader.supports( spec ) ) {
+				continue ;
+			}
+			std::auto_ptr< Recording > recording( new Recording ) ;
+			{
+				impl::RecordingSetter setter( *recording ) ;
+				reader.get( spec, setter ) ;
+			}
+			std::map< std::string, std::string >::const_iterator where = types.find( spec ) ;
+			if( where != types.end() ) {
+				recording->type = where->second ;
+			}
+			m_recordings[ spec ] = recording.release() ;
+		}
+
+		// Report cached specs in the order given by the original reader.
+		for( std::size_t i = 0; i < supported_specs.size(); ++i ) {
+			if( m_recordings.find( supported_specs[i] ) != m_recordings.end() ) {
+				m_specs.push_back( supported_specs[i] ) ;
+			}
+		}
+	}
+
+	CachedVariantDataReader::~CachedVariantDataReader() {
+		for( Recordings::iterator i = m_recordings.begin(); i != m_recordings.end(); ++i ) {
+			delete i->second ;
+		}
+	}
+
+	CachedVariantDataReader& CachedVariantDataReader::get( std::string const& spec, PerSampleSetter& setter ) {
+		Recordings::const_iterator where = m_recordings.find( spec ) ;
+		if( where == m_recordings.end() ) {
+			throw BadArgumentError(
+				"genfile::CachedVariantDataReader::get()",
+				"spec=\"" + spec + "\"",
+				"This spec was not cached when the data was read."
+			) ;
+		}
+		replay( *(where->second), setter ) ;
+		return *this ;
+	}
+
+	bool CachedVariantDataReader::supports( std::string const& spec ) const {
+		return m_recordings.find( spec ) != m_recordings.end() ;
+	}
+
+	void CachedVariantDataReader::get_supported_specs( SpecSetter setter ) const {
+		for( std::size_t i = 0; i < m_specs.size(); ++i ) {
+			setter( m_specs[i], m_recordings.find( m_specs[i] )->second->type ) ;
+		}
+	}
+
+	std::size_t CachedVariantDataReader::get_memory_usage() const {
+		std::size_t result = 0 ;
+		for( Recordings::const_iterator i = m_recordings.begin(); i != m_recordings.end(); ++i ) {
+			Recording const& recording = *(i->second) ;
+			result += recording.ops.capacity()
+				+ recording.arguments.capacity() * sizeof( uint32_t )
+				+ recording.doubles.capacity() * sizeof( double )
+				+ recording.integers.capacity() * sizeof( int64_t ) ;
+			for( std::size_t j = 0; j < recording.strings.size(); ++j ) {
+				result += sizeof( std::string ) + recording.strings[j].capacity() ;
+			}
+		}
+		return result ;
+	}
+
+	void CachedVariantDataReader::replay( Recording const& recording, PerSampleSetter& setter ) const {
+		std::vector< uint32_t >::const_iterator argument = recording.arguments.begin() ;
+		std::vector< double >::const_iterator double_value = recording.doubles.begin() ;
+		std::vector< int64_t >::const_iterator integer_value = recording.integers.begin() ;
+		std::vector< std::string >::const_iterator string_value = recording.strings.begin() ;
+		uint32_t ploidy = 0 ;
+		std::size_t n = 0 ;
+		OrderType order_type = eUnknownOrderType ;
+		ValueType value_type = eUnknownValueType ;
+		// If the setter declines a sample we must still step over the recorded arguments,
+		// but we do not forward the calls.
+		bool forward = true ;
+		for( std::size_t i = 0; i < recording.ops.size(); ++i ) {
+			switch( recording.ops[i] ) {
+				case Recording::eInitialise: {
+					std::size_t const nSamples = *argument++ ;
+					std::size_t const nAlleles = *argument++ ;
+					setter.initialise( nSamples, nAlleles ) ;
+					forward = true ;
+					break ;
+				}
+				case Recording::eSetSample:
+					forward = setter.set_sample( *argument++ ) ;
+					break ;
+				case Recording::eSetNumberOfEntries:
+					ploidy = *argument++ ;
+					n = *argument++ ;
+					order_type = OrderType( *argument++ ) ;
+					value_type = ValueType( *argument++ ) ;
+					// fall through
+				case Recording::eRepeatNumberOfEntries:
+					if( forward ) {
+						setter.set_number_of_entries( ploidy, n, order_type, value_type ) ;
+					}
+					break ;
+				case Recording::eMissingValue: {
+					std::size_t const index = *argument++ ;
+					if( forward ) {
+						setter.set_value( index, genfile::MissingValue() ) ;
+					}
+					break ;
+				}
+				case Recording::eStringValue: {
+					std::size_t const index = *argument++ ;
+					if( forward ) {
+						std::string value = *string_value ;
+						setter.set_value( index, value ) ;
+					}
+					++string_value ;
+					break ;
+				}
+				case Recording::eIntegerValue: {
+					std::size_t const index = *argument++ ;
+					if( forward ) {
+						setter.set_value( index, PerSampleSetter::Integer( *integer_value ) ) ;
+					}
+					++integer_value ;
+					break ;
+				}
+				case Recording::eDoubleValue: {
+					std::size_t const index = *argument++ ;
+					if( forward ) {
+						setter.set_value( index, *double_value ) ;
+					}
+					++double_value ;
+					break ;
+				}
+				case Recording::eFinalise:
+					setter.finalise() ;
+					break ;
+				default:
+					assert(0) ;
+			}
+		}
+	}
+}
@@ -16,9 +16,12 @@ namespace genfile {
 		: m_filename( filename ),
 		  m_compression_type( get_compression_type_indicated_by_filename( filename ) ),
 		  m_number_of_samples( 0 ),
-		  m_chromosome( chromosome )
+		  m_stream_ptr( open_text_file_for_input( filename, m_compression_type ) ),
+		  m_line_reader( *m_stream_ptr ),
+		  m_chromosome( chromosome ),
+		  m_end_of_data( false )
 	{
-		setup( filename, m_compression_type ) ; 
+		setup() ; 
 	}
 
 	DosageFileSNPDataSource::DosageFileSNPDataSource(
@@ -29,26 +32,22 @@ namespace genfile {
 		: m_filename( filename ),
 		  m_compression_type( compression_type ),
 		  m_number_of_samples( 0 ),
-		  m_chromosome( chromosome )
+		  m_stream_ptr( open_text_file_for_input( filename, compression_type ) ),
+		  m_line_reader( *m_stream_ptr ),
+		  m_chromosome( chromosome ),
+		  m_end_of_data( false )
 	{
-		setup( filename, compression_type ) ;
+		setup() ;
 	}
 
-	void DosageFileSNPDataSource::setup( std::string const& filename, CompressionType compression_type ) {
-		setup( open_text_file_for_input( filename, compression_type ) ) ;
-	}
-
-	void DosageFileSNPDataSource::setup( std::auto_ptr< std::istream > stream_ptr ) {
-		m_stream_ptr = stream_ptr ;
-        std::getline( stream(), m_line ) ;
-		while( stream() && m_line.size() > 0 && m_line[0] == '#' ) {
-			std::getline( stream(), m_line ) ;
-		}
+	void DosageFileSNPDataSource::setup() {
+		m_line_reader.set_read_ahead( !( m_compression_type == "no_compression" )) ;
+		read_header_line() ;
         bool bad = false ;
-        if( !stream() ) {
+        if( m_end_of_data ) {
             bad = true ;
         } else {
-            slice( m_line ).split( " ", &m_elts ) ;
+            m_line.as_slice().split( " ", &m_elts ) ;
             if( m_elts.size() < 6 ) {
                 bad = true ;
             } else if(
@@ -74,7 +73,16 @@ namespace genfile {
         }
 	}
 
+	// Read lines up to and including the header line, which follows any comment lines.
+	void DosageFileSNPDataSource::read_header_line() {
+		m_end_of_data = !m_line_reader.read_line( &m_line ) ;
+		while( !m_end_of_data && m_line.begin != m_line.end && m_line.begin[0] == '#' ) {
+			m_end_of_data = !m_line_reader.read_line( &m_line ) ;
+		}
+	}
+
 	void DosageFileSNPDataSource::reset_to_start_impl() {
+		m_line_reader.stop() ;
 		stream().clear() ;
 		stream().seekg( 0 ) ;
 		if( !stream() ) {
@@ -84,10 +92,8 @@ namespace genfile {
 		if( !stream() ) {
 			throw OperationFailedError( "genfile::DosageFileSNPDataSource::reset_to_start_impl()", get_source_spec(), "reset to start" ) ;
 		}
-        std::getline( stream(), m_line ) ;
-		while( stream() && m_line.size() > 0 && m_line[0] == '#' ) {
-			std::getline( stream(), m_line ) ;
-		}
+		m_line_reader.reset( stream() ) ;
+		read_header_line() ;
 	}
 	
 	SNPDataSource::Metadata DosageFileSNPDataSource::get_metadata() const {
@@ -102,39 +108,52 @@ namespace genfile {
 	}
 	
 	void DosageFileSNPDataSource::read_snp_identifying_data_impl( VariantIdentifyingData* result ) {
-        std::string SNPID, RSID, allele1, allele2, chromosome_string ;
-        uint32_t position ;
-        stream() >> chromosome_string ;
-        if( !stream() && !m_stream_ptr->eof() ) {
-            throw genfile::MalformedInputError(
-                m_filename,
-                "Unable to read chromosome, but not at EOF",
-                number_of_snps_read()
-            ) ;
-        }
-		if( stream() ) {
-			stream() >> SNPID >> RSID >> position >> allele1 >> allele2 ;
-			if( !stream() ) {
-				throw genfile::MalformedInputError(
-					m_filename,
-					"Malformed line",
-					number_of_snps_read()
-				) ;
-			} else {
-				*result = VariantIdentifyingData(
-					SNPID, RSID, GenomePosition( chromosome_string, position ), allele1, allele2
-				) ;
-				// Prepare for the data...
-				if( stream().peek() == ' ' ) {
-					stream().get() ;
-				}
+		if( !m_line_reader.read_line( &m_line )) {
+			m_end_of_data = true ;
+			return ;
+		}
+		slice line = m_line.as_slice() ;
+		if( line.size() > 0 && line[ line.size() - 1 ] == '\r' ) {
+			line = line.substr( 0, line.size() - 1 ) ;
+		}
+		try {
+			std::vector< slice > fields ;
+			slice const data = gen::impl::read_snp_identifying_data( line, 6, &fields ) ;
+			m_elts.clear() ;
+			data.split( " ", &m_elts ) ;
+			if( m_elts.size() != m_number_of_samples ) {
+				throw InputError( m_filename, "Wrong number of dosages" ) ;
 			}
+			*result = VariantIdentifyingData(
+				fields[1], fields[2],
+				GenomePosition( Chromosome( fields[0] ), string_utils::to_repr< uint32_t >( fields[3] )),
+				fields[4], fields[5]
+			) ;
+		}
+		catch( InputError const& ) {
+			throw genfile::MalformedInputError(
+				m_filename,
+				"Malformed line",
+				number_of_snps_read()
+			) ;
+		}
+		catch( string_utils::StringConversionError const& ) {
+			throw genfile::MalformedInputError(
+				m_filename,
+				"Malformed line",
+				number_of_snps_read()
+			) ;
 		}
 	}
 
 	namespace impl {
 		struct DosageFileSNPDataReader: public VariantDataReader {
-			DosageFileSNPDataReader( DosageFileSNPDataSource& source, std::vector< string_utils::slice > const& elts ):
+			DosageFileSNPDataReader(
+				DosageFileSNPDataSource& source,
+				BufferedLineReader::Line const& line,
+				std::vector< string_utils::slice > const& elts
+			):
+				m_line( line ),
 				m_elts( elts )
 			{
 				assert( elts.size() == source.number_of_samples() ) ;
@@ -153,6 +172,7 @@ namespace genfile {
 						setter.set_value( 0, string_utils::to_repr< Integer >( m_elts[i] )) ;
 					}
 				}
+				setter.finalise() ;
 				return *this ;
 			}
 			
@@ -169,17 +189,15 @@ namespace genfile {
 			}
 			
 		private:
+			// The elements refer into the line, which this keeps alive.
+			BufferedLineReader::Line const m_line ;
             std::vector< string_utils::slice > m_elts ;
 			std::vector< double > m_genotypes ;
 		} ;
 	}
 
 	VariantDataReader::UniquePtr DosageFileSNPDataSource::read_variant_data_impl() {
-        m_line.clear() ;
-		m_elts.clear() ;
-		std::getline( *m_stream_ptr, m_line ) ;
-		slice( m_line ).split( " ", &m_elts ) ;
-		return VariantDataReader::UniquePtr( new impl::DosageFileSNPDataReader( *this, m_elts ) ) ;
+		return VariantDataReader::UniquePtr( new impl::DosageFileSNPDataReader( *this, m_line, m_elts ) ) ;
 	}
 
 	void DosageFileSNPDataSource::ignore_snp_probability_data_impl() {
@@ -16,35 +16,39 @@ namespace genfile {
 		m_filename( "(unnamed stream)" ),
 		m_compression_type( "no_compression" ),
 		m_number_of_samples( 0 ),
+		m_stream_ptr( stream ),
+		m_line_reader( *m_stream_ptr ),
 		m_chromosome( chromosome ),
-		m_have_chromosome_column( false )
+		m_have_chromosome_column( false ),
+		m_end_of_data( false ),
+		m_probabilities( "" )
 	{
-		setup( stream ) ;
+		setup() ;
 	}
 	
 	GenFileSNPDataSource::GenFileSNPDataSource( std::string const& filename, Chromosome chromosome )
 		: m_filename( filename ),
 		  m_compression_type( get_compression_type_indicated_by_filename( filename ) ),
 		  m_number_of_samples( 0 ),
+		  m_stream_ptr( open_text_file_for_input( filename, m_compression_type ) ),
+		  m_line_reader( *m_stream_ptr ),
 		  m_chromosome( chromosome ),
-		  m_have_chromosome_column( false )
+		  m_have_chromosome_column( false ),
+		  m_end_of_data( false ),
+		  m_probabilities( "" )
 	{
-		setup( filename, m_compression_type ) ; 
+		setup() ; 
 	}
 
-	void GenFileSNPDataSource::setup( std::string const& filename, CompressionType compression_type ) {
-		m_stream_ptr = open_text_file_for_input( filename, compression_type ) ;
-		read_header_data() ;
-		reset_to_start() ;
-	}
-
-	void GenFileSNPDataSource::setup( std::auto_ptr< std::istream > stream_ptr ) {
-		m_stream_ptr = stream_ptr ;
+	void GenFileSNPDataSource::setup() {
+		// Decompression is the most expensive part of reading a compressed file, so do it in parallel with parsing.
+		m_line_reader.set_read_ahead( !( m_compression_type == "no_compression" )) ;
 		read_header_data() ;
 		reset_to_start() ;
 	}
 
 	void GenFileSNPDataSource::reset_to_start_impl() {
+		m_line_reader.stop() ;
 		stream().clear() ;
 		stream().seekg( 0 ) ;
 		if( !stream() ) {
@@ -54,6 +58,8 @@ namespace genfile {
 		if( !stream() ) {
 			throw OperationFailedError( "genfile::GenFileSNPDataSource::reset_to_start_impl()", get_source_spec(), "reset to start" ) ;
 		}
+		m_line_reader.reset( stream() ) ;
+		m_end_of_data = false ;
 	}
 	
 	SNPDataSource::Metadata GenFileSNPDataSource::get_metadata() const {
@@ -68,26 +74,36 @@ namespace genfile {
 	}
 	
 	void GenFileSNPDataSource::read_snp_identifying_data_impl( VariantIdentifyingData* result ) {
-		std::string SNPID, rsid, allele1, allele2 ;
-		uint32_t position ;
-		Chromosome chromosome ;
+		string_utils::slice line( "" ) ;
+		// Blank lines are skipped.
+		do {
+			if( !m_line_reader.read_line( &m_line )) {
+				m_end_of_data = true ;
+				return ;
+			}
+			line = m_line.as_slice() ;
+			if( line.size() > 0 && line[ line.size() - 1 ] == '\r' ) {
+				line = line.substr( 0, line.size() - 1 ) ;
+			}
+		} while( line.find_first_not_of( " \t" ) == std::string::npos ) ;
+
 		try {
-			std::string chromosome_string ;
-			if( m_have_chromosome_column ) {
-				gen::impl::read_snp_identifying_data( stream(), &chromosome_string, &SNPID, &rsid, &position, &allele1, &allele2 ) ;
-				if( *this ) {
-					*result = VariantIdentifyingData(
-						SNPID, rsid, GenomePosition( chromosome_string, position ), allele1, allele2
-					) ;
-				}
-			} else {
-				gen::impl::read_snp_identifying_data( stream(), &SNPID, &rsid, &position, &allele1, &allele2 ) ;
-				if( *this ) {
-					*result = VariantIdentifyingData(
-						SNPID, rsid, GenomePosition( m_chromosome, position ), allele1, allele2
-					) ;
-				}
+			std::size_t const number_of_fields = m_have_chromosome_column ? 6 : 5 ;
+			m_probabilities = gen::impl::read_snp_identifying_data( line, number_of_fields, &m_fields ) ;
+			std::vector< string_utils::slice > const& f = m_fields ;
+			std::size_t const i = m_have_chromosome_column ? 1 : 0 ;
+			Position position ;
+			try {
+				position = string_utils::to_repr< Position >( f[i+2] ) ;
+			}
+			catch( string_utils::StringConversionError const& ) {
+				throw InputError( m_filename, "Malformed position \"" + std::string( f[i+2] ) + "\"" ) ;
 			}
+			*result = VariantIdentifyingData(
+				f[i], f[i+1],
+				GenomePosition( m_have_chromosome_column ? Chromosome( f[0] ) : m_chromosome, position ),
+				f[i+3], f[i+4]
+			) ;
 		} catch( InputError const& e ) {
 			throw MalformedInputError(
 				m_filename,
@@ -101,16 +117,11 @@ namespace genfile {
 		struct GenFileSNPDataReader: public VariantDataReader {
 			GenFileSNPDataReader( GenFileSNPDataSource& source ) {
 				try {
-					uint32_t this_data_number_of_samples ;
+					m_genotypes.reserve( 3 * source.number_of_samples() ) ;
 					gen::impl::read_snp_probability_data(
-						source.stream(),
-						set_value( this_data_number_of_samples ),
-						set_genotypes( m_genotypes ),
-						source.m_line
+						source.m_probabilities,
+						set_genotypes( m_genotypes )
 					) ;
-					if( !source ) {
-						throw genfile::MalformedInputError( source.m_filename, source.number_of_snps_read() ) ;
-					}
 					assert(( m_genotypes.size() % 3 ) == 0 ) ;
 				} catch( genfile::InputError const& e ) {
 					throw genfile::MalformedInputError( source.m_filename, e.message(), source.number_of_snps_read() ) ;
@@ -138,6 +149,24 @@ namespace genfile {
 				setter.finalise() ;
 				return *this ;
 			}
+
+			GenFileSNPDataReader& get_probabilities( std::string const& spec, GenotypeProbabilityMatrix* result ) {
+				if( spec != "GP" && spec != ":genotypes:" ) {
+					throw BadArgumentError(
+						"genfile::GenFileSNPDataReader::get_probabilities()",
+						"spec=\"" + spec + "\"",
+						"Only \"GP\" and \":genotypes:\" are supported in a GEN file."
+					) ;
+				}
+				std::size_t const N = m_genotypes.size() / 3 ;
+				// m_genotypes is stored sample-major, i.e. as the transpose of the result.
+				result->probabilities = Eigen::Map< Eigen::Matrix< double, Eigen::Dynamic, 3, Eigen::RowMajor > const >( &m_genotypes[0], N, 3 ) ;
+				result->ploidy.setConstant( N, 2 ) ;
+				result->missing = ( result->probabilities.rowwise().sum().array() == 0.0 ).cast< int >() ;
+				result->number_of_alleles = 2 ;
+				result->min_ploidy = result->max_ploidy = 2 ;
+				return *this ;
+			}
 			
 			std::size_t get_number_of_samples() const {
 				return m_genotypes.size() / 3 ; 
@@ -163,8 +192,7 @@ namespace genfile {
 	}
 
 	void GenFileSNPDataSource::ignore_snp_probability_data_impl() {
-		std::string line ;
-		std::getline( stream(), line ) ;
+		// Nothing to do: the whole line was read with the identifying data.
 	}
 
 	void GenFileSNPDataSource::read_header_data() {
@@ -0,0 +1,385 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "genfile/snp_data_utils.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/PgenFileSNPDataSource.hpp"
+#include "genfile/pgen/pgen.hpp"
+#include "genfile/Error.hpp"
+#include "genfile/string_utils/string_utils.hpp"
+
+namespace genfile {
+	namespace {
+		enum PvarColumn { eChrom = 0, ePos = 1, eID = 2, eRef = 3, eAlt = 4 } ;
+	}
+
+	PgenFileSNPDataSource::PgenFileSNPDataSource( std::string const& pgenFilename, std::string const& pvarFilename, std::string const& psamFilename ):
+		m_pgen_filename( pgenFilename ),
+		m_pvar_filename( pvarFilename ),
+		m_pgen_stream_position( 0 ),
+		m_number_of_pvar_header_lines( 0 ),
+		m_exhausted( false ),
+		m_next_variant( 0 ),
+		m_current_variant( 0 ),
+		m_ld_base_variant( std::string::npos )
+	{
+		setup( psamFilename ) ;
+	}
+
+	void PgenFileSNPDataSource::setup( std::string const& psamFilename ) {
+		m_pgen_stream_ptr = open_binary_file_for_input( m_pgen_filename ) ;
+		pgen::read_index( *m_pgen_stream_ptr, m_pgen_filename, &m_index ) ;
+		m_pgen_stream_position = m_pgen_stream_ptr->tellg() ;
+
+		// Sample IDs are taken from the IID column of the .psam file.
+		// A file without a header line is treated as a PLINK 1 .fam file.
+		{
+			std::auto_ptr< std::istream > psam = open_text_file_for_input( psamFilename ) ;
+			std::string line ;
+			std::size_t iid_column = 1 ;
+			for( std::size_t line_number = 0; std::getline( *psam, line ); ++line_number ) {
+				std::vector< std::string > elts = string_utils::split_and_strip_discarding_empty_entries( line, " \t", " \t\r" ) ;
+				if( elts.empty() ) {
+					continue ;
+				}
+				if( line_number == 0 && line[0] == '#' ) {
+					elts[0] = elts[0].substr( 1 ) ;
+					std::vector< std::string >::const_iterator where = std::find( elts.begin(), elts.end(), "IID" ) ;
+					if( where == elts.end() ) {
+						throw MalformedInputError( psamFilename, "Expected an IID column in the header", 0 ) ;
+					}
+					iid_column = where - elts.begin() ;
+					continue ;
+				}
+				if( iid_column >= elts.size() ) {
+					throw MalformedInputError( psamFilename, line_number, iid_column ) ;
+				}
+				m_sample_ids.push_back( elts[ iid_column ] ) ;
+			}
+			if( m_sample_ids.size() != m_index.number_of_samples ) {
+				throw MalformedInputError(
+					psamFilename,
+					"Number of samples (" + string_utils::to_string( m_sample_ids.size() ) + ") does not match the number in \""
+						+ m_pgen_filename + "\" (" + string_utils::to_string( m_index.number_of_samples ) + ")",
+					0
+				) ;
+			}
+		}
+
+		// A .pvar file without a #CHROM header line is treated as a PLINK 1 .bim file,
+		// whose fifth and sixth columns hold the ALT and REF alleles.
+		{
+			std::auto_ptr< std::istream > pvar = open_text_file_for_input( m_pvar_filename ) ;
+			std::string line ;
+			while( std::getline( *pvar, line ) && line.compare( 0, 2, "##" ) == 0 ) {
+				++m_number_of_pvar_header_lines ;
+			}
+			if( line.compare( 0, 6, "#CHROM" ) == 0 ) {
+				++m_number_of_pvar_header_lines ;
+				std::vector< std::string > elts = string_utils::split_and_strip_discarding_empty_entries( line.substr( 1 ), "\t", "\r" ) ;
+				char const* names[5] = { "CHROM", "POS", "ID", "REF", "ALT" } ;
+				for( std::size_t i = 0; i < 5; ++i ) {
+					std::vector< std::string >::const_iterator where = std::find( elts.begin(), elts.end(), names[i] ) ;
+					if( where == elts.end() ) {
+						throw MalformedInputError( m_pvar_filename, "Expected a " + std::string( names[i] ) + " column in the header", m_number_of_pvar_header_lines - 1 ) ;
+					}
+					m_pvar_columns.push_back( where - elts.begin() ) ;
+				}
+			} else {
+				std::size_t const bim_columns[5] = { 0, 3, 1, 5, 4 } ;
+				m_pvar_columns.assign( bim_columns, bim_columns + 5 ) ;
+			}
+		}
+		open_pvar() ;
+	}
+
+	void PgenFileSNPDataSource::open_pvar() {
+		m_pvar_reader.reset() ;
+		m_pvar_stream_ptr = open_text_file_for_input( m_pvar_filename ) ;
+		m_pvar_reader.reset( new BufferedLineReader( *m_pvar_stream_ptr )) ;
+		BufferedLineReader::Line line ;
+		for( std::size_t i = 0; i < m_number_of_pvar_header_lines; ++i ) {
+			m_pvar_reader->read_line( &line ) ;
+		}
+	}
+
+	void PgenFileSNPDataSource::reset_to_start_impl() {
+		open_pvar() ;
+		m_exhausted = false ;
+		m_next_variant = 0 ;
+	}
+
+	SNPDataSource::Metadata PgenFileSNPDataSource::get_metadata() const {
+		SNPDataSource::Metadata result ;
+		{
+			std::map< std::string, std::string > format ;
+			format[ "ID" ] = "GT" ;
+			format[ "Number" ] = "1" ;
+			format[ "Type" ] = "String" ;
+			format[ "Description" ] = "Genotype calls" ;
+			result.insert( std::make_pair( "FORMAT", format )) ;
+		}
+		{
+			std::map< std::string, std::string > format ;
+			format[ "ID" ] = "DS" ;
+			format[ "Number" ] = "1" ;
+			format[ "Type" ] = "Float" ;
+			format[ "Description" ] = "ALT allele dosage" ;
+			result.insert( std::make_pair( "FORMAT", format )) ;
+		}
+		return result ;
+	}
+
+	void PgenFileSNPDataSource::get_sample_ids( GetSampleIds getter ) const {
+		for( std::size_t i = 0; i < m_sample_ids.size(); ++i ) {
+			getter( i, m_sample_ids[i] ) ;
+		}
+	}
+
+	SNPDataSource::OptionalSnpCount PgenFileSNPDataSource::total_number_of_snps() const {
+		if( m_ranges.empty() ) {
+			return OptionalSnpCount( m_index.number_of_variants ) ;
+		}
+		return OptionalSnpCount() ;
+	}
+
+	void PgenFileSNPDataSource::set_ranges( std::vector< GenomePositionRange > const& ranges ) {
+		m_ranges = ranges ;
+		reset_to_start() ;
+	}
+
+	bool PgenFileSNPDataSource::read_pvar_line( std::vector< string_utils::slice >* elts ) {
+		if( !m_pvar_reader->read_line( &m_pvar_line )) {
+			return false ;
+		}
+		string_utils::slice data = m_pvar_line.as_slice() ;
+		if( data.size() > 0 && data[ data.size() - 1 ] == '\r' ) {
+			data = data.substr( 0, data.size() - 1 ) ;
+		}
+		elts->clear() ;
+		data.split( " \t", elts ) ;
+		// PLINK 1 .bim files may separate columns by runs of spaces.
+		elts->erase( std::remove( elts->begin(), elts->end(), string_utils::slice( "" )), elts->end() ) ;
+		return true ;
+	}
+
+	void PgenFileSNPDataSource::read_snp_identifying_data_impl( VariantIdentifyingData* result ) {
+		while( true ) {
+			if( !read_pvar_line( &m_pvar_elts ) ) {
+				if( m_next_variant != m_index.number_of_variants ) {
+					throw MalformedInputError(
+						m_pvar_filename,
+						"Number of variants (" + string_utils::to_string( m_next_variant ) + ") does not match the number in \""
+							+ m_pgen_filename + "\" (" + string_utils::to_string( m_index.number_of_variants ) + ")",
+						m_number_of_pvar_header_lines + m_next_variant
+					) ;
+				}
+				m_exhausted = true ;
+				return ;
+			}
+			std::size_t const line_number = m_number_of_pvar_header_lines + m_next_variant ;
+			if( m_next_variant >= m_index.number_of_variants ) {
+				throw MalformedInputError( m_pvar_filename, "File has more variants than \"" + m_pgen_filename + "\"", line_number ) ;
+			}
+			if( m_pvar_elts.size() <= *std::max_element( m_pvar_columns.begin(), m_pvar_columns.end() )) {
+				throw MalformedInputError( m_pvar_filename, line_number, m_pvar_elts.size() ) ;
+			}
+			std::size_t const variant = m_next_variant++ ;
+
+			string_utils::slice const& chromosome = m_pvar_elts[ m_pvar_columns[ eChrom ]] ;
+			GenomePosition position(
+				( chromosome == "." ) ? Chromosome() : Chromosome( chromosome ),
+				string_utils::to_repr< Position >( m_pvar_elts[ m_pvar_columns[ ePos ]] )
+			) ;
+			if( !m_ranges.empty() ) {
+				bool in_range = false ;
+				for( std::size_t i = 0; !in_range && i < m_ranges.size(); ++i ) {
+					in_range = m_ranges[i].contains( position ) ;
+				}
+				if( !in_range ) {
+					continue ;
+				}
+			}
+
+			VariantIdentifyingData variant_data( m_pvar_elts[ m_pvar_columns[ eID ]] ) ;
+			variant_data.set_position( position ) ;
+			variant_data.add_allele( m_pvar_elts[ m_pvar_columns[ eRef ]] ) ;
+			std::vector< string_utils::slice > alts = m_pvar_elts[ m_pvar_columns[ eAlt ]].split( "," ) ;
+			for( std::size_t i = 0; i < alts.size(); ++i ) {
+				if( alts[i] != "." ) {
+					variant_data.add_allele( alts[i] ) ;
+				}
+			}
+			*result = variant_data ;
+			m_current_variant = variant ;
+			return ;
+		}
+	}
+
+	void PgenFileSNPDataSource::read_record( std::size_t variant, pgen::Record* result, bool hardcalls_only ) {
+		pgen::byte_t const type = m_index.types[ variant ] ;
+		if( pgen::is_ld_compressed( type )) {
+			std::size_t const base = m_index.get_ld_base( variant ) ;
+			if( base != m_ld_base_variant ) {
+				// The base was skipped, so read it now.
+				pgen::Record base_record ;
+				read_record( base, &base_record, true ) ;
+			}
+		}
+
+		uint64_t const offset = m_index.offsets[ variant ] ;
+		uint64_t const size = m_index.record_size( variant ) ;
+		if( offset != m_pgen_stream_position ) {
+			m_pgen_stream_ptr->clear() ;
+			m_pgen_stream_ptr->seekg( offset ) ;
+		}
+		m_buffer.resize( size ) ;
+		if( size > 0 ) {
+			m_pgen_stream_ptr->read( reinterpret_cast< char* >( &m_buffer[0] ), size ) ;
+		}
+		if( !*m_pgen_stream_ptr ) {
+			throw MalformedInputError( m_pgen_filename, "Unable to read genotypes from file", variant ) ;
+		}
+		m_pgen_stream_position = offset + size ;
+
+		try {
+			pgen::byte_t const* const buffer = ( size > 0 ) ? &m_buffer[0] : 0 ;
+			pgen::parse_record( buffer, buffer + size, m_index.number_of_samples, type, m_ld_base, result, hardcalls_only ) ;
+		}
+		catch( pgen::PgenError const& ) {
+			throw MalformedInputError(
+				m_pgen_filename,
+				"Variant record is malformed or uses an unsupported (multiallelic) hardcall track",
+				variant
+			) ;
+		}
+		if( !pgen::is_ld_compressed( type )) {
+			m_ld_base = result->hardcalls ;
+			m_ld_base_variant = variant ;
+		}
+	}
+
+	namespace impl {
+		struct PgenFileSNPDataReader: public VariantDataReader {
+			PgenFileSNPDataReader( PgenFileSNPDataSource& source ):
+				m_number_of_samples( source.number_of_samples() ),
+				m_samples( 0 )
+			{
+				source.read_record( source.m_current_variant, &m_record, false ) ;
+			}
+
+			PgenFileSNPDataReader& get( std::string const& spec, PerSampleSetter& setter ) {
+				if( spec == "GT" || ( spec == ":genotypes:" && m_record.dosages.empty() )) {
+					get_hardcalls( setter ) ;
+				} else if( spec == ":genotypes:" ) {
+					get_probabilities_from_dosages( setter ) ;
+				} else if( spec == "DS" ) {
+					get_dosages( setter ) ;
+				} else {
+					throw OperationUnsupportedError( "genfile::impl::PgenFileSNPDataReader::get()", "get \"" + spec + "\"", "PgenFileSNPDataReader" ) ;
+				}
+				setter.finalise() ;
+				return *this ;
+			}
+
+			std::size_t get_number_of_samples() const { return m_samples ? m_samples->size() : m_number_of_samples ; }
+
+			bool set_sample_subset( std::vector< std::size_t > const& samples ) {
+				m_samples = &samples ;
+				return true ;
+			}
+
+			bool supports( std::string const& spec ) const {
+				return spec == "GT" || spec == ":genotypes:" || spec == "DS" ;
+			}
+
+			void get_supported_specs( SpecSetter setter ) const {
+				setter( "GT", "Integer" ) ;
+				setter( ":genotypes:", m_record.dosages.empty() ? "Integer" : "Float" ) ;
+				setter( "DS", "Float" ) ;
+			}
+
+		private:
+			std::size_t const m_number_of_samples ;
+			pgen::Record m_record ;
+			// If non-null, the samples to report.
+			std::vector< std::size_t > const* m_samples ;
+
+		private:
+			void get_hardcalls( PerSampleSetter& setter ) const {
+				std::size_t const N = get_number_of_samples() ;
+				setter.initialise( N, 2 ) ;
+				for( std::size_t j = 0; j < N; ++j ) {
+					std::size_t const i = m_samples ? (*m_samples)[j] : j ;
+					pgen::byte_t const hardcall = m_record.hardcalls[i] ;
+					pgen::byte_t const phase = m_record.phases.empty() ? pgen::e_Unphased : m_record.phases[i] ;
+					setter.set_sample( j ) ;
+					setter.set_number_of_entries( 2, 2, ( phase == pgen::e_Unphased ) ? ePerUnorderedHaplotype : ePerOrderedHaplotype, eAlleleIndex ) ;
+					if( hardcall == pgen::e_MissingHardcall ) {
+						setter.set_value( 0, genfile::MissingValue() ) ;
+						setter.set_value( 1, genfile::MissingValue() ) ;
+					} else {
+						Integer const first = ( hardcall == pgen::e_HomAlt || phase == pgen::e_AltRef ) ? 1 : 0 ;
+						setter.set_value( 0, first ) ;
+						setter.set_value( 1, Integer( hardcall ) - first ) ;
+					}
+				}
+			}
+
+			void get_dosages( PerSampleSetter& setter ) const {
+				std::size_t const N = get_number_of_samples() ;
+				setter.initialise( N, 2 ) ;
+				for( std::size_t j = 0; j < N; ++j ) {
+					std::size_t const i = m_samples ? (*m_samples)[j] : j ;
+					setter.set_sample( j ) ;
+					setter.set_number_of_entries( 2, 1, ePerSample, eDosage ) ;
+					uint16_t const dosage = m_record.dosages.empty()
+						? (( m_record.hardcalls[i] == pgen::e_MissingHardcall ) ? pgen::e_MissingDosage : m_record.hardcalls[i] * pgen::e_DosageScale )
+						: m_record.dosages[i] ;
+					if( dosage == pgen::e_MissingDosage ) {
+						setter.set_value( 0, genfile::MissingValue() ) ;
+					} else {
+						setter.set_value( 0, double( dosage ) / pgen::e_DosageScale ) ;
+					}
+				}
+			}
+
+			// Report the genotype probabilities closest to certainty with the given dosage,
+			// as PLINK 2 does when exporting dosages to BGEN.
+			void get_probabilities_from_dosages( PerSampleSetter& setter ) const {
+				std::size_t const N = get_number_of_samples() ;
+				setter.initialise( N, 2 ) ;
+				for( std::size_t j = 0; j < N; ++j ) {
+					std::size_t const i = m_samples ? (*m_samples)[j] : j ;
+					setter.set_sample( j ) ;
+					setter.set_number_of_entries( 2, 3, ePerUnorderedGenotype, eProbability ) ;
+					uint16_t const dosage = m_record.dosages[i] ;
+					if( dosage == pgen::e_MissingDosage ) {
+						for( std::size_t g = 0; g < 3; ++g ) {
+							setter.set_value( g, genfile::MissingValue() ) ;
+						}
+					} else {
+						double const d = double( dosage ) / pgen::e_DosageScale ;
+						setter.set_value( 0, ( d <= 1.0 ) ? ( 1.0 - d ) : 0.0 ) ;
+						setter.set_value( 1, ( d <= 1.0 ) ? d : ( 2.0 - d ) ) ;
+						setter.set_value( 2, ( d <= 1.0 ) ? 0.0 : ( d - 1.0 ) ) ;
+					}
+				}
+			}
+		} ;
+	}
+
+	VariantDataReader::UniquePtr PgenFileSNPDataSource::read_variant_data_impl() {
+		return VariantDataReader::UniquePtr( new impl::PgenFileSNPDataReader( *this )) ;
+	}
+
+	void PgenFileSNPDataSource::ignore_snp_probability_data_impl() {
+		// Nothing to do: records are located using the index when they are read.
+	}
+}
@@ -20,6 +20,7 @@
 #include "genfile/ShapeITHaplotypesSNPDataSource.hpp"
 #include "genfile/DosageFileSNPDataSource.hpp"
 #include "genfile/BedFileSNPDataSource.hpp"
+#include "genfile/PgenFileSNPDataSource.hpp"
 #include "genfile/LongFormatSNPDataSource.hpp"
 #include "genfile/HLAIMPAsBiallelicVariantDataSource.hpp"
 #include "genfile/ImputeHapProbsSNPDataSource.hpp"
@@ -39,6 +40,7 @@ namespace genfile {
 		result.push_back( "impute_allele_probs" ) ;
 		result.push_back( "shapeit_haplotypes" ) ;
 		result.push_back( "binary_ped" ) ;
+		result.push_back( "pgen" ) ;
 		result.push_back( "long" ) ;
 		result.push_back( "hlaimp" ) ;
 		return result ;
@@ -107,6 +109,23 @@ namespace genfile {
 				uf.second, bimFilename, famFilename
 			) ) ;
 		}
+		else if( uf.first == "pgen" ) {
+			if( uf.second.size() < 5 || uf.second.substr( uf.second.size() - 5, 5 ) != ".pgen" ) {
+				throw genfile::BadArgumentError(
+					"SNPDataSource::create()",
+					"filename=\"" + uf.second + "\"",
+					"For PLINK 2 format, expected the .pgen extension."
+				) ;
+			}
+			std::string const pgenFilename = uf.second ;
+			std::string pvarFilename = pgenFilename ;
+			pvarFilename.replace( pvarFilename.size() - 5, 5, ".pvar" ) ;
+			std::string psamFilename = pgenFilename ;
+			psamFilename.replace( psamFilename.size() - 5, 5, ".psam" ) ;
+			return std::auto_ptr< SNPDataSource >( new PgenFileSNPDataSource(
+				pgenFilename, pvarFilename, psamFilename
+			) ) ;
+		}
 		else if( uf.first == "long" ) {
 			return std::auto_ptr< SNPDataSource >( new LongFormatSNPDataSource( uf.second ) ) ;
 		}
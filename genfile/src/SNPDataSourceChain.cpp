@@ -8,6 +8,7 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <algorithm>
 #include "config/config.hpp"
 #if HAVE_BOOST_FUNCTION
 #include <boost/function.hpp>
@@ -17,6 +18,7 @@
 #include "genfile/SNPDataSource.hpp"
 #include "genfile/SNPDataSourceChain.hpp"
 #include "genfile/SNPDataSourceRack.hpp"
+#include "genfile/VariantReadAheadQueue.hpp"
 #include "genfile/wildcard.hpp"
 
 namespace genfile {
@@ -71,10 +73,14 @@ namespace genfile {
 	}
 		
 	SNPDataSourceChain::SNPDataSourceChain()
-		: m_current_source(0), m_number_of_samples(0), m_moved_to_next_source_callback(0)
+		: m_current_source(0), m_number_of_samples(0), m_number_of_sources_read_ahead(0), m_moved_to_next_source_callback(0)
 	{}
 
 	SNPDataSourceChain::~SNPDataSourceChain() {
+		// Stop the read-ahead threads before the sources go away.
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			delete m_read_ahead[i] ;
+		}
 		for( std::size_t i = 0; i < m_sources.size(); ++i ) {
 			delete m_sources[i] ;
 		}
@@ -85,6 +91,7 @@ namespace genfile {
 	}
 
 	void SNPDataSourceChain::add_source( std::auto_ptr< SNPDataSource > source ) {
+		assert( m_read_ahead.empty() ) ;
 		if( m_sources.empty() ) {
 			m_number_of_samples = source->number_of_samples() ;
 			m_current_source = 0 ;
@@ -106,6 +113,27 @@ namespace genfile {
 		m_metadata = new_metadata ;
 	}
 
+	void SNPDataSourceChain::set_read_ahead(
+		std::size_t number_of_sources,
+		std::size_t number_of_variants,
+		std::vector< std::string > const& specs,
+		bool cache_supported_specs
+	) {
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			delete m_read_ahead[i] ;
+		}
+		m_read_ahead.clear() ;
+		m_number_of_sources_read_ahead = number_of_sources ;
+		if( number_of_sources > 0 ) {
+			for( std::size_t i = 0; i < m_sources.size(); ++i ) {
+				m_read_ahead.push_back(
+					new VariantReadAheadQueue( *m_sources[i], number_of_variants, specs, cache_supported_specs )
+				) ;
+			}
+		}
+		reset_to_start() ;
+	}
+
 	unsigned int SNPDataSourceChain::number_of_samples() const {
 		return m_number_of_samples ;
 	}
@@ -146,6 +174,10 @@ namespace genfile {
 	}
 
 	SNPDataSourceChain::operator bool() const {
+		if( !m_read_ahead.empty() ) {
+			// The sources are in use by the read-ahead threads.
+			return m_current_source < m_sources.size() ;
+		}
 		if( m_current_source < m_sources.size() ) {	
 			return *m_sources[ m_current_source ] ;
 		}
@@ -192,15 +224,35 @@ namespace genfile {
 	
 
 	void SNPDataSourceChain::reset_to_start_impl() {
+		m_current_data.reset() ;
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			m_read_ahead[i]->stop() ;
+		}
 		for( std::size_t i = 0; i < m_sources.size(); ++i ) {
 			m_sources[i]->reset_to_start() ;
 		}
 		m_current_source = 0 ;
+		for( std::size_t i = 0; i < std::min( m_number_of_sources_read_ahead, m_read_ahead.size() ); ++i ) {
+			start_read_ahead( i ) ;
+		}
 	}
 
 	void SNPDataSourceChain::get_snp_identifying_data_impl( 
 		VariantIdentifyingData* result
 	) {
+		if( !m_read_ahead.empty() ) {
+			while( m_current_source < m_sources.size() ) {
+				start_read_ahead( m_current_source ) ;
+				if( m_read_ahead[ m_current_source ]->peek( 0 ) ) {
+					VariantReadAheadQueue::Entry::UniquePtr entry = m_read_ahead[ m_current_source ]->take( 0 ) ;
+					*result = entry->variant ;
+					m_current_data = entry->data ;
+					return ;
+				}
+				move_to_next_source() ;
+			}
+			return ;
+		}
 		move_to_next_nonempty_source_if_necessary() ;
 		if( m_current_source < m_sources.size() ) {
 			m_sources[m_current_source]->get_snp_identifying_data( result ) ;
@@ -209,18 +261,34 @@ namespace genfile {
 
 	VariantDataReader::UniquePtr SNPDataSourceChain::read_variant_data_impl() {
 		assert( m_current_source < m_sources.size() ) ;
+		if( !m_read_ahead.empty() ) {
+			// Data was decoded by the read-ahead thread.
+			assert( m_current_data.get() ) ;
+			return m_current_data ;
+		}
 		return m_sources[m_current_source]->read_variant_data() ;
 	}
 
 	void SNPDataSourceChain::ignore_snp_probability_data_impl(
 	) {
 		assert( m_current_source < m_sources.size() ) ;
+		if( !m_read_ahead.empty() ) {
+			m_current_data.reset() ;
+			return ;
+		}
 		m_sources[m_current_source]->ignore_snp_probability_data() ;
 	}
 
 	void SNPDataSourceChain::set_moved_to_next_source_callback( moved_to_next_source_callback_t callback ) { m_moved_to_next_source_callback = callback ; }
 
 	void SNPDataSourceChain::move_to_next_source() {
+		if( !m_read_ahead.empty() ) {
+			// This source is finished, so its thread can be replaced by one further ahead.
+			m_read_ahead[ m_current_source ]->stop() ;
+			if( m_current_source + m_number_of_sources_read_ahead < m_read_ahead.size() ) {
+				start_read_ahead( m_current_source + m_number_of_sources_read_ahead ) ;
+			}
+		}
 		++m_current_source ;
 		if( m_moved_to_next_source_callback ) {
 			m_moved_to_next_source_callback( m_current_source ) ;
@@ -237,5 +305,10 @@ namespace genfile {
 			move_to_next_source() ;
 		}
 	}
+	void SNPDataSourceChain::start_read_ahead( std::size_t source_index ) {
+		assert( source_index < m_read_ahead.size() ) ;
+		if( !m_read_ahead[ source_index ]->started() ) {
+			m_read_ahead[ source_index ]->start() ;
+		}
+	}
 }
-
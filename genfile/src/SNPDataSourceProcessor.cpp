@@ -6,8 +6,16 @@
 
 //#include <boost/signal.hpp>
 #include <cassert>
+#include <deque>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/exception_ptr.hpp>
 #include "genfile/VariantIdentifyingData.hpp"
 #include "genfile/SNPDataSourceProcessor.hpp"
+#include "genfile/CachedVariantDataReader.hpp"
 #include "genfile/get_set.hpp"
 
 namespace genfile {
@@ -74,5 +82,186 @@ namespace genfile {
 
 		call_end_processing_snps() ;
 	}
-}
 
+	namespace impl {
+		struct ProcessorBatch {
+			typedef boost::shared_ptr< ProcessorBatch > SharedPtr ;
+			std::vector< VariantIdentifyingData > snps ;
+			std::vector< VariantDataReader::SharedPtr > readers ;
+		} ;
+
+		// State shared between the reading thread and the worker threads.
+		// Batches are kept in m_batches until every worker thread has processed them.
+		struct ProcessorPipeline {
+			typedef SNPDataSourceProcessor::Callback Callback ;
+
+			ProcessorPipeline(
+				std::vector< Callback* > const& callbacks,
+				std::size_t number_of_threads,
+				std::size_t max_batches_in_flight
+			):
+				m_callbacks( callbacks ),
+				m_number_of_threads( std::max( std::min( number_of_threads, callbacks.size() ), std::size_t( 1 ) ) ),
+				m_max_batches_in_flight( std::max( max_batches_in_flight, std::size_t( 1 ) ) ),
+				m_first_batch_index( 0 ),
+				m_number_of_batches_submitted( 0 ),
+				m_next_batch_index( m_number_of_threads, 0 ),
+				m_state( eRunning )
+			{
+				for( std::size_t i = 0; i < m_number_of_threads; ++i ) {
+					m_threads.create_thread( boost::bind( &ProcessorPipeline::worker_thread_loop, this, i ) ) ;
+				}
+			}
+
+			~ProcessorPipeline() {
+				// Only reached without finish() if an exception was thrown in the reading thread.
+				{
+					ScopedLock lock( m_mutex ) ;
+					if( m_state == eRunning ) {
+						m_state = eAborted ;
+					}
+					m_changed.notify_all() ;
+				}
+				m_threads.join_all() ;
+			}
+
+			// Hand over a batch, blocking while too many batches are in flight.
+			void submit( ProcessorBatch::SharedPtr batch ) {
+				ScopedLock lock( m_mutex ) ;
+				while( !m_error && m_batches.size() >= m_max_batches_in_flight ) {
+					m_changed.wait( lock ) ;
+				}
+				if( m_error ) {
+					boost::rethrow_exception( m_error ) ;
+				}
+				m_batches.push_back( batch ) ;
+				++m_number_of_batches_submitted ;
+				m_changed.notify_all() ;
+			}
+
+			// Wait for all submitted batches to be processed.
+			void finish() {
+				{
+					ScopedLock lock( m_mutex ) ;
+					m_state = eFinishing ;
+					m_changed.notify_all() ;
+				}
+				m_threads.join_all() ;
+				if( m_error ) {
+					boost::rethrow_exception( m_error ) ;
+				}
+			}
+
+		private:
+			typedef boost::mutex Mutex ;
+			typedef Mutex::scoped_lock ScopedLock ;
+			typedef boost::condition ConditionVariable ;
+			enum State { eRunning = 0, eFinishing = 1, eAborted = 2 } ;
+
+			std::vector< Callback* > const& m_callbacks ;
+			std::size_t const m_number_of_threads ;
+			std::size_t const m_max_batches_in_flight ;
+			boost::thread_group m_threads ;
+
+			Mutex m_mutex ;
+			ConditionVariable m_changed ;
+			std::deque< ProcessorBatch::SharedPtr > m_batches ;
+			std::size_t m_first_batch_index ;
+			std::size_t m_number_of_batches_submitted ;
+			std::vector< std::size_t > m_next_batch_index ;
+			State m_state ;
+			boost::exception_ptr m_error ;
+
+		private:
+			void worker_thread_loop( std::size_t const thread_index ) {
+				while( true ) {
+					ProcessorBatch::SharedPtr batch ;
+					{
+						ScopedLock lock( m_mutex ) ;
+						std::size_t const& next = m_next_batch_index[ thread_index ] ;
+						while( m_state == eRunning && !m_error && next == m_number_of_batches_submitted ) {
+							m_changed.wait( lock ) ;
+						}
+						if( m_state == eAborted || m_error || next == m_number_of_batches_submitted ) {
+							return ;
+						}
+						batch = m_batches[ next - m_first_batch_index ] ;
+					}
+
+					try {
+						process_batch( thread_index, *batch ) ;
+					}
+					catch( ... ) {
+						ScopedLock lock( m_mutex ) ;
+						m_error = boost::current_exception() ;
+						m_changed.notify_all() ;
+						return ;
+					}
+
+					{
+						ScopedLock lock( m_mutex ) ;
+						++m_next_batch_index[ thread_index ] ;
+						std::size_t const slowest = *std::min_element( m_next_batch_index.begin(), m_next_batch_index.end() ) ;
+						while( m_first_batch_index < slowest ) {
+							m_batches.pop_front() ;
+							++m_first_batch_index ;
+						}
+						m_changed.notify_all() ;
+					}
+				}
+			}
+
+			void process_batch( std::size_t const thread_index, ProcessorBatch const& batch ) const {
+				for( std::size_t snp_i = 0; snp_i < batch.snps.size(); ++snp_i ) {
+					for( std::size_t i = thread_index; i < m_callbacks.size(); i += m_number_of_threads ) {
+						m_callbacks[i]->processed_snp( batch.snps[snp_i], batch.readers[snp_i] ) ;
+					}
+				}
+			}
+		} ;
+	}
+
+	ThreadedSNPDataSourceProcessor::ThreadedSNPDataSourceProcessor(
+		std::size_t number_of_threads,
+		std::vector< std::string > const& specs,
+		bool cache_supported_specs,
+		std::size_t batch_size,
+		std::size_t max_batches_in_flight
+	):
+		m_number_of_threads( number_of_threads ),
+		m_specs( specs ),
+		m_cache_supported_specs( cache_supported_specs ),
+		m_batch_size( std::max( batch_size, std::size_t( 1 ) ) ),
+		m_max_batches_in_flight( max_batches_in_flight )
+	{}
+
+	void ThreadedSNPDataSourceProcessor::process( genfile::SNPDataSource& source, ProgressCallback progress_callback ) {
+		call_begin_processing_snps( source.number_of_samples(), source.get_metadata() ) ;
+
+		{
+			impl::ProcessorPipeline pipeline( get_callbacks(), m_number_of_threads, m_max_batches_in_flight ) ;
+			VariantIdentifyingData id_data ;
+			impl::ProcessorBatch::SharedPtr batch( new impl::ProcessorBatch ) ;
+			while( source.get_snp_identifying_data( &id_data ) ) {
+				VariantDataReader::UniquePtr data_reader = source.read_variant_data() ;
+				batch->snps.push_back( id_data ) ;
+				batch->readers.push_back(
+					VariantDataReader::SharedPtr( CachedVariantDataReader::create( *data_reader, m_specs, m_cache_supported_specs ).release() )
+				) ;
+				if( batch->snps.size() == m_batch_size ) {
+					pipeline.submit( batch ) ;
+					batch.reset( new impl::ProcessorBatch ) ;
+				}
+				if( progress_callback ) {
+					progress_callback( source.number_of_snps_read(), source.total_number_of_snps() ) ;
+				}
+			}
+			if( batch->snps.size() > 0 ) {
+				pipeline.submit( batch ) ;
+			}
+			pipeline.finish() ;
+		}
+
+		call_end_processing_snps() ;
+	}
+}
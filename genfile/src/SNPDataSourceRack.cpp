@@ -8,12 +8,13 @@
 #include <iomanip>
 #include <sstream>
 #include <vector>
-#include <set>
+#include <algorithm>
 #include <boost/bind.hpp>
 #include "genfile/Error.hpp"
 #include "genfile/SNPDataSource.hpp"
 #include "genfile/SNPDataSourceRack.hpp"
 #include "genfile/VariantIdentifyingData.hpp"
+#include "genfile/VariantReadAheadQueue.hpp"
 #include "genfile/OffsetFlippedAlleleSetter.hpp"
 #include "genfile/get_set.hpp"
 #include "genfile/get_list_of_snps_in_source.hpp"
@@ -76,6 +77,10 @@ namespace genfile {
 	}
 
 	SNPDataSourceRack::~SNPDataSourceRack() {
+		// Stop the read-ahead threads before the sources go away.
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			delete m_read_ahead[i] ;
+		}
 		for( std::size_t i = 0; i < m_sources.size(); ++i ) {
 			delete m_sources[i] ;
 		}
@@ -84,6 +89,7 @@ namespace genfile {
 	void SNPDataSourceRack::add_source(
 		std::auto_ptr< SNPDataSource > source
 	) {
+		assert( m_read_ahead.empty() ) ;
 		m_sources.push_back( source.release() ) ;
 		m_flips.push_back( eNoFlip ) ;
 		m_number_of_samples += m_sources.back()->number_of_samples() ;
@@ -115,11 +121,37 @@ namespace genfile {
 		}
 	}
 
+	void SNPDataSourceRack::set_read_ahead(
+		std::size_t number_of_variants,
+		std::vector< std::string > const& specs,
+		bool cache_supported_specs
+	) {
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			delete m_read_ahead[i] ;
+		}
+		m_read_ahead.clear() ;
+		if( number_of_variants > 0 ) {
+			for( std::size_t i = 0; i < m_sources.size(); ++i ) {
+				m_read_ahead.push_back(
+					new VariantReadAheadQueue(
+						*m_sources[i], number_of_variants, specs, cache_supported_specs,
+						boost::bind( &VariantIdentifyingData::CompareFields::hash, m_comparator, _1 )
+					)
+				) ;
+			}
+		}
+		reset_to_start() ;
+	}
+
 	// Implicit conversion to bool.  Return true if there have been no errors so far.
 	SNPDataSourceRack::operator bool() const {
 		if( m_sources.empty() ) {
 			return 0 ;
 		}
+		if( !m_read_ahead.empty() ) {
+			// The sources are in use by the read-ahead threads.
+			return !m_read_past_end ;
+		}
 		for( std::size_t i = 0; i < m_sources.size(); ++ i ) {
 			if( !*m_sources[i] ) {
 				return false ;
@@ -214,107 +246,158 @@ namespace genfile {
 	}
 
 	void SNPDataSourceRack::reset_to_start_impl() {
+		m_current_data.clear() ;
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			m_read_ahead[i]->stop() ;
+		}
 		for( std::size_t i = 0; i < m_sources.size(); ++i ) {
 			m_sources[i]->reset_to_start() ;
 		}
+		for( std::size_t i = 0; i < m_read_ahead.size(); ++i ) {
+			m_read_ahead[i]->start() ;
+		}
 		m_read_past_end = false ;
 	}
 
-	namespace {
-		void combine_ids( std::set< std::string >* target, std::string* combined, std::string const& value ) {
-			if( target->insert( value ).second ) {
-				(*combined) += ( combined->size() > 0 ? "/" : "" ) + value ;
-			}
-		}
-	}
-	
 	void SNPDataSourceRack::get_snp_identifying_data_impl( 
 		VariantIdentifyingData* result
 	) {
 		if( m_sources.size() == 0 ) {
 			return ;
 		}
-		
-		VariantIdentifyingData this_snp ;
-		VariantIdentifyingData merged_snp ;
-		std::string merged_SNPID, merged_rsid, merged_allele1, merged_allele2 ;
-		std::set< std::string > rsids ;
-		std::set< std::string > SNPIDs ;
-		std::vector< char > flips( m_sources.size(), eNoFlip ) ;
-		std::size_t source_i = 0 ;
-		if( m_sources[0]->get_snp_identifying_data( &this_snp ) ) {
+
+		std::vector< VariantIdentifyingData > variants( m_sources.size() ) ;
+		if( !m_read_ahead.empty() ) {
+			if( !get_matching_variants_from_read_ahead( &variants ) ) {
+				return ;
+			}
+		} else if( m_sources[0]->get_snp_identifying_data( &variants[0] ) ) {
 			// we use source_i == m_source.size() to indicate a successful match across cohorts.
+			std::size_t source_i = 0 ;
 			while( (*this) && source_i < m_sources.size() ) {
-				merged_SNPID = "" ;
-				merged_rsid = "" ;
-				merged_allele1 = "" ;
-				merged_allele2 = "" ;
-				SNPIDs.clear() ;
-				rsids.clear() ;
-
-				if( this_snp.number_of_identifiers() > 1 ) {
-					this_snp.get_identifiers( boost::bind( &combine_ids, &SNPIDs, &merged_SNPID, _1 ), 1 ) ;
-				}
-				rsids.insert( this_snp.get_primary_id() ) ;
-				merged_rsid = this_snp.get_primary_id() ;
-				merged_allele1 = this_snp.get_allele(0) ;
-				merged_allele2 = this_snp.get_allele(1) ;
-
-				VariantIdentifyingData this_source_snp ;
 				source_i = 1 ;
 				for( ;
-					source_i < m_sources.size() && move_source_to_snp_matching( source_i, this_snp, &this_source_snp );
+					source_i < m_sources.size() && move_source_to_snp_matching( source_i, variants[0], &variants[ source_i ] );
 					++source_i
 				) {
 #if DEBUG_SNP_DATA_SOURCE_RACK
-					std::cerr << "SNP " << this_snp << " is in source " << source_i << ".\n" ;
+					std::cerr << "SNP " << variants[0] << " is in source " << source_i << ".\n" ;
 #endif
-					if( this_source_snp.number_of_identifiers() > 1 ) {
-						this_source_snp.get_identifiers( boost::bind( &combine_ids, &SNPIDs, &merged_SNPID, _1 ), 1 ) ;
-					}
-					if( rsids.insert( this_source_snp.get_primary_id() ).second ) {
-						merged_rsid += ";" + std::string( this_source_snp.get_primary_id() ) ;
-					}
-					if( m_comparator.get_flip_alleles_if_necessary() ) {
-						assert( this_snp.number_of_alleles() == 2 ) ;
-						assert( this_source_snp.number_of_alleles() == 2 ) ;
-						if( this_source_snp.get_allele(0) == this_snp.get_allele(1) && this_source_snp.get_allele(1) == this_snp.get_allele(0) ) {
-							flips[ source_i ] = eFlip ;
-						} else if( this_source_snp.get_allele(0) == this_snp.get_allele(0) && this_source_snp.get_allele(1) == this_snp.get_allele(1) ) {
-							// do nothing
-						} else {
-							merged_allele1 += "/" + std::string( this_source_snp.get_allele(0) ) ;
-							merged_allele2 += "/" + std::string( this_source_snp.get_allele(1) ) ;
-							// Don't know how to flip.
-							flips[ source_i ] = eUnknownFlip ;
-						}
-					} else {
-						if( this_source_snp.get_allele(0) != this_snp.get_allele(0) || this_source_snp.get_allele(1) != this_snp.get_allele(1) ) {
-							merged_allele1 += "/" + std::string( this_source_snp.get_allele(0) ) ;
-							merged_allele2 += "/" + std::string( this_source_snp.get_allele(1) ) ;
-							// Set genotypes to missing for this cohort.
-							flips[ source_i ] = eUnknownFlip ;
-						}
-					}
 				}
 				if( (*this) && source_i < m_sources.size() ) {
 					m_sources[0]->ignore_snp_probability_data() ;
-					m_sources[0]->get_snp_identifying_data( &this_snp ) ;
+					m_sources[0]->get_snp_identifying_data( &variants[0] ) ;
 				}
 			}
 		}
 		if( *this ) {
-			VariantIdentifyingData merged_snp( this_snp.get_primary_id(), this_snp.get_position(), merged_allele1, merged_allele2 ) ;
-			for( std::set< std::string >::const_iterator i = rsids.begin(); i != rsids.end(); ++i ) {
-				merged_snp.add_identifier( *i ) ;
+			merge_matching_variants( variants, result ) ;
+		}
+	}
+
+	bool SNPDataSourceRack::get_matching_variants_from_read_ahead( std::vector< VariantIdentifyingData >* variants ) {
+		typedef VariantReadAheadQueue::Entry Entry ;
+		std::vector< std::size_t > where( m_sources.size(), 0 ) ;
+		while( true ) {
+			Entry const* reference = m_read_ahead[0]->peek( 0 ) ;
+			if( !reference ) {
+				m_read_past_end = true ;
+				return false ;
+			}
+			GenomePosition const& position = reference->variant.get_position() ;
+			bool matched = true ;
+			for( std::size_t source_i = 1; matched && source_i < m_sources.size(); ++source_i ) {
+				VariantReadAheadQueue& stage = *m_read_ahead[ source_i ] ;
+				// Variants before this position cannot match this or any later variant of the first source.
+				Entry const* entry = stage.peek( 0 ) ;
+				for( ; entry && entry->variant.get_position() < position; entry = stage.peek( 0 ) ) {
+					stage.erase( 0 ) ;
+				}
+				if( !entry ) {
+					// This source has no more variants, so there are no more matches.
+					m_read_past_end = true ;
+					return false ;
+				}
+				// Look for a match among the variants at this position.
+				// Variants that do not match are kept, as they may match a later variant of the first source.
+				matched = false ;
+				for( std::size_t i = 0; entry && entry->variant.get_position() == position; entry = stage.peek( ++i ) ) {
+					if( entry->key == reference->key && m_comparator.are_equal( entry->variant, reference->variant )) {
+						where[ source_i ] = i ;
+						matched = true ;
+						break ;
+					}
+				}
+			}
+			if( matched ) {
+				m_current_data.resize( m_sources.size() ) ;
+				for( std::size_t source_i = 0; source_i < m_sources.size(); ++source_i ) {
+					Entry::UniquePtr entry = m_read_ahead[ source_i ]->take( where[ source_i ] ) ;
+					(*variants)[ source_i ] = entry->variant ;
+					m_current_data[ source_i ].reset( entry->data.release() ) ;
+				}
+				return true ;
+			}
+			m_read_ahead[0]->erase( 0 ) ;
+		}
+	}
+
+	void SNPDataSourceRack::merge_matching_variants(
+		std::vector< VariantIdentifyingData > const& variants,
+		VariantIdentifyingData* result
+	) {
+		VariantIdentifyingData const& reference = variants[0] ;
+		std::string merged_allele1 = reference.get_allele(0) ;
+		std::string merged_allele2 = reference.get_allele(1) ;
+		std::vector< std::string > rsids ;
+		std::vector< std::string > SNPIDs ;
+		std::vector< char > flips( variants.size(), eNoFlip ) ;
+		for( std::size_t source_i = 0; source_i < variants.size(); ++source_i ) {
+			VariantIdentifyingData const& variant = variants[ source_i ] ;
+			rsids.push_back( variant.get_primary_id() ) ;
+			std::vector< string_utils::slice > const ids = variant.get_identifiers( 1 ) ;
+			SNPIDs.insert( SNPIDs.end(), ids.begin(), ids.end() ) ;
+			if( source_i == 0 ) {
+				continue ;
 			}
-			for( std::set< std::string >::const_iterator i = SNPIDs.begin(); i != SNPIDs.end(); ++i ) {
-				merged_snp.add_identifier( *i ) ;
+			if( m_comparator.get_flip_alleles_if_necessary() ) {
+				assert( reference.number_of_alleles() == 2 ) ;
+				assert( variant.number_of_alleles() == 2 ) ;
+				if( variant.get_allele(0) == reference.get_allele(1) && variant.get_allele(1) == reference.get_allele(0) ) {
+					flips[ source_i ] = eFlip ;
+				} else if( variant.get_allele(0) == reference.get_allele(0) && variant.get_allele(1) == reference.get_allele(1) ) {
+					// do nothing
+				} else {
+					merged_allele1 += "/" + std::string( variant.get_allele(0) ) ;
+					merged_allele2 += "/" + std::string( variant.get_allele(1) ) ;
+					// Don't know how to flip.
+					flips[ source_i ] = eUnknownFlip ;
+				}
+			} else {
+				if( variant.get_allele(0) != reference.get_allele(0) || variant.get_allele(1) != reference.get_allele(1) ) {
+					merged_allele1 += "/" + std::string( variant.get_allele(0) ) ;
+					merged_allele2 += "/" + std::string( variant.get_allele(1) ) ;
+					// Set genotypes to missing for this cohort.
+					flips[ source_i ] = eUnknownFlip ;
+				}
 			}
-			*result = merged_snp ;
-			// Remember the flips.
-			m_flips = flips ;
 		}
+		// Identifiers are added in sorted order, with duplicates removed.
+		std::sort( rsids.begin(), rsids.end() ) ;
+		rsids.erase( std::unique( rsids.begin(), rsids.end() ), rsids.end() ) ;
+		std::sort( SNPIDs.begin(), SNPIDs.end() ) ;
+		SNPIDs.erase( std::unique( SNPIDs.begin(), SNPIDs.end() ), SNPIDs.end() ) ;
+
+		VariantIdentifyingData merged_snp( reference.get_primary_id(), reference.get_position(), merged_allele1, merged_allele2 ) ;
+		for( std::size_t i = 0; i < rsids.size(); ++i ) {
+			merged_snp.add_identifier( rsids[i] ) ;
+		}
+		for( std::size_t i = 0; i < SNPIDs.size(); ++i ) {
+			merged_snp.add_identifier( SNPIDs[i] ) ;
+		}
+		*result = merged_snp ;
+		// Remember the flips.
+		m_flips = flips ;
 	}
 
 	// Read the identifying info of the next SNP in the given source
@@ -366,37 +449,38 @@ namespace genfile {
 			map->push_back( std::make_pair( name, type )) ;
 		}
 
+		// The flips and per-source data are copied, so this reader remains valid
+		// after the rack has moved on to later variants.
 		struct RackVariantDataReader: public VariantDataReader
 		{
-			RackVariantDataReader( SNPDataSourceRack& rack ):
-				m_rack( rack )
+			RackVariantDataReader(
+				SNPDataSourceRack const& rack,
+				std::vector< VariantDataReader::SharedPtr > const& data_readers
+			):
+				m_data_readers( data_readers ),
+				m_flips( rack.m_flips ),
+				m_number_of_samples( rack.number_of_samples() )
 			{
-				for( std::size_t i = 0; i < m_rack.m_sources.size(); ++i ) {
-					m_data_readers.push_back( m_rack.m_sources[i]->read_variant_data().release() ) ;
-				}
-			}
-
-			~RackVariantDataReader() {
-				for( std::size_t i = 0; i < m_data_readers.size(); ++i ) {
-					delete m_data_readers[i] ;
+				for( std::size_t i = 0; i < rack.m_sources.size(); ++i ) {
+					m_source_sizes.push_back( rack.m_sources[i]->number_of_samples() ) ;
 				}
 			}
 
 			RackVariantDataReader& get( std::string const& spec, PerSampleSetter& setter ) {
-				OffsetFlippedAlleleSetter offset_flip_sample_setter( setter, m_rack.number_of_samples(), eNoFlip, 0 ) ;
+				OffsetFlippedAlleleSetter offset_flip_sample_setter( setter, m_number_of_samples, eNoFlip, 0 ) ;
 				std::size_t sample_offset = 0 ;
-				for( std::size_t i = 0; i < m_rack.m_sources.size(); ++i ) {
+				for( std::size_t i = 0; i < m_data_readers.size(); ++i ) {
 					offset_flip_sample_setter.set_offset( sample_offset ) ;
-					offset_flip_sample_setter.set_flip( m_rack.get_flip( i ) ) ;
+					offset_flip_sample_setter.set_flip( m_flips[i] ) ;
 					m_data_readers[i]->get( spec, offset_flip_sample_setter ) ;
-					sample_offset += m_rack.m_sources[i]->number_of_samples() ;
+					sample_offset += m_source_sizes[i] ;
 				}
 				setter.finalise() ;
 				return *this ;
 			}
 
 			std::size_t get_number_of_samples() const {
-				return m_rack.number_of_samples() ;
+				return m_number_of_samples ;
 			}
 
 			// True if all the constituent sources support the spec.
@@ -456,17 +540,32 @@ namespace genfile {
 			}
 
 			private:
-				std::vector< VariantDataReader* > m_data_readers ;
-				SNPDataSourceRack& m_rack ;
+				std::vector< VariantDataReader::SharedPtr > const m_data_readers ;
+				std::vector< char > const m_flips ;
+				std::size_t const m_number_of_samples ;
+				std::vector< std::size_t > m_source_sizes ;
 		} ;
 	}
 
 	VariantDataReader::UniquePtr SNPDataSourceRack::read_variant_data_impl() {
-		VariantDataReader::UniquePtr result( new impl::RackVariantDataReader( *this ) ) ;
+		std::vector< VariantDataReader::SharedPtr > data_readers ;
+		if( !m_read_ahead.empty() ) {
+			// Data was decoded by the read-ahead threads.
+			data_readers.swap( m_current_data ) ;
+		} else {
+			for( std::size_t i = 0; i < m_sources.size(); ++i ) {
+				data_readers.push_back( VariantDataReader::SharedPtr( m_sources[i]->read_variant_data().release() )) ;
+			}
+		}
+		VariantDataReader::UniquePtr result( new impl::RackVariantDataReader( *this, data_readers ) ) ;
 		return result ;
 	}
 
 	void SNPDataSourceRack::ignore_snp_probability_data_impl() {
+		if( !m_read_ahead.empty() ) {
+			m_current_data.clear() ;
+			return ;
+		}
 		for( std::size_t i = 0; i < m_sources.size(); ++i ) {
 			m_sources[i]->ignore_snp_probability_data() ;
 		}
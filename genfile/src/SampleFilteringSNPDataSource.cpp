@@ -34,6 +34,15 @@ namespace genfile {
 		if( m_indices_of_samples_to_filter_out.size() > 0 && m_indices_of_samples_to_filter_out.back() >= m_source->number_of_samples() ) {
 			throw SampleIndexOutOfRangeError( m_indices_of_samples_to_filter_out.back(), m_source->number_of_samples() ) ;
 		}
+		m_indices_of_samples_to_keep.reserve( number_of_samples() ) ;
+		std::vector< std::size_t >::const_iterator next_filtered_out = m_indices_of_samples_to_filter_out.begin() ;
+		for( std::size_t i = 0; i < m_source->number_of_samples(); ++i ) {
+			if( next_filtered_out != m_indices_of_samples_to_filter_out.end() && *next_filtered_out == i ) {
+				++next_filtered_out ;
+			} else {
+				m_indices_of_samples_to_keep.push_back( i ) ;
+			}
+		}
 	}
 	
 	SampleFilteringSNPDataSource::~SampleFilteringSNPDataSource() {}
@@ -230,25 +239,51 @@ namespace genfile {
 			bool m_filter_out_this_sample ;
 		} ;
 		
+		// If the underlying reader supports it, samples are skipped at decode time;
+		// otherwise they are filtered out by wrapping the setter.
 		struct SampleFilteringVariantDataReader: public VariantDataReader {
 			SampleFilteringVariantDataReader(
 				VariantDataReader::UniquePtr data_reader,
-				std::vector< std::size_t > const& indices_of_samples_to_filter_out
+				std::vector< std::size_t > const& indices_of_samples_to_filter_out,
+				std::vector< std::size_t > const& indices_of_samples_to_keep
 			):
 				m_data_reader( data_reader ),
-				m_indices_of_samples_to_filter_out( indices_of_samples_to_filter_out )
+				m_indices_of_samples_to_filter_out( indices_of_samples_to_filter_out ),
+				m_filtering_in_reader(
+					m_data_reader.get() != 0
+					&& m_data_reader->set_sample_subset( indices_of_samples_to_keep )
+				)
 			{}
 
 			VariantDataReader& get( std::string const& spec, PerSampleSetter& setter ) {
-				SampleFilteringPerSampleSetter filtering_setter( setter, m_indices_of_samples_to_filter_out ) ;
-				m_data_reader->get(
-					spec,
-					filtering_setter
-				) ;
+				if( m_filtering_in_reader ) {
+					m_data_reader->get( spec, setter ) ;
+				} else {
+					SampleFilteringPerSampleSetter filtering_setter( setter, m_indices_of_samples_to_filter_out ) ;
+					m_data_reader->get(
+						spec,
+						filtering_setter
+					) ;
+				}
 				return *this ;
 			}
+
+			VariantDataReader& get_probabilities( std::string const& spec, GenotypeProbabilityMatrix* result ) {
+				if( m_filtering_in_reader ) {
+					m_data_reader->get_probabilities( spec, result ) ;
+					return *this ;
+				} else {
+					return VariantDataReader::get_probabilities( spec, result ) ;
+				}
+			}
 			
-			std::size_t get_number_of_samples() const { return m_data_reader->get_number_of_samples() - m_indices_of_samples_to_filter_out.size() ; }
+			std::size_t get_number_of_samples() const {
+				if( m_filtering_in_reader ) {
+					return m_data_reader->get_number_of_samples() ;
+				} else {
+					return m_data_reader->get_number_of_samples() - m_indices_of_samples_to_filter_out.size() ;
+				}
+			}
 
 			bool supports( std::string const& spec ) const {
 				return m_data_reader->supports( spec ) ;
@@ -261,6 +296,7 @@ namespace genfile {
 		private:
 			VariantDataReader::UniquePtr m_data_reader ;
 			std::vector< std::size_t > const& m_indices_of_samples_to_filter_out ;
+			bool const m_filtering_in_reader ;
 		} ;
 	}
 
@@ -268,7 +304,8 @@ namespace genfile {
 		return VariantDataReader::UniquePtr(
 			new impl::SampleFilteringVariantDataReader(
 				m_source->read_variant_data(),
-				m_indices_of_samples_to_filter_out
+				m_indices_of_samples_to_filter_out,
+				m_indices_of_samples_to_keep
 			)
 		) ;
 	}
@@ -10,6 +10,7 @@
 #include <vector>
 #include <fstream>
 #include <cstdio>
+#include <boost/bind.hpp>
 #include "config/config.hpp"
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -28,9 +29,15 @@ namespace genfile {
 	):
 		m_filename( filename ),
 		m_sink( sink ),
+		m_file_offsets( comparer ),
 		m_offset_of_first_snp( 0 ),
-		m_file_offsets( comparer )
+		m_sink_reports_locations( false )
 	{
+		BasicBGenFileSNPDataSink* bgen_sink = dynamic_cast< BasicBGenFileSNPDataSink* >( m_sink.get() ) ;
+		if( bgen_sink ) {
+			bgen_sink->send_variant_locations_to( boost::bind( &SortingBGenFileSNPDataSink::set_variant_location, this, _2, _3 )) ;
+			m_sink_reports_locations = true ;
+		}
 	}
 
 	std::string SortingBGenFileSNPDataSink::get_spec() const {
@@ -42,6 +49,15 @@ namespace genfile {
 		VariantDataReader& data_reader,
 		Info const& info
 	) {
+		if( m_sink_reports_locations ) {
+			m_unlocated_variants.push_back(
+				m_file_offsets.insert(
+					std::make_pair( id_data, std::make_pair( std::ostream::streampos( 0 ), std::ostream::streampos( 0 ) ))
+				)
+			) ;
+			m_sink->write_variant_data( id_data, data_reader, info ) ;
+			return ;
+		}
 		OffsetMap::iterator offset_i = m_file_offsets.insert(
 			std::make_pair(
 				id_data,
@@ -55,8 +71,18 @@ namespace genfile {
 		offset_i->second.second = m_sink->get_stream_pos().second ;
 	}
 
+	void SortingBGenFileSNPDataSink::set_variant_location( int64_t offset, int64_t size ) {
+		// Locations are reported in the order variants were written.
+		assert( !m_unlocated_variants.empty() ) ;
+		OffsetMap::iterator where = m_unlocated_variants.front() ;
+		m_unlocated_variants.pop_front() ;
+		where->second.first = offset ;
+		where->second.second = offset + size ;
+	}
+
 	SortingBGenFileSNPDataSink::~SortingBGenFileSNPDataSink() {
 		// Ensure temporary file is flushed.
+		// (This also reports any outstanding variant locations.)
 		m_sink.reset() ;
 		
 		boost::system::error_code ec ;
@@ -104,6 +130,9 @@ namespace genfile {
 			}
 			for( ; i != end_i; ++i ) {
 				std::pair< std::ostream::streampos, std::ostream::streampos > const& chunk = i->second ;
+				if( m_variant_location_callback ) {
+					m_variant_location_callback( i->first, int64_t( output.tellp() ), int64_t( chunk.second - chunk.first ) ) ;
+				}
 				input.seekg( chunk.first ) ;
 				// std::cerr << "copying chunk " << chunk.first << " - " << chunk.second << "...\n" ;
 				for( std::ostream::streampos i = chunk.first; i < chunk.second; i += buffer.size() ) {
@@ -130,4 +159,8 @@ namespace genfile {
 	void SortingBGenFileSNPDataSink::set_metadata_impl( Metadata const& metadata ) {
 		m_sink->set_metadata( metadata ) ;
 	}
+
+	void SortingBGenFileSNPDataSink::send_variant_locations_to( BasicBGenFileSNPDataSink::VariantLocationCallback callback ) {
+		m_variant_location_callback = callback ;
+	}
 }
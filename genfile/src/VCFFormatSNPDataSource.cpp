@@ -9,6 +9,7 @@
 #include <set>
 #include <memory>
 #include <iostream>
+#include <cstring>
 #include <boost/tuple/tuple.hpp>
 #include <boost/bimap.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -50,6 +51,9 @@ namespace genfile {
 		m_spec( "(unnamed stream)" ),
 		m_compression_type( "no_compression" ),
 		m_stream_ptr( stream_ptr ),
+		m_line_reader( *m_stream_ptr ),
+		m_line_position( 0 ),
+		m_end_of_data( false ),
 		m_metadata_parser( new vcf::StrictMetadataParser( m_spec, *m_stream_ptr ) ),
 		m_metadata( ( metadata ? *metadata : m_metadata_parser->get_metadata() ) ),
 		m_info_types( vcf::get_entry_types( m_metadata, "INFO" )),
@@ -71,6 +75,9 @@ namespace genfile {
 		m_spec( filename ),
 		m_compression_type( get_compression_type_indicated_by_filename( filename )),
 		m_stream_ptr( open_text_file_for_input( filename, m_compression_type ) ),
+		m_line_reader( *m_stream_ptr ),
+		m_line_position( 0 ),
+		m_end_of_data( false ),
 		m_metadata_parser( new vcf::StrictMetadataParser( m_spec, *m_stream_ptr ) ),
 		m_metadata( ( metadata ? *metadata : m_metadata_parser->get_metadata() ) ),
 		m_info_types( vcf::get_entry_types( m_metadata, "INFO" )),
@@ -133,8 +140,6 @@ namespace genfile {
 			throw OperationUnsupportedError( "void VCFFormatSNPDataSource::reset_stream()", "open stream", m_spec ) ;
 		}
 
-		m_stream_ptr->exceptions( std::ios::eofbit | std::ios::failbit | std::ios::badbit ) ;
-
 		// Find our way back to the start of data.
 		for( std::size_t i = 0; i < ( get_index_of_first_data_line() ); ++i ) {
 			std::string line ;
@@ -142,6 +147,8 @@ namespace genfile {
 		}
 
 		assert( *m_stream_ptr ) ;
+		m_line_reader.reset( *m_stream_ptr ) ;
+		m_end_of_data = false ;
 		m_have_id_data = false ;
 	}
 
@@ -185,7 +192,7 @@ namespace genfile {
 	}
 
 	VCFFormatSNPDataSource::operator bool() const {
-		return m_stream_ptr->good() ;
+		return !m_end_of_data ;
 	}
 
 	unsigned int VCFFormatSNPDataSource::number_of_samples() const {
@@ -215,78 +222,48 @@ namespace genfile {
 	}
 	
 	namespace impl {
-		void read_element( std::istream& stream, std::string& elt, char delim, std::size_t column ) {
-#if defined __GNUC__ && ( __GNUC__ == 5 || __GNUC__ == 6 )
-			// work around GCC 5 bug in which C++11 ABI and C++98 ABI interact badly,
-			// preventing catching the exception.
-			std::ios_base::iostate const state = stream.exceptions() ;
-			stream.exceptions( std::ios_base::iostate(0) ) ;
-#endif
-			std::getline( stream, elt, delim ) ;
-			if( !stream ) {
-				throw std::ios_base::failure( "Unable to read line" ) ;
-			}
-#if defined __GNUC__ && ( __GNUC__ == 5 || __GNUC__ == 6 )
-			stream.exceptions( state ) ;
-#endif
-			// ensure element contains no whitespace.
-			if( elt.find_first_of( " \t\n\r" ) != std::string::npos ) {
-				throw MalformedInputError( "(unnamed stream)", 0, column ) ;
-			}
+		// Return the end of the tab-delimited field starting at begin, or 0 if there is no following tab.
+		char const* find_tab( char const* begin, char const* end ) {
+			return reinterpret_cast< char const* >( std::memchr( begin, '\t', end - begin )) ;
 		}
 
-		char read_format_and_get_trailing_char( std::istream& stream, std::string& format, std::size_t column ) {
-			char after_format ;
-			for( after_format = stream.get(); after_format != '\n' && after_format != '\t'; after_format = stream.get() ) {
-				format.append( 1, after_format ) ;
-			}
-			if( format.find_first_of( " \t\n\r" ) != std::string::npos ) {
-				throw MalformedInputError( "(unnamed stream)", 0, column ) ;
+		bool contains_whitespace( char const* begin, char const* end ) {
+			for( ; begin != end; ++begin ) {
+				if( *begin == ' ' || *begin == '\r' ) {
+					return true ;
+				}
 			}
-			return after_format ;
+			return false ;
 		}
 	}
 	
-	void VCFFormatSNPDataSource::get_snp_identifying_data_impl( VariantIdentifyingData* variant	) {
-		return get_snp_identifying_data_impl( m_stream_ptr.get(), variant ) ;
-	}
-
-	void VCFFormatSNPDataSource::get_snp_identifying_data_impl( std::istream* stream_ptr, VariantIdentifyingData* result ) {
+	void VCFFormatSNPDataSource::get_snp_identifying_data_impl( VariantIdentifyingData* result ) {
 		if( !m_have_id_data ) {
-			std::size_t entry_count = 0 ;
-			try {
-				impl::read_element( *stream_ptr, m_CHROM, '\t', entry_count++ ) ;
-				if( m_number_of_lines && number_of_snps_read() == *m_number_of_lines ) {
-					throw MalformedInputError( m_spec, number_of_snps_read() + get_index_of_first_data_line() ) ;
-				}
-			}
-			catch( std::ios_base::failure const& ) {
+			if( !m_line_reader.read_line( &m_line ) ) {
+				m_end_of_data = true ;
 				// end of data, this is only an error if number of lines did not match.
 				if( m_number_of_lines && number_of_snps_read() != *m_number_of_lines ) {
 					throw MalformedInputError( m_spec, number_of_snps_read() + get_index_of_first_data_line() ) ;
 				}
 				return ;
 			}
-			catch( MalformedInputError const& e ) {
-				throw MalformedInputError( m_spec, number_of_snps_read() + get_index_of_first_data_line(), e.column() ) ;
+			if( m_number_of_lines && number_of_snps_read() == *m_number_of_lines ) {
+				throw MalformedInputError( m_spec, number_of_snps_read() + get_index_of_first_data_line() ) ;
 			}
 
-			try {
-				impl::read_element( *stream_ptr, m_POS, '\t', entry_count++ ) ;
-				impl::read_element( *stream_ptr, m_ID, '\t', entry_count++ ) ;
-				impl::read_element( *stream_ptr, m_REF, '\t', entry_count++ ) ;
-				impl::read_element( *stream_ptr, m_ALT, '\t', entry_count++ ) ;
-				impl::read_element( *stream_ptr, m_QUAL, '\t', entry_count++ ) ;
-				impl::read_element( *stream_ptr, m_FILTER, '\t', entry_count++ ) ;
-				impl::read_element( *stream_ptr, m_INFO, '\t', entry_count++ ) ;
-			}
-			catch( std::ios_base::failure const& ) {
-				throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), entry_count ) ;
-			}
-			catch( MalformedInputError const& e ) {
-				throw MalformedInputError( m_spec, number_of_snps_read() + get_index_of_first_data_line(), e.column() ) ;
+			// Split out the fields up to and including INFO.
+			// These are copied; the FORMAT and per-sample data are parsed in place later.
+			std::string* const fields[8] = { &m_CHROM, &m_POS, &m_ID, &m_REF, &m_ALT, &m_QUAL, &m_FILTER, &m_INFO } ;
+			char const* p = m_line.begin ;
+			for( std::size_t column = 0; column < 8; ++column ) {
+				char const* const field_end = impl::find_tab( p, m_line.end ) ;
+				if( field_end == 0 || impl::contains_whitespace( p, field_end )) {
+					throw MalformedInputError( m_spec, number_of_snps_read() + get_index_of_first_data_line(), column ) ;
+				}
+				fields[ column ]->assign( p, field_end ) ;
+				p = field_end + 1 ;
 			}
-			
+			m_line_position = p ;
 			m_have_id_data = true ;
 		}
 
@@ -338,17 +315,20 @@ namespace genfile {
 				std::vector< std::string > const& variant_alleles,
 				std::string const& FORMAT,
 				boost::ptr_map< std::string, vcf::VCFEntryType > const& format_types,
-				VCFFormatSNPDataSource::FieldMapping field_mapping
+				VCFFormatSNPDataSource::FieldMapping field_mapping,
+				BufferedLineReader::Line const& line,
+				char const* data_begin
 			):
 			 	m_source( source ),
 				m_format_types( format_types ),
 				m_format_elts( genfile::string_utils::split( FORMAT, ":" )),
-				m_field_mapping( field_mapping )
+				m_field_mapping( field_mapping ),
+				m_line( line ),
+				m_number_of_samples( source.number_of_samples() )
 			{
 				if( m_source.number_of_samples() > 0 ) {
-					std::string data ;
-					std::getline( *(m_source.m_stream_ptr), data ) ;
-					m_data_reader.reset( new vcf::CallReader( m_source.number_of_samples(), variant_alleles.size(), FORMAT, data, format_types ) ) ;
+					// The data is parsed in place; m_line keeps the buffer holding it alive.
+					m_data_reader.reset( new vcf::CallReader( m_source.number_of_samples(), variant_alleles.size(), FORMAT, data_begin, m_line.end, format_types ) ) ;
 					m_data_reader->set_strict_mode( m_source.m_strict_mode ) ;
 				}
 			}
@@ -384,7 +364,15 @@ namespace genfile {
 				return *this ;
 			}
 			
-			std::size_t get_number_of_samples() const { return m_source.number_of_samples() ; }
+			std::size_t get_number_of_samples() const { return m_number_of_samples ; }
+
+			bool set_sample_subset( std::vector< std::size_t > const& samples ) {
+				if( m_data_reader.get() ) {
+					m_data_reader->set_sample_subset( samples ) ;
+				}
+				m_number_of_samples = samples.size() ;
+				return true ;
+			}
 			
 			bool supports( std::string const& spec ) const {
 				return ( spec == ":genotypes:" && m_source.m_genotype_field != "" ) || ( spec == ":intensities:" && m_source.m_intensity_field != "" ) || ( m_field_mapping.left.find( spec ) != m_field_mapping.left.end() ) ;
@@ -408,25 +396,27 @@ namespace genfile {
 			std::vector< std::string > const m_format_elts ;
 			typedef VCFFormatSNPDataSource::FieldMapping FieldMapping ;
 			FieldMapping m_field_mapping ;
+			BufferedLineReader::Line const m_line ;
+			std::size_t m_number_of_samples ;
 			vcf::CallReader::UniquePtr m_data_reader ;
 		} ;
 	}
 	
 	std::string VCFFormatSNPDataSource::read_format() {
-		std::string FORMAT ;
-		std::size_t count = 8 ;
-		char after_format ;
-		try {
-			after_format = impl::read_format_and_get_trailing_char( *m_stream_ptr,FORMAT, count++ ) ;
+		assert( m_have_id_data ) ;
+		char const* format_end = impl::find_tab( m_line_position, m_line.end ) ;
+		bool const have_sample_data = ( format_end != 0 ) ;
+		if( !have_sample_data ) {
+			format_end = m_line.end ;
 		}
-		catch( std::ios_base::failure const& ) {
-			throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), count ) ;
+		if( impl::contains_whitespace( m_line_position, format_end )) {
+			throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), 8 ) ;
 		}
-
-		if(( m_number_of_samples == 0 && after_format != '\n' ) || ( m_number_of_samples > 0 && after_format != '\t' )) {
-			throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), count ) ;
+		if(( m_number_of_samples == 0 && have_sample_data ) || ( m_number_of_samples > 0 && !have_sample_data )) {
+			throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), 9 ) ;
 		}
-
+		std::string const FORMAT( m_line_position, format_end ) ;
+		m_line_position = have_sample_data ? ( format_end + 1 ) : format_end ;
 		return FORMAT ;
 	}
 
@@ -435,7 +425,7 @@ namespace genfile {
 		VariantDataReader::UniquePtr result ;
 		//if( m_number_of_samples > 0 ) {
 		try {
-			result.reset( new impl::VCFFormatDataReader( *this, m_variant_alleles, FORMAT, m_format_types, m_field_mapping )) ;
+			result.reset( new impl::VCFFormatDataReader( *this, m_variant_alleles, FORMAT, m_format_types, m_field_mapping, m_line, m_line_position )) ;
 		}
 		catch( BadArgumentError const& ) {
 			// problem with FORMAT
@@ -447,24 +437,16 @@ namespace genfile {
 	}
 	
 	void VCFFormatSNPDataSource::ignore_snp_probability_data_impl() {
-		std::string FORMAT ;
-		std::string data ;
-		std::size_t count = 7 ;
-		try {
-			impl::read_element( *m_stream_ptr, FORMAT, '\t', count++ ) ;
-			std::getline( *m_stream_ptr, data ) ;
-			++count ;
-		}
-		catch( std::ios_base::failure const& ) {
-			throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), count ) ;
-		}
+		std::string const FORMAT = read_format() ;
 		// We ignore the data, but parse the FORMAT spec anyway.
-		try {
-			vcf::CallReader( m_number_of_samples, m_variant_alleles.size(), FORMAT, data, m_format_types ) ;
-		}
-		catch( BadArgumentError const& ) {
-			// problem with FORMAT
-			throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), 8 ) ;
+		if( m_number_of_samples > 0 ) {
+			try {
+				vcf::CallReader( m_number_of_samples, m_variant_alleles.size(), FORMAT, m_line_position, m_line.end, m_format_types ) ;
+			}
+			catch( BadArgumentError const& ) {
+				// problem with FORMAT
+				throw MalformedInputError( get_source_spec(), number_of_snps_read() + get_index_of_first_data_line(), 8 ) ;
+			}
 		}
 		m_have_id_data = false ;
 	}
@@ -9,6 +9,8 @@
 #include "genfile/VariantDataReader.hpp"
 #include "genfile/vcf/get_set.hpp"
 #include "genfile/SingleSNPGenotypeProbabilities.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
+#include "genfile/ToGP.hpp"
 
 namespace genfile {
 
@@ -35,4 +37,13 @@ namespace genfile {
 	VariantDataReader& VariantDataReader::get( std::string const& spec, PerVariantSetter& data ) {
 		assert( 0 ) ; // This function should not be called.
 	}
+
+	VariantDataReader& VariantDataReader::get_probabilities( std::string const& spec, GenotypeProbabilityMatrix* result ) {
+		impl::GenotypeProbabilityMatrixFiller filler( result ) ;
+		return get( spec, to_GP_unphased( filler ) ) ;
+	}
+
+	bool VariantDataReader::set_sample_subset( std::vector< std::size_t > const& ) {
+		return false ;
+	}
 }
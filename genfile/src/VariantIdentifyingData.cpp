@@ -10,6 +10,7 @@
 #include <limits>
 #include <cassert>
 #include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
 #include "genfile/GenomePosition.hpp"
 #include "genfile/string_utils/slice.hpp"
 #include "genfile/string_utils/string_utils.hpp"
@@ -528,6 +529,41 @@ namespace genfile {
 		return true ;
 	}
 	
+	namespace {
+		void hash_slice( std::size_t* seed, string_utils::slice const& value ) {
+			boost::hash_combine( *seed, boost::hash_range( value.begin(), value.end() )) ;
+		}
+	}
+
+	std::size_t VariantIdentifyingData::CompareFields::hash( VariantIdentifyingData const& value ) const {
+		std::size_t result = 0 ;
+		for( std::size_t i = 0; i < m_fields_to_compare.size(); ++i ) {
+			switch( m_fields_to_compare[i] ) {
+				case ePosition:
+					boost::hash_combine( result, std::string( value.get_position().chromosome() )) ;
+					boost::hash_combine( result, value.get_position().position() ) ;
+					break ;
+				case eRSID:
+					hash_slice( &result, value.get_primary_id() ) ;
+					break ;
+				case eIDs:
+					value.get_identifiers( boost::bind( &hash_slice, &result, _1 )) ;
+					break ;
+				case eAlternateIDs:
+					value.get_identifiers( boost::bind( &hash_slice, &result, _1 ), 1 ) ;
+					break ;
+				case eAlleles:
+					hash_slice( &result, value.get_allele(0) ) ;
+					hash_slice( &result, value.get_allele(1) ) ;
+					break ;
+				default:
+					assert(0) ;
+					break ;
+			}
+		}
+		return result ;
+	}
+
 	std::string VariantIdentifyingData::CompareFields::get_summary() const {
 		std::string result = "comparing " ;
 		for( std::size_t i = 0; i < m_fields_to_compare.size(); ++i ) {
@@ -0,0 +1,132 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cassert>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "genfile/VariantReadAheadQueue.hpp"
+#include "genfile/CachedVariantDataReader.hpp"
+
+namespace genfile {
+	VariantReadAheadQueue::VariantReadAheadQueue(
+		SNPDataSource& source,
+		std::size_t number_of_variants,
+		std::vector< std::string > const& specs,
+		bool cache_supported_specs,
+		Hasher hasher
+	):
+		m_source( source ),
+		m_number_of_variants( std::max( number_of_variants, std::size_t( 1 ) ) ),
+		m_specs( specs ),
+		m_cache_supported_specs( cache_supported_specs ),
+		m_hasher( hasher ),
+		m_wanted( 0 ),
+		m_end_of_data( false ),
+		m_stop( false )
+	{}
+
+	VariantReadAheadQueue::~VariantReadAheadQueue() {
+		stop() ;
+	}
+
+	void VariantReadAheadQueue::start() {
+		assert( !m_thread.get() ) ;
+		m_end_of_data = false ;
+		m_stop = false ;
+		m_wanted = 0 ;
+		m_thread.reset( new boost::thread( boost::bind( &VariantReadAheadQueue::read_loop, this ))) ;
+	}
+
+	void VariantReadAheadQueue::stop() {
+		if( m_thread.get() ) {
+			{
+				ScopedLock lock( m_mutex ) ;
+				m_stop = true ;
+				m_space_available.notify_all() ;
+			}
+			m_thread->join() ;
+			m_thread.reset() ;
+		}
+		m_queue.clear() ;
+		m_error = boost::exception_ptr() ;
+	}
+
+	VariantReadAheadQueue::Entry const* VariantReadAheadQueue::peek( std::size_t i ) {
+		ScopedLock lock( m_mutex ) ;
+		if( i >= m_number_of_variants ) {
+			// Allow the queue to grow beyond its usual size while looking this far ahead.
+			m_wanted = std::max( m_wanted, i + 1 ) ;
+			m_space_available.notify_all() ;
+		}
+		while( m_queue.size() <= i && !m_end_of_data ) {
+			m_entry_available.wait( lock ) ;
+		}
+		if( m_queue.size() > i ) {
+			return &m_queue[i] ;
+		}
+		if( m_error && i == m_queue.size() ) {
+			boost::exception_ptr error = m_error ;
+			m_error = boost::exception_ptr() ;
+			boost::rethrow_exception( error ) ;
+		}
+		return 0 ;
+	}
+
+	void VariantReadAheadQueue::erase( std::size_t i ) {
+		take( i ) ;
+	}
+
+	VariantReadAheadQueue::Entry::UniquePtr VariantReadAheadQueue::take( std::size_t i ) {
+		ScopedLock lock( m_mutex ) ;
+		assert( i < m_queue.size() ) ;
+		Entry::UniquePtr result( m_queue.release( m_queue.begin() + i ).release() ) ;
+		m_wanted = 0 ;
+		m_space_available.notify_all() ;
+		return result ;
+	}
+
+	void VariantReadAheadQueue::read_loop() {
+		try {
+			while( true ) {
+				{
+					ScopedLock lock( m_mutex ) ;
+					while( !m_stop && m_queue.size() >= std::max( m_number_of_variants, m_wanted ) ) {
+						m_space_available.wait( lock ) ;
+					}
+					if( m_stop ) {
+						return ;
+					}
+				}
+				// Only this thread uses the source, so it is read without the lock.
+				std::auto_ptr< Entry > entry( new Entry ) ;
+				VariantDataReader::UniquePtr reader ;
+				if( m_source.get_snp_identifying_data( &entry->variant )) {
+					reader = m_source.read_variant_data() ;
+				}
+				if( !m_source || !reader.get() ) {
+					ScopedLock lock( m_mutex ) ;
+					m_end_of_data = true ;
+					m_entry_available.notify_all() ;
+					return ;
+				}
+				entry->key = m_hasher ? m_hasher( entry->variant ) : 0 ;
+				entry->data.reset(
+					CachedVariantDataReader::create( *reader, m_specs, m_cache_supported_specs ).release()
+				) ;
+				{
+					ScopedLock lock( m_mutex ) ;
+					m_queue.push_back( entry.release() ) ;
+					m_entry_available.notify_all() ;
+				}
+			}
+		}
+		catch( ... ) {
+			ScopedLock lock( m_mutex ) ;
+			m_error = boost::current_exception() ;
+			m_end_of_data = true ;
+			m_entry_available.notify_all() ;
+		}
+	}
+}
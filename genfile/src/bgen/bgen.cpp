@@ -10,6 +10,7 @@
 #include <climits>
 #include <algorithm>
 #include <iomanip>
+#include <cstring>
 #include "genfile/types.hpp"
 #include "genfile/bgen/bgen.hpp"
 
@@ -316,25 +317,32 @@ namespace genfile {
 			}
 		}
 
-		void ignore_genotype_data_block(
+		uint32_t read_genotype_data_block_size(
 			std::istream& aStream,
 			Context const& context
 		) {
-			if( (context.flags & bgen::e_CompressedSNPBlocks) != e_NoCompression ) {
-				uint32_t compressed_data_size = 0 ;
-				read_little_endian_integer( aStream, &compressed_data_size ) ;
-				if( compressed_data_size > 0 ) {
-					// gcc std::istream::ignore() has a bug / feature in which
-					// it peeks at the next char and sets eof() if you ignore all the bytes in the file.
-					// This breaks our expected invariant and means subsequent calls to peekg() fail with -1,
-					// which stops us getting file size.
-					// We deal with this by simply ignoring one less character here.
-					aStream.ignore( compressed_data_size - 1 ) ;
-					aStream.get() ;
-				}
+			uint32_t payload_size = 0 ;
+			if( (context.flags & e_Layout) == e_Layout2 || ((context.flags & e_CompressedSNPBlocks) != e_NoCompression ) ) {
+				read_little_endian_integer( aStream, &payload_size ) ;
+			} else {
+				payload_size = 6 * context.number_of_samples ;
 			}
-			else {
-				aStream.ignore( 6 * context.number_of_samples ) ;
+			return payload_size ;
+		}
+
+		void ignore_genotype_data_block(
+			std::istream& aStream,
+			Context const& context
+		) {
+			uint32_t const payload_size = read_genotype_data_block_size( aStream, context ) ;
+			if( payload_size > 0 ) {
+				// gcc std::istream::ignore() has a bug / feature in which
+				// it peeks at the next char and sets eof() if you ignore all the bytes in the file.
+				// This breaks our expected invariant and means subsequent calls to peekg() fail with -1,
+				// which stops us getting file size.
+				// We deal with this by simply ignoring one less character here.
+				aStream.ignore( payload_size - 1 ) ;
+				aStream.get() ;
 			}
 		}
 
@@ -343,12 +351,7 @@ namespace genfile {
 			Context const& context,
 			std::vector< byte_t >* buffer
 		) {
-			uint32_t payload_size = 0 ;
-			if( (context.flags & e_Layout) == e_Layout2 || ((context.flags & e_CompressedSNPBlocks) != e_NoCompression ) ) {
-				read_little_endian_integer( aStream, &payload_size ) ;
-			} else {
-				payload_size = 6 * context.number_of_samples ;
-			}
+			uint32_t const payload_size = read_genotype_data_block_size( aStream, context ) ;
 			buffer->resize( payload_size ) ;
 			aStream.read( reinterpret_cast< char* >( &(*buffer)[0] ), payload_size ) ;
 		}
@@ -358,11 +361,18 @@ namespace genfile {
 			std::vector< byte_t > const& compressed_data,
 			std::vector< byte_t >* buffer
 		) {
-			// compressed_data contains the (compressed or uncompressed) probability data.
+			uncompress_probability_data( context, &compressed_data[0], &compressed_data[0] + compressed_data.size(), buffer ) ;
+		}
+
+		void uncompress_probability_data(
+			Context const& context,
+			byte_t const* begin,
+			byte_t const* const end,
+			std::vector< byte_t >* buffer
+		) {
+			// [begin, end) contains the (compressed or uncompressed) probability data.
 			uint32_t const compressionType = (context.flags & bgen::e_CompressedSNPBlocks) ;
 			if( compressionType != e_NoCompression ) {
-				byte_t const* begin = &compressed_data[0] ;
-				byte_t const* const end = &compressed_data[0] + compressed_data.size() ;
 				uint32_t uncompressed_data_size = 0 ;
 				if( (context.flags & e_Layout) == e_Layout1 ) {
 					uncompressed_data_size = 6 * context.number_of_samples ;
@@ -379,7 +389,7 @@ namespace genfile {
 			}
 			else {
 				// copy the data between buffers.
-				buffer->assign( compressed_data.begin(), compressed_data.end() ) ;
+				buffer->assign( begin, end ) ;
 			}
 		}
 
@@ -423,6 +433,172 @@ namespace genfile {
 					} ;
 				}
 
+				namespace {
+					// Load 8 bytes stored in little-endian order.
+					inline uint64_t load_uint64( byte_t const* buffer ) {
+						uint64_t result ;
+#if BGEN_LITTLE_ENDIAN
+						std::memcpy( &result, buffer, 8 ) ;
+#else
+						result = 0 ;
+						for( int i = 7; i >= 0; --i ) {
+							result = ( result << 8 ) | uint64_t( buffer[i] ) ;
+						}
+#endif
+						return result ;
+					}
+
+					// Read bits at the given bit offset, without reading past end.
+					inline uint64_t load_bits( byte_t const* buffer, byte_t const* const end, std::size_t const offset, int const bits ) {
+						byte_t const* p = buffer + offset / 8 ;
+						int const shift = offset % 8 ;
+						byte_t const* const last = std::min( end, p + ( shift + bits + 7 ) / 8 ) ;
+						uint64_t result = 0 ;
+						for( int i = 0; p < last; ++p, i += 8 ) {
+							result |= uint64_t( *p ) << i ;
+						}
+						return result >> shift ;
+					}
+
+					// Unpacking kernel for a fixed bit depth.
+					// Eight consecutive values occupy exactly `bits` bytes, so we work in groups
+					// of eight, for which each value's byte offset and shift are constants.
+					template< int bits >
+					byte_t const* unpack_bits( byte_t const* buffer, byte_t const* const end, std::size_t const n, double* result ) {
+						uint64_t const bitMask = uint64_t( 0xFFFFFFFFFFFFFFFF ) >> ( 64 - bits ) ;
+						double const denominator = double( bitMask ) ;
+						std::size_t i = 0 ;
+						// Each load reads 8 bytes starting at most (7 * bits)/8 bytes into the group,
+						// so we need bits + 8 readable bytes per group.
+						for( ; ( i + 8 ) <= n && ( buffer + bits + 8 ) <= end; i += 8, buffer += bits, result += 8 ) {
+							for( int j = 0; j < 8; ++j ) {
+								uint64_t const data = load_uint64( buffer + ( j * bits ) / 8 ) ;
+								result[j] = double( ( data >> (( j * bits ) % 8 )) & bitMask ) / denominator ;
+							}
+						}
+						// Handle remaining values near the end of the buffer.
+						std::size_t offset = 0 ;
+						for( ; i < n; ++i, offset += bits, ++result ) {
+							*result = double( load_bits( buffer, end, offset, bits ) & bitMask ) / denominator ;
+						}
+						return buffer + offset / 8 ;
+					}
+
+					typedef byte_t const* (*Unpacker)( byte_t const*, byte_t const* const, std::size_t const, double* ) ;
+					Unpacker const unpackers[33] = {
+						0,
+						&unpack_bits<1>, &unpack_bits<2>, &unpack_bits<3>, &unpack_bits<4>,
+						&unpack_bits<5>, &unpack_bits<6>, &unpack_bits<7>, &unpack_bits<8>,
+						&unpack_bits<9>, &unpack_bits<10>, &unpack_bits<11>, &unpack_bits<12>,
+						&unpack_bits<13>, &unpack_bits<14>, &unpack_bits<15>, &unpack_bits<16>,
+						&unpack_bits<17>, &unpack_bits<18>, &unpack_bits<19>, &unpack_bits<20>,
+						&unpack_bits<21>, &unpack_bits<22>, &unpack_bits<23>, &unpack_bits<24>,
+						&unpack_bits<25>, &unpack_bits<26>, &unpack_bits<27>, &unpack_bits<28>,
+						&unpack_bits<29>, &unpack_bits<30>, &unpack_bits<31>, &unpack_bits<32>
+					} ;
+				}
+
+				byte_t const* unpack_probabilities(
+					byte_t const* buffer,
+					byte_t const* const end,
+					int const bits,
+					std::size_t const n,
+					double* result
+				) {
+					if( bits < 1 || bits > 32 || std::size_t( end - buffer ) < ( n * bits + 7 ) / 8 ) {
+						throw BGenError() ;
+					}
+					return unpackers[ bits ]( buffer, end, n, result ) ;
+				}
+
+				namespace {
+					// Unpack n values starting at the given value index, which need not be byte-aligned.
+					// Leading values are read individually until a byte boundary is reached
+					// (which happens within eight values) and the rest are unpacked in bulk.
+					void unpack_probabilities_from(
+						byte_t const* buffer,
+						byte_t const* const end,
+						int const bits,
+						std::size_t const first,
+						std::size_t n,
+						double* result
+					) {
+						uint64_t const bitMask = uint64_t( 0xFFFFFFFFFFFFFFFF ) >> ( 64 - bits ) ;
+						double const denominator = double( bitMask ) ;
+						std::size_t offset = first * bits ;
+						for( ; ( offset % 8 ) != 0 && n > 0; offset += bits, --n, ++result ) {
+							*result = double( load_bits( buffer, end, offset, bits ) & bitMask ) / denominator ;
+						}
+						if( n > 0 ) {
+							unpack_probabilities( buffer + offset / 8, end, bits, n, result ) ;
+						}
+					}
+				}
+
+				void unpack_sample_subset(
+					GenotypeDataBlock const& pack,
+					std::vector< std::size_t > const& samples,
+					std::vector< byte_t >* ploidy,
+					std::vector< double >* values
+				) {
+					assert( ploidy != 0 && values != 0 ) ;
+					if( pack.bits < 1 || pack.bits > 32 || pack.numberOfAlleles == 0 || pack.ploidyExtent[0] > pack.ploidyExtent[1] ) {
+						throw BGenError() ;
+					}
+					// Number of stored values for each ploidy in the range given by the block.
+					std::vector< std::size_t > value_counts( pack.ploidyExtent[1] + 1, 0 ) ;
+					for( uint32_t p = pack.ploidyExtent[0]; p <= pack.ploidyExtent[1]; ++p ) {
+						value_counts[p] = pack.phased
+							? ( p * ( pack.numberOfAlleles - 1 ))
+							: ( bgen::impl::n_choose_k( uint32_t( p + pack.numberOfAlleles - 1 ), uint32_t( pack.numberOfAlleles - 1 )) - 1 ) ;
+					}
+					bool const constant_ploidy = ( pack.ploidyExtent[0] == pack.ploidyExtent[1] ) ;
+					std::size_t const available_values = ( std::size_t( pack.end - pack.buffer ) * 8 ) / pack.bits ;
+
+					ploidy->resize( samples.size() ) ;
+					values->clear() ;
+					// Index of the first value of sample next_sample.
+					std::size_t next_sample = 0 ;
+					std::size_t value_index = 0 ;
+					for( std::size_t i = 0; i < samples.size(); ) {
+						// Find the run of consecutive samples [run_begin, run_end) starting here.
+						std::size_t const run_begin = samples[i] ;
+						std::size_t run_end = run_begin + 1 ;
+						std::size_t const first_i = i ;
+						for( ++i; i < samples.size() && samples[i] == run_end; ++i, ++run_end ) {}
+						assert( run_begin >= next_sample ) ;
+						if( run_end > pack.numberOfSamples ) {
+							throw BGenError() ;
+						}
+						std::copy( pack.ploidy + run_begin, pack.ploidy + run_end, ploidy->begin() + first_i ) ;
+
+						// Skip the values of samples before the run, and count those in it.
+						std::size_t run_count = 0 ;
+						if( constant_ploidy ) {
+							value_index = run_begin * value_counts[ pack.ploidyExtent[0] ] ;
+							run_count = ( run_end - run_begin ) * value_counts[ pack.ploidyExtent[0] ] ;
+						} else {
+							for( ; next_sample < run_end; ++next_sample ) {
+								uint32_t const p = uint32_t( pack.ploidy[ next_sample ] & 0x3F ) ;
+								if( p < pack.ploidyExtent[0] || p > pack.ploidyExtent[1] ) {
+									throw BGenError() ;
+								}
+								( next_sample < run_begin ? value_index : run_count ) += value_counts[p] ;
+							}
+						}
+						if( value_index + run_count > available_values ) {
+							throw BGenError() ;
+						}
+						std::size_t const size = values->size() ;
+						values->resize( size + run_count ) ;
+						if( run_count > 0 ) {
+							unpack_probabilities_from( pack.buffer, pack.end, pack.bits, value_index, run_count, &(*values)[0] + size ) ;
+						}
+						value_index += run_count ;
+						next_sample = run_end ;
+					}
+				}
+
 				void compute_approximate_probabilities( double* p, std::size_t* index, std::size_t const n, int const number_of_bits ) {
 					double const scale = ( 0xFFFFFFFFFFFFFFFF >> ( 64 - number_of_bits ) ) ;
 					double total_fractional_part = 0.0 ;
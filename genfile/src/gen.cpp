@@ -32,6 +32,31 @@ namespace genfile {
 			) {
 				aStream >> *chromosome >> *SNPID >> *RSID >> *SNP_position >> *first_allele >> *second_allele ;
 			}
+
+			string_utils::slice read_snp_identifying_data(
+				string_utils::slice const& line,
+				std::size_t const number_of_fields,
+				std::vector< string_utils::slice >* fields
+			) {
+				char const* p = line.begin() ;
+				char const* const end = line.end() ;
+				fields->clear() ;
+				for( std::size_t i = 0; i < number_of_fields; ++i ) {
+					for( ; p != end && ( *p == ' ' || *p == '\t' ); ++p ) ;
+					char const* q = p ;
+					for( ; q != end && *q != ' ' && *q != '\t'; ++q ) ;
+					if( q == p ) {
+						throw InputError( "(unknown)", "Expected identifying data" ) ;
+					}
+					fields->push_back( string_utils::slice( p, q )) ;
+					p = q ;
+				}
+				// Skip the single separator before the probabilities.
+				if( p != end ) {
+					++p ;
+				}
+				return string_utils::slice( p, end ) ;
+			}
 		}
 
 		uint32_t count_snp_blocks(
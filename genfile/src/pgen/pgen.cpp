@@ -0,0 +1,419 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include "genfile/pgen/pgen.hpp"
+#include "genfile/Error.hpp"
+#include "genfile/string_utils/string_utils.hpp"
+
+namespace genfile {
+	namespace pgen {
+		namespace {
+			// Variants are indexed in blocks of this many.
+			std::size_t const e_BlockSize = 65536 ;
+			// Difference lists are stored in groups of this many entries.
+			std::size_t const e_DifferenceListGroupSize = 64 ;
+
+			uint64_t read_little_endian( byte_t const* buffer, std::size_t const number_of_bytes ) {
+				uint64_t result = 0 ;
+				for( std::size_t i = number_of_bytes; i > 0; --i ) {
+					result = ( result << 8 ) | buffer[ i - 1 ] ;
+				}
+				return result ;
+			}
+
+			void read_bytes( std::istream& stream, std::string const& source, std::size_t const n, std::vector< byte_t >* buffer ) {
+				buffer->resize( n ) ;
+				if( n > 0 ) {
+					stream.read( reinterpret_cast< char* >( &(*buffer)[0] ), n ) ;
+				}
+				if( !stream ) {
+					throw MalformedInputError( source, "The .pgen header is truncated", 0 ) ;
+				}
+			}
+
+			void check_available( byte_t const* buffer, byte_t const* const end, std::size_t const n ) {
+				if( std::size_t( end - buffer ) < n ) {
+					throw PgenError() ;
+				}
+			}
+
+			// Read a variable-length integer (7 bits per byte, least significant first).
+			byte_t const* read_varint( byte_t const* buffer, byte_t const* const end, uint32_t* result ) {
+				uint32_t value = 0 ;
+				for( std::size_t shift = 0; shift < 32; shift += 7 ) {
+					check_available( buffer, end, 1 ) ;
+					byte_t const byte = *buffer++ ;
+					value |= uint32_t( byte & 0x7F ) << shift ;
+					if( byte < 0x80 ) {
+						*result = value ;
+						return buffer ;
+					}
+				}
+				throw PgenError() ;
+			}
+
+			std::size_t bytes_to_represent( uint32_t const value ) {
+				std::size_t result = 1 ;
+				for( uint32_t v = value >> 8; v > 0; v >>= 8 ) {
+					++result ;
+				}
+				return result ;
+			}
+
+			inline byte_t get_two_bits( byte_t const* buffer, std::size_t const i ) {
+				return ( buffer[ i / 4 ] >> ( 2 * ( i % 4 ))) & 0x3 ;
+			}
+
+			inline bool get_bit( byte_t const* buffer, std::size_t const i ) {
+				return ( buffer[ i / 8 ] >> ( i % 8 )) & 0x1 ;
+			}
+
+			// Parse a list of (sample, hardcall) differences, or just a list of samples if
+			// hardcalls is null.  The list has a length, the first sample of each group of 64
+			// entries, the byte sizes of all but the last group, the hardcalls (2 bits each),
+			// and then the remaining samples of each group as increments on the previous sample.
+			byte_t const* parse_difference_list(
+				byte_t const* buffer,
+				byte_t const* const end,
+				uint32_t const number_of_samples,
+				std::vector< uint32_t >* samples,
+				std::vector< byte_t >* hardcalls
+			) {
+				uint32_t length = 0 ;
+				buffer = read_varint( buffer, end, &length ) ;
+				samples->resize( length ) ;
+				if( hardcalls ) {
+					hardcalls->resize( length ) ;
+				}
+				if( length == 0 ) {
+					return buffer ;
+				}
+				std::size_t const number_of_groups = ( length + e_DifferenceListGroupSize - 1 ) / e_DifferenceListGroupSize ;
+				std::size_t const sample_id_size = bytes_to_represent( number_of_samples ) ;
+				byte_t const* const group_starts = buffer ;
+				// The group sizes are only needed to skip groups, so are not read.
+				buffer += number_of_groups * ( sample_id_size + 1 ) - 1 ;
+				check_available( group_starts, end, buffer - group_starts ) ;
+				if( hardcalls ) {
+					check_available( buffer, end, ( length + 3 ) / 4 ) ;
+					for( std::size_t i = 0; i < length; ++i ) {
+						(*hardcalls)[i] = get_two_bits( buffer, i ) ;
+					}
+					buffer += ( length + 3 ) / 4 ;
+				}
+				for( std::size_t i = 0; i < length; ++i ) {
+					uint32_t sample ;
+					if( i % e_DifferenceListGroupSize == 0 ) {
+						sample = uint32_t( read_little_endian( group_starts + ( i / e_DifferenceListGroupSize ) * sample_id_size, sample_id_size )) ;
+					} else {
+						uint32_t increment = 0 ;
+						buffer = read_varint( buffer, end, &increment ) ;
+						sample = (*samples)[ i - 1 ] + increment ;
+					}
+					if( sample >= number_of_samples ) {
+						throw PgenError() ;
+					}
+					(*samples)[i] = sample ;
+				}
+				return buffer ;
+			}
+
+			byte_t const* apply_difference_list(
+				byte_t const* buffer,
+				byte_t const* const end,
+				uint32_t const number_of_samples,
+				std::vector< byte_t >* result
+			) {
+				std::vector< uint32_t > samples ;
+				std::vector< byte_t > hardcalls ;
+				buffer = parse_difference_list( buffer, end, number_of_samples, &samples, &hardcalls ) ;
+				for( std::size_t i = 0; i < samples.size(); ++i ) {
+					(*result)[ samples[i] ] = hardcalls[i] ;
+				}
+				return buffer ;
+			}
+
+			byte_t const* parse_hardcalls(
+				byte_t const* buffer,
+				byte_t const* const end,
+				uint32_t const number_of_samples,
+				byte_t const type,
+				std::vector< byte_t > const& ld_base,
+				std::vector< byte_t >* result
+			) {
+				result->resize( number_of_samples ) ;
+				switch( type & e_MainTrackMask ) {
+					case e_TwoBitHardcalls: {
+						check_available( buffer, end, ( number_of_samples + 3 ) / 4 ) ;
+						for( std::size_t i = 0; i < number_of_samples; ++i ) {
+							(*result)[i] = get_two_bits( buffer, i ) ;
+						}
+						buffer += ( number_of_samples + 3 ) / 4 ;
+						break ;
+					}
+					case e_OneBitHardcalls: {
+						// The first byte encodes the two most common hardcalls as 4*first + (second-first).
+						check_available( buffer, end, 1 + ( number_of_samples + 7 ) / 8 ) ;
+						byte_t const first = buffer[0] / 4 ;
+						byte_t const second = first + ( buffer[0] & 0x3 ) ;
+						if( second > e_MissingHardcall || second == first ) {
+							throw PgenError() ;
+						}
+						++buffer ;
+						for( std::size_t i = 0; i < number_of_samples; ++i ) {
+							(*result)[i] = get_bit( buffer, i ) ? second : first ;
+						}
+						buffer += ( number_of_samples + 7 ) / 8 ;
+						buffer = apply_difference_list( buffer, end, number_of_samples, result ) ;
+						break ;
+					}
+					case e_LDCompressed:
+					case e_LDCompressedInverted: {
+						assert( ld_base.size() == number_of_samples ) ;
+						std::copy( ld_base.begin(), ld_base.end(), result->begin() ) ;
+						buffer = apply_difference_list( buffer, end, number_of_samples, result ) ;
+						if( ( type & e_MainTrackMask ) == e_LDCompressedInverted ) {
+							for( std::size_t i = 0; i < number_of_samples; ++i ) {
+								byte_t& value = (*result)[i] ;
+								value = ( value == e_MissingHardcall ) ? value : ( e_HomAlt - value ) ;
+							}
+						}
+						break ;
+					}
+					case e_AllHomRef:
+						std::fill( result->begin(), result->end(), byte_t( e_HomRef )) ;
+						break ;
+					default: {
+						// e_HomRefWithDifferences, e_HomAltWithDifferences or e_MissingWithDifferences.
+						std::fill( result->begin(), result->end(), byte_t( type & 0x3 )) ;
+						buffer = apply_difference_list( buffer, end, number_of_samples, result ) ;
+						break ;
+					}
+				}
+				return buffer ;
+			}
+
+			// The phase track is a bit array: the first bit says whether the phased hets are listed explicitly;
+			// if so, one bit per het says whether it is phased.  This is followed (after rounding up to a whole
+			// byte) by one bit per phased het, set if the ALT allele is on the first haplotype.
+			byte_t const* parse_phases(
+				byte_t const* buffer,
+				byte_t const* const end,
+				std::vector< byte_t > const& hardcalls,
+				std::vector< byte_t >* result
+			) {
+				std::vector< std::size_t > hets ;
+				for( std::size_t i = 0; i < hardcalls.size(); ++i ) {
+					if( hardcalls[i] == e_Het ) {
+						hets.push_back( i ) ;
+					}
+				}
+				result->assign( hardcalls.size(), byte_t( e_Unphased )) ;
+				check_available( buffer, end, ( hets.size() + 8 ) / 8 ) ;
+				if( !get_bit( buffer, 0 ) ) {
+					for( std::size_t i = 0; i < hets.size(); ++i ) {
+						(*result)[ hets[i] ] = get_bit( buffer, i + 1 ) ? e_AltRef : e_RefAlt ;
+					}
+					buffer += ( hets.size() + 8 ) / 8 ;
+				} else {
+					byte_t const* const present = buffer ;
+					buffer += ( hets.size() + 8 ) / 8 ;
+					std::size_t phased = 0 ;
+					for( std::size_t i = 0; i < hets.size(); ++i ) {
+						phased += get_bit( present, i + 1 ) ;
+					}
+					check_available( buffer, end, ( phased + 7 ) / 8 ) ;
+					for( std::size_t i = 0, j = 0; i < hets.size(); ++i ) {
+						if( get_bit( present, i + 1 )) {
+							(*result)[ hets[i] ] = get_bit( buffer, j++ ) ? e_AltRef : e_RefAlt ;
+						}
+					}
+					buffer += ( phased + 7 ) / 8 ;
+				}
+				return buffer ;
+			}
+
+			// The dosage track lists explicit dosages, either for samples given by a list (type 1),
+			// for all samples (type 2), or for samples given by a bit array (type 3).
+			byte_t const* parse_dosages(
+				byte_t const* buffer,
+				byte_t const* const end,
+				byte_t const type,
+				std::vector< byte_t > const& hardcalls,
+				std::vector< uint16_t >* result
+			) {
+				uint32_t const number_of_samples = hardcalls.size() ;
+				result->resize( number_of_samples ) ;
+				for( std::size_t i = 0; i < number_of_samples; ++i ) {
+					(*result)[i] = ( hardcalls[i] == e_MissingHardcall ) ? e_MissingDosage : ( hardcalls[i] * e_DosageScale ) ;
+				}
+				std::vector< uint32_t > samples ;
+				switch(( type & e_DosageTrackMask ) >> 5 ) {
+					case 1:
+						buffer = parse_difference_list( buffer, end, number_of_samples, &samples, 0 ) ;
+						break ;
+					case 2:
+						samples.resize( number_of_samples ) ;
+						for( std::size_t i = 0; i < number_of_samples; ++i ) {
+							samples[i] = i ;
+						}
+						break ;
+					case 3:
+						check_available( buffer, end, ( number_of_samples + 7 ) / 8 ) ;
+						for( std::size_t i = 0; i < number_of_samples; ++i ) {
+							if( get_bit( buffer, i )) {
+								samples.push_back( i ) ;
+							}
+						}
+						buffer += ( number_of_samples + 7 ) / 8 ;
+						break ;
+					default:
+						assert(0) ;
+				}
+				check_available( buffer, end, 2 * samples.size() ) ;
+				for( std::size_t i = 0; i < samples.size(); ++i, buffer += 2 ) {
+					uint16_t const dosage = uint16_t( read_little_endian( buffer, 2 )) ;
+					if( dosage != e_MissingDosage && dosage > 2 * e_DosageScale ) {
+						throw PgenError() ;
+					}
+					(*result)[ samples[i] ] = dosage ;
+				}
+				return buffer ;
+			}
+		}
+
+		Index::Index():
+			storage_mode( e_VariableWidthMode ),
+			number_of_variants( 0 ),
+			number_of_samples( 0 )
+		{}
+
+		std::size_t Index::get_ld_base( std::size_t variant ) const {
+			assert( variant < types.size() && is_ld_compressed( types[ variant ] )) ;
+			while( variant > 0 ) {
+				if( !is_ld_compressed( types[ --variant ] )) {
+					return variant ;
+				}
+			}
+			// The first record cannot be LD-compressed.
+			throw PgenError() ;
+		}
+
+		void read_index( std::istream& stream, std::string const& source, Index* index ) {
+			assert( index ) ;
+			std::vector< byte_t > buffer ;
+			read_bytes( stream, source, 11, &buffer ) ;
+			if( buffer[0] != 0x6c || buffer[1] != 0x1b ) {
+				throw MalformedInputError( source, "File does not appear to be a .pgen file (according to magic number).", 0 ) ;
+			}
+			index->number_of_variants = uint32_t( read_little_endian( &buffer[3], 4 )) ;
+			index->number_of_samples = uint32_t( read_little_endian( &buffer[7], 4 )) ;
+			uint64_t offset = 11 ;
+			switch( buffer[2] ) {
+				case e_FixedWidthHardcallMode:
+				case e_FixedWidthDosageMode: {
+					index->storage_mode = StorageMode( buffer[2] ) ;
+					bool const dosages = ( buffer[2] == e_FixedWidthDosageMode ) ;
+					uint64_t const record_size = ( index->number_of_samples + 3 ) / 4 + ( dosages ? 2 * uint64_t( index->number_of_samples ) : 0 ) ;
+					index->types.assign( index->number_of_variants, byte_t( dosages ? 0x40 : 0x00 )) ;
+					index->offsets.resize( index->number_of_variants + 1 ) ;
+					for( std::size_t i = 0; i <= index->number_of_variants; ++i ) {
+						index->offsets[i] = offset + i * record_size ;
+					}
+					return ;
+				}
+				case e_VariableWidthMode:
+					index->storage_mode = e_VariableWidthMode ;
+					break ;
+				default:
+					throw MalformedInputError(
+						source,
+						"File has storage mode " + string_utils::to_string( int( buffer[2] ) ) + "; only modes 2, 3 and 16 are supported.",
+						0
+					) ;
+			}
+
+			read_bytes( stream, source, 1, &buffer ) ;
+			byte_t const control = buffer[0] ;
+			if( control & 0x08 ) {
+				throw MalformedInputError(
+					source,
+					"File uses a specialised record type encoding (header control byte " + string_utils::to_string( int( control ) ) + "), which is not supported.",
+					0
+				) ;
+			}
+			std::size_t const type_bits = ( control & 0x04 ) ? 8 : 4 ;
+			std::size_t const length_bytes = ( control & 0x03 ) + 1 ;
+			std::size_t const allele_count_bytes = ( control >> 4 ) & 0x03 ;
+			bool const have_nonref_flags = ( control >> 6 ) == 3 ;
+			std::size_t const number_of_blocks = ( index->number_of_variants + e_BlockSize - 1 ) / e_BlockSize ;
+
+			read_bytes( stream, source, 8 * number_of_blocks, &buffer ) ;
+			std::vector< uint64_t > block_offsets( number_of_blocks ) ;
+			for( std::size_t b = 0; b < number_of_blocks; ++b ) {
+				block_offsets[b] = read_little_endian( &buffer[ 8 * b ], 8 ) ;
+			}
+
+			index->types.resize( index->number_of_variants ) ;
+			index->offsets.resize( index->number_of_variants + 1 ) ;
+			for( std::size_t b = 0; b < number_of_blocks; ++b ) {
+				std::size_t const first = b * e_BlockSize ;
+				std::size_t const n = std::min( e_BlockSize, index->number_of_variants - first ) ;
+				read_bytes( stream, source, ( n * type_bits + 7 ) / 8, &buffer ) ;
+				for( std::size_t i = 0; i < n; ++i ) {
+					index->types[ first + i ] = ( type_bits == 8 ) ? buffer[i] : (( buffer[ i / 2 ] >> ( 4 * ( i % 2 ))) & 0x0F ) ;
+				}
+				read_bytes( stream, source, n * length_bytes, &buffer ) ;
+				offset = block_offsets[b] ;
+				for( std::size_t i = 0; i < n; ++i ) {
+					index->offsets[ first + i ] = offset ;
+					offset += read_little_endian( &buffer[ i * length_bytes ], length_bytes ) ;
+				}
+				// Allele counts and provisional reference flags are not used.
+				stream.ignore( n * allele_count_bytes + ( have_nonref_flags ? ( n + 7 ) / 8 : 0 )) ;
+			}
+			index->offsets[ index->number_of_variants ] = offset ;
+			if( !stream ) {
+				throw MalformedInputError( source, "The .pgen header is truncated", 0 ) ;
+			}
+			if( index->number_of_variants > 0 && is_ld_compressed( index->types[0] )) {
+				throw MalformedInputError( source, "The first variant record is LD-compressed", 0 ) ;
+			}
+		}
+
+		void parse_record(
+			byte_t const* buffer,
+			byte_t const* const end,
+			uint32_t const number_of_samples,
+			byte_t const type,
+			std::vector< byte_t > const& ld_base,
+			Record* result,
+			bool hardcalls_only
+		) {
+			assert( result ) ;
+			buffer = parse_hardcalls( buffer, end, number_of_samples, type, ld_base, &result->hardcalls ) ;
+			result->phases.clear() ;
+			result->dosages.clear() ;
+			if( hardcalls_only ) {
+				return ;
+			}
+			if( type & e_MultiallelicTrack ) {
+				throw PgenError() ;
+			}
+			if( type & e_PhaseTrack ) {
+				buffer = parse_phases( buffer, end, result->hardcalls, &result->phases ) ;
+			}
+			if( type & e_DosageTrackMask ) {
+				buffer = parse_dosages( buffer, end, type, result->hardcalls, &result->dosages ) ;
+			}
+			// Any dosage phase track is ignored.
+		}
+	}
+}
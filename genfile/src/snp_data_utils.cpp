@@ -180,6 +180,7 @@ namespace genfile {
 		types[ ".vcf" ]     = types[ ".vcf.gz" ] 		= "vcf" ;
 		types[ ".dosage" ]  = types[ ".dosage.gz" ] 	= "dosage" ;
 		types[ ".bed" ]  								= "binary_ped" ;
+		types[ ".pgen" ]  								= "pgen" ;
 
 		for(
 			std::map< std::string, std::string >::const_iterator i = types.begin();
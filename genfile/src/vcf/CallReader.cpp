@@ -4,6 +4,7 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
+#include <cstring>
 #include "genfile/vcf/CallReader.hpp"
 #include "genfile/vcf/Types.hpp"
 #include "genfile/string_utils.hpp"
@@ -57,16 +58,43 @@ namespace genfile {
 			m_number_of_samples( number_of_samples ),
 			m_number_of_alleles( number_of_alleles ),
 			m_format_elts( impl::parse_format( format ) ),
-			m_data( data ),
+			m_data_storage( data ),
+			m_data( m_data_storage ),
 			m_entry_types( entry_types ),
 			m_entries_by_position( impl::get_entries_by_position( m_format_elts, entry_types )),
-			m_strict_mode( true )
+			m_strict_mode( true ),
+			m_samples( 0 )
 		{
+			check_arguments() ;
+		}
+
+		CallReader::CallReader(
+			std::size_t number_of_samples,
+			std::size_t number_of_alleles,
+			std::string const& format,
+			char const* data_begin,
+			char const* data_end,
+			boost::ptr_map< std::string, VCFEntryType > const& entry_types
+		):
+			m_number_of_samples( number_of_samples ),
+			m_number_of_alleles( number_of_alleles ),
+			m_format_elts( impl::parse_format( format ) ),
+			m_data_storage(),
+			m_data( data_begin, data_end ),
+			m_entry_types( entry_types ),
+			m_entries_by_position( impl::get_entries_by_position( m_format_elts, entry_types )),
+			m_strict_mode( true ),
+			m_samples( 0 )
+		{
+			check_arguments() ;
+		}
+
+		void CallReader::check_arguments() const {
 			if( m_number_of_alleles == 0 ) {
-				throw BadArgumentError( "genfile::vcf::CallReader::CallReader()", "number_of_alleles = " + string_utils::to_string( number_of_alleles ) ) ;
+				throw BadArgumentError( "genfile::vcf::CallReader::CallReader()", "number_of_alleles = " + string_utils::to_string( m_number_of_alleles ) ) ;
 			}
 			if( m_number_of_samples == 0 ) {
-				throw BadArgumentError( "genfile::vcf::CallReader::CallReader()", "number_of_samples = " + string_utils::to_string( number_of_samples ) ) ;
+				throw BadArgumentError( "genfile::vcf::CallReader::CallReader()", "number_of_samples = " + string_utils::to_string( m_number_of_samples ) ) ;
 			}
 		}
 
@@ -80,6 +108,26 @@ namespace genfile {
 			m_strict_mode = value ;
 		}
 
+		void CallReader::set_sample_subset( std::vector< std::size_t > const& samples ) {
+			assert( m_component_counts.empty() ) ;
+			if( samples.size() > 0 && samples.back() >= m_number_of_samples ) {
+				throw BadArgumentError(
+					"genfile::vcf::CallReader::set_sample_subset()",
+					"samples",
+					"Sample index " + string_utils::to_string( samples.back() ) + " is out of range."
+				) ;
+			}
+			m_samples = &samples ;
+		}
+
+		std::size_t CallReader::number_of_reported_samples() const {
+			return m_samples ? m_samples->size() : m_number_of_samples ;
+		}
+
+		std::size_t CallReader::get_sample_index( std::size_t reported_sample_i ) const {
+			return m_samples ? (*m_samples)[ reported_sample_i ] : reported_sample_i ;
+		}
+
 		namespace impl {
 			struct CallReaderGenotypeSetter: public CallReader::Setter {
 				CallReaderGenotypeSetter(
@@ -163,10 +211,11 @@ namespace genfile {
 				throw BadArgumentError( "genfile::vcf::CallReader::operator()", "spec = \"" + spec + "\"" ) ;
 			}
 			
-			if( m_components.empty() ) {
+			std::size_t const N = number_of_reported_samples() ;
+			if( m_component_counts.size() != N ) {
 				split_data() ;
 			}
-			assert( m_component_counts.size() == m_number_of_samples ) ;
+			assert( m_component_counts.size() == N ) ;
 
 			std::vector< std::string >::const_iterator where = std::find( m_format_elts.begin(), m_format_elts.end(), spec ) ;
 
@@ -176,7 +225,7 @@ namespace genfile {
 				if(
 					( spec == "GT" || entry_type_i->second->check_if_requires_ploidy() )
 					&&
-					( m_ploidy.size() != m_number_of_samples )
+					( m_ploidy.size() != N )
 				) {
 					load_genotypes() ;
 				}
@@ -184,8 +233,8 @@ namespace genfile {
 				if( spec == "GT" ) {
 					assert( m_ploidy.size() > 0 ) ;
 					std::size_t index = 0 ;
-					setter.initialise( m_number_of_samples, m_number_of_alleles ) ;
-					for( std::size_t sample_i = 0; sample_i < m_number_of_samples; ++sample_i ) {
+					setter.initialise( N, m_number_of_alleles ) ;
+					for( std::size_t sample_i = 0; sample_i < N; ++sample_i ) {
 						std::size_t const ploidy = m_ploidy[ sample_i ] ;
 						assert( m_genotype_calls.size() >= ( index + ploidy ) ) ;
 						setter.set_sample( sample_i ) ;
@@ -205,10 +254,10 @@ namespace genfile {
 					setter.finalise() ;
 				}
 				else {
-					setter.initialise( m_number_of_samples, m_number_of_alleles ) ;
+					setter.initialise( N, m_number_of_alleles ) ;
 					for(
 						std::size_t sample_i = 0, component_index = 0;
-						sample_i < m_number_of_samples;
+						sample_i < N;
 						component_index += m_component_counts[ sample_i++ ]
 					) {
 						setter.set_sample( sample_i ) ;
@@ -229,31 +278,68 @@ namespace genfile {
 			return *this ;
 		}
 
+		// Split the data into per-sample components in a single pass.
+		// memchr() is vectorised in the C library, which makes this quicker than
+		// splitting with a character set.
+		// Samples not in the subset (if any) are skipped without being split.
 		void CallReader::split_data() {
-			std::vector< string_utils::slice > elts ;
-			elts.reserve( m_number_of_samples ) ;
-			string_utils::slice( m_data ).split( "\t", &elts ) ;
-			if( elts.size() != m_number_of_samples ) {
-				throw MalformedInputError( "(data)", 0 ) ;
-			}
-			m_components.reserve( m_number_of_samples ) ;
-			for( std::size_t sample_i = 0; sample_i < elts.size(); ++sample_i ) {
+			char const* const data_begin = m_data.begin() ;
+			char const* const data_end = m_data.end() ;
+			std::size_t const N = number_of_reported_samples() ;
+			m_components.reserve( N * m_format_elts.size() ) ;
+			m_component_counts.reserve( N ) ;
+			std::size_t next_reported_sample_i = 0 ;
+			char const* p = data_begin ;
+			for( std::size_t sample_i = 0; sample_i < m_number_of_samples; ++sample_i ) {
+				if( sample_i > 0 ) {
+					if( p == data_end ) {
+						// too few samples.
+						throw MalformedInputError( "(data)", 0 ) ;
+					}
+					++p ; // skip tab.
+				}
+				char const* sample_end = reinterpret_cast< char const* >( std::memchr( p, '\t', data_end - p )) ;
+				if( !sample_end ) {
+					sample_end = data_end ;
+				}
+				if( next_reported_sample_i == N || get_sample_index( next_reported_sample_i ) != sample_i ) {
+					p = sample_end ;
+					continue ;
+				}
+				++next_reported_sample_i ;
 				std::size_t const current_size = m_components.size() ;
-				if( elts[ sample_i ].size() > 0 ) {
-					elts[ sample_i ].split( ":", &m_components ) ;
+				// An empty entry has no components.
+				if( sample_end > p ) {
+					while( true ) {
+						char const* component_end = reinterpret_cast< char const* >( std::memchr( p, ':', sample_end - p )) ;
+						if( !component_end ) {
+							component_end = sample_end ;
+						}
+						m_components.push_back( string_utils::slice( data_begin, data_end, p - data_begin, component_end - data_begin )) ;
+						if( component_end == sample_end ) {
+							break ;
+						}
+						p = component_end + 1 ;
+					}
 				}
+				p = sample_end ;
 				m_component_counts.push_back( m_components.size() - current_size ) ;
 				if( m_component_counts.back() > m_format_elts.size() ) {
 					throw MalformedInputError( "(data)", 0, sample_i ) ;
 				}
 			}
+			if( p != data_end ) {
+				// too many samples.
+				throw MalformedInputError( "(data)", 0 ) ;
+			}
 		}
 		
 		void CallReader::load_genotypes() {
 			// Find the GT field in the format string...
 			std::size_t const GT_field_pos = std::find( m_format_elts.begin(), m_format_elts.end(), "GT" ) - m_format_elts.begin() ;
 
-			m_ploidy.resize( m_number_of_samples ) ;
+			std::size_t const N = number_of_reported_samples() ;
+			m_ploidy.resize( N ) ;
 			if( GT_field_pos == m_format_elts.size() ) {
 				// GT not present.
 				// assume ploidy=2
@@ -268,13 +354,13 @@ namespace genfile {
 				throw MalformedInputError( "(data)", 0 ) ;
 			}
 
-			m_order_types.resize( m_number_of_samples ) ;
-			m_genotype_calls.reserve( m_number_of_samples * 2 ) ;
+			m_order_types.resize( N ) ;
+			m_genotype_calls.reserve( N * 2 ) ;
 			std::size_t total_number_of_calls = 0 ;
 			impl::CallReaderGenotypeSetter genotype_setter( m_genotype_calls, m_ploidy ) ;
 			for(
 				std::size_t sample_i = 0, component_index = 0;
-				sample_i < m_number_of_samples;
+				sample_i < N;
 				component_index += m_component_counts[ sample_i++ ]
 			) {
 				try {
@@ -284,10 +370,10 @@ namespace genfile {
 					m_order_types[ sample_i ] = genotype_setter.get_order_type() ;
 				}
 				catch( string_utils::StringConversionError const& ) {
-					throw MalformedInputError( "(data)", 0, sample_i ) ;
+					throw MalformedInputError( "(data)", 0, get_sample_index( sample_i ) ) ;
 				}
 				catch( BadArgumentError const& e ) {
-					throw MalformedInputError( "(data)", 0, sample_i ) ;
+					throw MalformedInputError( "(data)", 0, get_sample_index( sample_i ) ) ;
 				}
 			}
 			assert( m_genotype_calls.size() == total_number_of_calls ) ;
@@ -312,10 +398,10 @@ namespace genfile {
 				) ;
 			}
 			catch( string_utils::StringConversionError const& ) {
-				throw MalformedInputError( "(data)", 0, sample_i ) ;	
+				throw MalformedInputError( "(data)", 0, get_sample_index( sample_i ) ) ;	
 			}
 			catch( BadArgumentError const& ) {
-				throw MalformedInputError( "(data)", 0, sample_i ) ;
+				throw MalformedInputError( "(data)", 0, get_sample_index( sample_i ) ) ;
 			}
 		}
 
@@ -335,7 +421,7 @@ namespace genfile {
 			// std::cerr << "CallReader::unsafe_set_values(): sample_i=" << sample_i << ", field_i=" << field_i << ".\n" ;
 			uint32_t ploidy = eUnknownPloidy ;
 			if( entry_type.check_if_requires_ploidy() ) {
-				assert( m_ploidy.size() == m_number_of_samples ) ;
+				assert( m_ploidy.size() == number_of_reported_samples() ) ;
 				ploidy = m_ploidy[ sample_i ] ;
 			}
 			if( elt_is_trailing || elt_is_completely_missing ) {
@@ -8,6 +8,7 @@
 #include <string>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include <boost/ptr_container/ptr_map.hpp>
 #include "genfile/MissingValue.hpp"
 #include "genfile/VariantEntry.hpp"
@@ -194,24 +195,6 @@ namespace genfile {
 		}
 		
 		namespace impl {
-			void lex(
-				 string_utils::slice const& value,
-				 std::size_t number_of_alleles,
-				 char const* separator,
-				 std::pair< std::size_t, std::size_t > const& value_count_range,
-				 std::vector< string_utils::slice >* result
-			) {
-				assert( result ) ;
-				result->clear() ;
-				// An empty value is treated as an empty list, (not a list with one empty value)
-				if( !value.empty() ) {
-					string_utils::slice( value ).split( separator, result ) ;
-				}
-				if( result->size() < value_count_range.first || result->size() > value_count_range.second ) {
-					throw BadArgumentError( "genfile::vcf::()::lex()", "value = \"" + std::string( value ) + "\"" ) ;
-				}
-			}
-
 			void parse_elts(
 				std::vector< string_utils::slice > const& elts,
 				uint32_t ploidy,
@@ -253,10 +236,29 @@ namespace genfile {
 		{
 		}
 		
+		// This is called once per sample for each list-valued field (e.g. GP or GL) so we parse
+		// the elements in place rather than splitting the value into a vector first.
 		void ListVCFEntryType::parse( string_utils::slice const& value, std::size_t number_of_alleles, uint32_t ploidy, EntriesSetter& setter ) const {
-			std::vector< string_utils::slice > result ;
-			impl::lex( value, number_of_alleles, ",", get_value_count_range( number_of_alleles, ploidy ), &result ) ;
-			impl::parse_elts( result, ploidy, get_order_type(), get_value_type(), missing_value(), setter ) ;
+			// An empty value is treated as an empty list, (not a list with one empty value)
+			std::size_t const count = value.empty() ? 0 : ( std::count( value.begin(), value.end(), ',' ) + 1 ) ;
+			std::pair< std::size_t, std::size_t > const value_count_range = get_value_count_range( number_of_alleles, ploidy ) ;
+			if( count < value_count_range.first || count > value_count_range.second ) {
+				throw BadArgumentError( "genfile::vcf::ListVCFEntryType::parse()", "value = \"" + std::string( value ) + "\"" ) ;
+			}
+			SimpleType const& value_type = get_value_type() ;
+			setter.set_number_of_entries( ploidy, count, get_order_type(), value_type.represented_type() ) ;
+			char const* p = value.begin() ;
+			for( std::size_t i = 0; i < count; ++i ) {
+				char const* const elt_end = std::find( p, value.end(), ',' ) ;
+				string_utils::slice const elt( p, elt_end ) ;
+				if( elt == missing_value() ) {
+					setter.set_value( i, MissingValue() ) ;
+				}
+				else {
+					value_type.parse( i, elt, setter ) ;
+				}
+				p = elt_end + (( elt_end == value.end() ) ? 0 : 1 ) ;
+			}
 		}
 
 		void ListVCFEntryType::get_missing_value( std::size_t number_of_alleles, uint32_t ploidy, EntriesSetter& setter ) const {
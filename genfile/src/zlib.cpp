@@ -38,19 +38,41 @@ namespace genfile {
 		std::vector< uint8_t >* dest,
 		std::size_t const offset,
 		int const compressionLevel
+	) {
+		zstd_compress( 0, buffer, end, dest, offset, compressionLevel ) ;
+	}
+
+	void zstd_compress(
+		ZSTD_CCtx* context,
+		uint8_t const* buffer,
+		uint8_t const* const end,
+		std::vector< uint8_t >* dest,
+		std::size_t const offset,
+		int const compressionLevel
 	) {
 		assert( dest != 0 ) ;
 		assert( compressionLevel >= 1 && compressionLevel <= 22 ) ;
 		std::size_t const source_size = ( end - buffer ) ;
 		std::size_t compressed_size = ZSTD_compressBound( source_size ) ;
 		dest->resize( compressed_size + offset ) ;
-		compressed_size = ZSTD_compress(
-			reinterpret_cast< void* >( &( dest->operator[](0) ) + offset ),
-			compressed_size,
-			reinterpret_cast< void const* >( buffer ),
-			source_size,
-			compressionLevel
-		) ;
+		if( context ) {
+			compressed_size = ZSTD_compressCCtx(
+				context,
+				reinterpret_cast< void* >( &( dest->operator[](0) ) + offset ),
+				compressed_size,
+				reinterpret_cast< void const* >( buffer ),
+				source_size,
+				compressionLevel
+			) ;
+		} else {
+			compressed_size = ZSTD_compress(
+				reinterpret_cast< void* >( &( dest->operator[](0) ) + offset ),
+				compressed_size,
+				reinterpret_cast< void const* >( buffer ),
+				source_size,
+				compressionLevel
+			) ;
+		}
 		assert( !ZSTD_isError( compressed_size )) ;
 		dest->resize( compressed_size + offset ) ;
 	}
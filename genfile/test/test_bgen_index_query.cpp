@@ -0,0 +1,133 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <boost/bind.hpp>
+#include "test_case.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/GenFileSNPDataSource.hpp"
+#include "genfile/BGenFileSNPDataSink.hpp"
+#include "genfile/BGenFileSNPDataSource.hpp"
+#include "genfile/bgen/IndexQuery.hpp"
+#include "genfile/FileUtils.hpp"
+
+AUTO_TEST_SUITE( test_bgen_index_query )
+
+namespace data {
+	namespace {
+		std::string data =
+			"SNP1 rs1 1000 A G 1 0 0 0 1 0 0 0 1\n"
+			"SNP2 rs2 2000 A C 0 1 0 0 0 1 0 0 0\n"
+			"SNP3 rs3 3000 C T 0.2 0.3 0.5 1 0 0 0 0 1\n"
+			"SNP4 rs4 4000 G T 0 0 1 0.1 0.8 0.1 0 1 0\n"
+			"SNP5 rs5 5000 A T 0.25 0.5 0.25 0 0 0 1 0 0\n" ;
+	}
+}
+
+namespace {
+	typedef genfile::bgen::IndexQuery::FileRange FileRange ;
+
+	// An IndexQuery that returns a fixed list of locations.
+	struct VectorIndexQuery: public genfile::bgen::IndexQuery {
+		VectorIndexQuery( std::vector< FileRange > const& positions ): m_positions( positions ) {}
+		std::size_t number_of_variants() const { return m_positions.size() ; }
+		FileRange locate_variant( std::size_t index ) const { return m_positions.at( index ) ; }
+	private:
+		std::vector< FileRange > const m_positions ;
+	} ;
+
+	struct Location {
+		genfile::VariantIdentifyingData variant ;
+		FileRange range ;
+	} ;
+
+	void record_location( std::vector< Location >* result, genfile::VariantIdentifyingData const& variant, int64_t offset, int64_t size ) {
+		Location location ;
+		location.variant = variant ;
+		location.range = FileRange( offset, size ) ;
+		result->push_back( location ) ;
+	}
+
+	genfile::VariantEntry get_sample_name( std::size_t i ) {
+		return "sample_" + genfile::string_utils::to_string( i ) ;
+	}
+
+	std::vector< Location > write_bgen_file( std::string const& filename, std::string const& version ) {
+		std::vector< Location > result ;
+		genfile::GenFileSNPDataSource source(
+			std::auto_ptr< std::istream >( new std::istringstream( data::data ) ),
+			genfile::Chromosome( "01" )
+		) ;
+		genfile::BGenFileSNPDataSink sink( filename, genfile::SNPDataSink::Metadata(), version ) ;
+		sink.send_variant_locations_to( boost::bind( &record_location, &result, _1, _2, _3 )) ;
+		sink.set_sample_names( source.number_of_samples(), &get_sample_name ) ;
+		genfile::VariantIdentifyingData snp ;
+		while( source.get_snp_identifying_data( &snp )) {
+			genfile::VariantDataReader::UniquePtr reader = source.read_variant_data() ;
+			sink.write_variant_data( snp, *reader ) ;
+		}
+		return result ;
+	}
+
+	std::vector< genfile::VariantIdentifyingData > read_variants( genfile::SNPDataSource& source ) {
+		std::vector< genfile::VariantIdentifyingData > result ;
+		genfile::VariantIdentifyingData snp ;
+		while( source.get_snp_identifying_data( &snp )) {
+			// Read the data as well, to check the source is positioned correctly afterwards.
+			source.read_variant_data() ;
+			result.push_back( snp ) ;
+		}
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_bgen_index_query ) {
+	std::cerr << "test_bgen_index_query()..." ;
+	std::vector< std::string > versions ;
+	versions.push_back( "v11" ) ;
+	versions.push_back( "v12" ) ;
+	for( std::size_t version_i = 0; version_i < versions.size(); ++version_i ) {
+		std::string const filename = genfile::create_temporary_filename() + ".bgen" ;
+		std::vector< Location > const locations = write_bgen_file( filename, versions[ version_i ] ) ;
+		std::vector< genfile::VariantIdentifyingData > all_variants ;
+		{
+			genfile::BGenFileSNPDataSource source( filename ) ;
+			all_variants = read_variants( source ) ;
+		}
+		BOOST_CHECK_EQUAL( locations.size(), 5 ) ;
+		BOOST_CHECK_EQUAL( all_variants.size(), 5 ) ;
+		for( std::size_t i = 1; i < locations.size(); ++i ) {
+			// Variants are written contiguously.
+			BOOST_CHECK_EQUAL( locations[i].range.first, locations[i-1].range.first + locations[i-1].range.second ) ;
+		}
+
+		// Each subset of the variants should be read back, in order, when given as a query.
+		for( std::size_t mask = 0; mask < ( 1u << locations.size() ); ++mask ) {
+			std::vector< FileRange > positions ;
+			std::vector< genfile::VariantIdentifyingData > expected ;
+			for( std::size_t i = 0; i < locations.size(); ++i ) {
+				if( mask & ( 1u << i )) {
+					positions.push_back( locations[i].range ) ;
+					expected.push_back( all_variants[i] ) ;
+				}
+			}
+			genfile::BGenFileSNPDataSource source( filename ) ;
+			source.set_index_query( genfile::bgen::IndexQuery::UniquePtr( new VectorIndexQuery( positions ))) ;
+			BOOST_CHECK_EQUAL( *source.total_number_of_snps(), expected.size() ) ;
+			BOOST_CHECK( read_variants( source ) == expected ) ;
+			// Resetting should start the query again.
+			source.reset_to_start() ;
+			BOOST_CHECK( read_variants( source ) == expected ) ;
+		}
+		std::remove( filename.c_str() ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
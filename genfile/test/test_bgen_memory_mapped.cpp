@@ -0,0 +1,166 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <boost/bind.hpp>
+#include "test_case.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/GenFileSNPDataSource.hpp"
+#include "genfile/BGenFileSNPDataSink.hpp"
+#include "genfile/BGenFileSNPDataSource.hpp"
+#include "genfile/bgen/IndexQuery.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
+#include "genfile/FileUtils.hpp"
+
+AUTO_TEST_SUITE( test_bgen_memory_mapped )
+
+namespace data {
+	namespace {
+		std::string data =
+			"SNP1 rs1 1000 A G 1 0 0 0 1 0 0 0 1\n"
+			"SNP2 rs2 2000 A C 0 1 0 0 0 1 0 0 0\n"
+			"SNP3 rs3 3000 C T 0.2 0.3 0.5 1 0 0 0 0 1\n"
+			"SNP4 rs4 4000 G T 0 0 1 0.1 0.8 0.1 0 1 0\n"
+			"SNP5 rs5 5000 A T 0.25 0.5 0.25 0 0 0 1 0 0\n"
+			"SNP6 rs6 6000 A G 0 0 0 0 0 1 1 0 0\n" ;
+	}
+}
+
+namespace {
+	typedef genfile::bgen::IndexQuery::FileRange FileRange ;
+
+	// An IndexQuery that returns a fixed list of locations.
+	struct VectorIndexQuery: public genfile::bgen::IndexQuery {
+		VectorIndexQuery( std::vector< FileRange > const& positions ): m_positions( positions ) {}
+		std::size_t number_of_variants() const { return m_positions.size() ; }
+		FileRange locate_variant( std::size_t index ) const { return m_positions.at( index ) ; }
+	private:
+		std::vector< FileRange > const m_positions ;
+	} ;
+
+	struct Variant {
+		genfile::VariantIdentifyingData snp ;
+		Eigen::MatrixXd probabilities ;
+		bool operator==( Variant const& other ) const {
+			return snp == other.snp && probabilities == other.probabilities ;
+		}
+	} ;
+
+	void record_location( std::vector< FileRange >* result, genfile::VariantIdentifyingData const&, int64_t offset, int64_t size ) {
+		result->push_back( FileRange( offset, size )) ;
+	}
+
+	genfile::VariantEntry get_sample_name( std::size_t i ) {
+		return "sample_" + genfile::string_utils::to_string( i ) ;
+	}
+
+	std::vector< FileRange > write_bgen_file( std::string const& filename, std::string const& version, std::string const& compression ) {
+		std::vector< FileRange > result ;
+		genfile::GenFileSNPDataSource source(
+			std::auto_ptr< std::istream >( new std::istringstream( data::data ) ),
+			genfile::Chromosome( "01" )
+		) ;
+		genfile::BGenFileSNPDataSink sink( filename, genfile::SNPDataSink::Metadata(), version ) ;
+		sink.set_compression_type( compression ) ;
+		sink.send_variant_locations_to( boost::bind( &record_location, &result, _1, _2, _3 )) ;
+		sink.set_sample_names( source.number_of_samples(), &get_sample_name ) ;
+		genfile::VariantIdentifyingData snp ;
+		while( source.get_snp_identifying_data( &snp )) {
+			genfile::VariantDataReader::UniquePtr reader = source.read_variant_data() ;
+			sink.write_variant_data( snp, *reader ) ;
+		}
+		return result ;
+	}
+
+	// Read variants, skipping the data of those whose index is in the given set of bits.
+	std::vector< Variant > read_variants( genfile::SNPDataSource& source, std::size_t ignore_mask = 0 ) {
+		std::vector< Variant > result ;
+		genfile::GenotypeProbabilityMatrix matrix ;
+		Variant variant ;
+		for( std::size_t i = 0; source.get_snp_identifying_data( &variant.snp ); ++i ) {
+			if( ignore_mask & ( 1u << i )) {
+				source.ignore_snp_probability_data() ;
+			} else {
+				source.read_variant_data()->get_probabilities( ":genotypes:", &matrix ) ;
+				variant.probabilities = matrix.probabilities ;
+				result.push_back( variant ) ;
+			}
+		}
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_bgen_memory_mapped ) {
+	std::cerr << "test_bgen_memory_mapped()..." ;
+	std::vector< std::pair< std::string, std::string > > formats ;
+	formats.push_back( std::make_pair( "v11", "zlib" )) ;
+	formats.push_back( std::make_pair( "v12", "zlib" )) ;
+	formats.push_back( std::make_pair( "v12", "zstd" )) ;
+	formats.push_back( std::make_pair( "v12", "none" )) ;
+	for( std::size_t format_i = 0; format_i < formats.size(); ++format_i ) {
+		std::string const filename = genfile::create_temporary_filename() + ".bgen" ;
+		std::vector< FileRange > const locations = write_bgen_file( filename, formats[ format_i ].first, formats[ format_i ].second ) ;
+		std::vector< Variant > expected ;
+		std::vector< Variant > expected_with_ignores ;
+		{
+			genfile::BGenFileSNPDataSource source( filename ) ;
+			expected = read_variants( source ) ;
+			source.reset_to_start() ;
+			expected_with_ignores = read_variants( source, 0x15 ) ;
+		}
+		BOOST_CHECK_EQUAL( expected.size(), 6 ) ;
+		BOOST_CHECK_EQUAL( expected_with_ignores.size(), 3 ) ;
+
+		{
+			genfile::BGenFileSNPDataSource source( filename, genfile::Chromosome(), genfile::BGenFileSNPDataSource::eMemoryMappedAccess ) ;
+			BOOST_CHECK( read_variants( source ) == expected ) ;
+			BOOST_CHECK( !source ) ;
+			source.reset_to_start() ;
+			BOOST_CHECK( read_variants( source, 0x15 ) == expected_with_ignores ) ;
+		}
+
+		// Read every other variant through an index query.
+		{
+			std::vector< FileRange > positions ;
+			std::vector< Variant > expected_in_query ;
+			for( std::size_t i = 0; i < locations.size(); i += 2 ) {
+				positions.push_back( locations[i] ) ;
+				expected_in_query.push_back( expected[i] ) ;
+			}
+			genfile::BGenFileSNPDataSource source( filename, genfile::Chromosome(), genfile::BGenFileSNPDataSource::eMemoryMappedAccess ) ;
+			source.set_index_query( genfile::bgen::IndexQuery::UniquePtr( new VectorIndexQuery( positions ))) ;
+			BOOST_CHECK( read_variants( source ) == expected_in_query ) ;
+		}
+
+		for( std::size_t number_of_threads = 1; number_of_threads < 3; ++number_of_threads ) {
+			genfile::BGenFileSNPDataSource source( filename, genfile::Chromosome(), genfile::BGenFileSNPDataSource::eMemoryMappedAccess ) ;
+			source.set_read_ahead( number_of_threads, 3 ) ;
+			BOOST_CHECK( read_variants( source ) == expected ) ;
+			source.reset_to_start() ;
+			BOOST_CHECK( read_variants( source, 0x15 ) == expected_with_ignores ) ;
+		}
+		std::remove( filename.c_str() ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_bgen_memory_mapped_compressed_file ) {
+	std::cerr << "test_bgen_memory_mapped_compressed_file()..." ;
+	bool caught = false ;
+	try {
+		genfile::BGenFileSNPDataSource source( "nonexistent.bgen.gz", genfile::Chromosome(), genfile::BGenFileSNPDataSource::eMemoryMappedAccess ) ;
+	}
+	catch( genfile::BadArgumentError const& ) {
+		caught = true ;
+	}
+	BOOST_CHECK( caught ) ;
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
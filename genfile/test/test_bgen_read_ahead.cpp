@@ -0,0 +1,122 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "test_case.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/GenFileSNPDataSource.hpp"
+#include "genfile/BGenFileSNPDataSink.hpp"
+#include "genfile/BGenFileSNPDataSource.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
+#include "genfile/FileUtils.hpp"
+
+AUTO_TEST_SUITE( test_bgen_read_ahead )
+
+namespace data {
+	namespace {
+		std::string data =
+			"SNP1 rs1 1000 A G 1 0 0 0 1 0 0 0 1\n"
+			"SNP2 rs2 2000 A C 0 1 0 0 0 1 0 0 0\n"
+			"SNP3 rs3 3000 C T 0.2 0.3 0.5 1 0 0 0 0 1\n"
+			"SNP4 rs4 4000 G T 0 0 1 0.1 0.8 0.1 0 1 0\n"
+			"SNP5 rs5 5000 A T 0.25 0.5 0.25 0 0 0 1 0 0\n"
+			"SNP6 rs6 6000 A G 0 0 0 0 0 1 1 0 0\n"
+			"SNP7 rs7 7000 C G 0.5 0.5 0 0 0.5 0.5 0 0 1\n" ;
+	}
+}
+
+namespace {
+	struct Variant {
+		genfile::VariantIdentifyingData snp ;
+		Eigen::MatrixXd probabilities ;
+		bool operator==( Variant const& other ) const {
+			return snp == other.snp && probabilities == other.probabilities ;
+		}
+	} ;
+
+	genfile::VariantEntry get_sample_name( std::size_t i ) {
+		return "sample_" + genfile::string_utils::to_string( i ) ;
+	}
+
+	void write_bgen_file( std::string const& filename, std::string const& version, std::string const& compression ) {
+		genfile::GenFileSNPDataSource source(
+			std::auto_ptr< std::istream >( new std::istringstream( data::data ) ),
+			genfile::Chromosome( "01" )
+		) ;
+		genfile::BGenFileSNPDataSink sink( filename, genfile::SNPDataSink::Metadata(), version ) ;
+		sink.set_compression_type( compression ) ;
+		sink.set_sample_names( source.number_of_samples(), &get_sample_name ) ;
+		genfile::VariantIdentifyingData snp ;
+		while( source.get_snp_identifying_data( &snp )) {
+			genfile::VariantDataReader::UniquePtr reader = source.read_variant_data() ;
+			sink.write_variant_data( snp, *reader ) ;
+		}
+	}
+
+	// Read variants, skipping the data of those whose index is in the given set of bits.
+	std::vector< Variant > read_variants( genfile::SNPDataSource& source, std::size_t ignore_mask = 0 ) {
+		std::vector< Variant > result ;
+		genfile::GenotypeProbabilityMatrix matrix ;
+		Variant variant ;
+		for( std::size_t i = 0; source.get_snp_identifying_data( &variant.snp ); ++i ) {
+			if( ignore_mask & ( 1u << i )) {
+				source.ignore_snp_probability_data() ;
+			} else {
+				source.read_variant_data()->get_probabilities( ":genotypes:", &matrix ) ;
+				variant.probabilities = matrix.probabilities ;
+				result.push_back( variant ) ;
+			}
+		}
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_bgen_read_ahead ) {
+	std::cerr << "test_bgen_read_ahead()..." ;
+	std::vector< std::pair< std::string, std::string > > formats ;
+	formats.push_back( std::make_pair( "v11", "zlib" )) ;
+	formats.push_back( std::make_pair( "v12", "zlib" )) ;
+	formats.push_back( std::make_pair( "v12", "zstd" )) ;
+	formats.push_back( std::make_pair( "v12", "none" )) ;
+	for( std::size_t format_i = 0; format_i < formats.size(); ++format_i ) {
+		std::string const filename = genfile::create_temporary_filename() + ".bgen" ;
+		write_bgen_file( filename, formats[ format_i ].first, formats[ format_i ].second ) ;
+		std::vector< Variant > expected ;
+		std::vector< Variant > expected_with_ignores ;
+		{
+			genfile::BGenFileSNPDataSource source( filename ) ;
+			expected = read_variants( source ) ;
+			source.reset_to_start() ;
+			expected_with_ignores = read_variants( source, 0x2D ) ;
+		}
+		BOOST_CHECK_EQUAL( expected.size(), 7 ) ;
+		BOOST_CHECK_EQUAL( expected_with_ignores.size(), 3 ) ;
+
+		for( std::size_t number_of_threads = 1; number_of_threads < 4; ++number_of_threads ) {
+			for( std::size_t number_of_blocks = 1; number_of_blocks < 9; ++number_of_blocks ) {
+				genfile::BGenFileSNPDataSource source( filename ) ;
+				source.set_read_ahead( number_of_threads, number_of_blocks ) ;
+				BOOST_CHECK( read_variants( source ) == expected ) ;
+				BOOST_CHECK( !source ) ;
+				source.reset_to_start() ;
+				BOOST_CHECK( read_variants( source, 0x2D ) == expected_with_ignores ) ;
+				// Reset part way through.
+				source.reset_to_start() ;
+				Variant variant ;
+				source.get_snp_identifying_data( &variant.snp ) ;
+				source.reset_to_start() ;
+				BOOST_CHECK( read_variants( source ) == expected ) ;
+			}
+		}
+		std::remove( filename.c_str() ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
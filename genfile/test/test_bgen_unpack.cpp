@@ -0,0 +1,164 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <vector>
+#include "test_case.hpp"
+#include "genfile/MissingValue.hpp"
+#include "genfile/bgen/bgen.hpp"
+
+AUTO_TEST_SUITE( test_bgen_unpack )
+
+namespace {
+	// Pack the given values into a little-endian bit stream, as bgen v1.2 does.
+	std::vector< genfile::byte_t > pack( std::vector< uint64_t > const& values, int const bits ) {
+		std::vector< genfile::byte_t > result( ( values.size() * bits + 7 ) / 8, 0 ) ;
+		std::size_t offset = 0 ;
+		for( std::size_t i = 0; i < values.size(); ++i ) {
+			for( int b = 0; b < bits; ++b, ++offset ) {
+				if( ( values[i] >> b ) & 0x1 ) {
+					result[ offset / 8 ] |= genfile::byte_t( 1 << ( offset % 8 )) ;
+				}
+			}
+		}
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_unpack_probabilities ) {
+	std::cerr << "test_unpack_probabilities()..." ;
+	uint64_t state = 12345 ;
+	for( int bits = 1; bits <= 32; ++bits ) {
+		uint64_t const mask = uint64_t( 0xFFFFFFFFFFFFFFFF ) >> ( 64 - bits ) ;
+		for( std::size_t n = 0; n < 50; ++n ) {
+			std::vector< uint64_t > values( n ) ;
+			for( std::size_t i = 0; i < n; ++i ) {
+				state = state * 6364136223846793005ULL + 1442695040888963407ULL ;
+				values[i] = ( state >> 17 ) & mask ;
+			}
+			if( n > 1 ) {
+				values[0] = 0 ;
+				values[1] = mask ;
+			}
+			std::vector< genfile::byte_t > buffer = pack( values, bits ) ;
+			std::vector< double > result( n + 1, -1 ) ;
+			genfile::byte_t const* const end = &buffer[0] + buffer.size() ;
+			genfile::bgen::v12::impl::unpack_probabilities( &buffer[0], end, bits, n, &result[0] ) ;
+			for( std::size_t i = 0; i < n; ++i ) {
+				BOOST_CHECK_EQUAL( result[i], double( values[i] ) / double( mask ) ) ;
+			}
+			// Nothing past the requested values is written.
+			BOOST_CHECK_EQUAL( result[n], -1 ) ;
+		}
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_unpack_probabilities_checks_size ) {
+	std::cerr << "test_unpack_probabilities_checks_size()..." ;
+	std::vector< genfile::byte_t > buffer( 3, 0 ) ;
+	std::vector< double > result( 10 ) ;
+	genfile::byte_t const* const end = &buffer[0] + buffer.size() ;
+	BOOST_CHECK_THROW(
+		genfile::bgen::v12::impl::unpack_probabilities( &buffer[0], end, 8, 4, &result[0] ),
+		genfile::bgen::BGenError
+	) ;
+	BOOST_CHECK_THROW(
+		genfile::bgen::v12::impl::unpack_probabilities( &buffer[0], end, 33, 0, &result[0] ),
+		genfile::bgen::BGenError
+	) ;
+	genfile::bgen::v12::impl::unpack_probabilities( &buffer[0], end, 8, 3, &result[0] ) ;
+	std::cerr << "ok.\n" ;
+}
+
+namespace {
+	// Record values as a vector of vectors, with missing values stored as -1.
+	struct RecordingSetter {
+		void initialise( std::size_t nSamples, std::size_t ) { values.assign( nSamples, std::vector< double >() ) ; }
+		bool set_sample( std::size_t i ) { sample = i ; return true ; }
+		void set_number_of_entries( uint32_t, std::size_t n, genfile::OrderType, genfile::ValueType ) { values[sample].reserve( n ) ; }
+		void set_value( std::size_t, double value ) { values[sample].push_back( value ) ; }
+		void set_value( std::size_t, genfile::MissingValue ) { values[sample].push_back( -1 ) ; }
+		std::size_t sample ;
+		std::vector< std::vector< double > > values ;
+	} ;
+
+	// Make a bgen v1.2 genotype data block for N biallelic samples with ploidy in the given range.
+	std::vector< genfile::byte_t > make_block(
+		uint32_t const N,
+		uint32_t const min_ploidy,
+		uint32_t const max_ploidy,
+		bool const phased,
+		int const bits,
+		uint64_t* state
+	) {
+		uint64_t const mask = uint64_t( 0xFFFFFFFFFFFFFFFF ) >> ( 64 - bits ) ;
+		std::vector< genfile::byte_t > result( 4 + 2 + 2 ) ;
+		for( int i = 0; i < 4; ++i ) {
+			result[i] = genfile::byte_t( N >> ( 8 * i )) ;
+		}
+		result[4] = 2 ;
+		result[6] = genfile::byte_t( min_ploidy ) ;
+		result[7] = genfile::byte_t( max_ploidy ) ;
+		std::vector< uint64_t > values ;
+		for( uint32_t i = 0; i < N; ++i ) {
+			*state = (*state) * 6364136223846793005ULL + 1442695040888963407ULL ;
+			uint32_t const ploidy = min_ploidy + ( (*state) >> 40 ) % ( max_ploidy - min_ploidy + 1 ) ;
+			bool const missing = ( ( (*state) >> 50 ) % 5 == 0 ) ;
+			result.push_back( genfile::byte_t( ploidy | ( missing ? 0x80 : 0 ))) ;
+			// For biallelic variants, ploidy values are stored whether phased or not.
+			for( uint32_t j = 0; j < ploidy; ++j ) {
+				values.push_back( ( (*state) >> j ) & mask ) ;
+			}
+		}
+		result.push_back( phased ? 1 : 0 ) ;
+		result.push_back( genfile::byte_t( bits )) ;
+		std::vector< genfile::byte_t > const packed = pack( values, bits ) ;
+		result.insert( result.end(), packed.begin(), packed.end() ) ;
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_parse_sample_subset ) {
+	std::cerr << "test_parse_sample_subset()..." ;
+	uint64_t state = 54321 ;
+	uint32_t const N = 37 ;
+	genfile::bgen::Context context ;
+	context.number_of_samples = N ;
+	context.flags = genfile::bgen::e_Layout2 ;
+	for( int bits = 1; bits <= 32; ++bits ) {
+		for( int phased = 0; phased < 2; ++phased ) {
+			// Even bits use the diploid biallelic parser, odd bits the general one.
+			std::vector< genfile::byte_t > const block = ( bits % 2 )
+				? make_block( N, 1, 3, phased, bits, &state )
+				: make_block( N, 2, 2, phased, bits, &state ) ;
+			genfile::byte_t const* const end = &block[0] + block.size() ;
+			RecordingSetter all ;
+			genfile::bgen::v12::parse_probability_data( &block[0], end, context, all ) ;
+
+			// Subsets with runs starting at various bit offsets.
+			std::vector< std::size_t > samples ;
+			for( std::size_t i = 0; i < N; ++i ) {
+				state = state * 6364136223846793005ULL + 1442695040888963407ULL ;
+				if( ( state >> 33 ) % 3 != 0 ) {
+					samples.push_back( i ) ;
+				}
+			}
+			RecordingSetter subset ;
+			genfile::bgen::v12::parse_probability_data( &block[0], end, context, samples, subset ) ;
+			BOOST_CHECK_EQUAL( subset.values.size(), samples.size() ) ;
+			for( std::size_t i = 0; i < samples.size(); ++i ) {
+				BOOST_CHECK( subset.values[i] == all.values[ samples[i] ] ) ;
+			}
+
+			// The empty subset reports no samples.
+			genfile::bgen::v12::parse_probability_data( &block[0], end, context, std::vector< std::size_t >(), subset ) ;
+			BOOST_CHECK_EQUAL( subset.values.size(), 0 ) ;
+		}
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
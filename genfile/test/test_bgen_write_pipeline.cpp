@@ -0,0 +1,185 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <boost/bind.hpp>
+#include "test_case.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/GenFileSNPDataSource.hpp"
+#include "genfile/BGenFileSNPDataSink.hpp"
+#include "genfile/SortingBGenFileSNPDataSink.hpp"
+#include "genfile/FileUtils.hpp"
+
+AUTO_TEST_SUITE( test_bgen_write_pipeline )
+
+namespace data {
+	namespace {
+		// Not in position order, so that sorting has something to do.
+		std::string data =
+			"SNP1 rs1 1000 A G 1 0 0 0 1 0 0 0 1\n"
+			"SNP4 rs4 4000 G T 0 0 1 0.1 0.8 0.1 0 1 0\n"
+			"SNP2 rs2 2000 A C 0 1 0 0 0 1 0 0 0\n"
+			"SNP3 rs3 3000 C T 0.2 0.3 0.5 1 0 0 0 0 1\n"
+			"SNP6 rs6 6000 A G 0 0 0 0 0 1 1 0 0\n"
+			"SNP5 rs5 5000 A T 0.25 0.5 0.25 0 0 0 1 0 0\n"
+			"SNP7 rs7 7000 C G 0.5 0.5 0 0 0.5 0.5 0 0 1\n" ;
+	}
+}
+
+namespace {
+	struct Location {
+		std::string rsid ;
+		int64_t offset ;
+		int64_t size ;
+		bool operator==( Location const& other ) const {
+			return rsid == other.rsid && offset == other.offset && size == other.size ;
+		}
+	} ;
+
+	void record_location( std::vector< Location >* result, genfile::VariantIdentifyingData const& variant, int64_t offset, int64_t size ) {
+		Location location ;
+		location.rsid = variant.get_primary_id() ;
+		location.offset = offset ;
+		location.size = size ;
+		result->push_back( location ) ;
+	}
+
+	genfile::VariantEntry get_sample_name( std::size_t i ) {
+		return "sample_" + genfile::string_utils::to_string( i ) ;
+	}
+
+	void copy_data( genfile::SNPDataSink& sink ) {
+		genfile::GenFileSNPDataSource source(
+			std::auto_ptr< std::istream >( new std::istringstream( data::data ) ),
+			genfile::Chromosome( "01" )
+		) ;
+		sink.set_sample_names( source.number_of_samples(), &get_sample_name ) ;
+		genfile::VariantIdentifyingData snp ;
+		while( source.get_snp_identifying_data( &snp )) {
+			genfile::VariantDataReader::UniquePtr reader = source.read_variant_data() ;
+			sink.write_variant_data( snp, *reader ) ;
+		}
+	}
+
+	std::string read_file( std::string const& filename ) {
+		std::ifstream file( filename.c_str(), std::ios::binary ) ;
+		return std::string( std::istreambuf_iterator< char >( file ), std::istreambuf_iterator< char >() ) ;
+	}
+
+	std::auto_ptr< genfile::BGenFileSNPDataSink > create_sink(
+		std::string const& filename,
+		std::string const& version,
+		std::string const& compression,
+		int compression_level,
+		std::size_t number_of_threads,
+		std::size_t max_variants_in_flight
+	) {
+		std::auto_ptr< genfile::BGenFileSNPDataSink > sink(
+			new genfile::BGenFileSNPDataSink( filename, genfile::SNPDataSink::Metadata(), version )
+		) ;
+		sink->set_compression_type( compression ) ;
+		sink->set_compression_level( compression_level ) ;
+		sink->set_number_of_threads( number_of_threads, max_variants_in_flight ) ;
+		return sink ;
+	}
+
+	// Write the data and return the file contents.
+	std::string write_bgen_file(
+		std::string const& version,
+		std::string const& compression,
+		int compression_level,
+		std::size_t number_of_threads,
+		std::size_t max_variants_in_flight,
+		std::vector< Location >* locations
+	) {
+		std::string const filename = genfile::create_temporary_filename() + ".bgen" ;
+		{
+			std::auto_ptr< genfile::BGenFileSNPDataSink > sink = create_sink(
+				filename, version, compression, compression_level, number_of_threads, max_variants_in_flight
+			) ;
+			sink->send_variant_locations_to( boost::bind( &record_location, locations, _1, _2, _3 )) ;
+			copy_data( *sink ) ;
+			sink->finalise() ;
+		}
+		std::string const result = read_file( filename ) ;
+		std::remove( filename.c_str() ) ;
+		return result ;
+	}
+
+	std::string write_sorted_bgen_file(
+		std::size_t number_of_threads,
+		std::vector< Location >* locations
+	) {
+		std::string const filename = genfile::create_temporary_filename() + ".bgen" ;
+		{
+			genfile::SortingBGenFileSNPDataSink sink(
+				filename,
+				genfile::SNPDataSink::UniquePtr( create_sink( filename, "v12", "zstd", -1, number_of_threads, 3 ).release() ),
+				genfile::VariantIdentifyingData::CompareFields( "position,alleles" )
+			) ;
+			sink.send_variant_locations_to( boost::bind( &record_location, locations, _1, _2, _3 )) ;
+			copy_data( sink ) ;
+		}
+		std::string const result = read_file( filename ) ;
+		std::remove( filename.c_str() ) ;
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_bgen_write_pipeline ) {
+	std::cerr << "test_bgen_write_pipeline()..." ;
+	struct Format {
+		char const* version ;
+		char const* compression ;
+		int level ;
+	} ;
+	Format const formats[] = {
+		{ "v11", "zlib", -1 },
+		{ "v12", "zlib", 1 },
+		{ "v12", "zstd", -1 },
+		{ "v12", "zstd", 3 },
+		{ "v12", "none", -1 }
+	} ;
+	for( std::size_t format_i = 0; format_i < 5; ++format_i ) {
+		Format const& format = formats[ format_i ] ;
+		std::vector< Location > expected_locations ;
+		std::string const expected = write_bgen_file( format.version, format.compression, format.level, 0, 0, &expected_locations ) ;
+		BOOST_CHECK_EQUAL( expected_locations.size(), 7 ) ;
+		for( std::size_t number_of_threads = 1; number_of_threads < 4; ++number_of_threads ) {
+			for( std::size_t max_variants_in_flight = 1; max_variants_in_flight < 9; ++max_variants_in_flight ) {
+				std::vector< Location > locations ;
+				std::string const result = write_bgen_file( format.version, format.compression, format.level, number_of_threads, max_variants_in_flight, &locations ) ;
+				BOOST_CHECK( result == expected ) ;
+				BOOST_CHECK( locations == expected_locations ) ;
+			}
+		}
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_sorting_bgen_write_pipeline ) {
+	std::cerr << "test_sorting_bgen_write_pipeline()..." ;
+	std::vector< Location > expected_locations ;
+	std::string const expected = write_sorted_bgen_file( 0, &expected_locations ) ;
+	BOOST_CHECK_EQUAL( expected_locations.size(), 7 ) ;
+	for( std::size_t i = 0; i < expected_locations.size(); ++i ) {
+		BOOST_CHECK_EQUAL( expected_locations[i].rsid, "rs" + genfile::string_utils::to_string( i + 1 )) ;
+	}
+	for( std::size_t number_of_threads = 1; number_of_threads < 4; ++number_of_threads ) {
+		std::vector< Location > locations ;
+		std::string const result = write_sorted_bgen_file( number_of_threads, &locations ) ;
+		BOOST_CHECK( result == expected ) ;
+		BOOST_CHECK( locations == expected_locations ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
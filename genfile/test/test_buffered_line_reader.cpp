@@ -0,0 +1,114 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "test_case.hpp"
+#include "genfile/BufferedLineReader.hpp"
+
+BOOST_AUTO_TEST_SUITE( test_buffered_line_reader )
+
+namespace {
+	std::vector< std::string > read_all_lines( std::string const& data, std::size_t const block_size, bool const read_ahead = false ) {
+		std::istringstream stream( data ) ;
+		genfile::BufferedLineReader reader( stream, block_size ) ;
+		reader.set_read_ahead( read_ahead ) ;
+		std::vector< std::string > result ;
+		genfile::BufferedLineReader::Line line ;
+		while( reader.read_line( &line )) {
+			result.push_back( std::string( line.begin, line.end )) ;
+		}
+		TEST_ASSERT( reader.number_of_lines_read() == result.size() ) ;
+		return result ;
+	}
+}
+
+AUTO_TEST_CASE( test_lines ) {
+	std::cerr << "test_lines()..." ;
+	// Block sizes smaller than, equal to, and larger than the line lengths.
+	for( std::size_t block_size = 1; block_size < 40; ++block_size ) {
+		std::vector< std::string > lines = read_all_lines( "", block_size ) ;
+		TEST_ASSERT( lines.size() == 0 ) ;
+
+		lines = read_all_lines( "\n", block_size ) ;
+		TEST_ASSERT( lines.size() == 1 && lines[0] == "" ) ;
+
+		lines = read_all_lines( "hello\tworld\n\nA long line of text\n", block_size ) ;
+		TEST_ASSERT( lines.size() == 3 ) ;
+		TEST_ASSERT( lines[0] == "hello\tworld" ) ;
+		TEST_ASSERT( lines[1] == "" ) ;
+		TEST_ASSERT( lines[2] == "A long line of text" ) ;
+
+		// The last line need not end in a newline.
+		lines = read_all_lines( "first\nsecond", block_size ) ;
+		TEST_ASSERT( lines.size() == 2 ) ;
+		TEST_ASSERT( lines[0] == "first" ) ;
+		TEST_ASSERT( lines[1] == "second" ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_held_lines ) {
+	std::cerr << "test_held_lines()..." ;
+	std::ostringstream data ;
+	for( std::size_t i = 0; i < 1000; ++i ) {
+		data << "line " << i << "\n" ;
+	}
+	std::istringstream stream( data.str() ) ;
+	genfile::BufferedLineReader reader( stream, 64 ) ;
+	// Lines that are held must remain valid while later lines are read.
+	std::vector< genfile::BufferedLineReader::Line > lines ;
+	genfile::BufferedLineReader::Line line ;
+	while( reader.read_line( &line )) {
+		lines.push_back( line ) ;
+	}
+	TEST_ASSERT( lines.size() == 1000 ) ;
+	for( std::size_t i = 0; i < lines.size(); ++i ) {
+		std::ostringstream expected ;
+		expected << "line " << i ;
+		TEST_ASSERT( std::string( lines[i].as_slice() ) == expected.str() ) ;
+	}
+
+	// After reset, reading starts from the new stream.
+	std::istringstream stream2( "another\n" ) ;
+	reader.reset( stream2 ) ;
+	TEST_ASSERT( reader.read_line( &line )) ;
+	TEST_ASSERT( std::string( line.begin, line.end ) == "another" ) ;
+	TEST_ASSERT( !reader.read_line( &line )) ;
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_read_ahead ) {
+	std::cerr << "test_read_ahead()..." ;
+	std::ostringstream data ;
+	for( std::size_t i = 0; i < 1000; ++i ) {
+		data << "line " << i << "\n" ;
+	}
+	// Lines are the same whether or not blocks are read on another thread.
+	for( std::size_t block_size = 1; block_size < 100; block_size += 7 ) {
+		TEST_ASSERT( read_all_lines( data.str(), block_size, true ) == read_all_lines( data.str(), block_size, false )) ;
+		TEST_ASSERT( read_all_lines( "first\nsecond", block_size, true ).size() == 2 ) ;
+		TEST_ASSERT( read_all_lines( "", block_size, true ).size() == 0 ) ;
+	}
+
+	// Reading can be stopped part way through and restarted on another stream.
+	std::istringstream stream( data.str() ) ;
+	genfile::BufferedLineReader reader( stream, 16 ) ;
+	reader.set_read_ahead( true ) ;
+	genfile::BufferedLineReader::Line line ;
+	for( std::size_t i = 0; i < 10; ++i ) {
+		TEST_ASSERT( reader.read_line( &line )) ;
+	}
+	reader.stop() ;
+	std::istringstream stream2( "another\n" ) ;
+	reader.reset( stream2 ) ;
+	TEST_ASSERT( reader.read_line( &line )) ;
+	TEST_ASSERT( std::string( line.begin, line.end ) == "another" ) ;
+	TEST_ASSERT( !reader.read_line( &line )) ;
+	std::cerr << "ok.\n" ;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
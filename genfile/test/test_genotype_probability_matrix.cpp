@@ -0,0 +1,62 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "test_case.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/GenFileSNPDataSource.hpp"
+#include "genfile/VariantDataReader.hpp"
+#include "genfile/GenotypeProbabilityMatrix.hpp"
+
+AUTO_TEST_SUITE( test_genotype_probability_matrix )
+
+namespace data {
+	namespace {
+		std::string data =
+			"SNP1 rs1 1000 A G 1 0 0 0 1 0 0 0 1\n"
+			"SNP2 rs2 2000 A C 0 1 0 0 0 0 0.5 0.5 0\n"
+			"SNP3 rs3 3000 C T 0.2 0.3 0.5 1 0 0 0 0 0\n" ;
+	}
+}
+
+AUTO_TEST_CASE( test_get_probabilities ) {
+	std::cerr << "test_get_probabilities()..." ;
+	genfile::SNPDataSource::UniquePtr source(
+		new genfile::GenFileSNPDataSource(
+			std::auto_ptr< std::istream >( new std::istringstream( data::data ) ),
+			genfile::Chromosome( "01" )
+		)
+	) ;
+	genfile::VariantIdentifyingData snp ;
+	genfile::GenotypeProbabilityMatrix expected ;
+	genfile::GenotypeProbabilityMatrix got ;
+	std::size_t count = 0 ;
+	while( source->get_snp_identifying_data( &snp )) {
+		genfile::VariantDataReader::UniquePtr reader = source->read_variant_data() ;
+		// Compare the direct implementation with the generic one.
+		reader->VariantDataReader::get_probabilities( ":genotypes:", &expected ) ;
+		reader->get_probabilities( ":genotypes:", &got ) ;
+		TEST_ASSERT( expected.probabilities.rows() == 3 ) ;
+		TEST_ASSERT( expected.probabilities.cols() == 3 ) ;
+		BOOST_CHECK( got.probabilities == expected.probabilities ) ;
+		BOOST_CHECK( got.ploidy == expected.ploidy ) ;
+		BOOST_CHECK( got.missing == expected.missing ) ;
+		BOOST_CHECK_EQUAL( got.number_of_alleles, 2 ) ;
+		BOOST_CHECK_EQUAL( expected.number_of_alleles, 2 ) ;
+		BOOST_CHECK_EQUAL( got.min_ploidy, 2 ) ;
+		BOOST_CHECK_EQUAL( got.max_ploidy, 2 ) ;
+		++count ;
+	}
+	BOOST_CHECK_EQUAL( count, 3 ) ;
+	// The last SNP has one sample with all-zero probabilities.
+	BOOST_CHECK_EQUAL( got.missing.sum(), 1 ) ;
+	BOOST_CHECK_EQUAL( got.missing(2), 1 ) ;
+	BOOST_CHECK_EQUAL( got.probabilities( 0, 2 ), 0.5 ) ;
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
@@ -0,0 +1,246 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "test_case.hpp"
+#include "genfile/snp_data_utils.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/PgenFileSNPDataSource.hpp"
+#include "genfile/GenomePositionRange.hpp"
+
+AUTO_TEST_SUITE( test_pgen_file_snp_data_source )
+
+namespace data {
+	namespace {
+		// Four samples and eight variants, one for each main track type.
+		// The variants are:
+		// 0: 2-bit hardcalls 0,1,2,3.
+		// 1: LD-compressed against variant 0, with sample 1 set to 2.
+		// 2: LD-compressed and inverted against variant 0, with no differences.
+		// 3: all hom ref.
+		// 4: hom ref with differences (sample 0 and 2 het, sample 3 missing), with a phase track.
+		// 5: 1-bit hardcalls (0 or 2) with sample 0 missing, with a listed dosage track.
+		// 6: hom alt with no differences, with a bitarray dosage track setting sample 3 missing.
+		// 7: missing with sample 2 set to 0, with dosages for all samples.
+		unsigned char const types[8] = { 0x00, 0x02, 0x03, 0x05, 0x14, 0x21, 0x66, 0x47 } ;
+		unsigned char const record0[] = { 0xE4 } ;
+		unsigned char const record1[] = { 0x01, 0x01, 0x02 } ;
+		unsigned char const record2[] = { 0x00 } ;
+		unsigned char const record4[] = { 0x03, 0x00, 0x35, 0x02, 0x01, 0x02 } ;
+		unsigned char const record5[] = { 0x02, 0x0A, 0x01, 0x00, 0x03, 0x02, 0x01, 0x01, 0x00, 0x60, 0x00, 0x10 } ;
+		unsigned char const record6[] = { 0x00, 0x08, 0xFF, 0xFF } ;
+		unsigned char const record7[] = { 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x20, 0x00, 0x80 } ;
+
+		std::string const pvar =
+			"##fileformat=PVARv1.0\n"
+			"#CHROM\tPOS\tID\tREF\tALT\n"
+			"1\t1000\trs0\tA\tG\n"
+			"1\t2000\trs1\tA\tG\n"
+			"1\t3000\trs2\tA\tG\n"
+			"1\t4000\trs3\tA\tG\n"
+			"1\t5000\trs4\tA\tG\n"
+			"1\t6000\trs5\tA\tG\n"
+			"1\t7000\trs6\tA\tG\n"
+			"1\t8000\trs7\tA\tG\n" ;
+
+		std::string const psam =
+			"#FID\tIID\tSEX\n"
+			"F1\tS1\t1\n"
+			"F2\tS2\t2\n"
+			"F3\tS3\t1\n"
+			"F4\tS4\t2\n" ;
+
+		std::string construct_pgen() {
+			std::vector< std::string > records( 8 ) ;
+			records[0] = std::string( record0, record0 + sizeof( record0 )) ;
+			records[1] = std::string( record1, record1 + sizeof( record1 )) ;
+			records[2] = std::string( record2, record2 + sizeof( record2 )) ;
+			records[4] = std::string( record4, record4 + sizeof( record4 )) ;
+			records[5] = std::string( record5, record5 + sizeof( record5 )) ;
+			records[6] = std::string( record6, record6 + sizeof( record6 )) ;
+			records[7] = std::string( record7, record7 + sizeof( record7 )) ;
+
+			// Magic number, storage mode, counts, control byte (8-bit types and 1-byte lengths),
+			// the block offset, record types, and record lengths.
+			std::string result( "\x6c\x1b\x10", 3 ) ;
+			result += std::string( "\x08\x00\x00\x00", 4 ) ;
+			result += std::string( "\x04\x00\x00\x00", 4 ) ;
+			result += '\x04' ;
+			unsigned char const records_start = 3 + 4 + 4 + 1 + 8 + 8 + 8 ;
+			result += char( records_start ) ;
+			result += std::string( 7, '\0' ) ;
+			result += std::string( types, types + 8 ) ;
+			for( std::size_t i = 0; i < 8; ++i ) {
+				result += char( records[i].size() ) ;
+			}
+			assert( result.size() == records_start ) ;
+			for( std::size_t i = 0; i < 8; ++i ) {
+				result += records[i] ;
+			}
+			return result ;
+		}
+
+		double const M = -100 ;
+		// GT values, two per sample.
+		double const GT[8][8] = {
+			{ 0, 0, 0, 1, 1, 1, M, M },
+			{ 0, 0, 1, 1, 1, 1, M, M },
+			{ 1, 1, 0, 1, 0, 0, M, M },
+			{ 0, 0, 0, 0, 0, 0, 0, 0 },
+			{ 1, 0, 0, 0, 0, 1, M, M },
+			{ M, M, 1, 1, 0, 0, 1, 1 },
+			{ 1, 1, 1, 1, 1, 1, 1, 1 },
+			{ M, M, M, M, 0, 0, M, M }
+		} ;
+		// DS values, one per sample.
+		double const DS[8][4] = {
+			{ 0, 1, 2, M },
+			{ 0, 2, 2, M },
+			{ 2, 1, 0, M },
+			{ 0, 0, 0, 0 },
+			{ 1, 0, 1, M },
+			{ M, 1.5, 0.25, 2 },
+			{ 2, 2, 2, M },
+			{ 0, 1, 0.5, 2 }
+		} ;
+	}
+}
+
+namespace {
+	struct ValueRecorder: public genfile::VariantDataReader::PerSampleSetter {
+		ValueRecorder( std::vector< double >& values, std::vector< OrderType >* orders = 0 ):
+			m_values( values ),
+			m_orders( orders )
+		{}
+		void initialise( std::size_t, std::size_t ) { m_values.clear() ; }
+		bool set_sample( std::size_t ) { return true ; }
+		void set_number_of_entries( uint32_t, std::size_t, OrderType const order_type, ValueType const ) {
+			if( m_orders ) {
+				m_orders->push_back( order_type ) ;
+			}
+		}
+		void set_value( std::size_t, MissingValue const ) { m_values.push_back( data::M ) ; }
+		void set_value( std::size_t, Integer const value ) { m_values.push_back( value ) ; }
+		void set_value( std::size_t, double const value ) { m_values.push_back( value ) ; }
+		void finalise() {}
+	private:
+		std::vector< double >& m_values ;
+		std::vector< OrderType >* m_orders ;
+	} ;
+
+	void record_sample_id( std::vector< std::string >* ids, std::size_t i, std::string const& id ) {
+		ids->resize( std::max( ids->size(), i + 1 )) ;
+		(*ids)[i] = id ;
+	}
+
+	void create_file( std::string const& data, std::string const& filename ) {
+		std::ofstream file( filename.c_str(), std::ios::binary ) ;
+		file << data ;
+	}
+
+	void check_variant( genfile::SNPDataSource& source, std::size_t const v ) {
+		genfile::VariantIdentifyingData snp ;
+		TEST_ASSERT( source.get_snp_identifying_data( &snp )) ;
+		TEST_ASSERT( snp.get_primary_id() == "rs" + genfile::string_utils::to_string( v )) ;
+		TEST_ASSERT( snp.get_position() == genfile::GenomePosition( genfile::Chromosome( "1" ), 1000 * ( v + 1 ))) ;
+		TEST_ASSERT( snp.number_of_alleles() == 2 ) ;
+		genfile::VariantDataReader::UniquePtr reader = source.read_variant_data() ;
+		TEST_ASSERT( reader->get_number_of_samples() == 4 ) ;
+
+		std::vector< double > values ;
+		std::vector< genfile::OrderType > orders ;
+		reader->get( "GT", ValueRecorder( values, &orders )) ;
+		BOOST_CHECK( values == std::vector< double >( data::GT[v], data::GT[v] + 8 )) ;
+		if( v == 4 ) {
+			// Samples 0 and 2 carry phased hets.
+			BOOST_CHECK( orders[0] == genfile::ePerOrderedHaplotype ) ;
+			BOOST_CHECK( orders[1] == genfile::ePerUnorderedHaplotype ) ;
+			BOOST_CHECK( orders[2] == genfile::ePerOrderedHaplotype ) ;
+		} else {
+			BOOST_CHECK( orders == std::vector< genfile::OrderType >( 4, genfile::ePerUnorderedHaplotype )) ;
+		}
+
+		reader->get( "DS", ValueRecorder( values )) ;
+		BOOST_CHECK( values == std::vector< double >( data::DS[v], data::DS[v] + 4 )) ;
+
+		reader->get( ":genotypes:", ValueRecorder( values )) ;
+		if( v < 5 ) {
+			// No dosage track, so hardcalls are reported.
+			BOOST_CHECK( values == std::vector< double >( data::GT[v], data::GT[v] + 8 )) ;
+		} else {
+			TEST_ASSERT( values.size() == 12 ) ;
+			for( std::size_t i = 0; i < 4; ++i ) {
+				double const d = data::DS[v][i] ;
+				if( d == data::M ) {
+					BOOST_CHECK( values[3*i] == data::M && values[3*i+1] == data::M && values[3*i+2] == data::M ) ;
+				} else {
+					BOOST_CHECK_SMALL( values[3*i] + values[3*i+1] + values[3*i+2] - 1.0, 1e-9 ) ;
+					BOOST_CHECK_SMALL( values[3*i+1] + 2 * values[3*i+2] - d, 1e-9 ) ;
+				}
+			}
+		}
+	}
+}
+
+AUTO_TEST_CASE( test_pgen_file_snp_data_source ) {
+	std::cerr << "test_pgen_file_snp_data_source()..." ;
+	std::string const stub = genfile::create_temporary_filename() ;
+	create_file( data::construct_pgen(), stub + ".pgen" ) ;
+	create_file( data::pvar, stub + ".pvar" ) ;
+	create_file( data::psam, stub + ".psam" ) ;
+
+	genfile::SNPDataSource::UniquePtr source = genfile::SNPDataSource::create( stub + ".pgen" ) ;
+	TEST_ASSERT( source->number_of_samples() == 4 ) ;
+	TEST_ASSERT( source->total_number_of_snps() && *source->total_number_of_snps() == 8 ) ;
+
+	std::vector< std::string > ids ;
+	source->get_sample_ids( boost::bind( &record_sample_id, &ids, _1, _2 )) ;
+	TEST_ASSERT( ids.size() == 4 && ids[0] == "S1" && ids[3] == "S4" ) ;
+
+	for( std::size_t pass = 0; pass < 2; ++pass ) {
+		for( std::size_t v = 0; v < 8; ++v ) {
+			check_variant( *source, v ) ;
+		}
+		genfile::VariantIdentifyingData snp ;
+		TEST_ASSERT( !source->get_snp_identifying_data( &snp )) ;
+		source->reset_to_start() ;
+	}
+
+	// Reading variant 1 and 2 requires their LD base, which is skipped.
+	genfile::PgenFileSNPDataSource& pgen_source = dynamic_cast< genfile::PgenFileSNPDataSource& >( *source ) ;
+	pgen_source.set_ranges( std::vector< genfile::GenomePositionRange >( 1, genfile::GenomePositionRange::parse( "1:1500-3000" ))) ;
+	TEST_ASSERT( !source->total_number_of_snps() ) ;
+	check_variant( *source, 1 ) ;
+	check_variant( *source, 2 ) ;
+	{
+		genfile::VariantIdentifyingData snp ;
+		TEST_ASSERT( !source->get_snp_identifying_data( &snp )) ;
+	}
+
+	// Sample subsets are supported.
+	source->reset_to_start() ;
+	{
+		genfile::VariantIdentifyingData snp ;
+		TEST_ASSERT( source->get_snp_identifying_data( &snp )) ;
+		genfile::VariantDataReader::UniquePtr reader = source->read_variant_data() ;
+		std::vector< std::size_t > subset ;
+		subset.push_back( 2 ) ;
+		subset.push_back( 0 ) ;
+		TEST_ASSERT( reader->set_sample_subset( subset )) ;
+		TEST_ASSERT( reader->get_number_of_samples() == 2 ) ;
+		std::vector< double > values ;
+		reader->get( "DS", ValueRecorder( values )) ;
+		TEST_ASSERT( values.size() == 2 ) ;
+		BOOST_CHECK( values[0] == 2.0 && values[1] == 0.0 ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
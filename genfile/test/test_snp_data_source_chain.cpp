@@ -204,6 +204,17 @@ AUTO_TEST_CASE( test_snp_data_source_chain ) {
 	results.push_back( read_snp_data( chain )) ;
 	std::cerr << "Reading gen files (2)...\n" ;
 	results.push_back( read_gen_files( filenames )) ;
+	{
+		std::cerr << "Reading gen files (3), one file at a time on another thread...\n" ;
+		genfile::SNPDataSourceChain::UniquePtr read_ahead_chain = genfile::SNPDataSourceChain::create( filenames ) ;
+		read_ahead_chain->set_read_ahead( 1, 3, std::vector< std::string >( 1, ":genotypes:" )) ;
+		results.push_back( read_snp_data( *read_ahead_chain )) ;
+		std::cerr << "Reading gen files (4), all files at once on other threads...\n" ;
+		read_ahead_chain->set_read_ahead( 2, 1, std::vector< std::string >( 1, ":genotypes:" )) ;
+		read_snp_data( *read_ahead_chain ) ;
+		read_ahead_chain->reset_to_start() ;
+		results.push_back( read_snp_data( *read_ahead_chain )) ;
+	}
 
 	for( std::size_t i = 0; i < results.size(); ++i ) {
 		TEST_ASSERT( results[i].size() == (2*data::number_of_snps) ) ;
@@ -210,5 +210,37 @@ AUTO_TEST_CASE( test_snp_data_source_rack ) {
 	
 }
 
+AUTO_TEST_CASE( test_snp_data_source_rack_read_ahead ) {
+	std::vector< std::vector< std::string > > data = construct_data() ;
+	std::vector< std::string > specs( 1, ":genotypes:" ) ;
+	for( std::size_t i = 0; i < data.size(); ++i ) {
+		std::cout << "==== Looking at test data " << i << " with read-ahead ====\n" ;
+		std::auto_ptr< genfile::SNPDataSourceRack > rack( new genfile::SNPDataSourceRack() ) ;
+		std::auto_ptr< genfile::SNPDataSourceRack > read_ahead_rack( new genfile::SNPDataSourceRack() ) ;
+		std::vector< std::string > filenames( data[i].size() ) ;
+		for( std::size_t j = 0; j < filenames.size(); ++j ) {
+			filenames[j] = tmpnam(0) + std::string( ".gen" ) ;
+			create_file( data[i][j], filenames[j] ) ;
+			rack->add_source( genfile::SNPDataSource::create( filenames[j] )) ;
+			read_ahead_rack->add_source( genfile::SNPDataSource::create( filenames[j] )) ;
+		}
+		// A small queue forces the matching to wait for the reading threads.
+		read_ahead_rack->set_read_ahead( 1, specs ) ;
+
+		std::vector< SnpData > const expected = read_snp_data( *rack ) ;
+		TEST_ASSERT( read_snp_data( *read_ahead_rack ) == expected ) ;
+		// Reading again after a reset gives the same results.
+		read_ahead_rack->reset_to_start() ;
+		TEST_ASSERT( read_snp_data( *read_ahead_rack ) == expected ) ;
+
+		rack.reset() ;
+		read_ahead_rack.reset() ;
+		for( std::size_t j = 0; j < filenames.size(); ++j ) {
+			boost::filesystem::remove( filenames[j] ) ;
+		}
+	}
+	std::cout << "==== success ====\n" ;
+}
+
 AUTO_TEST_SUITE_END()
 
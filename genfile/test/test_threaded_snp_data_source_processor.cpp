@@ -0,0 +1,132 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include "test_case.hpp"
+#include "genfile/SNPDataSource.hpp"
+#include "genfile/GenFileSNPDataSource.hpp"
+#include "genfile/SNPDataSourceProcessor.hpp"
+#include "genfile/CachedVariantDataReader.hpp"
+
+AUTO_TEST_SUITE( test_threaded_snp_data_source_processor )
+
+namespace data {
+	namespace {
+		unsigned int const number_of_snps = 5 ;
+		std::string data =
+			"SNP1 rs1 1000 A G 1 0 0 0 1 0 0 0 1\n"
+			"SNP2 rs2 2000 A C 0 1 0 0 0 1 0 0 0\n"
+			"SNP3 rs3 3000 C T 0.2 0.3 0.5 1 0 0 0 0 1\n"
+			"SNP4 rs4 4000 G T 0 0 1 0.1 0.8 0.1 0 1 0\n"
+			"SNP5 rs5 5000 A T 0.25 0.5 0.25 0 0 0 1 0 0\n" ;
+	}
+}
+
+namespace {
+	struct ValueRecorder: public genfile::VariantDataReader::PerSampleSetter {
+		ValueRecorder( std::vector< double >& values ): m_values( values ) {}
+		void initialise( std::size_t, std::size_t ) {}
+		bool set_sample( std::size_t i ) { m_values.push_back( -double(i) - 1 ) ; return true ; }
+		void set_number_of_entries( uint32_t, std::size_t n, OrderType const, ValueType const ) { m_values.push_back( n ) ; }
+		void set_value( std::size_t, MissingValue const ) { m_values.push_back( -100 ) ; }
+		void set_value( std::size_t, double const value ) { m_values.push_back( value ) ; }
+		void finalise() { m_values.push_back( -200 ) ; }
+	private:
+		std::vector< double >& m_values ;
+	} ;
+
+	struct RecordingCallback: public genfile::SNPDataSourceProcessor::Callback {
+		void begin_processing_snps( std::size_t, genfile::SNPDataSource::Metadata const& ) {
+			m_snps.clear() ;
+			m_values.clear() ;
+			m_finished = false ;
+		}
+		void processed_snp( genfile::VariantIdentifyingData const& snp, genfile::VariantDataReader& data_reader ) {
+			m_snps.push_back( snp ) ;
+			data_reader.get( ":genotypes:", ValueRecorder( m_values ) ) ;
+		}
+		void end_processing_snps() {
+			m_finished = true ;
+		}
+
+		std::vector< genfile::VariantIdentifyingData > m_snps ;
+		std::vector< double > m_values ;
+		bool m_finished ;
+	} ;
+
+	genfile::SNPDataSource::UniquePtr open_source() {
+		return genfile::SNPDataSource::UniquePtr(
+			new genfile::GenFileSNPDataSource(
+				std::auto_ptr< std::istream >( new std::istringstream( data::data ) ),
+				genfile::Chromosome( "01" )
+			)
+		) ;
+	}
+}
+
+AUTO_TEST_CASE( test_cached_variant_data_reader ) {
+	std::cerr << "test_cached_variant_data_reader()..." ;
+	genfile::SNPDataSource::UniquePtr source = open_source() ;
+	genfile::VariantIdentifyingData snp ;
+	while( source->get_snp_identifying_data( &snp )) {
+		genfile::VariantDataReader::UniquePtr reader = source->read_variant_data() ;
+		std::vector< double > expected ;
+		std::vector< double > got ;
+		genfile::CachedVariantDataReader::UniquePtr cached = genfile::CachedVariantDataReader::create(
+			*reader, std::vector< std::string >( 1, ":genotypes:" )
+		) ;
+		reader->get( ":genotypes:", ValueRecorder( expected ) ) ;
+		TEST_ASSERT( cached->supports( ":genotypes:" )) ;
+		TEST_ASSERT( cached->get_number_of_samples() == 3 ) ;
+		// Replaying twice should give the same result each time.
+		ValueRecorder recorder( got ) ;
+		cached->get( ":genotypes:", recorder ) ;
+		BOOST_CHECK( got == expected ) ;
+		got.clear() ;
+		cached->get( ":genotypes:", recorder ) ;
+		BOOST_CHECK( got == expected ) ;
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_threaded_snp_data_source_processor ) {
+	std::cerr << "test_threaded_snp_data_source_processor()..." ;
+	RecordingCallback expected ;
+	{
+		genfile::SimpleSNPDataSourceProcessor processor ;
+		processor.add_callback( expected ) ;
+		genfile::SNPDataSource::UniquePtr source = open_source() ;
+		processor.process( *source ) ;
+	}
+	BOOST_CHECK_EQUAL( expected.m_snps.size(), data::number_of_snps ) ;
+
+	for( std::size_t number_of_threads = 1; number_of_threads < 5; ++number_of_threads ) {
+		for( std::size_t batch_size = 1; batch_size < 7; ++batch_size ) {
+			std::vector< RecordingCallback > callbacks( 3 ) ;
+			genfile::ThreadedSNPDataSourceProcessor processor(
+				number_of_threads,
+				std::vector< std::string >( 1, ":genotypes:" ),
+				false,
+				batch_size
+			) ;
+			for( std::size_t i = 0; i < callbacks.size(); ++i ) {
+				processor.add_callback( callbacks[i] ) ;
+			}
+			genfile::SNPDataSource::UniquePtr source = open_source() ;
+			processor.process( *source ) ;
+			for( std::size_t i = 0; i < callbacks.size(); ++i ) {
+				BOOST_CHECK( callbacks[i].m_finished ) ;
+				BOOST_CHECK( callbacks[i].m_snps == expected.m_snps ) ;
+				BOOST_CHECK( callbacks[i].m_values == expected.m_values ) ;
+			}
+		}
+	}
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_SUITE_END()
@@ -0,0 +1,97 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef QCTOOL_QCDB_ASYNCHRONOUS_STORAGE_HPP
+#define QCTOOL_QCDB_ASYNCHRONOUS_STORAGE_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/exception_ptr.hpp>
+#include "genfile/VariantIdentifyingData.hpp"
+#include "genfile/VariantEntry.hpp"
+#include "qcdb/Storage.hpp"
+#include "qcdb/StorageOptions.hpp"
+
+namespace qcdb {
+	// Storage that passes calls on to another Storage object on a separate writer thread.
+	// Calls are collected into blocks of up to max_variants_per_block variants, and at most
+	// max_blocks_in_flight blocks are queued; when the queue is full the calling thread waits
+	// for the writer to catch up.  The wrapped storage sees the same calls in the same order,
+	// and is only ever used by one thread at a time.
+	// Errors raised by the wrapped storage are rethrown by the next call made after they occur.
+	struct AsynchronousStorage: public Storage {
+		static UniquePtr create( Storage::SharedPtr storage, std::size_t max_variants_per_block = 1000, std::size_t max_blocks_in_flight = 4 ) ;
+		static SharedPtr create_shared( Storage::SharedPtr storage, std::size_t max_variants_per_block = 1000, std::size_t max_blocks_in_flight = 4 ) ;
+
+		AsynchronousStorage( Storage::SharedPtr storage, std::size_t max_variants_per_block, std::size_t max_blocks_in_flight ) ;
+		~AsynchronousStorage() ;
+
+		void add_variable( std::string const& ) ;
+
+		void create_new_variant( genfile::VariantIdentifyingData const& ) ;
+		void store_per_variant_data(
+			genfile::VariantIdentifyingData const& snp,
+			std::string const& variable,
+			genfile::VariantEntry const& value
+		) ;
+
+		// Write all queued data, then finalise the wrapped storage.
+		void finalise( long options = eCreateIndices ) ;
+
+		AnalysisId analysis_id() const ;
+
+	private:
+		struct Operation {
+			enum Type { eAddVariable = 0, eCreateNewVariant = 1, eStorePerVariantData = 2 } ;
+			Operation( Type type_, std::size_t snp_index_, std::string const& variable_, genfile::VariantEntry const& value_ ):
+				type( type_ ), snp_index( snp_index_ ), variable( variable_ ), value( value_ )
+			{}
+			Type type ;
+			std::size_t snp_index ;
+			std::string variable ;
+			genfile::VariantEntry value ;
+		} ;
+
+		struct Block {
+			std::vector< genfile::VariantIdentifyingData > snps ;
+			std::vector< Operation > operations ;
+			void swap( Block& other ) ;
+			void clear() ;
+		} ;
+
+		typedef boost::mutex Mutex ;
+		typedef boost::mutex::scoped_lock ScopedLock ;
+		typedef boost::condition ConditionVariable ;
+
+		Storage::SharedPtr m_storage ;
+		std::size_t const m_max_variants_per_block ;
+		std::size_t const m_max_blocks_in_flight ;
+		// The block being filled by the calling thread.
+		Block m_block ;
+		// Blocks waiting to be written, and the state of the writer thread.
+		std::deque< Block > m_queue ;
+		bool m_writing ;
+		bool m_stop ;
+		boost::exception_ptr m_error ;
+		Mutex m_mutex ;
+		ConditionVariable m_queue_changed ;
+		std::auto_ptr< boost::thread > m_thread ;
+
+	private:
+		void submit_block() ;
+		void wait_until_written() ;
+		void rethrow_error_if_necessary() ;
+		void writer_thread_loop() ;
+		void write_block( Block const& block ) ;
+	} ;
+}
+
+#endif
@@ -0,0 +1,49 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef QCTOOL_QCDB_BGEN_INDEX_QUERY_HPP
+#define QCTOOL_QCDB_BGEN_INDEX_QUERY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "genfile/GenomePositionRange.hpp"
+#include "genfile/bgen/IndexQuery.hpp"
+#include "db/Connection.hpp"
+
+namespace qcdb {
+	// class BGenIndexQuery
+	// Finds variants in a bgen file using a .bgi index file.
+	// The index is a SQLite database with a Variant table recording the chromosome, position,
+	// rsid, alleles, file_start_position and size_in_bytes of each variant, as written by
+	// BGenIndexWriter (and by bgenix).
+	// Usage: construct, call include_range() and/or include_rsids(), then call initialise().
+	// Ranges are combined with OR; if rsids are also given, variants must match both.
+	class BGenIndexQuery: public genfile::bgen::IndexQuery {
+	public:
+		typedef std::auto_ptr< BGenIndexQuery > UniquePtr ;
+		static UniquePtr create( std::string const& filename ) ;
+
+	public:
+		BGenIndexQuery( std::string const& filename ) ;
+
+		BGenIndexQuery& include_range( genfile::GenomePositionRange const& range ) ;
+		BGenIndexQuery& include_rsids( std::vector< std::string > const& ids ) ;
+		void initialise() ;
+
+		std::size_t number_of_variants() const ;
+		FileRange locate_variant( std::size_t index ) const ;
+
+	private:
+		std::string const m_filename ;
+		db::Connection::UniquePtr m_connection ;
+		std::vector< genfile::GenomePositionRange > m_ranges ;
+		bool m_have_rsids ;
+		std::vector< FileRange > m_positions ;
+		bool m_initialised ;
+	} ;
+}
+
+#endif
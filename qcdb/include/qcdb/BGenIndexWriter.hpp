@@ -0,0 +1,42 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef QCTOOL_QCDB_BGEN_INDEX_WRITER_HPP
+#define QCTOOL_QCDB_BGEN_INDEX_WRITER_HPP
+
+#include <string>
+#include <memory>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include "genfile/VariantIdentifyingData.hpp"
+#include "db/Connection.hpp"
+#include "db/SQLStatement.hpp"
+
+namespace qcdb {
+	// class BGenIndexWriter
+	// Writes a .bgi index file for a bgen file, in the format read by BGenIndexQuery.
+	// Any existing file is replaced.  Variants are stored in a single transaction
+	// which is committed when the writer is destroyed.
+	// add_variant() has the signature of BasicBGenFileSNPDataSink::VariantLocationCallback.
+	class BGenIndexWriter: public boost::noncopyable {
+	public:
+		typedef std::auto_ptr< BGenIndexWriter > UniquePtr ;
+		typedef boost::shared_ptr< BGenIndexWriter > SharedPtr ;
+		static SharedPtr create_shared( std::string const& filename ) ;
+
+	public:
+		BGenIndexWriter( std::string const& filename ) ;
+		~BGenIndexWriter() ;
+
+		void add_variant( genfile::VariantIdentifyingData const& variant, int64_t offset, int64_t size ) ;
+
+	private:
+		db::Connection::UniquePtr m_connection ;
+		db::Connection::ScopedTransactionPtr m_transaction ;
+		db::Connection::StatementPtr m_insert_variant_statement ;
+	} ;
+}
+
+#endif
@@ -0,0 +1,66 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef QCTOOL_QCDB_COLUMNAR_FILE_OUTPUTTER_HPP
+#define QCTOOL_QCDB_COLUMNAR_FILE_OUTPUTTER_HPP
+
+#include <string>
+#include <memory>
+#include <map>
+#include <vector>
+#include <utility>
+#include "genfile/VariantEntry.hpp"
+#include "genfile/VariantIdentifyingData.hpp"
+#include "statfile/ColumnarFileWriter.hpp"
+#include "qcdb/Storage.hpp"
+#include "qcdb/StorageOptions.hpp"
+
+namespace qcdb {
+	// Class ColumnarFileOutputter writes per-variant data to a columnar stat file
+	// (see statfile/columnar_format.hpp).  Rows are buffered into chunks which are broken
+	// at chromosome boundaries, so that the file's index can be used to find variants by position.
+	// Unlike FlatFileOutputter, variables may be added at any point.
+	struct ColumnarFileOutputter: public Storage {
+		typedef std::map< std::string, std::pair< std::vector< std::string >, std::string > > Metadata ;
+		static UniquePtr create( std::string const& filename, std::string const& analysis_name, Metadata const& metadata ) ;
+		static SharedPtr create_shared( std::string const& filename, std::string const& analysis_name, Metadata const& metadata ) ;
+
+		ColumnarFileOutputter( std::string const& filename, std::string const& analysis_name, Metadata const& metadata ) ;
+		~ColumnarFileOutputter() ;
+
+		void add_variable( std::string const& ) ;
+
+		void create_new_variant( genfile::VariantIdentifyingData const& ) ;
+		void store_per_variant_data(
+			genfile::VariantIdentifyingData const& snp,
+			std::string const& value_name,
+			genfile::VariantEntry const& value
+		) ;
+
+		void finalise( long options = eCreateIndices ) ;
+
+		AnalysisId analysis_id() const ;
+	private:
+		std::string const m_filename ;
+		std::string const m_analysis_name ;
+		Metadata const m_metadata ;
+		std::size_t const m_max_snps_per_block ;
+		statfile::ColumnarFileWriter::UniquePtr m_writer ;
+		std::vector< genfile::VariantIdentifyingData > m_snps ;
+		typedef std::map< std::string, std::size_t > VariableMap ;
+		VariableMap m_variables ;
+		// Values for the current block, indexed by column; the leading columns hold variant identifying data.
+		std::vector< std::vector< genfile::VariantEntry > > m_values ;
+	
+	private:
+		std::size_t get_or_add_column( std::string const& variable ) ;
+		void add_snp( genfile::VariantIdentifyingData const& snp ) ;
+		void store_block() ;
+		std::string format_metadata() const ;
+	} ;
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
 #include <utility>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
@@ -70,6 +71,14 @@ namespace qcdb {
 		// Create a variant
 #endif
 		db::Connection::RowId get_or_create_variant( genfile::VariantIdentifyingData const& snp ) const ;
+		// Get or create variants for the SNPs in [begin, end), storing the same variants and identifiers as
+		// calling get_or_create_variant() on each in turn.  Variants seen before are remembered; the rest are
+		// looked up and inserted using a handful of statements for the whole block.
+		void get_or_create_variants(
+			std::vector< genfile::VariantIdentifyingData >::const_iterator const begin,
+			std::vector< genfile::VariantIdentifyingData >::const_iterator const end,
+			std::vector< db::Connection::RowId >* result
+		) const ;
 		// Store some data for a variant.
 		void insert_summary_data( db::Connection::RowId snp_id, db::Connection::RowId variable_id, genfile::VariantEntry const& value ) const ;
 
@@ -79,6 +88,8 @@ namespace qcdb {
 		void finalise( long options = eCreateIndices ) ;
 		
 	private:
+		// Number of rows put into the VariantBlock table by each multi-row insert.
+		enum { eVariantBlockRowsPerInsert = 64 } ;
 		db::Connection::UniquePtr m_connection ;
 		std::string const m_analysis_name ;
 		std::string const m_analysis_chunk ;
@@ -105,12 +116,28 @@ namespace qcdb {
 		db::Connection::StatementPtr m_find_variant_identifier_statement ;
 		db::Connection::StatementPtr m_insert_variant_identifier_statement ;
 
+		db::Connection::StatementPtr m_clear_variant_block_statement ;
+		db::Connection::StatementPtr m_insert_variant_block_statement ;
+		db::Connection::StatementPtr m_insert_variant_block_rows_statement ;
+		db::Connection::StatementPtr m_delete_variant_block_statement ;
+		db::Connection::StatementPtr m_insert_new_variants_statement ;
+		db::Connection::StatementPtr m_find_variant_block_statement ;
+		db::Connection::StatementPtr m_clear_variant_identifier_block_statement ;
+		db::Connection::StatementPtr m_insert_variant_identifier_block_statement ;
+		db::Connection::StatementPtr m_insert_new_variant_identifiers_statement ;
+
 		boost::optional< db::Connection::RowId > m_analysis_id ;
 		db::Connection::RowId m_is_a ;
 		db::Connection::RowId m_used_by ;
 
 		typedef boost::unordered_map< std::pair< std::string, std::string >, db::Connection::RowId > EntityMap ;
 		mutable EntityMap m_entity_map ;
+		// Ids of variants already stored, with all their identifiers.
+		struct VariantHash {
+			std::size_t operator()( genfile::VariantIdentifyingData const& snp ) const ;
+		} ;
+		typedef boost::unordered_map< genfile::VariantIdentifyingData, db::Connection::RowId, VariantHash > VariantMap ;
+		mutable VariantMap m_variant_map ;
 	private:
 		void construct_statements() ;
 		void store_metadata() ;
@@ -146,6 +173,13 @@ namespace qcdb {
 		void end_analysis( db::Connection::RowId const ) const ;
 		void add_alternative_variant_identifier( db::Connection::RowId const variant_id, std::string const& identifier, std::string const& rsid ) const ;
 		void add_variant_identifier( db::Connection::RowId const variant_id, std::string const& identifier ) const ;
+		std::string get_variant_match_key( genfile::VariantIdentifyingData const& snp ) const ;
+		// Look up or insert the given SNPs using the VariantBlock temporary table.
+		void resolve_variants(
+			std::vector< genfile::VariantIdentifyingData >::const_iterator const snps,
+			std::vector< std::size_t > const& unresolved,
+			std::vector< db::Connection::RowId >* result
+		) const ;
 	} ;
 }
 
@@ -9,6 +9,8 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <map>
 #include <boost/shared_ptr.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/bimap.hpp>
@@ -69,11 +71,29 @@ namespace qcdb {
 		std::vector< genfile::VariantIdentifyingData > m_snps ;
 		typedef boost::bimap< std::string, std::size_t > VariableMap ;
 		VariableMap m_variables ;
-		typedef std::map< std::pair< std::size_t, std::size_t >, genfile::VariantEntry > ValueMap ;
-		ValueMap m_values ;
+		// Index of the variable expected next; values are usually stored in the same order for each variant.
+		std::size_t m_next_variable ;
+
+		// Values of one variable for the variants in the current block, indexed by variant.
+		// Integer and floating-point values are stored in typed arrays, which are sized once
+		// per block; the rarer string and other values are kept in a map.
+		struct Column {
+			enum ValueType { eMissing = 0, eInteger = 1, eDouble = 2, eOther = 3 } ;
+			std::vector< char > types ;
+			std::vector< genfile::VariantEntry::Integer > integers ;
+			std::vector< double > doubles ;
+			std::map< std::size_t, genfile::VariantEntry > others ;
+
+			void resize( std::size_t size ) ;
+			void clear() ;
+			void set( std::size_t i, genfile::VariantEntry const& value ) ;
+		} ;
+		std::vector< Column > m_columns ;
 
 	private:
 		std::string get_table_name() const ;
+		std::size_t get_variable_index( std::string const& variable, std::string const& caller ) ;
+		void clear_block() ;
 		void store_block() ;
 		void create_schema() ;
 		void store_data_for_variant(
@@ -0,0 +1,200 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cassert>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/exception_ptr.hpp>
+#include "genfile/VariantIdentifyingData.hpp"
+#include "genfile/VariantEntry.hpp"
+#include "genfile/Error.hpp"
+#include "db/Error.hpp"
+#include "qcdb/Storage.hpp"
+#include "qcdb/AsynchronousStorage.hpp"
+
+namespace qcdb {
+	AsynchronousStorage::UniquePtr AsynchronousStorage::create(
+		Storage::SharedPtr storage, std::size_t max_variants_per_block, std::size_t max_blocks_in_flight
+	) {
+		return UniquePtr( new AsynchronousStorage( storage, max_variants_per_block, max_blocks_in_flight ) ) ;
+	}
+
+	AsynchronousStorage::SharedPtr AsynchronousStorage::create_shared(
+		Storage::SharedPtr storage, std::size_t max_variants_per_block, std::size_t max_blocks_in_flight
+	) {
+		return SharedPtr( new AsynchronousStorage( storage, max_variants_per_block, max_blocks_in_flight ) ) ;
+	}
+
+	AsynchronousStorage::AsynchronousStorage(
+		Storage::SharedPtr storage,
+		std::size_t max_variants_per_block,
+		std::size_t max_blocks_in_flight
+	):
+		m_storage( storage ),
+		m_max_variants_per_block( max_variants_per_block ),
+		m_max_blocks_in_flight( max_blocks_in_flight ),
+		m_writing( false ),
+		m_stop( false )
+	{
+		assert( m_storage.get() ) ;
+		assert( m_max_variants_per_block > 0 ) ;
+		assert( m_max_blocks_in_flight > 0 ) ;
+		m_thread.reset( new boost::thread( boost::bind( &AsynchronousStorage::writer_thread_loop, this ))) ;
+	}
+
+	AsynchronousStorage::~AsynchronousStorage() {
+		{
+			ScopedLock lock( m_mutex ) ;
+			m_stop = true ;
+			m_queue_changed.notify_all() ;
+		}
+		m_thread->join() ;
+	}
+
+	void AsynchronousStorage::Block::swap( Block& other ) {
+		snps.swap( other.snps ) ;
+		operations.swap( other.operations ) ;
+	}
+
+	void AsynchronousStorage::Block::clear() {
+		snps.clear() ;
+		operations.clear() ;
+	}
+
+	void AsynchronousStorage::add_variable( std::string const& variable ) {
+		m_block.operations.push_back( Operation( Operation::eAddVariable, 0, variable, genfile::MissingValue() )) ;
+	}
+
+	void AsynchronousStorage::create_new_variant( genfile::VariantIdentifyingData const& snp ) {
+		if( m_block.snps.size() == m_max_variants_per_block ) {
+			submit_block() ;
+		}
+		m_block.snps.push_back( snp ) ;
+		m_block.operations.push_back( Operation( Operation::eCreateNewVariant, m_block.snps.size() - 1, "", genfile::MissingValue() )) ;
+	}
+
+	void AsynchronousStorage::store_per_variant_data(
+		genfile::VariantIdentifyingData const& snp,
+		std::string const& variable,
+		genfile::VariantEntry const& value
+	) {
+		bool const new_snp = m_block.snps.empty() || snp != m_block.snps.back() ;
+		if( new_snp ) {
+			if( m_block.snps.size() == m_max_variants_per_block ) {
+				submit_block() ;
+			}
+			m_block.snps.push_back( snp ) ;
+		}
+		m_block.operations.push_back( Operation( Operation::eStorePerVariantData, m_block.snps.size() - 1, variable, value )) ;
+	}
+
+	void AsynchronousStorage::finalise( long options ) {
+		submit_block() ;
+		wait_until_written() ;
+		// The writer thread is now idle, so it is safe to use the wrapped storage here.
+		m_storage->finalise( options ) ;
+	}
+
+	AsynchronousStorage::AnalysisId AsynchronousStorage::analysis_id() const {
+		return m_storage->analysis_id() ;
+	}
+
+	void AsynchronousStorage::submit_block() {
+		ScopedLock lock( m_mutex ) ;
+		rethrow_error_if_necessary() ;
+		if( m_block.operations.empty() ) {
+			return ;
+		}
+		while( m_queue.size() >= m_max_blocks_in_flight && !m_error ) {
+			m_queue_changed.wait( lock ) ;
+		}
+		rethrow_error_if_necessary() ;
+		m_queue.push_back( Block() ) ;
+		m_queue.back().swap( m_block ) ;
+		m_queue_changed.notify_all() ;
+	}
+
+	void AsynchronousStorage::wait_until_written() {
+		ScopedLock lock( m_mutex ) ;
+		while( ( m_writing || !m_queue.empty() ) && !m_error ) {
+			m_queue_changed.wait( lock ) ;
+		}
+		rethrow_error_if_necessary() ;
+	}
+
+	// Must be called with m_mutex held.
+	void AsynchronousStorage::rethrow_error_if_necessary() {
+		if( m_error ) {
+			boost::exception_ptr error = m_error ;
+			m_error = boost::exception_ptr() ;
+			m_queue.clear() ;
+			boost::rethrow_exception( error ) ;
+		}
+	}
+
+	void AsynchronousStorage::writer_thread_loop() {
+		Block block ;
+		ScopedLock lock( m_mutex ) ;
+		while( true ) {
+			while( m_queue.empty() && !m_stop ) {
+				m_queue_changed.wait( lock ) ;
+			}
+			if( m_queue.empty() ) {
+				// Stopping, and nothing left to write.
+				break ;
+			}
+			block.swap( m_queue.front() ) ;
+			m_queue.pop_front() ;
+			m_writing = true ;
+			// Wake the calling thread, which may be waiting for space in the queue.
+			m_queue_changed.notify_all() ;
+			lock.unlock() ;
+			boost::exception_ptr error ;
+			try {
+				write_block( block ) ;
+			}
+			// Keep the type of errors that are commonly handled by callers.
+			catch( genfile::BadArgumentError const& e ) {
+				error = boost::copy_exception( e ) ;
+			}
+			catch( db::StatementStepError const& e ) {
+				error = boost::copy_exception( e ) ;
+			}
+			catch( ... ) {
+				error = boost::current_exception() ;
+			}
+			block.clear() ;
+			lock.lock() ;
+			m_writing = false ;
+			if( error ) {
+				// Further queued data is discarded; the error is reported to the calling thread.
+				m_error = error ;
+				m_queue.clear() ;
+			}
+			m_queue_changed.notify_all() ;
+		}
+	}
+
+	void AsynchronousStorage::write_block( Block const& block ) {
+		for( std::size_t i = 0; i < block.operations.size(); ++i ) {
+			Operation const& operation = block.operations[i] ;
+			switch( operation.type ) {
+				case Operation::eAddVariable:
+					m_storage->add_variable( operation.variable ) ;
+					break ;
+				case Operation::eCreateNewVariant:
+					m_storage->create_new_variant( block.snps[ operation.snp_index ] ) ;
+					break ;
+				case Operation::eStorePerVariantData:
+					m_storage->store_per_variant_data( block.snps[ operation.snp_index ], operation.variable, operation.value ) ;
+					break ;
+			}
+		}
+	}
+}
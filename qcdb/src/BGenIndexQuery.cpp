@@ -0,0 +1,117 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <cassert>
+#include "genfile/Error.hpp"
+#include "genfile/GenomePositionRange.hpp"
+#include "db/SQLite3Connection.hpp"
+#include "db/SQLStatement.hpp"
+#include "qcdb/BGenIndexQuery.hpp"
+
+namespace qcdb {
+	BGenIndexQuery::UniquePtr BGenIndexQuery::create( std::string const& filename ) {
+		return UniquePtr( new BGenIndexQuery( filename )) ;
+	}
+
+	BGenIndexQuery::BGenIndexQuery( std::string const& filename ):
+		m_filename( filename ),
+		// Open the existing index; do not create it.
+		m_connection( new db::SQLite3Connection( filename, false )),
+		m_have_rsids( false ),
+		m_initialised( false )
+	{
+		m_connection->run_statement( "CREATE TEMP TABLE IF NOT EXISTS tmpIncludedId( identifier TEXT NOT NULL PRIMARY KEY ) WITHOUT ROWID" ) ;
+	}
+
+	BGenIndexQuery& BGenIndexQuery::include_range( genfile::GenomePositionRange const& range ) {
+		assert( !m_initialised ) ;
+		m_ranges.push_back( range ) ;
+		return *this ;
+	}
+
+	BGenIndexQuery& BGenIndexQuery::include_rsids( std::vector< std::string > const& ids ) {
+		assert( !m_initialised ) ;
+		// Only the temporary table is written, so use a deferred transaction; this works
+		// even if the index file itself is read-only.
+		m_connection->run_statement( "BEGIN TRANSACTION" ) ;
+		db::Connection::StatementPtr statement = m_connection->get_statement(
+			"INSERT OR IGNORE INTO tmpIncludedId( identifier ) VALUES( ? )"
+		) ;
+		for( std::size_t i = 0; i < ids.size(); ++i ) {
+			statement
+				->bind( 1, ids[i] )
+				.step() ;
+			statement->reset() ;
+		}
+		statement.reset() ;
+		m_connection->run_statement( "COMMIT" ) ;
+		m_have_rsids = true ;
+		return *this ;
+	}
+
+	void BGenIndexQuery::initialise() {
+		std::string SQL = "SELECT DISTINCT file_start_position, size_in_bytes FROM Variant" ;
+		std::string join = " WHERE " ;
+		if( m_ranges.size() > 0 ) {
+			SQL += join + "(" ;
+			for( std::size_t i = 0; i < m_ranges.size(); ++i ) {
+				SQL += ( i > 0 ? " OR " : "" ) ;
+				if( m_ranges[i].chromosome().is_missing() ) {
+					SQL += "( position BETWEEN ? AND ? )" ;
+				} else {
+					// Variants with no stored chromosome might lie in the range, so include them.
+					SQL += "( chromosome IN ( ?, '' ) AND position BETWEEN ? AND ? )" ;
+				}
+			}
+			SQL += ")" ;
+			join = " AND " ;
+		}
+		if( m_have_rsids ) {
+			SQL += join + "rsid IN ( SELECT identifier FROM tmpIncludedId )" ;
+		}
+		SQL += " ORDER BY file_start_position" ;
+
+		db::Connection::StatementPtr statement = m_connection->get_statement( SQL ) ;
+		std::size_t parameter = 1 ;
+		for( std::size_t i = 0; i < m_ranges.size(); ++i ) {
+			genfile::GenomePositionRange const& range = m_ranges[i] ;
+			if( !range.chromosome().is_missing() ) {
+				statement->bind( parameter++, std::string( range.chromosome() )) ;
+			}
+			statement->bind( parameter++, int64_t( range.start().position() )) ;
+			statement->bind( parameter++, int64_t( range.end().position() )) ;
+		}
+
+		m_positions.clear() ;
+		while( statement->step() ) {
+			m_positions.push_back(
+				FileRange(
+					statement->get< int64_t >( 0 ),
+					statement->get< int64_t >( 1 )
+				)
+			) ;
+		}
+		m_initialised = true ;
+	}
+
+	std::size_t BGenIndexQuery::number_of_variants() const {
+		if( !m_initialised ) {
+			throw genfile::BadArgumentError(
+				"qcdb::BGenIndexQuery::number_of_variants()",
+				"this",
+				"Query on \"" + m_filename + "\" has not been initialised."
+			) ;
+		}
+		return m_positions.size() ;
+	}
+
+	BGenIndexQuery::FileRange BGenIndexQuery::locate_variant( std::size_t index ) const {
+		assert( m_initialised ) ;
+		assert( index < m_positions.size() ) ;
+		return m_positions[ index ] ;
+	}
+}
@@ -0,0 +1,78 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <cstdio>
+#include <boost/filesystem.hpp>
+#include "genfile/VariantIdentifyingData.hpp"
+#include "db/Connection.hpp"
+#include "db/SQLStatement.hpp"
+#include "qcdb/BGenIndexWriter.hpp"
+
+namespace qcdb {
+	BGenIndexWriter::SharedPtr BGenIndexWriter::create_shared( std::string const& filename ) {
+		return SharedPtr( new BGenIndexWriter( filename )) ;
+	}
+
+	namespace impl {
+		std::string const& remove_existing_file( std::string const& filename ) {
+			if( boost::filesystem::exists( filename )) {
+				boost::filesystem::remove( filename ) ;
+			}
+			return filename ;
+		}
+	}
+
+	BGenIndexWriter::BGenIndexWriter( std::string const& filename ):
+		m_connection( db::Connection::create( impl::remove_existing_file( filename )))
+	{
+		m_connection->run_statement( "PRAGMA journal_mode = OFF" ) ;
+		m_connection->run_statement( "PRAGMA synchronous = OFF" ) ;
+		m_connection->run_statement(
+			"CREATE TABLE Variant ("
+			" chromosome TEXT NOT NULL,"
+			" position INT NOT NULL,"
+			" rsid TEXT NOT NULL,"
+			" number_of_alleles INT NOT NULL,"
+			" allele1 TEXT NOT NULL,"
+			" allele2 TEXT NULL,"
+			" file_start_position INT NOT NULL,"
+			" size_in_bytes INT NOT NULL,"
+			" PRIMARY KEY( chromosome, position, rsid, allele1, allele2, file_start_position )"
+			") WITHOUT ROWID"
+		) ;
+		m_transaction = m_connection->open_transaction( 240 ) ;
+		m_insert_variant_statement = m_connection->get_statement(
+			"INSERT INTO Variant( chromosome, position, rsid, number_of_alleles, allele1, allele2, file_start_position, size_in_bytes ) "
+			"VALUES( ?, ?, ?, ?, ?, ?, ?, ? )"
+		) ;
+	}
+
+	BGenIndexWriter::~BGenIndexWriter() {
+		m_insert_variant_statement.reset() ;
+		// Commit the transaction.
+		m_transaction.reset() ;
+	}
+
+	void BGenIndexWriter::add_variant( genfile::VariantIdentifyingData const& variant, int64_t offset, int64_t size ) {
+		genfile::Chromosome const& chromosome = variant.get_position().chromosome() ;
+		m_insert_variant_statement
+			->bind( 1, chromosome.is_missing() ? std::string() : std::string( chromosome ) )
+			.bind( 2, int64_t( variant.get_position().position() ))
+			.bind( 3, variant.get_primary_id() )
+			.bind( 4, int64_t( variant.number_of_alleles() ))
+			.bind( 5, variant.get_allele(0) ) ;
+		if( variant.number_of_alleles() > 1 ) {
+			m_insert_variant_statement->bind( 6, variant.get_allele(1) ) ;
+		} else {
+			m_insert_variant_statement->bind_NULL( 6 ) ;
+		}
+		m_insert_variant_statement
+			->bind( 7, offset )
+			.bind( 8, size )
+			.step() ;
+		m_insert_variant_statement->reset() ;
+	}
+}
@@ -0,0 +1,172 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "genfile/VariantEntry.hpp"
+#include "genfile/VariantIdentifyingData.hpp"
+#include "genfile/Error.hpp"
+#include "genfile/string_utils.hpp"
+#include "statfile/ColumnarFileWriter.hpp"
+#include "appcontext/get_current_time_as_string.hpp"
+#include "qcdb/Storage.hpp"
+#include "qcdb/ColumnarFileOutputter.hpp"
+
+namespace qcdb {
+	namespace {
+		void append_to_string( std::string* target, std::string const& value ) {
+			(*target) += ( target->size() > 0 ? "," : "" ) + value ;
+		}
+
+		enum { eAlternateIds = 0, eRsid = 1, eChromosome = 2, ePosition = 3, eAlleleA = 4, eAlleleB = 5, eNumberOfFixedColumns = 6 } ;
+	}
+
+	ColumnarFileOutputter::UniquePtr ColumnarFileOutputter::create( std::string const& filename, std::string const& analysis_name, Metadata const& metadata ) {
+		return UniquePtr( new ColumnarFileOutputter( filename, analysis_name, metadata ) ) ;
+	}
+
+	ColumnarFileOutputter::SharedPtr ColumnarFileOutputter::create_shared( std::string const& filename, std::string const& analysis_name, Metadata const& metadata ) {
+		return SharedPtr( new ColumnarFileOutputter( filename, analysis_name, metadata ) ) ;
+	}
+
+	ColumnarFileOutputter::ColumnarFileOutputter( std::string const& filename, std::string const& analysis_name, Metadata const& metadata ):
+		m_filename( filename ),
+		m_analysis_name( analysis_name ),
+		m_metadata( metadata ),
+		m_max_snps_per_block( 10000 ),
+		m_writer( statfile::ColumnarFileWriter::create( filename, format_metadata() ) )
+	{
+		m_writer->add_column( "alternate_ids" ) ;
+		m_writer->add_column( "rsid" ) ;
+		m_writer->add_column( "chromosome" ) ;
+		m_writer->add_column( "position" ) ;
+		m_writer->add_column( "alleleA" ) ;
+		m_writer->add_column( "alleleB" ) ;
+		m_values.resize( eNumberOfFixedColumns ) ;
+		m_snps.reserve( m_max_snps_per_block ) ;
+	}
+	
+	ColumnarFileOutputter::~ColumnarFileOutputter() {
+	}
+	
+	void ColumnarFileOutputter::finalise( long ) {
+		store_block() ;
+		m_writer->finalise() ;
+	}
+
+	ColumnarFileOutputter::AnalysisId ColumnarFileOutputter::analysis_id() const {
+		// A columnar file only ever has one analysis.
+		return 0 ;
+	}
+
+	void ColumnarFileOutputter::add_variable(
+		std::string const& variable
+	) {
+		get_or_add_column( variable ) ;
+	}
+
+	void ColumnarFileOutputter::create_new_variant( genfile::VariantIdentifyingData const& snp ) {
+		add_snp( snp ) ;
+	}
+
+	void ColumnarFileOutputter::store_per_variant_data(
+		genfile::VariantIdentifyingData const& snp,
+		std::string const& variable,
+		genfile::VariantEntry const& value
+	) {
+		if( m_snps.empty() || snp != m_snps.back() ) {
+			add_snp( snp ) ;
+		}
+		std::vector< genfile::VariantEntry >& column = m_values[ get_or_add_column( variable ) ] ;
+		// Columns are filled lazily; earlier rows with no value for this variable are missing.
+		column.resize( m_snps.size() ) ;
+		column.back() = value ;
+	}
+
+	std::size_t ColumnarFileOutputter::get_or_add_column( std::string const& variable ) {
+		VariableMap::const_iterator where = m_variables.find( variable ) ;
+		if( where == m_variables.end() ) {
+			where = m_variables.insert( std::make_pair( variable, m_writer->add_column( variable ) ) ).first ;
+			m_values.resize( m_writer->number_of_columns() ) ;
+		}
+		return where->second ;
+	}
+
+	void ColumnarFileOutputter::add_snp( genfile::VariantIdentifyingData const& snp ) {
+		// Start a new block when this one is full or the chromosome changes,
+		// so that each chunk in the file covers a single chromosome.
+		if(
+			m_snps.size() == m_max_snps_per_block
+			|| ( !m_snps.empty() && snp.get_position().chromosome() != m_snps.back().get_position().chromosome() )
+		) {
+			store_block() ;
+		}
+		m_snps.push_back( snp ) ;
+	}
+
+	void ColumnarFileOutputter::store_block() {
+		if( m_snps.empty() ) {
+			return ;
+		}
+		genfile::Position first_position = m_snps[0].get_position().position() ;
+		genfile::Position last_position = first_position ;
+		for( std::size_t i = 0; i < eNumberOfFixedColumns; ++i ) {
+			m_values[i].resize( m_snps.size() ) ;
+		}
+		for( std::size_t snp_i = 0; snp_i < m_snps.size(); ++snp_i ) {
+			genfile::VariantIdentifyingData const& snp = m_snps[ snp_i ] ;
+			genfile::Position const position = snp.get_position().position() ;
+			first_position = std::min( first_position, position ) ;
+			last_position = std::max( last_position, position ) ;
+			std::string SNPID ;
+			if( snp.number_of_identifiers() == 1 ) {
+				SNPID = "NA" ;
+			} else {
+				snp.get_identifiers( boost::bind( &append_to_string, &SNPID, _1 ), 1 ) ;
+			}
+			m_values[ eAlternateIds ][ snp_i ] = SNPID ;
+			m_values[ eRsid ][ snp_i ] = snp.get_primary_id() ;
+			m_values[ eChromosome ][ snp_i ] = std::string( snp.get_position().chromosome() ) ;
+			m_values[ ePosition ][ snp_i ] = int64_t( position ) ;
+			m_values[ eAlleleA ][ snp_i ] = snp.get_allele(0) ;
+			m_values[ eAlleleB ][ snp_i ] = (( snp.number_of_alleles() < 2 ) ? "." : snp.get_alleles_as_string( ",", 1, snp.number_of_alleles() )) ;
+		}
+		// Pad variable columns that were not set for the last rows of the block.
+		for( std::size_t i = eNumberOfFixedColumns; i < m_values.size(); ++i ) {
+			if( !m_values[i].empty() ) {
+				m_values[i].resize( m_snps.size() ) ;
+			}
+		}
+		m_writer->write_chunk(
+			m_snps[0].get_position().chromosome(),
+			first_position, last_position,
+			m_snps.size(),
+			m_values
+		) ;
+		m_snps.clear() ;
+		for( std::size_t i = 0; i < m_values.size(); ++i ) {
+			m_values[i].clear() ;
+		}
+	}
+	
+	std::string ColumnarFileOutputter::format_metadata() const {
+		std::ostringstream str ;
+		str << "Analysis: \"" << m_analysis_name << "\"\n"
+			<< " started: " << appcontext::get_current_time_as_string() << "\n" ;
+		str << "\nAnalysis properties:\n" ;
+		for( Metadata::const_iterator i = m_metadata.begin(); i != m_metadata.end(); ++i ) {
+			str << "  "
+				<< i->first
+				<< " "
+				<< genfile::string_utils::join( i->second.first, " " )
+				<< " (" + i->second.second + ")\n" ;
+		}
+		return str.str() ;
+	}
+}
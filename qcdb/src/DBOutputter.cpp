@@ -6,9 +6,12 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <cassert>
 #include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/thread/thread.hpp>
 #include "genfile/VariantIdentifyingData.hpp"
 #include "genfile/VariantEntry.hpp"
@@ -216,6 +219,56 @@ namespace qcdb {
 		) ;
 		m_find_variant_identifier_statement = m_connection->get_statement( "SELECT * FROM VariantIdentifier WHERE variant_id == ?1 AND identifier == ?2" ) ;
 		m_insert_variant_identifier_statement = m_connection->get_statement( "INSERT INTO VariantIdentifier( variant_id, identifier ) VALUES ( ?1, ?2 )" ) ;
+
+		// Statements used to look up and insert a block of variants at once.
+		// Variants are first put in a temporary table, which is then joined to the Variant table.
+		m_connection->run_statement(
+			"CREATE TEMP TABLE IF NOT EXISTS VariantBlock ( i INTEGER PRIMARY KEY, rsid TEXT, chromosome TEXT, position INTEGER, alleleA TEXT, alleleB TEXT )"
+		) ;
+		m_connection->run_statement(
+			"CREATE TEMP TABLE IF NOT EXISTS VariantIdentifierBlock ( variant_id INTEGER NOT NULL, identifier TEXT )"
+		) ;
+		std::string const match_variant_sql = std::string(
+			"V.chromosome == T.chromosome AND V.position == T.position AND V.alleleA == T.alleleA AND V.alleleB == T.alleleB"
+		) + ( m_match_rsid ? " AND V.rsid == T.rsid" : "" ) ;
+		m_clear_variant_block_statement = m_connection->get_statement( "DELETE FROM VariantBlock" ) ;
+		m_insert_variant_block_statement = m_connection->get_statement(
+			"INSERT INTO VariantBlock ( i, rsid, chromosome, position, alleleA, alleleB ) VALUES( ?1, ?2, ?3, ?4, ?5, ?6 )"
+		) ;
+		{
+			// Rows are put into the VariantBlock table several at a time.
+			std::string sql = "INSERT INTO VariantBlock ( i, rsid, chromosome, position, alleleA, alleleB ) VALUES" ;
+			for( std::size_t row = 0; row < eVariantBlockRowsPerInsert; ++row ) {
+				sql += ( row == 0 ? " (" : ", (" ) ;
+				for( std::size_t column = 0; column < 6; ++column ) {
+					sql += ( column == 0 ? "?" : ", ?" ) + genfile::string_utils::to_string( 6 * row + column + 1 ) ;
+				}
+				sql += ")" ;
+			}
+			m_insert_variant_block_rows_statement = m_connection->get_statement( sql ) ;
+		}
+		m_delete_variant_block_statement = m_connection->get_statement( "DELETE FROM VariantBlock WHERE i == ?1" ) ;
+		// As for m_find_variant_statement, the first matching variant is used.
+		m_find_variant_block_statement = m_connection->get_statement(
+			"SELECT T.i, MIN( V.id ), V.rsid FROM VariantBlock T "
+			"INNER JOIN Variant V ON " + match_variant_sql + " "
+			"GROUP BY T.i"
+		) ;
+		m_insert_new_variants_statement = m_connection->get_statement(
+			"INSERT INTO Variant ( rsid, chromosome, position, alleleA, alleleB ) "
+			"SELECT rsid, chromosome, position, alleleA, alleleB FROM VariantBlock ORDER BY i"
+		) ;
+		m_clear_variant_identifier_block_statement = m_connection->get_statement( "DELETE FROM VariantIdentifierBlock" ) ;
+		m_insert_variant_identifier_block_statement = m_connection->get_statement(
+			"INSERT INTO VariantIdentifierBlock ( variant_id, identifier ) VALUES( ?1, ?2 )"
+		) ;
+		m_insert_new_variant_identifiers_statement = m_connection->get_statement(
+			"INSERT INTO VariantIdentifier ( variant_id, identifier ) "
+			"SELECT variant_id, identifier FROM VariantIdentifierBlock T "
+			"WHERE NOT EXISTS ( SELECT 1 FROM VariantIdentifier VI WHERE VI.variant_id == T.variant_id AND VI.identifier == T.identifier ) "
+			"GROUP BY variant_id, identifier "
+			"ORDER BY MIN( T.rowid )"
+		) ;
 	}
 
 	void DBOutputter::store_metadata() {
@@ -503,5 +556,190 @@ namespace qcdb {
 		m_find_variant_statement->reset() ;
 		return result ;
 	}
-	
+
+	namespace {
+		void bind_variant_block_row( db::SQLStatement& statement, std::size_t const offset, std::size_t const i, genfile::VariantIdentifyingData const& snp ) {
+			statement
+				.bind( offset + 1, int64_t( i ) )
+				.bind( offset + 2, snp.get_primary_id() )
+				.bind( offset + 3, std::string( snp.get_position().chromosome() ) )
+				.bind( offset + 4, snp.get_position().position() )
+				.bind( offset + 5, snp.get_allele(0) )
+				.bind( offset + 6, snp.get_allele(1) ) ;
+		}
+	}
+
+	std::size_t DBOutputter::VariantHash::operator()( genfile::VariantIdentifyingData const& snp ) const {
+		genfile::string_utils::slice const rsid = snp.get_primary_id() ;
+		genfile::string_utils::slice const alleleA = snp.get_allele(0) ;
+		genfile::string_utils::slice const alleleB = snp.get_allele(1) ;
+		std::size_t result = boost::hash_range( rsid.begin(), rsid.end() ) ;
+		boost::hash_combine( result, snp.get_position().position() ) ;
+		boost::hash_range( result, alleleA.begin(), alleleA.end() ) ;
+		boost::hash_range( result, alleleB.begin(), alleleB.end() ) ;
+		return result ;
+	}
+
+	std::string DBOutputter::get_variant_match_key( genfile::VariantIdentifyingData const& snp ) const {
+		// The position is appended in binary to avoid formatting it.
+		genfile::Position const position = snp.get_position().position() ;
+		genfile::string_utils::slice const alleleA = snp.get_allele(0) ;
+		genfile::string_utils::slice const alleleB = snp.get_allele(1) ;
+		std::string result = snp.get_position().chromosome() ;
+		result.push_back( '\t' ) ;
+		result.append( reinterpret_cast< char const* >( &position ), sizeof( position ) ) ;
+		result.append( alleleA.begin(), alleleA.end() ) ;
+		result.push_back( '\t' ) ;
+		result.append( alleleB.begin(), alleleB.end() ) ;
+		if( m_match_rsid ) {
+			result.push_back( '\t' ) ;
+			genfile::string_utils::slice const rsid = snp.get_primary_id() ;
+			result.append( rsid.begin(), rsid.end() ) ;
+		}
+		return result ;
+	}
+
+	void DBOutputter::get_or_create_variants(
+		std::vector< genfile::VariantIdentifyingData >::const_iterator const snps,
+		std::vector< genfile::VariantIdentifyingData >::const_iterator const end,
+		std::vector< db::Connection::RowId >* result
+	) const {
+		assert( result ) ;
+		std::size_t const number_of_snps = end - snps ;
+		result->resize( number_of_snps ) ;
+
+		// Use remembered ids where possible.  A variant seen before with the same identifiers
+		// has nothing more to be stored for it.
+		std::vector< std::size_t > unresolved ;
+		for( std::size_t i = 0; i < number_of_snps; ++i ) {
+			if( snps[i].get_position().chromosome().is_missing() ) {
+				// A missing chromosome never matches an existing variant; handle these singly,
+				// after the variants before them so that ids are assigned in order.
+				resolve_variants( snps, unresolved, result ) ;
+				unresolved.clear() ;
+				(*result)[i] = get_or_create_variant( snps[i] ) ;
+				continue ;
+			}
+			VariantMap::const_iterator where = m_variant_map.find( snps[i] ) ;
+			if( where == m_variant_map.end() ) {
+				unresolved.push_back( i ) ;
+			} else {
+				(*result)[i] = where->second ;
+			}
+		}
+		resolve_variants( snps, unresolved, result ) ;
+	}
+
+	void DBOutputter::resolve_variants(
+		std::vector< genfile::VariantIdentifyingData >::const_iterator const snps,
+		std::vector< std::size_t > const& unresolved,
+		std::vector< db::Connection::RowId >* result
+	) const {
+		if( unresolved.empty() ) {
+			return ;
+		}
+
+		// Put each distinct variant into the VariantBlock table once.
+		std::vector< std::size_t > distinct ;
+		std::vector< std::size_t > which( unresolved.size() ) ;
+		{
+			boost::unordered_map< std::string, std::size_t > seen ;
+			for( std::size_t k = 0; k < unresolved.size(); ++k ) {
+				genfile::VariantIdentifyingData const& snp = snps[ unresolved[k] ] ;
+				std::pair< boost::unordered_map< std::string, std::size_t >::iterator, bool > const inserted
+					= seen.insert( std::make_pair( get_variant_match_key( snp ), distinct.size() )) ;
+				if( inserted.second ) {
+					distinct.push_back( unresolved[k] ) ;
+				}
+				which[k] = inserted.first->second ;
+			}
+		}
+
+		m_clear_variant_block_statement->step() ;
+		m_clear_variant_block_statement->reset() ;
+		{
+			std::size_t d = 0 ;
+			for( ; d + eVariantBlockRowsPerInsert <= distinct.size(); d += eVariantBlockRowsPerInsert ) {
+				for( std::size_t row = 0; row < eVariantBlockRowsPerInsert; ++row ) {
+					bind_variant_block_row( *m_insert_variant_block_rows_statement, 6 * row, d + row, snps[ distinct[ d + row ] ] ) ;
+				}
+				m_insert_variant_block_rows_statement->step() ;
+				m_insert_variant_block_rows_statement->reset() ;
+			}
+			for( ; d < distinct.size(); ++d ) {
+				bind_variant_block_row( *m_insert_variant_block_statement, 0, d, snps[ distinct[d] ] ) ;
+				m_insert_variant_block_statement->step() ;
+				m_insert_variant_block_statement->reset() ;
+			}
+		}
+
+		// Look up the variants already stored...
+		std::vector< db::Connection::RowId > ids( distinct.size() ) ;
+		std::vector< std::string > rsids( distinct.size() ) ;
+		std::vector< bool > found( distinct.size(), false ) ;
+		std::size_t number_found = 0 ;
+		for( m_find_variant_block_statement->step(); !m_find_variant_block_statement->empty(); m_find_variant_block_statement->step() ) {
+			std::size_t const d = m_find_variant_block_statement->get< int64_t >( 0 ) ;
+			assert( d < distinct.size() ) ;
+			ids[d] = m_find_variant_block_statement->get< db::Connection::RowId >( 1 ) ;
+			rsids[d] = m_find_variant_block_statement->get< std::string >( 2 ) ;
+			found[d] = true ;
+			++number_found ;
+		}
+		m_find_variant_block_statement->reset() ;
+
+		// ...and insert the rest in one statement.  Variant ids are assigned in increasing order,
+		// so the new variants take the ids ending at the last inserted row id.
+		if( number_found < distinct.size() ) {
+			for( std::size_t d = 0; d < distinct.size(); ++d ) {
+				if( found[d] ) {
+					m_delete_variant_block_statement->bind( 1, int64_t( d ) ).step() ;
+					m_delete_variant_block_statement->reset() ;
+				}
+			}
+			m_insert_new_variants_statement->step() ;
+			m_insert_new_variants_statement->reset() ;
+			db::Connection::RowId id = m_connection->get_last_insert_row_id() - db::Connection::RowId( distinct.size() - number_found ) ;
+			for( std::size_t d = 0; d < distinct.size(); ++d ) {
+				if( !found[d] ) {
+					ids[d] = ++id ;
+					rsids[d] = snps[ distinct[d] ].get_primary_id() ;
+				}
+			}
+		}
+
+		// Store any identifiers not already recorded for each variant.  For a new variant the
+		// stored rsid is its primary id, so this covers both cases in get_or_create_variant().
+		m_clear_variant_identifier_block_statement->step() ;
+		m_clear_variant_identifier_block_statement->reset() ;
+		bool have_identifiers = false ;
+		for( std::size_t k = 0; k < unresolved.size(); ++k ) {
+			std::size_t const i = unresolved[k] ;
+			(*result)[i] = ids[ which[k] ] ;
+			std::vector< genfile::string_utils::slice > const identifiers = snps[i].get_identifiers() ;
+			for( std::size_t j = 0; j < identifiers.size(); ++j ) {
+				std::string const identifier = identifiers[j] ;
+				if( identifier != rsids[ which[k] ] && identifier != "---" && identifier != "." ) {
+					m_insert_variant_identifier_block_statement
+						->bind( 1, (*result)[i] )
+						.bind( 2, identifier )
+						.step() ;
+					m_insert_variant_identifier_block_statement->reset() ;
+					have_identifiers = true ;
+				}
+			}
+		}
+		if( have_identifiers ) {
+			m_insert_new_variant_identifiers_statement->step() ;
+			m_insert_new_variant_identifiers_statement->reset() ;
+		}
+
+		// Remember these variants, within reason.
+		if( m_variant_map.size() + unresolved.size() > 100000 ) {
+			m_variant_map.clear() ;
+		}
+		for( std::size_t k = 0; k < unresolved.size(); ++k ) {
+			m_variant_map[ snps[ unresolved[k] ] ] = (*result)[ unresolved[k] ] ;
+		}
+	}
 }
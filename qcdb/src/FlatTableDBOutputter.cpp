@@ -6,6 +6,9 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/thread/thread.hpp>
@@ -44,8 +47,11 @@ namespace qcdb {
 	):
 		m_outputter( filename, analysis_name, analysis_description, metadata, boost::optional< db::Connection::RowId >(), snp_match_fields ),
 		m_table_name( "Analysis" + genfile::string_utils::to_string( m_outputter.analysis_id() ) ),
-		m_max_snps_per_block( 1000 )
-	{}
+		m_max_snps_per_block( 1000 ),
+		m_next_variable( 0 )
+	{
+		m_snps.reserve( m_max_snps_per_block ) ;
+	}
 
 	FlatTableDBOutputter::~FlatTableDBOutputter() {
 	}
@@ -63,8 +69,7 @@ namespace qcdb {
 
 	void FlatTableDBOutputter::finalise( long options ) {
 		store_block() ;
-		m_snps.clear() ;
-		m_values.clear() ;
+		clear_block() ;
 
 		if( options & eCreateIndices ) {
 			db::Connection::ScopedTransactionPtr transaction = m_outputter.connection().open_transaction( 7200 ) ;
@@ -75,25 +80,39 @@ namespace qcdb {
 	}
 
 	void FlatTableDBOutputter::add_variable( std::string const& variable ) {
-		VariableMap::left_const_iterator where = m_variables.left.find( variable ) ;
-		if( where == m_variables.left.end() ) {
-			if( m_insert_data_sql.get() ) {
-				// Uh-oh, table columns are already fixed.
-				// TODO: alter to put this data in SummaryData table?
-				throw genfile::BadArgumentError( "qcdb::FlatTableDBOutputter::add_variable()", "variable=\"" + variable + "\"" ) ;
-			}
-			else {
-				// Still have time to add the variable to our list of variables, retaining the order of addition.
-				m_variables.left.insert( VariableMap::left_value_type( variable, m_variables.size() ) ) ;
+		get_variable_index( variable, "qcdb::FlatTableDBOutputter::add_variable()" ) ;
+	}
+
+	std::size_t FlatTableDBOutputter::get_variable_index( std::string const& variable, std::string const& caller ) {
+		VariableMap::right_const_iterator expected = m_variables.right.find( m_next_variable ) ;
+		std::size_t index = 0 ;
+		if( expected != m_variables.right.end() && expected->second == variable ) {
+			index = m_next_variable ;
+		} else {
+			VariableMap::left_const_iterator where = m_variables.left.find( variable ) ;
+			if( where == m_variables.left.end() ) {
+				if( m_insert_data_sql.get() ) {
+					// Uh-oh, table columns are already fixed.
+					// TODO: alter to put this data in SummaryData table?
+					throw genfile::BadArgumentError( caller, "variable=\"" + variable + "\"" ) ;
+				}
+				else {
+					// Still have time to add the variable to our list of variables, retaining the order of addition.
+					where = m_variables.left.insert( VariableMap::left_value_type( variable, m_variables.size() ) ).first ;
+					m_columns.push_back( Column() ) ;
+					m_columns.back().resize( m_max_snps_per_block ) ;
+				}
 			}
+			index = where->second ;
 		}
+		m_next_variable = ( index + 1 ) % m_variables.size() ;
+		return index ;
 	}
 
 	void FlatTableDBOutputter::create_new_variant( genfile::VariantIdentifyingData const& snp ) {
 		if( m_snps.size() == m_max_snps_per_block ) {
 			store_block() ;
-			m_snps.clear() ;
-			m_values.clear() ;
+			clear_block() ;
 		}
 		m_snps.push_back( snp ) ;
 	}
@@ -108,27 +127,50 @@ namespace qcdb {
 			// If we have a whole block's worth of data, store it now.
 			if( m_snps.size() == m_max_snps_per_block ) {
 				store_block() ;
-				m_snps.clear() ;
-				m_values.clear() ;
+				clear_block() ;
 			}
 			m_snps.push_back( snp ) ;
 		}
 
-		VariableMap::left_const_iterator where = m_variables.left.find( variable ) ;
-		if( where == m_variables.left.end() ) {
-			if( m_insert_data_sql.get() ) {
-				// Uh-oh, table columns are already fixed.
-				// TODO: alter to put this data in SummaryData table?
-				throw genfile::BadArgumentError( "qcdb::FlatTableDBOutputter::store_per_variant_data()", "variable=\"" + variable + "\"" ) ;
-			}
-			else {
-				// Still have time to add the variable to our list of variables, retaining the order of addition.
-				where = m_variables.left.insert( VariableMap::left_value_type( variable, m_variables.size() ) ).first ;
-			}
+		// Store the value of this variable
+		std::size_t const variable_i = get_variable_index( variable, "qcdb::FlatTableDBOutputter::store_per_variant_data()" ) ;
+		m_columns[ variable_i ].set( m_snps.size() - 1, value ) ;
+	}
+
+	void FlatTableDBOutputter::clear_block() {
+		m_snps.clear() ;
+		for( std::size_t i = 0; i < m_columns.size(); ++i ) {
+			m_columns[i].clear() ;
 		}
+	}
 
-		// Store the value of this variable
-		m_values[ std::make_pair( m_snps.size() - 1, where->second ) ] = value ;
+	void FlatTableDBOutputter::Column::resize( std::size_t size ) {
+		types.resize( size, eMissing ) ;
+		integers.resize( size ) ;
+		doubles.resize( size ) ;
+	}
+
+	void FlatTableDBOutputter::Column::clear() {
+		std::fill( types.begin(), types.end(), char( eMissing ) ) ;
+		others.clear() ;
+	}
+
+	void FlatTableDBOutputter::Column::set( std::size_t i, genfile::VariantEntry const& value ) {
+		if( types[i] == eOther ) {
+			others.erase( i ) ;
+		}
+		if( value.is_missing() ) {
+			types[i] = eMissing ;
+		} else if( value.is_double() ) {
+			types[i] = eDouble ;
+			doubles[i] = value.as< double >() ;
+		} else if( value.is_int() ) {
+			types[i] = eInteger ;
+			integers[i] = value.as< genfile::VariantEntry::Integer >() ;
+		} else {
+			types[i] = eOther ;
+			others[i] = value ;
+		}
 	}
 
 	void FlatTableDBOutputter::store_block() {
@@ -138,9 +180,10 @@ namespace qcdb {
 			create_schema() ;
 			create_variables() ;
 		}
+		std::vector< db::Connection::RowId > variant_ids ;
+		m_outputter.get_or_create_variants( m_snps.begin(), m_snps.end(), &variant_ids ) ;
 		for( std::size_t i = 0; i < m_snps.size(); ++i ) {
-			db::Connection::RowId const variant_id = m_outputter.get_or_create_variant( m_snps[i] ) ;
-			store_data_for_variant( i, m_snps[i], m_outputter.analysis_id(), variant_id ) ;
+			store_data_for_variant( i, m_snps[i], m_outputter.analysis_id(), variant_ids[i] ) ;
 		}
 	}
 
@@ -251,11 +294,20 @@ namespace qcdb {
 			end_var_i = m_variables.right.end() ;
 		
 		for( std::size_t bind_i = 5; var_i != end_var_i; ++var_i, ++bind_i ) {
-			ValueMap::const_iterator where = m_values.find( std::make_pair( snp_i, var_i->first )) ;
-			if( where == m_values.end() ) {
-				m_insert_data_sql->bind( bind_i, genfile::MissingValue() ) ;
-			} else {
-				m_insert_data_sql->bind( bind_i, where->second ) ;
+			Column const& column = m_columns[ var_i->first ] ;
+			switch( column.types[ snp_i ] ) {
+				case Column::eMissing:
+					m_insert_data_sql->bind_NULL( bind_i ) ;
+					break ;
+				case Column::eInteger:
+					m_insert_data_sql->bind( bind_i, column.integers[ snp_i ] ) ;
+					break ;
+				case Column::eDouble:
+					m_insert_data_sql->bind( bind_i, column.doubles[ snp_i ] ) ;
+					break ;
+				default:
+					m_insert_data_sql->bind( bind_i, column.others.find( snp_i )->second ) ;
+					break ;
 			}
 		}
 		
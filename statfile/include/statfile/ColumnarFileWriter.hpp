@@ -0,0 +1,69 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef STATFILE_COLUMNAR_FILE_WRITER_HPP
+#define STATFILE_COLUMNAR_FILE_WRITER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include "genfile/types.hpp"
+#include "genfile/Chromosome.hpp"
+#include "genfile/GenomePosition.hpp"
+#include "genfile/VariantEntry.hpp"
+#include "genfile/zlib.hpp"
+#include "statfile/columnar_format.hpp"
+
+namespace statfile {
+	// Class ColumnarFileWriter writes a columnar stat file (see columnar_format.hpp) one chunk of rows at a time.
+	// Columns can be added at any point; chunks written before a column was added read as missing for that column.
+	// The footer is written by finalise(); a file that was not finalised cannot be read.
+	struct ColumnarFileWriter: public boost::noncopyable {
+		typedef std::auto_ptr< ColumnarFileWriter > UniquePtr ;
+		static UniquePtr create( std::string const& filename, std::string const& descriptive_text, int const compression_level = 3 ) ;
+
+		ColumnarFileWriter( std::string const& filename, std::string const& descriptive_text, int const compression_level = 3 ) ;
+		~ColumnarFileWriter() ;
+
+		// Add a column, returning its index.
+		std::size_t add_column( std::string const& name ) ;
+		std::size_t number_of_columns() const { return m_column_names.size() ; }
+		std::vector< std::string > const& column_names() const { return m_column_names ; }
+
+		// Write a chunk of rows lying on the given chromosome between the given positions.
+		// values[i] holds the values of column i, one per row, or is empty if the column has no values in this chunk.
+		void write_chunk(
+			genfile::Chromosome const& chromosome,
+			genfile::Position const first_position,
+			genfile::Position const last_position,
+			std::size_t const number_of_rows,
+			std::vector< std::vector< genfile::VariantEntry > > const& values
+		) ;
+
+		// Write the footer and close the file.
+		void finalise() ;
+
+	private:
+		std::string const m_filename ;
+		std::string const m_descriptive_text ;
+		int const m_compression_level ;
+		std::ofstream m_stream ;
+		uint64_t m_offset ;
+		std::vector< std::string > m_column_names ;
+		std::vector< columnar::ChunkIndex > m_chunks ;
+		ZSTD_CCtx* m_zstd_context ;
+		std::vector< genfile::byte_t > m_buffer ;
+		std::vector< genfile::byte_t > m_compressed_buffer ;
+		bool m_finalised ;
+
+	private:
+		void write( std::vector< genfile::byte_t > const& buffer ) ;
+	} ;
+}
+
+#endif
@@ -0,0 +1,83 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef STATFILE_COLUMNAR_STAT_SOURCE_HPP
+#define STATFILE_COLUMNAR_STAT_SOURCE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "genfile/types.hpp"
+#include "genfile/GenomePositionRange.hpp"
+#include "statfile/StatSource.hpp"
+#include "statfile/BuiltInTypeStatSource.hpp"
+#include "statfile/columnar_format.hpp"
+
+namespace statfile {
+	// Class ColumnarStatSource reads files written by ColumnarFileWriter.
+	// Rows can be read through the usual StatSource interface; in addition, single columns
+	// can be loaded with read_column(), which decompresses only that column of each chunk.
+	// Missing values read as "NA" for strings and NaN for doubles.
+	class ColumnarStatSource: public ColumnNamingStatSource< BuiltInTypeStatSource >
+	{
+		typedef ColumnNamingStatSource< BuiltInTypeStatSource > Base ;
+	public:
+		ColumnarStatSource( std::string const& filename ) ;
+
+		void reset_to_start() ;
+		operator bool() const ;
+		OptionalCount number_of_rows() const { return m_number_of_rows ; }
+		std::string get_descriptive_text() const { return m_descriptive_text ; }
+		std::string get_source_spec() const { return m_filename ; }
+
+	public:
+		std::size_t number_of_chunks() const { return m_chunks.size() ; }
+		columnar::ChunkIndex const& get_chunk( std::size_t chunk_i ) const ;
+		// Return the indices of chunks that may contain rows in the given range.
+		std::vector< std::size_t > find_chunks( genfile::GenomePositionRange const& range ) const ;
+
+		// Read the values of the named column from all chunks, or from the given chunks.
+		void read_column( std::string const& name, std::vector< double >* result ) ;
+		void read_column( std::string const& name, std::vector< std::string >* result ) ;
+		void read_column( std::string const& name, std::vector< std::size_t > const& chunks, std::vector< double >* result ) ;
+		void read_column( std::string const& name, std::vector< std::size_t > const& chunks, std::vector< std::string >* result ) ;
+		// Read the values of a column from one chunk.
+		void read_column( std::size_t const column_i, std::size_t const chunk_i, columnar::ColumnData* result ) ;
+
+	protected:
+		using Base::read_value ;
+		void read_value( int32_t& ) ;
+		void read_value( uint32_t& ) ;
+		void read_value( std::string& ) ;
+		void read_value( double& ) ;
+		void ignore_value() ;
+		void ignore_all() ;
+		void move_to_next_row_impl() ;
+		void restart_row() ;
+
+	private:
+		std::string const m_filename ;
+		std::ifstream m_stream ;
+		std::string m_descriptive_text ;
+		std::vector< columnar::ChunkIndex > m_chunks ;
+		OptionalCount m_number_of_rows ;
+		// State for reading rows.
+		std::size_t m_chunk_i ;
+		std::size_t m_row_i ;
+		std::vector< columnar::ColumnData > m_chunk_data ;
+		std::vector< genfile::byte_t > m_buffer ;
+		std::vector< genfile::byte_t > m_uncompressed_buffer ;
+
+	private:
+		void read_footer() ;
+		void load_chunk() ;
+		void read_bytes( uint64_t const offset, std::size_t const size, std::vector< genfile::byte_t >* result ) ;
+		void get_all_chunks( std::vector< std::size_t >* result ) const ;
+		int64_t get_integer_value() ;
+	} ;
+}
+
+#endif
@@ -0,0 +1,99 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef STATFILE_COLUMNAR_FORMAT_HPP
+#define STATFILE_COLUMNAR_FORMAT_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "genfile/types.hpp"
+#include "genfile/Chromosome.hpp"
+#include "genfile/GenomePosition.hpp"
+#include "genfile/VariantEntry.hpp"
+
+// Definitions shared by ColumnarStatSink and ColumnarStatSource.
+//
+// A columnar stat file holds rows of values, grouped into chunks.  Each column of a chunk is
+// encoded according to its type in that chunk and compressed separately with zstd, so a reader
+// can load one column without touching the rest.  The file layout is:
+//   "qcol", version (uint32)
+//   compressed column data for each chunk
+//   footer: descriptive text, column names, and for each chunk its number of rows, the chromosome
+//     and range of positions it covers, and the type and location of each of its columns
+//   footer offset (uint64), "qcol"
+// All integers are little-endian; strings are stored as a uint32 length followed by the bytes.
+namespace statfile {
+	namespace columnar {
+		extern char const* const magic ;
+		uint32_t const version = 1 ;
+
+		enum ColumnType { eMissing = 0, eInteger = 1, eDouble = 2, eString = 3 } ;
+
+		// The values of one column of one chunk.
+		// For each row, missing[i] is nonzero if the value is missing; otherwise the value is held
+		// in integers, doubles or strings according to type.
+		struct ColumnData {
+			ColumnData(): type( eMissing ) {}
+			ColumnType type ;
+			std::vector< char > missing ;
+			std::vector< int64_t > integers ;
+			std::vector< double > doubles ;
+			std::vector< std::string > strings ;
+		} ;
+
+		struct ColumnLocation {
+			ColumnLocation(): type( eMissing ), offset( 0 ), compressed_size( 0 ), uncompressed_size( 0 ) {}
+			ColumnType type ;
+			uint64_t offset ;
+			uint32_t compressed_size ;
+			uint32_t uncompressed_size ;
+		} ;
+
+		struct ChunkIndex {
+			ChunkIndex(): number_of_rows( 0 ), first_position( 0 ), last_position( 0 ) {}
+			uint32_t number_of_rows ;
+			// All rows of a chunk lie on one chromosome, in the given range of positions.
+			genfile::Chromosome chromosome ;
+			genfile::Position first_position ;
+			genfile::Position last_position ;
+			// One location for each column known when the chunk was written.
+			std::vector< ColumnLocation > columns ;
+		} ;
+
+		// Return the narrowest type that can hold all the given values.
+		ColumnType get_column_type( std::vector< genfile::VariantEntry > const& values ) ;
+
+		// Encode values as a column of the given type, appending the result to buffer.
+		void encode_column( std::vector< genfile::VariantEntry > const& values, ColumnType const type, std::vector< genfile::byte_t >* buffer ) ;
+
+		// Decode a column of the given type and number of rows from the given buffer.
+		void decode_column(
+			genfile::byte_t const* begin,
+			genfile::byte_t const* const end,
+			ColumnType const type,
+			std::size_t const number_of_rows,
+			ColumnData* result
+		) ;
+
+		void encode_footer(
+			std::string const& descriptive_text,
+			std::vector< std::string > const& column_names,
+			std::vector< ChunkIndex > const& chunks,
+			std::vector< genfile::byte_t >* buffer
+		) ;
+
+		void decode_footer(
+			genfile::byte_t const* begin,
+			genfile::byte_t const* const end,
+			std::string* descriptive_text,
+			std::vector< std::string >* column_names,
+			std::vector< ChunkIndex >* chunks
+		) ;
+	}
+}
+
+#endif
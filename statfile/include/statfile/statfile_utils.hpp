@@ -19,7 +19,8 @@ namespace statfile {
 		e_UnknownFormat = 0,
 		e_SpaceDelimited = 1,					// Readable by R's read.table( <filename>, header = T )
 		e_CommaDelimitedFormat = 2,		// CSV format, same number of column headers as columns.
-		e_TabDelimitedFormat = 3		// Tab-delimited format, same number of column headers as columns.
+		e_TabDelimitedFormat = 3,		// Tab-delimited format, same number of column headers as columns.
+		e_ColumnarFormat = 4			// Chunked, compressed binary columns; see columnar_format.hpp.
 	} ;
 
 	struct MapValueSetter
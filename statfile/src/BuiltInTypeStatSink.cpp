@@ -24,6 +24,10 @@ namespace statfile {
 		else if( format == statfile::e_SpaceDelimited ) {
 			result.reset( new statfile::DelimitedStatSink( filename, " " ) ) ;
 		}
+		else if( format == statfile::e_ColumnarFormat ) {
+			// Columnar files are written in chunks by ColumnarFileWriter, not row-by-row.
+			throw FormatUnsupportedError() ;
+		}
 		else {
 			// default to tab-separated format.
 			result.reset( new statfile::DelimitedStatSink( filename, "\t" ) ) ;
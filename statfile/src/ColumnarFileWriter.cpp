@@ -0,0 +1,113 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cassert>
+#include "genfile/types.hpp"
+#include "genfile/Error.hpp"
+#include "genfile/endianness_utils.hpp"
+#include "genfile/zlib.hpp"
+#include "statfile/columnar_format.hpp"
+#include "statfile/ColumnarFileWriter.hpp"
+
+namespace statfile {
+	ColumnarFileWriter::UniquePtr ColumnarFileWriter::create( std::string const& filename, std::string const& descriptive_text, int const compression_level ) {
+		return UniquePtr( new ColumnarFileWriter( filename, descriptive_text, compression_level )) ;
+	}
+
+	ColumnarFileWriter::ColumnarFileWriter( std::string const& filename, std::string const& descriptive_text, int const compression_level ):
+		m_filename( filename ),
+		m_descriptive_text( descriptive_text ),
+		m_compression_level( compression_level ),
+		m_stream( filename.c_str(), std::ios::binary | std::ios::trunc ),
+		m_offset( 0 ),
+		m_zstd_context( ZSTD_createCCtx() ),
+		m_finalised( false )
+	{
+		if( !m_stream ) {
+			ZSTD_freeCCtx( m_zstd_context ) ;
+			throw genfile::ResourceNotOpenedError( m_filename ) ;
+		}
+		m_buffer.assign( columnar::magic, columnar::magic + 4 ) ;
+		m_buffer.resize( 8 ) ;
+		genfile::write_little_endian_integer( &m_buffer[0] + 4, &m_buffer[0] + 8, columnar::version ) ;
+		write( m_buffer ) ;
+	}
+
+	ColumnarFileWriter::~ColumnarFileWriter() {
+		ZSTD_freeCCtx( m_zstd_context ) ;
+	}
+
+	std::size_t ColumnarFileWriter::add_column( std::string const& name ) {
+		assert( !m_finalised ) ;
+		m_column_names.push_back( name ) ;
+		return m_column_names.size() - 1 ;
+	}
+
+	void ColumnarFileWriter::write_chunk(
+		genfile::Chromosome const& chromosome,
+		genfile::Position const first_position,
+		genfile::Position const last_position,
+		std::size_t const number_of_rows,
+		std::vector< std::vector< genfile::VariantEntry > > const& values
+	) {
+		assert( !m_finalised ) ;
+		assert( values.size() <= m_column_names.size() ) ;
+		if( number_of_rows == 0 ) {
+			return ;
+		}
+		columnar::ChunkIndex chunk ;
+		chunk.number_of_rows = number_of_rows ;
+		chunk.chromosome = chromosome ;
+		chunk.first_position = first_position ;
+		chunk.last_position = last_position ;
+		chunk.columns.resize( m_column_names.size() ) ;
+		for( std::size_t i = 0; i < values.size(); ++i ) {
+			assert( values[i].empty() || values[i].size() == number_of_rows ) ;
+			columnar::ColumnLocation& column = chunk.columns[i] ;
+			column.type = columnar::get_column_type( values[i] ) ;
+			if( column.type != columnar::eMissing ) {
+				m_buffer.clear() ;
+				columnar::encode_column( values[i], column.type, &m_buffer ) ;
+				genfile::zstd_compress( m_zstd_context, &m_buffer[0], &m_buffer[0] + m_buffer.size(), &m_compressed_buffer, 0, m_compression_level ) ;
+				column.offset = m_offset ;
+				column.compressed_size = m_compressed_buffer.size() ;
+				column.uncompressed_size = m_buffer.size() ;
+				write( m_compressed_buffer ) ;
+			}
+		}
+		m_chunks.push_back( chunk ) ;
+	}
+
+	void ColumnarFileWriter::finalise() {
+		assert( !m_finalised ) ;
+		uint64_t const footer_offset = m_offset ;
+		m_buffer.clear() ;
+		columnar::encode_footer( m_descriptive_text, m_column_names, m_chunks, &m_buffer ) ;
+		std::size_t const size = m_buffer.size() ;
+		m_buffer.resize( size + 12 ) ;
+		genfile::write_little_endian_integer( &m_buffer[0] + size, &m_buffer[0] + size + 8, footer_offset ) ;
+		std::copy( columnar::magic, columnar::magic + 4, m_buffer.begin() + size + 8 ) ;
+		write( m_buffer ) ;
+		m_stream.close() ;
+		if( !m_stream ) {
+			throw genfile::OperationFailedError( "statfile::ColumnarFileWriter::finalise()", m_filename, "close" ) ;
+		}
+		m_finalised = true ;
+	}
+
+	void ColumnarFileWriter::write( std::vector< genfile::byte_t > const& buffer ) {
+		m_stream.write( reinterpret_cast< char const* >( &buffer[0] ), buffer.size() ) ;
+		if( !m_stream ) {
+			throw genfile::OperationFailedError( "statfile::ColumnarFileWriter::write()", m_filename, "write" ) ;
+		}
+		m_offset += buffer.size() ;
+	}
+}
@@ -0,0 +1,312 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include "genfile/types.hpp"
+#include "genfile/Error.hpp"
+#include "genfile/endianness_utils.hpp"
+#include "genfile/zlib.hpp"
+#include "genfile/string_utils/string_utils.hpp"
+#include "statfile/statfile_utils.hpp"
+#include "statfile/columnar_format.hpp"
+#include "statfile/ColumnarStatSource.hpp"
+
+namespace statfile {
+	namespace {
+		std::string format_double( double const value ) {
+			if( value == std::numeric_limits< double >::infinity() ) {
+				return "inf" ;
+			}
+			std::ostringstream ostr ;
+			ostr << std::setprecision( std::numeric_limits< double >::digits10 + 2 ) << value ;
+			return ostr.str() ;
+		}
+
+		void append_values( columnar::ColumnData const& data, std::vector< double >* result ) {
+			for( std::size_t i = 0; i < data.missing.size(); ++i ) {
+				if( data.missing[i] || ( data.type == columnar::eString && data.strings[i] == "NA" )) {
+					result->push_back( std::numeric_limits< double >::quiet_NaN() ) ;
+				} else if( data.type == columnar::eInteger ) {
+					result->push_back( double( data.integers[i] )) ;
+				} else if( data.type == columnar::eDouble ) {
+					result->push_back( data.doubles[i] ) ;
+				} else {
+					result->push_back( genfile::string_utils::to_repr< double >( data.strings[i] )) ;
+				}
+			}
+		}
+
+		void append_values( columnar::ColumnData const& data, std::vector< std::string >* result ) {
+			for( std::size_t i = 0; i < data.missing.size(); ++i ) {
+				if( data.missing[i] ) {
+					result->push_back( "NA" ) ;
+				} else if( data.type == columnar::eInteger ) {
+					result->push_back( genfile::string_utils::to_string( data.integers[i] )) ;
+				} else if( data.type == columnar::eDouble ) {
+					result->push_back( format_double( data.doubles[i] )) ;
+				} else {
+					result->push_back( data.strings[i] ) ;
+				}
+			}
+		}
+	}
+
+	ColumnarStatSource::ColumnarStatSource( std::string const& filename ):
+		m_filename( filename ),
+		m_stream( filename.c_str(), std::ios::binary ),
+		m_chunk_i( 0 ),
+		m_row_i( 0 )
+	{
+		if( !m_stream ) {
+			throw FileNotOpenedError( m_filename ) ;
+		}
+		read_footer() ;
+		reset_to_start() ;
+	}
+
+	void ColumnarStatSource::read_footer() {
+		m_stream.seekg( 0, std::ios::end ) ;
+		uint64_t const file_size = m_stream.tellg() ;
+		if( file_size < 20 ) {
+			throw FileStructureInvalidError() ;
+		}
+		read_bytes( 0, 8, &m_buffer ) ;
+		uint32_t version = 0 ;
+		genfile::read_little_endian_integer( &m_buffer[0] + 4, &m_buffer[0] + 8, &version ) ;
+		if( !std::equal( m_buffer.begin(), m_buffer.begin() + 4, columnar::magic ) ) {
+			throw FileStructureInvalidError() ;
+		}
+		if( version != columnar::version ) {
+			throw FormatUnsupportedError() ;
+		}
+
+		read_bytes( file_size - 12, 12, &m_buffer ) ;
+		if( !std::equal( m_buffer.begin() + 8, m_buffer.end(), columnar::magic ) ) {
+			// The file was not finalised.
+			throw FileStructureInvalidError() ;
+		}
+		uint64_t footer_offset = 0 ;
+		genfile::read_little_endian_integer( &m_buffer[0], &m_buffer[0] + 8, &footer_offset ) ;
+		if( footer_offset < 8 || footer_offset > file_size - 12 ) {
+			throw FileStructureInvalidError() ;
+		}
+		read_bytes( footer_offset, file_size - 12 - footer_offset, &m_buffer ) ;
+		std::vector< std::string > column_names ;
+		columnar::decode_footer( &m_buffer[0], &m_buffer[0] + m_buffer.size(), &m_descriptive_text, &column_names, &m_chunks ) ;
+		for( std::size_t i = 0; i < column_names.size(); ++i ) {
+			add_column( column_names[i] ) ;
+		}
+		std::size_t number_of_rows = 0 ;
+		for( std::size_t i = 0; i < m_chunks.size(); ++i ) {
+			number_of_rows += m_chunks[i].number_of_rows ;
+		}
+		m_number_of_rows = number_of_rows ;
+	}
+
+	void ColumnarStatSource::reset_to_start() {
+		Base::reset_to_start() ;
+		m_chunk_i = 0 ;
+		m_row_i = 0 ;
+		load_chunk() ;
+	}
+
+	ColumnarStatSource::operator bool() const {
+		return m_chunk_i < m_chunks.size() ;
+	}
+
+	columnar::ChunkIndex const& ColumnarStatSource::get_chunk( std::size_t chunk_i ) const {
+		assert( chunk_i < m_chunks.size() ) ;
+		return m_chunks[ chunk_i ] ;
+	}
+
+	std::vector< std::size_t > ColumnarStatSource::find_chunks( genfile::GenomePositionRange const& range ) const {
+		std::vector< std::size_t > result ;
+		for( std::size_t i = 0; i < m_chunks.size(); ++i ) {
+			columnar::ChunkIndex const& chunk = m_chunks[i] ;
+			if(
+				( range.chromosome().is_missing() || chunk.chromosome == range.chromosome() )
+				&& chunk.first_position <= range.end().position()
+				&& chunk.last_position >= range.start().position()
+			) {
+				result.push_back( i ) ;
+			}
+		}
+		return result ;
+	}
+
+	void ColumnarStatSource::get_all_chunks( std::vector< std::size_t >* result ) const {
+		result->resize( m_chunks.size() ) ;
+		for( std::size_t i = 0; i < m_chunks.size(); ++i ) {
+			(*result)[i] = i ;
+		}
+	}
+
+	void ColumnarStatSource::read_column( std::string const& name, std::vector< double >* result ) {
+		std::vector< std::size_t > chunks ;
+		get_all_chunks( &chunks ) ;
+		read_column( name, chunks, result ) ;
+	}
+
+	void ColumnarStatSource::read_column( std::string const& name, std::vector< std::string >* result ) {
+		std::vector< std::size_t > chunks ;
+		get_all_chunks( &chunks ) ;
+		read_column( name, chunks, result ) ;
+	}
+
+	void ColumnarStatSource::read_column( std::string const& name, std::vector< std::size_t > const& chunks, std::vector< double >* result ) {
+		assert( result ) ;
+		std::size_t const column_i = index_of_column( name ) ;
+		columnar::ColumnData data ;
+		result->clear() ;
+		for( std::size_t i = 0; i < chunks.size(); ++i ) {
+			read_column( column_i, chunks[i], &data ) ;
+			try {
+				append_values( data, result ) ;
+			}
+			catch( genfile::string_utils::StringConversionError const& ) {
+				throw genfile::MalformedInputError( m_filename, "Column \"" + name + "\" contains non-numeric values.", 0 ) ;
+			}
+		}
+	}
+
+	void ColumnarStatSource::read_column( std::string const& name, std::vector< std::size_t > const& chunks, std::vector< std::string >* result ) {
+		assert( result ) ;
+		std::size_t const column_i = index_of_column( name ) ;
+		columnar::ColumnData data ;
+		result->clear() ;
+		for( std::size_t i = 0; i < chunks.size(); ++i ) {
+			read_column( column_i, chunks[i], &data ) ;
+			append_values( data, result ) ;
+		}
+	}
+
+	void ColumnarStatSource::read_column( std::size_t const column_i, std::size_t const chunk_i, columnar::ColumnData* result ) {
+		assert( column_i < number_of_columns() ) ;
+		assert( chunk_i < m_chunks.size() ) ;
+		columnar::ChunkIndex const& chunk = m_chunks[ chunk_i ] ;
+		if( column_i >= chunk.columns.size() || chunk.columns[ column_i ].type == columnar::eMissing ) {
+			// This column was added after the chunk was written, or has no values in it.
+			columnar::decode_column( 0, 0, columnar::eMissing, chunk.number_of_rows, result ) ;
+			return ;
+		}
+		columnar::ColumnLocation const& column = chunk.columns[ column_i ] ;
+		read_bytes( column.offset, column.compressed_size, &m_buffer ) ;
+		m_uncompressed_buffer.resize( column.uncompressed_size ) ;
+		if( column.uncompressed_size > 0 ) {
+			genfile::zstd_uncompress( &m_buffer[0], &m_buffer[0] + m_buffer.size(), &m_uncompressed_buffer ) ;
+		}
+		columnar::decode_column(
+			&m_uncompressed_buffer[0], &m_uncompressed_buffer[0] + m_uncompressed_buffer.size(),
+			column.type, chunk.number_of_rows, result
+		) ;
+	}
+
+	void ColumnarStatSource::read_bytes( uint64_t const offset, std::size_t const size, std::vector< genfile::byte_t >* result ) {
+		result->resize( size ) ;
+		m_stream.clear() ;
+		m_stream.seekg( offset ) ;
+		if( size > 0 ) {
+			m_stream.read( reinterpret_cast< char* >( &(*result)[0] ), size ) ;
+		}
+		if( !m_stream ) {
+			throw FileStructureInvalidError() ;
+		}
+	}
+
+	void ColumnarStatSource::load_chunk() {
+		if( m_chunk_i < m_chunks.size() ) {
+			m_chunk_data.resize( number_of_columns() ) ;
+			for( std::size_t column_i = 0; column_i < number_of_columns(); ++column_i ) {
+				read_column( column_i, m_chunk_i, &m_chunk_data[ column_i ] ) ;
+			}
+		}
+	}
+
+	int64_t ColumnarStatSource::get_integer_value() {
+		assert( *this ) ;
+		columnar::ColumnData const& data = m_chunk_data[ current_column() ] ;
+		if( !data.missing[ m_row_i ] ) {
+			if( data.type == columnar::eInteger ) {
+				return data.integers[ m_row_i ] ;
+			} else if( data.type == columnar::eDouble && data.doubles[ m_row_i ] == int64_t( data.doubles[ m_row_i ] )) {
+				return int64_t( data.doubles[ m_row_i ] ) ;
+			} else if( data.type == columnar::eString ) {
+				try {
+					return genfile::string_utils::to_repr< long >( data.strings[ m_row_i ] ) ;
+				}
+				catch( genfile::string_utils::StringConversionError const& ) {
+				}
+			}
+		}
+		throw genfile::MalformedInputError( get_source_spec(), number_of_rows_read(), current_column() ) ;
+	}
+
+	void ColumnarStatSource::read_value( int32_t& value ) {
+		value = get_integer_value() ;
+	}
+
+	void ColumnarStatSource::read_value( uint32_t& value ) {
+		value = get_integer_value() ;
+	}
+
+	void ColumnarStatSource::read_value( std::string& value ) {
+		assert( *this ) ;
+		columnar::ColumnData const& data = m_chunk_data[ current_column() ] ;
+		if( data.missing[ m_row_i ] ) {
+			value = "NA" ;
+		} else if( data.type == columnar::eInteger ) {
+			value = genfile::string_utils::to_string( data.integers[ m_row_i ] ) ;
+		} else if( data.type == columnar::eDouble ) {
+			value = format_double( data.doubles[ m_row_i ] ) ;
+		} else {
+			value = data.strings[ m_row_i ] ;
+		}
+	}
+
+	void ColumnarStatSource::read_value( double& value ) {
+		assert( *this ) ;
+		columnar::ColumnData const& data = m_chunk_data[ current_column() ] ;
+		if( data.missing[ m_row_i ] ) {
+			value = std::numeric_limits< double >::quiet_NaN() ;
+		} else if( data.type == columnar::eInteger ) {
+			value = data.integers[ m_row_i ] ;
+		} else if( data.type == columnar::eDouble ) {
+			value = data.doubles[ m_row_i ] ;
+		} else if( data.strings[ m_row_i ] == "NA" ) {
+			value = std::numeric_limits< double >::quiet_NaN() ;
+		} else {
+			try {
+				value = genfile::string_utils::to_repr< double >( data.strings[ m_row_i ] ) ;
+			}
+			catch( genfile::string_utils::StringConversionError const& ) {
+				throw genfile::MalformedInputError( get_source_spec(), number_of_rows_read(), current_column() ) ;
+			}
+		}
+	}
+
+	void ColumnarStatSource::ignore_value() {}
+
+	void ColumnarStatSource::ignore_all() {}
+
+	void ColumnarStatSource::restart_row() {}
+
+	void ColumnarStatSource::move_to_next_row_impl() {
+		assert( *this ) ;
+		if( ++m_row_i == m_chunks[ m_chunk_i ].number_of_rows ) {
+			++m_chunk_i ;
+			m_row_i = 0 ;
+			load_chunk() ;
+		}
+	}
+}
@@ -0,0 +1,259 @@
+
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <cstring>
+#include <cassert>
+#include "genfile/types.hpp"
+#include "genfile/endianness_utils.hpp"
+#include "genfile/VariantEntry.hpp"
+#include "statfile/statfile_utils.hpp"
+#include "statfile/columnar_format.hpp"
+
+namespace statfile {
+	namespace columnar {
+		char const* const magic = "qcol" ;
+
+		namespace {
+			template< typename IntegerType >
+			void append_integer( std::vector< genfile::byte_t >* buffer, IntegerType const value ) {
+				std::size_t const offset = buffer->size() ;
+				buffer->resize( offset + sizeof( IntegerType )) ;
+				genfile::write_little_endian_integer( &(*buffer)[0] + offset, &(*buffer)[0] + buffer->size(), value ) ;
+			}
+
+			void append_string( std::vector< genfile::byte_t >* buffer, std::string const& value ) {
+				append_integer( buffer, uint32_t( value.size() )) ;
+				buffer->insert( buffer->end(), value.begin(), value.end() ) ;
+			}
+
+			template< typename IntegerType >
+			genfile::byte_t const* read_integer( genfile::byte_t const* buffer, genfile::byte_t const* const end, IntegerType* value ) {
+				if( std::size_t( end - buffer ) < sizeof( IntegerType )) {
+					throw FileStructureInvalidError() ;
+				}
+				return genfile::read_little_endian_integer( buffer, end, value ) ;
+			}
+
+			genfile::byte_t const* read_string( genfile::byte_t const* buffer, genfile::byte_t const* const end, std::string* value ) {
+				uint32_t size = 0 ;
+				buffer = read_integer( buffer, end, &size ) ;
+				if( std::size_t( end - buffer ) < size ) {
+					throw FileStructureInvalidError() ;
+				}
+				value->assign( buffer, buffer + size ) ;
+				return buffer + size ;
+			}
+
+			uint64_t double_to_bits( double const value ) {
+				uint64_t result ;
+				std::memcpy( &result, &value, sizeof( double )) ;
+				return result ;
+			}
+
+			double bits_to_double( uint64_t const value ) {
+				double result ;
+				std::memcpy( &result, &value, sizeof( double )) ;
+				return result ;
+			}
+
+			std::string format_value( genfile::VariantEntry const& value ) {
+				std::ostringstream ostr ;
+				if( value.is_double() ) {
+					ostr << std::setprecision( std::numeric_limits< double >::digits10 + 2 ) ;
+				}
+				ostr << value ;
+				return ostr.str() ;
+			}
+		}
+
+		ColumnType get_column_type( std::vector< genfile::VariantEntry > const& values ) {
+			ColumnType result = eMissing ;
+			for( std::size_t i = 0; i < values.size() && result != eString; ++i ) {
+				genfile::VariantEntry const& value = values[i] ;
+				if( value.is_int() ) {
+					result = std::max( result, eInteger ) ;
+				} else if( value.is_double() ) {
+					result = eDouble ;
+				} else if( !value.is_missing() ) {
+					result = eString ;
+				}
+			}
+			return result ;
+		}
+
+		void encode_column( std::vector< genfile::VariantEntry > const& values, ColumnType const type, std::vector< genfile::byte_t >* buffer ) {
+			assert( buffer ) ;
+			if( type == eMissing ) {
+				return ;
+			}
+			for( std::size_t i = 0; i < values.size(); ++i ) {
+				buffer->push_back( values[i].is_missing() ? 1 : 0 ) ;
+			}
+			switch( type ) {
+				case eInteger:
+					for( std::size_t i = 0; i < values.size(); ++i ) {
+						append_integer( buffer, values[i].is_missing() ? int64_t( 0 ) : values[i].as< int64_t >() ) ;
+					}
+					break ;
+				case eDouble:
+					for( std::size_t i = 0; i < values.size(); ++i ) {
+						append_integer( buffer, values[i].is_missing() ? uint64_t( 0 ) : double_to_bits( values[i].as< double >() )) ;
+					}
+					break ;
+				case eString:
+					for( std::size_t i = 0; i < values.size(); ++i ) {
+						if( values[i].is_missing() ) {
+							append_string( buffer, "" ) ;
+						} else if( values[i].is_string() ) {
+							append_string( buffer, values[i].as< std::string >() ) ;
+						} else {
+							append_string( buffer, format_value( values[i] )) ;
+						}
+					}
+					break ;
+				default:
+					assert(0) ;
+			}
+		}
+
+		void decode_column(
+			genfile::byte_t const* begin,
+			genfile::byte_t const* const end,
+			ColumnType const type,
+			std::size_t const number_of_rows,
+			ColumnData* result
+		) {
+			assert( result ) ;
+			result->type = type ;
+			result->integers.clear() ;
+			result->doubles.clear() ;
+			result->strings.clear() ;
+			if( type == eMissing ) {
+				result->missing.assign( number_of_rows, 1 ) ;
+				return ;
+			}
+			if( std::size_t( end - begin ) < number_of_rows ) {
+				throw FileStructureInvalidError() ;
+			}
+			result->missing.assign( begin, begin + number_of_rows ) ;
+			begin += number_of_rows ;
+			switch( type ) {
+				case eInteger:
+					result->integers.resize( number_of_rows ) ;
+					for( std::size_t i = 0; i < number_of_rows; ++i ) {
+						begin = read_integer( begin, end, &result->integers[i] ) ;
+					}
+					break ;
+				case eDouble:
+					result->doubles.resize( number_of_rows ) ;
+					for( std::size_t i = 0; i < number_of_rows; ++i ) {
+						uint64_t bits = 0 ;
+						begin = read_integer( begin, end, &bits ) ;
+						result->doubles[i] = bits_to_double( bits ) ;
+					}
+					break ;
+				case eString:
+					result->strings.resize( number_of_rows ) ;
+					for( std::size_t i = 0; i < number_of_rows; ++i ) {
+						begin = read_string( begin, end, &result->strings[i] ) ;
+					}
+					break ;
+				default:
+					throw FileStructureInvalidError() ;
+			}
+			if( begin != end ) {
+				throw FileStructureInvalidError() ;
+			}
+		}
+
+		void encode_footer(
+			std::string const& descriptive_text,
+			std::vector< std::string > const& column_names,
+			std::vector< ChunkIndex > const& chunks,
+			std::vector< genfile::byte_t >* buffer
+		) {
+			assert( buffer ) ;
+			append_string( buffer, descriptive_text ) ;
+			append_integer( buffer, uint32_t( column_names.size() )) ;
+			for( std::size_t i = 0; i < column_names.size(); ++i ) {
+				append_string( buffer, column_names[i] ) ;
+			}
+			append_integer( buffer, uint32_t( chunks.size() )) ;
+			for( std::size_t i = 0; i < chunks.size(); ++i ) {
+				ChunkIndex const& chunk = chunks[i] ;
+				append_integer( buffer, chunk.number_of_rows ) ;
+				append_string( buffer, chunk.chromosome.is_missing() ? "" : std::string( chunk.chromosome ) ) ;
+				append_integer( buffer, chunk.first_position ) ;
+				append_integer( buffer, chunk.last_position ) ;
+				append_integer( buffer, uint32_t( chunk.columns.size() )) ;
+				for( std::size_t j = 0; j < chunk.columns.size(); ++j ) {
+					ColumnLocation const& column = chunk.columns[j] ;
+					buffer->push_back( genfile::byte_t( column.type )) ;
+					append_integer( buffer, column.offset ) ;
+					append_integer( buffer, column.compressed_size ) ;
+					append_integer( buffer, column.uncompressed_size ) ;
+				}
+			}
+		}
+
+		void decode_footer(
+			genfile::byte_t const* begin,
+			genfile::byte_t const* const end,
+			std::string* descriptive_text,
+			std::vector< std::string >* column_names,
+			std::vector< ChunkIndex >* chunks
+		) {
+			assert( descriptive_text ) ;
+			assert( column_names ) ;
+			assert( chunks ) ;
+			begin = read_string( begin, end, descriptive_text ) ;
+			uint32_t number_of_columns = 0 ;
+			begin = read_integer( begin, end, &number_of_columns ) ;
+			column_names->resize( number_of_columns ) ;
+			for( std::size_t i = 0; i < number_of_columns; ++i ) {
+				begin = read_string( begin, end, &(*column_names)[i] ) ;
+			}
+			uint32_t number_of_chunks = 0 ;
+			begin = read_integer( begin, end, &number_of_chunks ) ;
+			chunks->resize( number_of_chunks ) ;
+			for( std::size_t i = 0; i < number_of_chunks; ++i ) {
+				ChunkIndex& chunk = (*chunks)[i] ;
+				std::string chromosome ;
+				begin = read_integer( begin, end, &chunk.number_of_rows ) ;
+				begin = read_string( begin, end, &chromosome ) ;
+				chunk.chromosome = chromosome.empty() ? genfile::Chromosome() : genfile::Chromosome( chromosome ) ;
+				begin = read_integer( begin, end, &chunk.first_position ) ;
+				begin = read_integer( begin, end, &chunk.last_position ) ;
+				uint32_t number_of_chunk_columns = 0 ;
+				begin = read_integer( begin, end, &number_of_chunk_columns ) ;
+				if( number_of_chunk_columns > number_of_columns ) {
+					throw FileStructureInvalidError() ;
+				}
+				chunk.columns.resize( number_of_chunk_columns ) ;
+				for( std::size_t j = 0; j < number_of_chunk_columns; ++j ) {
+					ColumnLocation& column = chunk.columns[j] ;
+					uint8_t type = 0 ;
+					begin = read_integer( begin, end, &type ) ;
+					if( type > eString ) {
+						throw FileStructureInvalidError() ;
+					}
+					column.type = ColumnType( type ) ;
+					begin = read_integer( begin, end, &column.offset ) ;
+					begin = read_integer( begin, end, &column.compressed_size ) ;
+					begin = read_integer( begin, end, &column.uncompressed_size ) ;
+				}
+			}
+			if( begin != end ) {
+				throw FileStructureInvalidError() ;
+			}
+		}
+	}
+}
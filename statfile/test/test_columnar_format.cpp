@@ -0,0 +1,115 @@
+//          Copyright Gavin Band 2008 - 2012.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include "test_case.hpp"
+#include "genfile/VariantEntry.hpp"
+#include "genfile/GenomePositionRange.hpp"
+#include "statfile/BuiltInTypeStatSource.hpp"
+#include "statfile/ColumnarFileWriter.hpp"
+#include "statfile/ColumnarStatSource.hpp"
+
+namespace {
+	typedef std::vector< std::vector< genfile::VariantEntry > > Values ;
+
+	// Write two chunks; the column "added" only appears in the second.
+	void write_test_file( std::string const& filename ) {
+		statfile::ColumnarFileWriter::UniquePtr writer = statfile::ColumnarFileWriter::create( filename, "A test file" ) ;
+		writer->add_column( "position" ) ;
+		writer->add_column( "beta" ) ;
+		writer->add_column( "name" ) ;
+		writer->add_column( "empty" ) ;
+
+		Values values( 4 ) ;
+		for( int i = 0; i < 3; ++i ) {
+			values[0].push_back( genfile::VariantEntry( int64_t( 100 + i ))) ;
+			values[1].push_back( genfile::VariantEntry( 0.5 * i )) ;
+			values[2].push_back( genfile::VariantEntry( "row" + std::string( 1, 'A' + i ))) ;
+		}
+		values[1][1] = genfile::MissingValue() ;
+		writer->write_chunk( genfile::Chromosome( "01" ), 100, 102, 3, values ) ;
+
+		writer->add_column( "added" ) ;
+		values.assign( 5, std::vector< genfile::VariantEntry >() ) ;
+		for( int i = 0; i < 2; ++i ) {
+			values[0].push_back( genfile::VariantEntry( int64_t( 5000 + i ))) ;
+			// A mixture of integers and doubles is stored as doubles.
+			values[1].push_back( ( i == 0 ) ? genfile::VariantEntry( int64_t( 2 )) : genfile::VariantEntry( 2.25 )) ;
+			values[2].push_back( genfile::MissingValue() ) ;
+			values[4].push_back( genfile::VariantEntry( int64_t( i ))) ;
+		}
+		writer->write_chunk( genfile::Chromosome( "02" ), 5000, 5001, 2, values ) ;
+		writer->finalise() ;
+	}
+}
+
+AUTO_TEST_CASE( test_columnar_rows ) {
+	std::cerr << "test_columnar_rows..." ;
+	std::string const filename = std::tmpnam(0) + std::string( ".qcol" ) ;
+	write_test_file( filename ) ;
+	{
+		statfile::BuiltInTypeStatSource::UniquePtr source = statfile::BuiltInTypeStatSource::open( filename ) ;
+		TEST_ASSERT( source->number_of_columns() == 5 ) ;
+		TEST_ASSERT( source->column_names()[4] == "added" ) ;
+		TEST_ASSERT( *source->number_of_rows() == 5 ) ;
+		TEST_ASSERT( source->get_descriptive_text() == "A test file" ) ;
+
+		int position ;
+		double beta ;
+		std::string name, empty, added ;
+		(*source) >> position >> beta >> name >> empty >> added >> statfile::end_row() ;
+		TEST_ASSERT( position == 100 && beta == 0.0 && name == "rowA" && empty == "NA" && added == "NA" ) ;
+		(*source) >> position >> beta >> name >> empty >> added >> statfile::end_row() ;
+		TEST_ASSERT( position == 101 && beta != beta && name == "rowB" ) ;
+		(*source) >> position >> beta >> name >> statfile::ignore_all() ;
+		TEST_ASSERT( position == 102 && beta == 1.0 && name == "rowC" ) ;
+		(*source) >> position >> beta >> name >> empty >> added >> statfile::end_row() ;
+		TEST_ASSERT( position == 5000 && beta == 2.0 && name == "NA" && added == "0" ) ;
+		(*source) >> position >> beta >> name >> empty >> added >> statfile::end_row() ;
+		TEST_ASSERT( position == 5001 && beta == 2.25 && added == "1" ) ;
+		TEST_ASSERT( !*source ) ;
+		TEST_ASSERT( source->number_of_rows_read() == 5 ) ;
+
+		source->reset_to_start() ;
+		(*source) >> position >> statfile::ignore_all() ;
+		TEST_ASSERT( position == 100 ) ;
+	}
+	std::remove( filename.c_str() ) ;
+	std::cerr << "ok.\n" ;
+}
+
+AUTO_TEST_CASE( test_columnar_columns ) {
+	std::cerr << "test_columnar_columns..." ;
+	std::string const filename = std::tmpnam(0) + std::string( ".qcol" ) ;
+	write_test_file( filename ) ;
+	{
+		statfile::ColumnarStatSource source( filename ) ;
+		TEST_ASSERT( source.number_of_chunks() == 2 ) ;
+		TEST_ASSERT( source.get_chunk(1).chromosome == genfile::Chromosome( "02" )) ;
+		TEST_ASSERT( source.get_chunk(1).first_position == 5000 && source.get_chunk(1).last_position == 5001 ) ;
+
+		std::vector< double > values ;
+		source.read_column( "beta", &values ) ;
+		TEST_ASSERT( values.size() == 5 ) ;
+		TEST_ASSERT( values[0] == 0.0 && values[1] != values[1] && values[2] == 1.0 && values[3] == 2.0 && values[4] == 2.25 ) ;
+
+		std::vector< std::string > strings ;
+		source.read_column( "added", &strings ) ;
+		TEST_ASSERT( strings.size() == 5 && strings[0] == "NA" && strings[3] == "0" && strings[4] == "1" ) ;
+
+		std::vector< std::size_t > chunks = source.find_chunks( genfile::GenomePositionRange::parse( "02:1-5000" )) ;
+		TEST_ASSERT( chunks.size() == 1 && chunks[0] == 1 ) ;
+		source.read_column( "position", chunks, &values ) ;
+		TEST_ASSERT( values.size() == 2 && values[0] == 5000 ) ;
+		TEST_ASSERT( source.find_chunks( genfile::GenomePositionRange::parse( "01:103-200" )).empty() ) ;
+		TEST_ASSERT( source.find_chunks( genfile::GenomePositionRange::parse( "01:102-200" )).size() == 1 ) ;
+	}
+	std::remove( filename.c_str() ) ;
+	std::cerr << "ok.\n" ;
+}